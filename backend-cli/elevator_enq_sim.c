@@ -1,213 +1,1612 @@
 // elevator_enq_sim.c
+// ビルド例 (MinGW-w64):
+//   gcc -municode -O2 -I../raspberryPi/product elevator_enq_sim.c sim_platform.c timer_wheel.c sim_clock.c traffic_model.c serial_writer.c ../raspberryPi/product/enq_port.c ../raspberryPi/product/enq_metrics.c ../raspberryPi/product/enq_log.c -o elevator_enq_sim.exe
+// ビルド例 (Linux):
+//   gcc -O2 -pthread -I../raspberryPi/product elevator_enq_sim.c sim_platform.c timer_wheel.c sim_clock.c traffic_model.c serial_writer.c ../raspberryPi/product/enq_port.c ../raspberryPi/product/enq_tty.c ../raspberryPi/product/enq_parser.c ../raspberryPi/product/enq_simd.c ../raspberryPi/product/enq_metrics.c ../raspberryPi/product/enq_log.c -lm -o elevator_enq_sim
+//
+// シナリオは号機ごとの状態機械として階層タイマーホイール (timer_wheel.h) に
+// 登録し、1本のタイマーを待つループで全号機を駆動する。シナリオと traffic の
+// 号機は仮想時計 (sim_clock.h) のイベントで、-speed で実時間・早送り・待ちなし (max) を
+// 選べる。乱数は種 (-seed) から作るので、同じ種なら伝文の並びは毎回同じになり、
+// -trace で仮想時刻付きの記録を残せる (ポートに none を指定すると記録だけ)。
+// 送信は非同期 (serial_writer.h) で、同じティックに満了した伝文はポートごとに
+// 1回の書き込みにまとめ、完了は別スレッドで受け取る。
+// OS 依存部分 (時計・待機・シグナル・ファイル) は sim_platform.h にまとめてあり、
+// Linux ではポートに pty を指定すると疑似端末を作るので、同じマシンで動かした
+// serial_debug_test をそのスレーブに繋げば実機なしで試せる。
+// unix:/tmp/enq.sock を指定すると UNIX ドメインソケットで直結し、9600bps の上限なしで
+// 受信側に負荷をかけられる (load の max と組み合わせる。"@9600" を付けると
+// 実回線と同じ間隔で1バイトずつ送る)。
+// traffic モードは建物の利用者の流れ (traffic_model.h) で号機を動かす。階の並び・
+// 時刻帯ごとの到着率・定員を指定でき、仮想時刻を早送りして数時間分を数秒で流せる
+// (max なら待ち時間なしで、送信バッファが空く限り次のイベントへ進む)。
+//
+// タイマーの起床遅れ・送信キューへの投入・書き込み完了の所要時間は
+// HDR 形式のヒストグラム (enq_metrics.h) に記録し、Ctrl+Break (Linux は SIGUSR1) と
+// 終了時に分位点を表示する。
+// 環境変数 ENQ_METRICS_FILE を指定すると、同じ値を Prometheus テキスト形式で
+// 1秒ごとにそのファイルへ書き出す (node_exporter の textfile コレクター用)。
+// シナリオの送信表示はログスレッド (enq_log.h) が書式化してコンソールに書くので、
+// 遅いコンソールでもタイマーは遅れない。環境変数 ENQ_LOG で形式 (text / json / bin)・
+// 出力先・カテゴリ (tx / scenario / error) ごとの上限や間引きを指定できる。
+//
+// 使用方法 (COMポートは Linux では /dev/ttyUSB0 などのパス、pty、unix:パス):
+//   elevator_enq_sim.exe [COMポート|none] [開始階] [-speed 倍|max] [-hours 時間] [-trace ファイル]
+//   elevator_enq_sim.exe load <COMポート[,COMポート...]> <台数> <目標fps|max> [秒数]
+//   elevator_enq_sim.exe traffic <COMポート[,COMポート...]|none> <台数> [オプション]  (オプションは引数なしで表示)
+//   elevator_enq_sim.exe replay <COMポート> <キャプチャ> [倍速|max] [開始秒] [ポート番号]
+//   elevator_enq_sim.exe probe <COMポート> [Hz] [秒数]
+//   どのモードでも -seed 数 で乱数の種を指定できる (既定は起動時刻から作り、開始時に表示する)
 #define _CRT_SECURE_NO_WARNINGS
-#include <windows.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <signal.h>
+#include <stdint.h>
 
-static HANDLE hSerial = INVALID_HANDLE_VALUE;
+#include "sim_platform.h"
+#include "timer_wheel.h"
+#include "sim_clock.h"
+#include "serial_writer.h"
+#include "traffic_model.h"
+#include "enq_capture_format.h"
+#include "enq_parser.h"
+#include "enq_metrics.h"
+#include "enq_log.h"
+
+static serial_writer_t main_port;
 static volatile int running = 1;
+static timer_wheel_t wheel;  // 実時刻のタイマー (1ティック = TW_TICK_US)
+static uint64_t sim_seed;    // -seed (なければ起動時刻から作る)
 
-// シグナルハンドラー
-void sigint_handler(int sig) {
-    printf("\n🛑 シグナル %d を受信しました。終了処理中...\n", sig);
-    running = 0;
+// ---- 計測 ----
+
+static enq_hist_t wake_hist;   // タイマーの予定時刻から起床までの遅れ
+static enq_hist_t queue_hist;  // 伝文1件を送信キューに積む時間 (ロック + コピー)
+
+// 階数→文字列 ("B2F" / "B1F" / "12F")
+const char* floor_to_string(int floor, char* buf, size_t len) {
+    if (floor < 0) snprintf(buf, len, "B%dF", -floor);
+    else snprintf(buf, len, "%dF", floor);
+    return buf;
 }
 
-// 階数→文字列
-const char* floor_to_string(int floor) {
-    switch (floor) {
-        case -1: return "B1F";
-        case  1: return "1F";
-        case  2: return "2F";
-        case  3: return "3F";
-        default: return "?";
-    }
-}
-
-// シリアルポート初期化
-int init_serial(const wchar_t* portName) {
-    hSerial = CreateFileW(portName,
-                          GENERIC_READ|GENERIC_WRITE,
-                          0, NULL,
-                          OPEN_EXISTING,
-                          FILE_ATTRIBUTE_NORMAL,
-                          NULL);
-    if (hSerial == INVALID_HANDLE_VALUE) {
-        fwprintf(stderr, L"❌ シリアルポート %ls を開けません: エラーコード %lu\n",
-                 portName, GetLastError());
-        return 0;
+// ---- ENQ伝文の組み立て ----
+// 送信時は sprintf / strlen を使わず、起動時に作った参照表から16バイトを組み立てる。
+// 号機は行先が決まるたびにその行程で送る伝文をすべて作っておき、送信は表引きと
+// 蓄積バッファへのコピーだけになる。
+
+// 伝文の長さ・データ番号・プローブの形式は受信側と同じ enq_parser.h の定義を使う
+#define PROBE_TICK_US (ENQ_PROBE_TICK_NS / 1000)
+
+typedef struct {
+    uint8_t b[ENQ_FRAME_LEN];
+} enq_wire_t;
+
+// ENQ + 局番号 + 'W' と、そのチェックサム対象部分の途中和
+typedef struct {
+    uint8_t b[6];
+    unsigned sum;
+} station_prefix_t;
+
+// 1バイト → HEX 2文字 と、その2文字の加算値
+static uint8_t hex2_tab[256][2];
+static unsigned hex2_sum[256];
+
+void frame_tables_init(void) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (int i = 0; i < 256; i++) {
+        hex2_tab[i][0] = (uint8_t)digits[i >> 4];
+        hex2_tab[i][1] = (uint8_t)digits[i & 15];
+        hex2_sum[i] = hex2_tab[i][0] + hex2_tab[i][1];
+    }
+}
+
+void station_prefix_init(station_prefix_t* sp, int station) {
+    sp->b[0] = ENQ_CODE;
+    sp->b[1] = (uint8_t)('0' + station / 1000 % 10);
+    sp->b[2] = (uint8_t)('0' + station / 100 % 10);
+    sp->b[3] = (uint8_t)('0' + station / 10 % 10);
+    sp->b[4] = (uint8_t)('0' + station % 10);
+    sp->b[5] = 'W';
+    sp->sum = 0;
+    for (int i = 1; i < 6; i++) sp->sum += sp->b[i];
+}
+
+// 局番号の途中和にデータ番号・データの加算値を足してチェックサムを求める
+void build_frame(enq_wire_t* f, const station_prefix_t* sp, uint16_t dataNum, uint16_t value) {
+    uint8_t n0 = (uint8_t)(dataNum >> 8), n1 = (uint8_t)dataNum;
+    uint8_t v0 = (uint8_t)(value >> 8),   v1 = (uint8_t)value;
+    memcpy(f->b, sp->b, 6);
+    memcpy(f->b + 6,  hex2_tab[n0], 2);
+    memcpy(f->b + 8,  hex2_tab[n1], 2);
+    memcpy(f->b + 10, hex2_tab[v0], 2);
+    memcpy(f->b + 12, hex2_tab[v1], 2);
+    unsigned sum = sp->sum + hex2_sum[n0] + hex2_sum[n1] + hex2_sum[v0] + hex2_sum[v1];
+    memcpy(f->b + 14, hex2_tab[sum & 0xFF], 2);
+}
+
+// 階数→データ値 (地下は2の補数: B1F は FFFF、B2F は FFFE)
+uint16_t floor_to_value(int floor) {
+    return traffic_floor_value(floor);
+}
+
+// 現在時刻文字列取得 (秒が変わったときだけ整形し直す)
+const char* current_time_str(void) {
+    static time_t cached = (time_t)-1;
+    static char buf[32];
+    time_t t = time(NULL);
+    if (t != cached) {
+        struct tm lt;
+        plat_localtime(t, &lt);
+        strftime(buf, sizeof(buf), "%Y年%m月%d日 %H:%M:%S", &lt);
+        cached = t;
     }
-    DCB dcb = {0};
-    dcb.DCBlength = sizeof(dcb);
-    if (!GetCommState(hSerial, &dcb)) {
-        fwprintf(stderr, L"❌ GetCommState 失敗: %lu\n", GetLastError());
+    return buf;
+}
+
+// ENQ伝文を送信キューに積む (表示なし)。書き込みはティックの終わりにまとめて発行する
+int send_frame(serial_writer_t* w, const enq_wire_t* f) {
+    uint64_t t0 = plat_now_ns();
+    int ok = serial_writer_queue(w, f->b, ENQ_FRAME_LEN);
+    enq_hist_record(&queue_hist, plat_now_ns() - t0);
+    return ok;
+}
+
+static uint64_t now_tick(void) {
+    return plat_now_us() / TW_TICK_US;
+}
+
+// ---- 仮想時刻の駆動 ----
+// シナリオと交通流モデルは仮想時計 (sim_clock.h) にイベントを予約し、実時刻の
+// ホイールに置いた1本のタイマーがその時計を進める。実時刻に合わせる (speed > 0) ときは
+// 次のイベントの実時刻に起き、待ちなし (max) のときは時計を見ずに次のイベントへ進む。
+// 待ちなしで送信バッファに入りきらない伝文は順序を保つために溜めておき、その間だけ
+// 次のティックまで待つ。
+// -trace を指定すると、モデルが出した伝文を仮想時刻と一緒にテキストで記録する。
+// 同じ種なら進め方によらず同じ内容になるので、回帰試験の比較に使える
+// (ポートに none を指定すると送らずに記録だけ行う)。
+
+#define VDRIVE_BACKLOG 16384  // 待ちなしで送信バッファに入りきらなかった伝文 (2のべき乗)
+
+typedef struct {
+    enq_wire_t f;
+    int port;
+} vdrive_frame_t;
+
+static struct {
+    sim_clock_t* clock;
+    serial_writer_t* ports;  // NULL なら送らない (none)
+    FILE* trace;
+    vdrive_frame_t backlog[VDRIVE_BACKLOG];
+    unsigned bl_head, bl_tail;
+    uint64_t sent, dropped;
+    uint64_t start_us;
+    time_t start_time;
+    int done;                // 待ちなし: 終わりに達した (溜めた分を送ったら止める)
+    tw_timer_t pump;
+} vdrive;
+
+static void vdrive_trace(int port, const enq_wire_t* f) {
+    uint64_t t = sim_clock_now(vdrive.clock);
+    fprintf(vdrive.trace, "%llu.%u %d %.15s\n", (unsigned long long)(t / 10), (unsigned)(t % 10),
+            port, (const char*)f->b + 1);
+}
+
+// 送信バッファに積む。満杯なら一度発行して、それでも空かなければ 0
+static int vdrive_queue(const vdrive_frame_t* vf) {
+    serial_writer_t* w = &vdrive.ports[vf->port];
+    if (serial_writer_pending(w) + ENQ_FRAME_LEN > SW_STAGE_MAX) {
+        serial_writer_flush(w);
+        if (serial_writer_pending(w) + ENQ_FRAME_LEN > SW_STAGE_MAX) return 0;
+    }
+    if (send_frame(w, &vf->f)) vdrive.sent++;
+    else vdrive.dropped++;
+    return 1;
+}
+
+// 溜まっている伝文を送る。全部送れたら 1
+static int vdrive_drain(void) {
+    while (vdrive.bl_head != vdrive.bl_tail) {
+        if (!vdrive_queue(&vdrive.backlog[vdrive.bl_head & (VDRIVE_BACKLOG - 1)])) return 0;
+        vdrive.bl_head++;
+    }
+    return 1;
+}
+
+// モデルの伝文を送る。戻り値: 送信 (または順番待ち) 1 / 破棄 0
+static int vdrive_send(int port, const enq_wire_t* f) {
+    if (vdrive.trace) vdrive_trace(port, f);
+    if (vdrive.ports == NULL) {
+        vdrive.sent++;
+        return 1;
+    }
+    vdrive_frame_t vf = { *f, port };
+    if (sim_clock_paced(vdrive.clock)) {
+        // 実時間・早送り: 溢れた分は load と同じく送信側で捨てて数える
+        if (send_frame(&vdrive.ports[port], f)) {
+            vdrive.sent++;
+            return 1;
+        }
+        vdrive.dropped++;
         return 0;
     }
-    dcb.BaudRate = CBR_9600;
-    dcb.ByteSize = 8;
-    dcb.Parity   = EVENPARITY;
-    dcb.StopBits = ONESTOPBIT;
-    if (!SetCommState(hSerial, &dcb)) {
-        fwprintf(stderr, L"❌ SetCommState 失敗: %lu\n", GetLastError());
+    if (vdrive.bl_head == vdrive.bl_tail && vdrive_queue(&vf)) return 1;
+    if (vdrive.bl_tail - vdrive.bl_head == VDRIVE_BACKLOG) {
+        vdrive.dropped++;
         return 0;
     }
-    COMMTIMEOUTS timeouts = {0};
-    timeouts.ReadIntervalTimeout         = 50;
-    timeouts.ReadTotalTimeoutConstant    = 50;
-    timeouts.ReadTotalTimeoutMultiplier  = 10;
-    timeouts.WriteTotalTimeoutConstant   = 50;
-    timeouts.WriteTotalTimeoutMultiplier = 10;
-    SetCommTimeouts(hSerial, &timeouts);
-    wprintf(L"✅ シリアルポート %ls 接続成功\n", portName);
+    vdrive.backlog[vdrive.bl_tail++ & (VDRIVE_BACKLOG - 1)] = vf;
     return 1;
 }
 
-// チェックサム計算
-void calculate_checksum(const char* data, char* out) {
-    unsigned int sum = 0;
-    while (*data) sum += (unsigned char)*data++;
-    sprintf(out, "%02X", sum & 0xFF);
+// 実時間・早送り: 実時刻に対応する仮想時刻まで進め、次のイベントの実時刻に起きる
+static void vdrive_paced(tw_timer_t* t, void* ctx) {
+    sim_clock_t* c = vdrive.clock;
+    (void)ctx;
+    if (sim_clock_advance(c, sim_clock_target(c, plat_now_us()))) {
+        running = 0;
+        return;
+    }
+    uint64_t next = sim_clock_next(c);
+    if (c->end_tick && next > c->end_tick) next = c->end_tick;
+    if (next == UINT64_MAX) {
+        running = 0;  // 何も予約されていない
+        return;
+    }
+    uint64_t due = sim_clock_wall_us(c, next) / TW_TICK_US;
+    tw_schedule(&wheel, t, due > wheel.now ? due : wheel.now + 1);
 }
 
-// 階数→HEX
-void floor_to_hex(int floor, char* out) {
-    if (floor == -1) strcpy(out, "FFFF");
-    else sprintf(out, "%04X", floor);
+// 待ちなし: 時計を見ずにイベントを順に処理する。1回で回すのは 1ms までにして、
+// 1秒ごとの表示と停止を遅らせない。送信側が詰まったときだけ次のティックまで待つ
+static void vdrive_unpaced(tw_timer_t* t, void* ctx) {
+    sim_clock_t* c = vdrive.clock;
+    (void)ctx;
+    uint64_t until = plat_now_us() + 1000;
+    for (unsigned n = 0;; n++) {
+        if (!vdrive_drain()) {
+            tw_schedule(&wheel, t, now_tick() + 1);
+            return;
+        }
+        if (vdrive.done) {
+            running = 0;
+            return;
+        }
+        uint64_t next = sim_clock_next(c);
+        if (next == UINT64_MAX && !c->end_tick) vdrive.done = 1;
+        else vdrive.done = sim_clock_advance(c, next);
+        if ((n & 63) == 63 && plat_now_us() >= until) break;
+    }
+    tw_schedule(&wheel, t, wheel.now + 1);
 }
 
-// 現在時刻文字列取得
-void current_time_str(char* buf, size_t len) {
-    time_t t = time(NULL);
+// 実時刻のホイールを初期化して、仮想時計を進めるタイマーを置く。
+// ports が NULL なら伝文は送らない (trace にだけ記録する)
+static void vdrive_start(sim_clock_t* clock, serial_writer_t* ports, FILE* trace) {
+    vdrive.clock = clock;
+    vdrive.ports = ports;
+    vdrive.trace = trace;
+    vdrive.start_us = plat_now_us();
+    vdrive.start_time = time(NULL);
+    sim_clock_start(clock, vdrive.start_us);
+    tw_init(&wheel, vdrive.start_us / TW_TICK_US);
+    tw_timer_init(&vdrive.pump, sim_clock_paced(clock) ? vdrive_paced : vdrive_unpaced, NULL);
+    tw_schedule(&wheel, &vdrive.pump, wheel.now);
+}
+
+// 表示用の時刻: 実時刻に合わせるなら開始時刻 + 仮想時刻、待ちなしなら仮想の経過時間
+// (待ちなしの表示は実時刻を含まないので、同じ種なら毎回同じになる)。
+// ticks は sim_clock_now() の値 (ログは積んだ時点の値を持っていく)
+static void sim_time_format(uint64_t ticks, char* buf, size_t len) {
+    uint64_t sec = ticks / SIM_TICKS_PER_SEC;
+    if (!sim_clock_paced(vdrive.clock)) {
+        snprintf(buf, len, "仮想 +%02llu:%02u:%02u", (unsigned long long)(sec / 3600),
+                 (unsigned)(sec / 60 % 60), (unsigned)(sec % 60));
+        return;
+    }
     struct tm lt;
-    localtime_s(&lt, &t);
+    plat_localtime(vdrive.start_time + (time_t)sec, &lt);
     strftime(buf, len, "%Y年%m月%d日 %H:%M:%S", &lt);
 }
 
-// ENQ送信
-void send_enq(const char* dataNum, const char* dataValue, const char* desc) {
-    const char* station = "0002";
-    const char* cmd = "W";
-    char data_part[64], checksum[3], message[80];
-    sprintf(data_part, "%s%s%s%s", station, cmd, dataNum, dataValue);
-    calculate_checksum(data_part, checksum);
-    sprintf(message, "\x05%s%s", data_part, checksum);
-    DWORD written;
-    if (!WriteFile(hSerial, message, (DWORD)strlen(message), &written, NULL)) {
-        fprintf(stderr, "❌ ENQ送信エラー: %lu\n", GetLastError());
+// -speed の値 ("max" は待ちなしで 0)。不正なら -1
+static double parse_speed(const char* v) {
+    if (strcmp(v, "max") == 0) return 0;
+    double s = atof(v);
+    return s > 0 ? s : -1;
+}
+
+// 引数から -seed 数 を取り除いて sim_seed に入れる (なければ起動時刻から作る)。
+// どのモードでも同じように指定できるよう、モードごとの解析の前に呼ぶ
+static int take_seed_option(int* argc, char* argv[]) {
+    sim_seed = plat_now_ns() ^ ((uint64_t)time(NULL) << 20);
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "-seed") != 0) continue;
+        char* end = NULL;
+        if (i + 1 < *argc) sim_seed = strtoull(argv[i + 1], &end, 0);
+        if (end == NULL || end == argv[i + 1] || *end != '\0') {
+            fprintf(stderr, "❌ -seed には数を指定してください\n");
+            return 0;
+        }
+        memmove(&argv[i], &argv[i + 2], (size_t)(*argc - i - 2) * sizeof(char*));
+        *argc -= 2;
+        i--;
+    }
+    return 1;
+}
+
+static void print_seed(void) {
+    printf("🎲 乱数の種: %llu (同じ動きは -seed %llu で再現できます)\n",
+           (unsigned long long)sim_seed, (unsigned long long)sim_seed);
+}
+
+// 1行程で送る伝文 (行先が決まった時点で組み立てる)
+enum { FR_CURRENT, FR_TARGET, FR_LOAD, FR_ARRIVAL, FR_COUNT };
+
+// ---- ログ (enq_log.h) ----
+// シナリオの表示はスケジューラーでは仮想時刻と数値を積むだけにし、
+// 書式化とコンソールへの書き込みはログスレッドが行う (遅いコンソールで送信を止めない)
+
+enum { LOG_CAT_TX, LOG_CAT_SCENARIO, LOG_CAT_ERROR };
+static const enq_log_category_t log_categories[] = {
+    [LOG_CAT_TX]       = { .name = "tx" },
+    [LOG_CAT_SCENARIO] = { .name = "scenario" },
+    // 止まったポートでは伝文ごとに出るので、既定で1秒10件までにする
+    [LOG_CAT_ERROR]    = { .name = "error", .to_stderr = 1, .rate = 10 },
+};
+
+enum { LOG_EV_SEND, LOG_EV_TRIP, LOG_EV_ARRIVED, LOG_EV_PAUSE, LOG_EV_SEND_FULL };
+
+static void log_send_text(const enq_log_rec_t* r, enq_log_buf_t* o);
+static void log_trip_text(const enq_log_rec_t* r, enq_log_buf_t* o);
+static void log_arrived_text(const enq_log_rec_t* r, enq_log_buf_t* o);
+static void log_pause_text(const enq_log_rec_t* r, enq_log_buf_t* o);
+static void log_send_full_text(const enq_log_rec_t* r, enq_log_buf_t* o);
+
+// 階は int を uint64_t に入れて signed_mask で符号付きとして出す。sim_ticks は仮想時刻
+// (SIM_TICKS_PER_SEC 単位)
+static const enq_log_event_t log_events[] = {
+    [LOG_EV_SEND]      = { .name = "send", .category = LOG_CAT_TX,
+                           .keys = { "sim_ticks", "kind", "floor", "count" }, .signed_mask = 1u << 2,
+                           .str_key = "raw", .str_kind = ENQ_LOG_STR_HEX, .text = log_send_text },
+    [LOG_EV_TRIP]      = { .name = "trip", .category = LOG_CAT_SCENARIO,
+                           .keys = { "sim_ticks", "from", "to" }, .signed_mask = 3u << 1,
+                           .text = log_trip_text },
+    [LOG_EV_ARRIVED]   = { .name = "arrived", .category = LOG_CAT_SCENARIO,
+                           .keys = { "sim_ticks", "floor" }, .signed_mask = 1u << 1,
+                           .text = log_arrived_text },
+    [LOG_EV_PAUSE]     = { .name = "pause", .category = LOG_CAT_SCENARIO,
+                           .keys = { "sim_ticks", "seconds" }, .text = log_pause_text },
+    [LOG_EV_SEND_FULL] = { .name = "send_full", .category = LOG_CAT_ERROR,
+                           .keys = { "sim_ticks" }, .str_key = "raw", .str_kind = ENQ_LOG_STR_HEX,
+                           .text = log_send_full_text },
+};
+
+static void log_send_text(const enq_log_rec_t* r, enq_log_buf_t* o) {
+    char ts[40], floor_s[16], desc[48];
+    sim_time_format(r->arg[0], ts, sizeof(ts));
+    floor_to_string((int)(int64_t)r->arg[2], floor_s, sizeof(floor_s));
+    unsigned count = (unsigned)r->arg[3];
+    switch (r->arg[1]) {
+    case FR_CURRENT: snprintf(desc, sizeof(desc), "現在階: %s (%u/5)", floor_s, count); break;
+    case FR_TARGET:  snprintf(desc, sizeof(desc), "行先階: %s (%u/5)", floor_s, count); break;
+    case FR_LOAD:    snprintf(desc, sizeof(desc), "乗客降客: 1870kg (%u/5)", count); break;
+    default:         snprintf(desc, sizeof(desc), "着床: クリア (%u/5)", count); break;
+    }
+    const char* b = (const char*)r->str;
+    enq_log_printf(o, "[%s] 📤 ENQ送信: %s (局番号:%.4s データ:%.4s チェック:%.2s)\n",
+                   ts, desc, b + 1, b + 10, b + 14);
+}
+
+static void log_trip_text(const enq_log_rec_t* r, enq_log_buf_t* o) {
+    char cur[16], tgt[16];
+    floor_to_string((int)(int64_t)r->arg[1], cur, sizeof(cur));
+    floor_to_string((int)(int64_t)r->arg[2], tgt, sizeof(tgt));
+    enq_log_printf(o, "\n🎯 シナリオ: %s → %s\n", cur, tgt);
+}
+
+static void log_arrived_text(const enq_log_rec_t* r, enq_log_buf_t* o) {
+    char floor_s[16];
+    floor_to_string((int)(int64_t)r->arg[1], floor_s, sizeof(floor_s));
+    enq_log_printf(o, "🏁 着床完了: %s\n", floor_s);
+}
+
+static void log_pause_text(const enq_log_rec_t* r, enq_log_buf_t* o) {
+    enq_log_printf(o, "⏰ %u秒待機中...\n", (unsigned)r->arg[1]);
+}
+
+static void log_send_full_text(const enq_log_rec_t* r, enq_log_buf_t* o) {
+    (void)r;
+    enq_log_printf(o, "❌ ENQ送信エラー: 送信バッファ満杯 (ポートが応答していません)\n");
+}
+
+static void sim_log(unsigned event, const enq_wire_t* f, uint64_t a1, uint64_t a2, uint64_t a3) {
+    const uint64_t args[ENQ_LOG_ARGS] = { sim_clock_now(vdrive.clock), a1, a2, a3 };
+    enq_log(event, f ? f->b : NULL, f ? ENQ_FRAME_LEN : 0, args);
+}
+
+// ENQ_LOG の設定を読み、ログスレッドを起動する
+static void start_log(void) {
+    enq_log_init(log_categories, sizeof(log_categories) / sizeof(log_categories[0]),
+                 log_events, sizeof(log_events) / sizeof(log_events[0]));
+    const char* env = getenv("ENQ_LOG");
+    if (enq_log_configure(env) < 0) {
+        fprintf(stderr, "⚠️ ENQ_LOG が不正です: %s (既定のテキスト表示を使います)\n", env);
+    }
+    if (enq_log_start() < 0) {
+        fprintf(stderr, "⚠️ ログスレッドを起動できません (表示はスケジューラーで行います)\n");
+    }
+}
+
+// ENQ送信 (シナリオ)。count は 1〜5
+void send_enq(const enq_wire_t* f, int kind, int floor, int count) {
+    if (!vdrive_send(0, f)) {
+        sim_log(LOG_EV_SEND_FULL, f, 0, 0, 0);
         return;
     }
-    char ts[32];
-    current_time_str(ts, sizeof(ts));
-    printf("[%s] 📤 ENQ送信: %s (局番号:%s データ:%s チェック:%s)\n",
-           ts, desc, station, dataValue, checksum);
+    sim_log(LOG_EV_SEND, f, (uint64_t)kind, (uint64_t)(int64_t)floor, (uint64_t)count);
 }
 
-// エントリポイント
-int wmain(int argc, wchar_t* argv[]) {
-    // コンソールを UTF-8 モード、VT 処理オン
-    SetConsoleOutputCP(CP_UTF8);
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    DWORD mode = 0;
-    if (GetConsoleMode(hOut, &mode)) {
-        SetConsoleMode(hOut, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
-    }
-
-    // ポート名取得・自動補完
-    wchar_t fullPort[64];
-    if (argc >= 2) {
-        if (wcsncmp(argv[1], L"\\\\.\\", 4) == 0) {
-            wcscpy(fullPort, argv[1]);
-        } else {
-            swprintf(fullPort, 64, L"\\\\.\\%ls", argv[1]);
+void build_trip_frames(enq_wire_t frames[FR_COUNT], const station_prefix_t* sp,
+                       int current_floor, int target_floor, uint16_t load_kg) {
+    build_frame(&frames[FR_CURRENT], sp, ENQ_DATA_CURRENT_FLOOR, floor_to_value(current_floor));
+    build_frame(&frames[FR_TARGET],  sp, ENQ_DATA_TARGET_FLOOR,  floor_to_value(target_floor));
+    build_frame(&frames[FR_LOAD],    sp, ENQ_DATA_LOAD_WEIGHT,   load_kg);
+    build_frame(&frames[FR_ARRIVAL], sp, ENQ_DATA_TARGET_FLOOR,  0x0000);
+}
+
+// ---- シナリオ (号機ごとの状態機械) ----
+// ①現在階×5 → 3秒 → ②行先階×5 → 3秒 → ③乗客降客×5 → 10秒 → ④着床×5 → 10秒
+// 各送信の間隔は1秒。待機は「前の送信の1秒後」に表示して残りの秒数を待つ。
+
+typedef enum {
+    PH_START,     // 行先選択
+    PH_CURRENT,   // ①現在階
+    PH_TARGET,    // ②行先階
+    PH_LOAD,      // ③乗客降客
+    PH_ARRIVAL,   // ④着床
+    PH_PAUSE      // 待機表示 → next_phase
+} car_phase_t;
+
+typedef struct {
+    tw_timer_t timer;
+    car_phase_t phase;
+    car_phase_t next_phase;
+    int pause_sec;
+    int count;
+    int current_floor;
+    int target_floor;
+    station_prefix_t station;
+    enq_wire_t frames[FR_COUNT];
+} car_t;
+
+static const int floors[] = { -1, 1, 2, 3 };
+static const int num_floors = sizeof(floors)/sizeof(floors[0]);
+
+static sim_clock_t scenario_clock;
+static sim_rng_t scenario_rng;
+
+// 直前の予定時刻から ms 後に次のステップを予約する (処理遅延が累積しない)
+static void car_after(car_t *car, uint64_t ms) {
+    tw_schedule(&scenario_clock.wheel, &car->timer, car->timer.expires + tw_ms(ms));
+}
+
+// 5回送信のフェーズを1ステップ進める。5回目の後は pause_sec 秒待って next へ
+static void car_repeat(car_t *car, car_phase_t next, int pause_sec) {
+    if (++car->count < 5) {
+        car_after(car, 1000);
+        return;
+    }
+    car->phase = PH_PAUSE;
+    car->next_phase = next;
+    car->pause_sec = pause_sec;
+    car_after(car, 1000);
+}
+
+static void car_step(tw_timer_t *t, void *ctx) {
+    car_t *car = ctx;
+    (void)t;
+
+    switch (car->phase) {
+    case PH_START: {
+        // 行先選択
+        do {
+            car->target_floor = floors[sim_rng_below(&scenario_rng, num_floors)];
+        } while (car->target_floor == car->current_floor);
+
+        build_trip_frames(car->frames, &car->station, car->current_floor,
+                          car->target_floor, 1870);
+        sim_log(LOG_EV_TRIP, NULL, (uint64_t)(int64_t)car->current_floor,
+                (uint64_t)(int64_t)car->target_floor, 0);
+
+        car->phase = PH_CURRENT;
+        car->count = 0;
+        car_after(car, 0);
+        break;
+    }
+    case PH_CURRENT:
+        send_enq(&car->frames[FR_CURRENT], FR_CURRENT, car->current_floor, car->count+1);
+        car_repeat(car, PH_TARGET, 3);
+        break;
+    case PH_TARGET:
+        send_enq(&car->frames[FR_TARGET], FR_TARGET, car->target_floor, car->count+1);
+        car_repeat(car, PH_LOAD, 3);
+        break;
+    case PH_LOAD:
+        send_enq(&car->frames[FR_LOAD], FR_LOAD, 0, car->count+1);
+        car_repeat(car, PH_ARRIVAL, 10);
+        break;
+    case PH_ARRIVAL:
+        send_enq(&car->frames[FR_ARRIVAL], FR_ARRIVAL, 0, car->count+1);
+        if (car->count + 1 == 5) {
+            car->current_floor = car->target_floor;
+            sim_log(LOG_EV_ARRIVED, NULL, (uint64_t)(int64_t)car->target_floor, 0, 0);
         }
-    } else {
-        wcscpy(fullPort, L"\\\\.\\COM31");
+        car_repeat(car, PH_START, 10);
+        break;
+    case PH_PAUSE:
+        sim_log(LOG_EV_PAUSE, NULL, (uint64_t)car->pause_sec, 0, 0);
+        car->phase = car->next_phase;
+        car->count = 0;
+        car_after(car, (uint64_t)car->pause_sec * 1000);
+        break;
     }
-    const wchar_t* portW = fullPort;
-    int start_floor = (argc >= 3 ? _wtoi(argv[2]) : 1);
+}
 
-    signal(SIGINT, sigint_handler);
-    signal(SIGTERM, sigint_handler);
+static void car_init(car_t *car, int station, int start_floor) {
+    memset(car, 0, sizeof(*car));
+    station_prefix_init(&car->station, station);
+    car->current_floor = start_floor;
+    car->phase = PH_START;
+    tw_timer_init(&car->timer, car_step, car);
+}
 
-    printf("🏢 エレベーターENQシミュレーター初期化\n");
-    wprintf(L"📡 シリアルポート: %ls\n", portW);
-    if (!init_serial(portW)) return 1;
+// ---- 計測値の表示・書き出し ----
 
-    int floors[] = { -1, 1, 2, 3 };
-    int num_floors = sizeof(floors)/sizeof(floors[0]);
-    int current_floor = start_floor;
+// 開いている全ポートの書き込み完了時間とカウンターを Prometheus テキスト形式で書き出す。
+// 読み手が途中の内容を見ないよう一時ファイルに書いてから置き換える
+static void write_metrics_file(void) {
+    const char* path = getenv("ENQ_METRICS_FILE");
+    if (path == NULL || *path == '\0') return;
 
-    srand((unsigned)time(NULL));
+    serial_writer_t* ws[SW_MAX_PORTS];
+    int n = serial_writer_list(ws, SW_MAX_PORTS);
+    char labels[128];
+    enq_metrics_out_t o;
+    enq_metrics_out_init(&o);
 
-    printf("🏢 開始階数: %s\n", floor_to_string(current_floor));
-    printf("🚀 シミュレーション開始 (Ctrl+C で終了)\n");
-    printf("📋 仕様: ①現在階→②行先階→③乗客降客→10秒→④着床\n");
+    enq_metrics_family(&o, "enq_sim_stage_latency_seconds", "histogram",
+                       "シミュレーターの送信経路の区間ごとの所要時間");
+    enq_metrics_histogram(&o, "enq_sim_stage_latency_seconds", "stage=\"wakeup\"", &wake_hist);
+    enq_metrics_histogram(&o, "enq_sim_stage_latency_seconds", "stage=\"queue\"", &queue_hist);
+    for (int i = 0; i < n; i++) {
+        snprintf(labels, sizeof(labels), "stage=\"write\",port=\"%s\"", ws[i]->name);
+        enq_metrics_histogram(&o, "enq_sim_stage_latency_seconds", labels, &ws[i]->write_hist);
+    }
+    enq_metrics_family(&o, "enq_sim_stage_latency_quantile_seconds", "gauge",
+                       "区間ごとの所要時間の分位点 (quantile=1 は最大値)");
+    enq_metrics_quantiles(&o, "enq_sim_stage_latency_quantile_seconds", "stage=\"wakeup\"", &wake_hist);
+    enq_metrics_quantiles(&o, "enq_sim_stage_latency_quantile_seconds", "stage=\"queue\"", &queue_hist);
+    for (int i = 0; i < n; i++) {
+        snprintf(labels, sizeof(labels), "stage=\"write\",port=\"%s\"", ws[i]->name);
+        enq_metrics_quantiles(&o, "enq_sim_stage_latency_quantile_seconds", labels, &ws[i]->write_hist);
+    }
+
+    static const struct {
+        const char* name;
+        const char* help;
+        size_t offset;
+    } counters[] = {
+        { "enq_sim_frames_total", "書き込んだ伝文数", offsetof(serial_writer_stats_t, frames) },
+        { "enq_sim_dropped_frames_total", "送信バッファ満杯で捨てた伝文数",
+          offsetof(serial_writer_stats_t, dropped_frames) },
+        { "enq_sim_write_errors_total", "書き込みの完了・発行エラー数",
+          offsetof(serial_writer_stats_t, errors) },
+        { "enq_sim_short_writes_total", "タイムアウトで一部しか書けなかった回数",
+          offsetof(serial_writer_stats_t, short_writes) },
+    };
+    serial_writer_stats_t st[SW_MAX_PORTS];
+    for (int i = 0; i < n; i++) serial_writer_get_stats(ws[i], &st[i]);
+    for (size_t k = 0; k < sizeof(counters) / sizeof(counters[0]); k++) {
+        enq_metrics_family(&o, counters[k].name, "counter", counters[k].help);
+        for (int i = 0; i < n; i++) {
+            snprintf(labels, sizeof(labels), "port=\"%s\"", ws[i]->name);
+            enq_metrics_value(&o, counters[k].name, labels,
+                              *(const uint64_t*)((const char*)&st[i] + counters[k].offset));
+        }
+    }
+
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* fp = fopen(tmp, "wb");
+    if (fp) {
+        int ok = fwrite(o.buf, 1, o.len, fp) == o.len;
+        ok = fclose(fp) == 0 && ok;
+        if (!ok) remove(tmp);
+        else plat_replace_file(tmp, path);
+    }
+    enq_metrics_out_free(&o);
+}
+
+// 区間ごとの分位点の要約 (書き込みはポートごと)
+static void print_metrics(const char* title) {
+    serial_writer_t* ws[SW_MAX_PORTS];
+    int n = serial_writer_list(ws, SW_MAX_PORTS);
+    enq_metrics_out_t o;
+    enq_metrics_out_init(&o);
+    enq_metrics_printf(&o, "⏱️ 区間レイテンシ%s\n", title);
+    enq_metrics_summary(&o, "wakeup", &wake_hist);
+    enq_metrics_summary(&o, "queue", &queue_hist);
+    for (int i = 0; i < n; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "write:%s", ws[i]->name);
+        enq_metrics_summary(&o, label, &ws[i]->write_hist);
+    }
+    if (o.len) fwrite(o.buf, 1, o.len, stdout);
+    fflush(stdout);
+    enq_metrics_out_free(&o);
+    write_metrics_file();
+}
+
+// ---- イベントループ ----
 
+// 全タイマーを1本のタイマー (sim_platform.h) で駆動する。running は発火ごとに確認する。
+// 1回の tw_advance で積まれた伝文はポートごとに1回の書き込みとして発行する
+static void run_event_loop(void) {
+    int metrics_file = getenv("ENQ_METRICS_FILE") != NULL;
+    uint64_t last_metrics_us = plat_now_us();
     while (running) {
-        // 行先選択
-        int target_floor;
+        uint64_t now = now_tick();
+        tw_advance(&wheel, now, &running);
+        serial_writer_flush_all();
+        if (metrics_file && plat_now_us() - last_metrics_us >= 1000000) {
+            write_metrics_file();
+            last_metrics_us = plat_now_us();
+        }
+
+        uint64_t next;
+        if (!running || !tw_next_expiry(&wheel, &next)) break;
+        now = now_tick();
+        if (next <= now) continue;
+
+        uint64_t due_us = next * TW_TICK_US;
+        int r = plat_wait_until(due_us);
+        if (r == PLAT_WAKE_TIMER) {
+            uint64_t woke = plat_now_us();
+            enq_hist_record(&wake_hist, woke > due_us ? (woke - due_us) * 1000 : 0);
+        } else if (r == PLAT_WAKE_DUMP) {
+            print_metrics(" (" PLAT_DUMP_KEY ")");
+        } else if (r == PLAT_WAKE_ERROR) {
+            break;
+        }
+    }
+}
+
+// ---- 負荷生成モード ----
+// N 台の号機がそれぞれ局番号と状態機械を持ち、1つ以上の COM ポートを共有する。
+// 合計の送信レートが目標 fps になるよう各号機は N/fps 秒ごとに1フレーム送り、
+// 待機時間は入れない。1秒ごとに実測レートとフレーム間隔のジッターを表示する。
+// 実測レートとジッターは送信キューに積んだ時刻で測り、書き込み完了までの遅延と
+// 完了エラーはポートごとに serial_writer の統計として表示する。
+// 目標 fps に max を指定すると間隔を置かず、送信バッファが空く限り号機を順に回して
+// 積み続ける (unix: ポートと組み合わせて受信側の処理上限を測る)。
+
+#define MAX_LOAD_PORTS 16
+#define MAX_LOAD_CARS  256
+
+// 9600bps 8E1 (1フレーム = 16バイト x 11ビット) で1ポートが運べる上限
+#define ENQ_FRAME_BITS    (16 * 11)
+#define WIRE_FPS_PER_PORT (9600.0 / ENQ_FRAME_BITS)
+
+typedef struct {
+    tw_timer_t timer;
+    int port;               // 使用ポートのインデックス
+    station_prefix_t station;
+    car_phase_t phase;
+    int count;
+    int current_floor;
+    int target_floor;
+    enq_wire_t frames[FR_COUNT];
+    double next_us;         // 次の送信予定 (開始からの µs)
+    uint64_t last_send_us;  // 前回の実送信時刻
+} load_car_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t errors;
+    uint64_t intervals;     // 間隔を測れた回数 (各号機の2フレーム目以降)
+    double jitter_sum_us;   // |実間隔 - 予定間隔| の合計
+    double jitter_max_us;
+    double late_sum_us;     // 予定時刻からの遅れの合計
+    double late_max_us;
+} load_stats_t;
+
+static struct {
+    serial_writer_t ports[MAX_LOAD_PORTS];
+    int num_ports;
+    load_car_t cars[MAX_LOAD_CARS];
+    int num_cars;
+    double fps;
+    int max_speed;          // 目標 fps が max: 間隔を置かずに積めるだけ積む
+    int next_car;           // max で次に送る号機
+    double period_us;       // 号機ごとの送信間隔
+    uint64_t start_us;
+    uint64_t last_report_us;
+    load_stats_t interval;  // 直近1秒
+    load_stats_t total;
+    tw_timer_t report_timer;
+    tw_timer_t stop_timer;
+} load;
+
+static sim_rng_t load_rng;
+
+static uint64_t load_tick(double offset_us) {
+    return (load.start_us + (uint64_t)offset_us) / TW_TICK_US;
+}
+
+static void stats_add(load_stats_t* st, int ok, int has_interval, double jitter_us, double late_us) {
+    if (!ok) { st->errors++; return; }
+    st->frames++;
+    if (late_us > 0) {
+        st->late_sum_us += late_us;
+        if (late_us > st->late_max_us) st->late_max_us = late_us;
+    }
+    if (has_interval) {
+        st->intervals++;
+        st->jitter_sum_us += jitter_us;
+        if (jitter_us > st->jitter_max_us) st->jitter_max_us = jitter_us;
+    }
+}
+
+// 号機の次の伝文を選び、状態機械を1回進める
+// (戻り値は car->frames を指し、次に呼ぶまで有効)
+static const enq_wire_t* load_next_frame(load_car_t* car) {
+    if (car->phase == PH_START) {
         do {
-            target_floor = floors[rand() % num_floors];
-        } while (target_floor == current_floor);
+            car->target_floor = floors[sim_rng_below(&load_rng, num_floors)];
+        } while (car->target_floor == car->current_floor);
+        build_trip_frames(car->frames, &car->station, car->current_floor,
+                          car->target_floor, 1870);
+        car->phase = PH_CURRENT;
+        car->count = 0;
+    }
+
+    const enq_wire_t* f;
+    switch (car->phase) {
+    case PH_CURRENT: f = &car->frames[FR_CURRENT]; break;
+    case PH_TARGET:  f = &car->frames[FR_TARGET];  break;
+    case PH_LOAD:    f = &car->frames[FR_LOAD];    break;
+    default:         f = &car->frames[FR_ARRIVAL]; break;  // 着床
+    }
+
+    // 5回ごとに次の段階へ
+    if (++car->count == 5) {
+        car->count = 0;
+        switch (car->phase) {
+        case PH_CURRENT: car->phase = PH_TARGET;  break;
+        case PH_TARGET:  car->phase = PH_LOAD;    break;
+        case PH_LOAD:    car->phase = PH_ARRIVAL; break;
+        default:
+            car->current_floor = car->target_floor;
+            car->phase = PH_START;
+            break;
+        }
+    }
+    return f;
+}
+
+static void load_car_step(tw_timer_t* t, void* ctx) {
+    load_car_t* car = ctx;
+    (void)t;
+
+    int ok = send_frame(&load.ports[car->port], load_next_frame(car));
+
+    uint64_t sent = plat_now_us();
+    double late = (double)sent - (double)(load.start_us + (uint64_t)car->next_us);
+    int has_interval = car->last_send_us != 0;
+    double jitter = 0;
+    if (has_interval) {
+        jitter = (double)(sent - car->last_send_us) - load.period_us;
+        if (jitter < 0) jitter = -jitter;
+    }
+    car->last_send_us = sent;
+    stats_add(&load.interval, ok, has_interval, jitter, late);
+    stats_add(&load.total, ok, has_interval, jitter, late);
 
-        char cur_s[4], tgt_s[4];
-        strcpy(cur_s, floor_to_string(current_floor));
-        strcpy(tgt_s, floor_to_string(target_floor));
-        printf("\n🎯 シナリオ: %s → %s\n", cur_s, tgt_s);
+    car->next_us += load.period_us;
+    tw_schedule(&wheel, &car->timer, load_tick(car->next_us));
+}
 
-        // ①現在階送信×5
-        char cur_hex[5]; floor_to_hex(current_floor, cur_hex);
-        for (int i = 0; i < 5 && running; i++) {
-            char desc[32]; sprintf(desc, "現在階: %s (%d/5)", cur_s, i+1);
-            send_enq("0001", cur_hex, desc);
-            Sleep(1000);
+// max: 号機を順に回して、送信バッファに空きがある限り積む。蓄積バッファが
+// いっぱいになったポートはその場で発行し、発行中でまだ空かなければ次のティックを待つ。
+// 1回で回すのは 1ms までにして、1秒ごとの表示と停止を遅らせない
+static void load_blast(tw_timer_t* t, void* ctx) {
+    (void)ctx;
+    uint64_t until = plat_now_us() + 1000;
+    int full = 0;  // 連続して空きのなかった号機の数
+    while (full < load.num_cars) {
+        load_car_t* car = &load.cars[load.next_car];
+        load.next_car = (load.next_car + 1) % load.num_cars;
+        serial_writer_t* w = &load.ports[car->port];
+        if (serial_writer_pending(w) + ENQ_FRAME_LEN > SW_STAGE_MAX) {
+            serial_writer_flush(w);
+            if (serial_writer_pending(w) + ENQ_FRAME_LEN > SW_STAGE_MAX) {
+                full++;
+                continue;
+            }
         }
-        if (!running) break;
-        printf("⏰ 3秒待機中...\n"); Sleep(3000);
+        full = 0;
+        int ok = send_frame(w, load_next_frame(car));
+        stats_add(&load.interval, ok, 0, 0, 0);
+        stats_add(&load.total, ok, 0, 0, 0);
+        if ((load.interval.frames & 255) == 0 && plat_now_us() >= until) break;
+    }
+    tw_schedule(&wheel, t, now_tick() + 1);
+}
+
+// 全ポートの書き込み完了統計 (起動からの累計)
+static void print_writer_summary(void) {
+    serial_writer_stats_t sum = {0};
+    for (int i = 0; i < load.num_ports; i++) {
+        serial_writer_stats_t st;
+        serial_writer_get_stats(&load.ports[i], &st);
+        sum.writes += st.writes;
+        sum.frames += st.frames;
+        sum.errors += st.errors + st.short_writes;
+        sum.dropped_frames += st.dropped_frames;
+        sum.lat_sum_us += st.lat_sum_us;
+        if (st.lat_max_us > sum.lat_max_us) sum.lat_max_us = st.lat_max_us;
+    }
+    printf("   書き込み %llu 回 (%.1f 伝文/回) / 完了遅延 平均 %.0fus 最大 %lluus / "
+           "完了エラー %llu / 破棄 %llu\n",
+           (unsigned long long)sum.writes,
+           sum.writes ? (double)sum.frames / (double)sum.writes : 0,
+           sum.writes ? (double)sum.lat_sum_us / (double)sum.writes : 0,
+           (unsigned long long)sum.lat_max_us, (unsigned long long)sum.errors,
+           (unsigned long long)sum.dropped_frames);
+}
+
+static void print_load_stats(const char* label, const load_stats_t* st, double elapsed_s) {
+    double rate = elapsed_s > 0 ? (double)st->frames / elapsed_s : 0;
+    double jitter_avg = st->intervals ? st->jitter_sum_us / (double)st->intervals : 0;
+    double late_avg = st->frames ? st->late_sum_us / (double)st->frames : 0;
+    if (load.max_speed) {
+        // 間隔の予定がないのでジッターと遅れは出さない
+        printf("📊 %s 目標 max / 実測 %.0f fps (%.2f MB/s, %llu フレーム, エラー %llu)\n",
+               label, rate, rate * ENQ_FRAME_LEN / 1e6, (unsigned long long)st->frames,
+               (unsigned long long)st->errors);
+        return;
+    }
+    printf("📊 %s 目標 %.1f fps / 実測 %.1f fps (%llu フレーム, エラー %llu) / "
+           "間隔ジッター 平均 %.0fus 最大 %.0fus / 遅れ 平均 %.0fus 最大 %.0fus\n",
+           label, load.fps, rate, (unsigned long long)st->frames,
+           (unsigned long long)st->errors, jitter_avg, st->jitter_max_us,
+           late_avg, st->late_max_us);
+}
+
+static void load_report(tw_timer_t* t, void* ctx) {
+    (void)ctx;
+    uint64_t now = plat_now_us();
+    print_load_stats("[1秒]", &load.interval, (double)(now - load.last_report_us) / 1e6);
+    print_writer_summary();
+    memset(&load.interval, 0, sizeof(load.interval));
+    load.last_report_us = now;
+    tw_schedule(&wheel, t, t->expires + tw_ms(1000));
+}
+
+static void load_stop(tw_timer_t* t, void* ctx) {
+    (void)t; (void)ctx;
+    running = 0;
+}
+
+// load <COMポート[,COMポート...]> <台数> <目標fps|max> [秒数]
+static int run_load_mode(int argc, char* argv[]) {
+    if (argc < 5) {
+        printf("使用方法: elevator_enq_sim.exe load <COMポート[,COMポート...]> <台数> <目標fps|max> [秒数]\n");
+        return 1;
+    }
+
+    if (!serial_writer_system_init()) return 1;
+
+    // ポート一覧 (カンマ区切り)
+    char list[512];
+    snprintf(list, sizeof(list), "%s", argv[2]);
+    for (char* tok = strtok(list, ","); tok && load.num_ports < MAX_LOAD_PORTS;
+         tok = strtok(NULL, ",")) {
+        if (!serial_writer_open(&load.ports[load.num_ports], tok)) return 1;
+        load.num_ports++;
+    }
+
+    load.num_cars = atoi(argv[3]);
+    load.max_speed = strcmp(argv[4], "max") == 0;
+    load.fps = load.max_speed ? 1 : atof(argv[4]);
+    double duration_s = argc >= 6 ? atof(argv[5]) : 0;
+    if (load.num_ports == 0 || load.num_cars <= 0 || load.num_cars > MAX_LOAD_CARS || load.fps <= 0) {
+        fprintf(stderr, "❌ 引数が不正です (台数 1〜%d, fps > 0)\n", MAX_LOAD_CARS);
+        return 1;
+    }
+    load.period_us = 1e6 * load.num_cars / load.fps;
+
+    double wire_fps = WIRE_FPS_PER_PORT * load.num_ports;
+    if (load.max_speed) {
+        printf("🏭 負荷生成モード: %d 台 / %d ポート / 目標 max (送信バッファが空く限り送る)\n",
+               load.num_cars, load.num_ports);
+    } else {
+        printf("🏭 負荷生成モード: %d 台 / %d ポート / 目標 %.1f fps (号機あたり %.1f ms 間隔)\n",
+               load.num_cars, load.num_ports, load.fps, load.period_us / 1000.0);
+    }
+    if (!load.max_speed && load.fps > wire_fps) {
+        printf("⚠️ 目標レートが回線上限 (%.1f fps = 9600bps 8E1 x %d ポート) を超えています\n",
+               wire_fps, load.num_ports);
+    }
+
+    sim_rng_seed(&load_rng, sim_seed);
+    frame_tables_init();
+    load.start_us = plat_now_us();
+    load.last_report_us = load.start_us;
+    tw_init(&wheel, load.start_us / TW_TICK_US);
+
+    // 号機ごとに局番号 0002, 0003, ... を割り当て、ポートは順番に振り分ける。
+    // 開始時刻をずらして送信を均等に分散させる
+    for (int i = 0; i < load.num_cars; i++) {
+        load_car_t* car = &load.cars[i];
+        memset(car, 0, sizeof(*car));
+        car->port = i % load.num_ports;
+        station_prefix_init(&car->station, (2 + i) % 10000);
+        car->current_floor = floors[sim_rng_below(&load_rng, num_floors)];
+        car->phase = PH_START;
+        car->next_us = load.period_us * i / load.num_cars;
+        if (load.max_speed) continue;  // 号機ごとのタイマーは使わない
+        tw_timer_init(&car->timer, load_car_step, car);
+        tw_schedule(&wheel, &car->timer, load_tick(car->next_us));
+    }
+    static tw_timer_t blast_timer;
+    if (load.max_speed) {
+        tw_timer_init(&blast_timer, load_blast, NULL);
+        tw_schedule(&wheel, &blast_timer, load_tick(0));
+    }
+    tw_timer_init(&load.report_timer, load_report, NULL);
+    tw_schedule(&wheel, &load.report_timer, load_tick(1e6));
+    if (duration_s > 0) {
+        tw_timer_init(&load.stop_timer, load_stop, NULL);
+        tw_schedule(&wheel, &load.stop_timer, load_tick(duration_s * 1e6));
+    }
+
+    printf("🚀 負荷生成開始 (Ctrl+C で終了)\n");
+    run_event_loop();
+
+    print_load_stats("[合計]", &load.total, (double)(plat_now_us() - load.start_us) / 1e6);
+    print_metrics("");
+    for (int i = 0; i < load.num_ports; i++) {
+        serial_writer_close(&load.ports[i], 200);
+        serial_writer_print_stats(&load.ports[i]);
+    }
+    serial_writer_system_shutdown();
+    printf("🛑 負荷生成終了\n");
+    return 0;
+}
+
+// ---- 交通流モード ----
+// traffic_model.h のモデルで利用者の到着と号機の運行を仮想時刻で動かし、号機の
+// 状態変化と定期の再送を伝文にして送る。号機は局番号 0002 から順に、ポートは
+// load と同じく順番に振り分ける。
+// -speed は仮想時刻の進み方 (1 = 実時間、3600 なら実時間1秒で1時間)。max は
+// 時計を見ずに次のイベントへ進み、送信バッファが空く限り伝文を積む
+// (待つのは送信側が詰まったときだけ)。1秒ごとに仮想時刻と待ち人数などを表示する。
+
+static traffic_model_t traffic_model;
+
+static struct {
+    serial_writer_t ports[MAX_LOAD_PORTS];
+    int num_ports;
+    int no_port;                // none: 送らずに -trace へ記録だけ行う
+    station_prefix_t stations[TM_MAX_CARS];
+    sim_clock_t clock;
+    uint64_t last_report_us, last_report_sent;
+    tw_timer_t report_timer;
+} traffic;
 
-        // ②行先階送信×5
-        char tgt_hex[5]; floor_to_hex(target_floor, tgt_hex);
-        for (int i = 0; i < 5 && running; i++) {
-            char desc[32]; sprintf(desc, "行先階: %s (%d/5)", tgt_s, i+1);
-            send_enq("0002", tgt_hex, desc);
-            Sleep(1000);
+static void traffic_emit(void* ctx, int car, uint16_t data_num, uint16_t value) {
+    enq_wire_t f;
+    (void)ctx;
+    build_frame(&f, &traffic.stations[car], data_num, value);
+    vdrive_send(car % traffic.num_ports, &f);
+}
+
+static void print_traffic_stats(const char* label, double elapsed_s, double fps) {
+    const traffic_stats_t* st = &traffic_model.stats;
+    char clock[32];
+    unsigned waiting, riding;
+    traffic_clock(&traffic_model, clock, sizeof(clock));
+    traffic_counts(&traffic_model, &waiting, &riding);
+    double virt_s = (double)traffic_now(&traffic_model) / TM_TICKS_PER_SEC;
+    printf("📊 %s %s / 仮想 %.1f 倍 / %.0f fps / 待ち %u 人 乗車中 %u 人 / 到着 %llu 人 輸送 %llu 人 / "
+           "平均待ち %.1f 秒 (最大 %.0f 秒) / 平均乗車 %.1f 秒 / 停止 %llu 回 / 破棄 %llu\n",
+           label, clock, elapsed_s > 0 ? virt_s / elapsed_s : 0, fps, waiting, riding,
+           (unsigned long long)st->arrived, (unsigned long long)st->delivered,
+           st->boarded ? (double)st->wait_sum_ms / 1000.0 / (double)st->boarded : 0,
+           (double)st->wait_max_ms / 1000.0,
+           st->delivered ? (double)st->ride_sum_ms / 1000.0 / (double)st->delivered : 0,
+           (unsigned long long)st->stops, (unsigned long long)vdrive.dropped);
+}
+
+static void traffic_report(tw_timer_t* t, void* ctx) {
+    (void)ctx;
+    uint64_t now = plat_now_us();
+    double dt = (double)(now - traffic.last_report_us) / 1e6;
+    double fps = dt > 0 ? (double)(vdrive.sent - traffic.last_report_sent) / dt : 0;
+    print_traffic_stats("[1秒]", (double)(now - vdrive.start_us) / 1e6, fps);
+    traffic.last_report_us = now;
+    traffic.last_report_sent = vdrive.sent;
+    tw_schedule(&wheel, t, t->expires + tw_ms(1000));
+}
+
+static void print_traffic_usage(void) {
+    printf("使用方法: elevator_enq_sim.exe traffic <COMポート[,COMポート...]|none> <台数> [オプション]\n");
+    printf("  -floors 階     階の並び (既定 B1..10)。範囲 B2..40 や列挙 B1,1,2,3,5 を組み合わせられる\n");
+    printf("  -lobby 階      玄関階 (既定 1F、なければ最下階)\n");
+    printf("  -rates 時=人   到着率の上書き (1台あたり人/時)。例: 8=240,12-13=160\n");
+    printf("  -scale 倍率    全時刻の到着率に掛ける\n");
+    printf("  -capacity kg   定員 (既定 1600kg)\n");
+    printf("  -refresh ms    状態を送り直す間隔 (既定 1000、0 なら変化時だけ)\n");
+    printf("  -start HH:MM   仮想時刻の開始 (既定は現在時刻)\n");
+    printf("  -hours 時間    仮想時刻でこの時間だけ動かして終了 (既定は Ctrl+C まで)\n");
+    printf("  -speed 倍|max  仮想時刻の進み方 (既定 1 = 実時間、3600 なら1秒で1時間、max は待ちなし)\n");
+    printf("  -trace ファイル 伝文を仮想時刻と一緒に記録する (none と組み合わせると記録だけ)\n");
+    printf("  -seed 数       乱数の種 (同じ種・同じ設定なら同じ伝文の並びになる)\n");
+}
+
+// traffic <COMポート[,COMポート...]|none> <台数> [オプション]
+static int run_traffic_mode(int argc, char* argv[]) {
+    if (argc < 4) {
+        print_traffic_usage();
+        return 1;
+    }
+    static traffic_config_t cfg;
+    traffic_default_config(&cfg);
+    const char* lobby = NULL;
+    const char* trace_path = NULL;
+    double scale = 1, hours = 0, speed = 1;
+    time_t now_t = time(NULL);
+    struct tm lt;
+    plat_localtime(now_t, &lt);
+    unsigned start_sec = (unsigned)(lt.tm_hour * 3600 + lt.tm_min * 60 + lt.tm_sec);
+
+    int num_cars = atoi(argv[3]);
+    for (int i = 4; i < argc; i += 2) {
+        const char* opt = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = v != NULL;
+        if (!ok) {
+        } else if (strcmp(opt, "-floors") == 0) {
+            ok = traffic_parse_floors(&cfg, v) == 0;
+        } else if (strcmp(opt, "-lobby") == 0) {
+            lobby = v;
+        } else if (strcmp(opt, "-rates") == 0) {
+            ok = traffic_parse_rates(&cfg, v) == 0;
+        } else if (strcmp(opt, "-scale") == 0) {
+            scale = atof(v);
+            ok = scale >= 0;
+        } else if (strcmp(opt, "-capacity") == 0) {
+            cfg.capacity_kg = (unsigned)atoi(v);
+            ok = cfg.capacity_kg >= 110;  // 1人 (最大105kg) は乗れること
+        } else if (strcmp(opt, "-refresh") == 0) {
+            cfg.refresh_ms = (unsigned)atoi(v);
+        } else if (strcmp(opt, "-start") == 0) {
+            unsigned hh, mm;
+            ok = sscanf(v, "%u:%u", &hh, &mm) == 2 && hh < 24 && mm < 60;
+            start_sec = hh * 3600 + mm * 60;
+        } else if (strcmp(opt, "-hours") == 0) {
+            hours = atof(v);
+            ok = hours >= 0;
+        } else if (strcmp(opt, "-speed") == 0) {
+            speed = parse_speed(v);
+            ok = speed >= 0;
+        } else if (strcmp(opt, "-trace") == 0) {
+            trace_path = v;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "❌ オプションが不正です: %s %s\n", opt, v ? v : "");
+            print_traffic_usage();
+            return 1;
+        }
+    }
+    if (lobby) {
+        cfg.lobby = traffic_floor_index(&cfg, lobby);
+        if (cfg.lobby < 0) {
+            fprintf(stderr, "❌ 玄関階 %s は階の並びにありません\n", lobby);
+            return 1;
         }
-        if (!running) break;
-        printf("⏰ 3秒待機中...\n"); Sleep(3000);
+    }
+    for (int h = 0; h < 24; h++) cfg.rate[h] *= scale;
+    if (num_cars <= 0 || num_cars > TM_MAX_CARS) {
+        fprintf(stderr, "❌ 台数は 1〜%d で指定してください\n", TM_MAX_CARS);
+        return 1;
+    }
+    FILE* trace = NULL;
+    if (trace_path && (trace = fopen(trace_path, "w")) == NULL) {
+        fprintf(stderr, "❌ 記録ファイル %s を作成できません\n", trace_path);
+        return 1;
+    }
 
-        // ③乗客降客送信×5
-        for (int i = 0; i < 5 && running; i++) {
-            char desc[32]; sprintf(desc, "乗客降客: 1870kg (%d/5)", i+1);
-            send_enq("0003", "074E", desc);
-            Sleep(1000);
+    if (!serial_writer_system_init()) return 1;
+    if (strcmp(argv[2], "none") == 0) {
+        traffic.no_port = 1;
+        traffic.num_ports = 1;
+    } else {
+        char list[512];
+        snprintf(list, sizeof(list), "%s", argv[2]);
+        for (char* tok = strtok(list, ","); tok && traffic.num_ports < MAX_LOAD_PORTS;
+             tok = strtok(NULL, ",")) {
+            if (!serial_writer_open(&traffic.ports[traffic.num_ports], tok)) return 1;
+            traffic.num_ports++;
         }
-        if (!running) break;
+        if (traffic.num_ports == 0) return 1;
+    }
 
-        // 10秒待機
-        printf("⏰ 10秒待機中...\n");
-        for (int i = 0; i < 10 && running; i++) Sleep(1000);
-        if (!running) break;
+    frame_tables_init();
+    for (int i = 0; i < num_cars; i++) station_prefix_init(&traffic.stations[i], (2 + i) % 10000);
 
-        // ④着床送信×5
-        for (int i = 0; i < 5 && running; i++) {
-            char desc[32]; sprintf(desc, "着床: クリア (%d/5)", i+1);
-            send_enq("0002", "0000", desc);
-            Sleep(1000);
+    char lo[16], hi[16], lb[16];
+    printf("🏢 交通流モード: %d 台 / %d ポート / %s〜%s (%d 階床、玄関 %s) / 定員 %ukg\n",
+           num_cars, traffic.no_port ? 0 : traffic.num_ports,
+           floor_to_string(cfg.floors[0], lo, sizeof(lo)),
+           floor_to_string(cfg.floors[cfg.num_floors - 1], hi, sizeof(hi)), cfg.num_floors,
+           floor_to_string(cfg.floors[cfg.lobby], lb, sizeof(lb)), cfg.capacity_kg);
+    printf("   到着率 (1台あたり人/時):");
+    for (int h = 0; h < 24; h++) printf(" %d時=%.0f", h, cfg.rate[h]);
+    printf("\n");
+    if (speed == 0) printf("   仮想時刻: %02u:%02u から待ちなし (max)", start_sec / 3600, start_sec / 60 % 60);
+    else printf("   仮想時刻: %02u:%02u から %.1f 倍速", start_sec / 3600, start_sec / 60 % 60, speed);
+    if (hours > 0) printf(" / %.2f 時間で終了", hours);
+    printf("\n");
+    print_seed();
+    // 再送だけで回線上限を超えるなら先に知らせる
+    double refresh_fps = cfg.refresh_ms ? 3.0 * num_cars * 1000.0 / cfg.refresh_ms : 0;
+    if (speed > 0 && !traffic.no_port &&
+        refresh_fps * speed > WIRE_FPS_PER_PORT * traffic.num_ports) {
+        printf("⚠️ 再送だけで %.0f fps になり、回線上限 (%.1f fps = 9600bps 8E1 x %d ポート) を超えます\n",
+               refresh_fps * speed, WIRE_FPS_PER_PORT * traffic.num_ports, traffic.num_ports);
+    }
+
+    sim_clock_init(&traffic.clock, speed,
+                   hours > 0 ? (uint64_t)(hours * (double)TM_TICKS_PER_HOUR) : 0);
+    traffic_init(&traffic_model, &cfg, &traffic.clock, num_cars, start_sec, sim_seed,
+                 traffic_emit, NULL);
+
+    vdrive_start(&traffic.clock, traffic.no_port ? NULL : traffic.ports, trace);
+    traffic.last_report_us = vdrive.start_us;
+    tw_timer_init(&traffic.report_timer, traffic_report, NULL);
+    tw_schedule(&wheel, &traffic.report_timer, wheel.now + tw_ms(1000));
+
+    printf("🚀 運行開始 (Ctrl+C で終了)\n");
+    run_event_loop();
+
+    double elapsed = (double)(plat_now_us() - vdrive.start_us) / 1e6;
+    print_traffic_stats("[合計]", elapsed, elapsed > 0 ? (double)vdrive.sent / elapsed : 0);
+    printf("   伝文 %llu (モデル %llu) / 溢れた到着 %llu 人\n", (unsigned long long)vdrive.sent,
+           (unsigned long long)traffic_model.stats.frames,
+           (unsigned long long)traffic_model.stats.overflow);
+    if (trace) {
+        fclose(trace);
+        printf("📝 伝文の記録: %s\n", trace_path);
+    }
+    print_metrics("");
+    for (int i = 0; !traffic.no_port && i < traffic.num_ports; i++) {
+        serial_writer_close(&traffic.ports[i], speed == 0 ? 2000 : 200);
+        serial_writer_print_stats(&traffic.ports[i]);
+    }
+    serial_writer_system_shutdown();
+    printf("🛑 交通流モード終了\n");
+    return 0;
+}
+
+// ---- キャプチャ再生モード ----
+// serial_debug_test capture で記録したファイルをメモリマップし、記録時の受信
+// チャンクをそのままの間隔 (倍速指定ならその分短縮) で COM ポートへ送り直す。
+// max は待ち時間なしで、送信バッファに空きができ次第次のレコードを積む。
+// 開始秒はブロック索引の二分探索で飛ぶので、長時間のキャプチャでも途中から
+// すぐに再生できる。
+
+static struct {
+    plat_map_t map;
+    enqcap_reader_t reader;
+    enqcap_cursor_t cursor;
+    enqcap_record_t rec;    // 次に送るレコード
+    int have_rec;
+    int port_filter;        // -1 なら全ポート
+    int max_speed;
+    double speed;
+    uint64_t t0_ns;         // 再生開始位置 (キャプチャ時刻)
+    uint64_t start_us;
+    uint64_t records, bytes, dropped;
+    uint64_t last_report_us, last_report_bytes;
+    serial_writer_t port;
+    tw_timer_t timer;
+    tw_timer_t report_timer;
+} replay;
+
+// フィルターに合う次のレコードを取り出す
+static int replay_fetch(void) {
+    while (enqcap_next(&replay.cursor, &replay.rec)) {
+        if (replay.port_filter < 0 || replay.rec.port == replay.port_filter) return 1;
+    }
+    return 0;
+}
+
+static void replay_step(tw_timer_t* t, void* ctx) {
+    (void)ctx;
+    uint64_t now = plat_now_us();
+    while (replay.have_rec) {
+        if (replay.max_speed) {
+            // 送信バッファに入りきらなければ少し待つ (破棄はしない)
+            if (serial_writer_pending(&replay.port) + replay.rec.len > SW_STAGE_MAX) {
+                tw_schedule(&wheel, t, now / TW_TICK_US + tw_ms(1));
+                return;
+            }
+        } else {
+            uint64_t due = replay.start_us +
+                (uint64_t)((double)(replay.rec.t_ns - replay.t0_ns) / 1000.0 / replay.speed);
+            if (due > now) {
+                tw_schedule(&wheel, t, due / TW_TICK_US);
+                return;
+            }
+        }
+        if (serial_writer_queue(&replay.port, replay.rec.data, replay.rec.len)) {
+            replay.records++;
+            replay.bytes += replay.rec.len;
+        } else {
+            replay.dropped++;
         }
-        current_floor = target_floor;
-        printf("🏁 着床完了: %s\n", tgt_s);
+        replay.have_rec = replay_fetch();
+    }
+    printf("✅ キャプチャの終端に到達しました\n");
+    running = 0;
+}
+
+static void replay_report(tw_timer_t* t, void* ctx) {
+    (void)ctx;
+    uint64_t now = plat_now_us();
+    double elapsed = (double)(now - replay.last_report_us) / 1e6;
+    double pos_s = replay.have_rec
+        ? (double)(replay.rec.t_ns - replay.reader.blocks[0].first_ns) / 1e9 : 0;
+    printf("📊 [1秒] 再生位置 %.1f 秒 / %llu レコード %llu バイト (%.0f B/s) / 破棄 %llu\n",
+           pos_s, (unsigned long long)replay.records, (unsigned long long)replay.bytes,
+           elapsed > 0 ? (double)(replay.bytes - replay.last_report_bytes) / elapsed : 0,
+           (unsigned long long)replay.dropped);
+    replay.last_report_us = now;
+    replay.last_report_bytes = replay.bytes;
+    tw_schedule(&wheel, t, t->expires + tw_ms(1000));
+}
+
+// キャプチャファイルを読み取り専用でマップする
+static int replay_map(const char* path) {
+    if (!plat_map_file(&replay.map, path)) return 0;
+    if (!enqcap_reader_init(&replay.reader, replay.map.base, replay.map.size)) {
+        fprintf(stderr, "❌ %s はキャプチャ形式ではありません\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+static void replay_unmap(void) {
+    enqcap_reader_free(&replay.reader);
+    plat_unmap_file(&replay.map);
+}
+
+// replay <COMポート> <キャプチャ> [倍速|max] [開始秒] [ポート番号]
+static int run_replay_mode(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("使用方法: elevator_enq_sim.exe replay <COMポート> <キャプチャ> [倍速|max] [開始秒] [ポート番号]\n");
+        return 1;
+    }
+    replay.speed = 1.0;
+    if (argc >= 5) {
+        if (strcmp(argv[4], "max") == 0) replay.max_speed = 1;
+        else replay.speed = atof(argv[4]);
+    }
+    double offset_s = argc >= 6 ? atof(argv[5]) : 0;
+    replay.port_filter = argc >= 7 ? atoi(argv[6]) : -1;
+    if (!replay.max_speed && replay.speed <= 0) {
+        fprintf(stderr, "❌ 倍速は 0 より大きい値か max を指定してください\n");
+        return 1;
+    }
+
+    int ok = replay_map(argv[3]);
+    uint64_t first = 0, last = 0;
+    if (ok && !enqcap_time_range(&replay.reader, &first, &last)) {
+        fprintf(stderr, "❌ キャプチャにレコードがありません\n");
+        ok = 0;
+    }
+    if (!ok) {
+        replay_unmap();
+        return 1;
+    }
+
+    printf("📼 キャプチャ: %s (%.1f 秒 / %zu ブロック%s)\n", argv[3],
+           (double)(last - first) / 1e9, replay.reader.num_blocks,
+           replay.reader.indexed ? "" : " / 索引なし: ブロックを走査して復元");
+    if (replay.reader.truncated) printf("⚠️ 末尾の不完全なブロックは無視します\n");
+    for (unsigned i = 0; i < replay.reader.hdr.port_count; i++) {
+        printf("    ポート %u: %s%s\n", i, enqcap_port_name(&replay.reader, i),
+               replay.port_filter < 0 || replay.port_filter == (int)i ? "" : " (除外)");
+    }
+
+    replay.t0_ns = first + (uint64_t)(offset_s * 1e9);
+    enqcap_cursor_seek(&replay.cursor, &replay.reader, replay.t0_ns);
+    replay.have_rec = replay_fetch();
+    if (!replay.have_rec) {
+        fprintf(stderr, "❌ 開始位置以降に再生するレコードがありません\n");
+        replay_unmap();
+        return 1;
+    }
+
+    if (!serial_writer_system_init() || !serial_writer_open(&replay.port, argv[2])) {
+        replay_unmap();
+        return 1;
+    }
+
+    if (replay.max_speed) printf("🚀 再生開始 (最大速度, %.1f 秒から)\n", offset_s);
+    else printf("🚀 再生開始 (%.2f 倍速, %.1f 秒から)\n", replay.speed, offset_s);
+
+    replay.start_us = plat_now_us();
+    replay.last_report_us = replay.start_us;
+    tw_init(&wheel, replay.start_us / TW_TICK_US);
+    tw_timer_init(&replay.timer, replay_step, NULL);
+    tw_schedule(&wheel, &replay.timer, wheel.now);
+    tw_timer_init(&replay.report_timer, replay_report, NULL);
+    tw_schedule(&wheel, &replay.report_timer, wheel.now + tw_ms(1000));
+
+    run_event_loop();
+
+    double elapsed = (double)(plat_now_us() - replay.start_us) / 1e6;
+    printf("📊 [合計] %llu レコード %llu バイト / %.1f 秒 / 破棄 %llu\n",
+           (unsigned long long)replay.records, (unsigned long long)replay.bytes, elapsed,
+           (unsigned long long)replay.dropped);
+    print_metrics("");
+    // 最大速度では送信バッファ分 (9600bps で数秒) が残っている
+    serial_writer_close(&replay.port, replay.max_speed ? 10000 : 1000);
+    serial_writer_print_stats(&replay.port);
+    serial_writer_system_shutdown();
+    replay_unmap();
+    printf("🛑 再生終了\n");
+    return 0;
+}
+
+// ---- 遅延測定プローブモード ----
+// 局番号 9999 の伝文を一定間隔で送る。データ番号の下位12ビットに送信キューへ
+// 積んだ時刻 (sim_platform.h の単調時計、100µs 単位で 409.6ms 周期)、データに通番を
+// 載せる。受信側 (serial_debug_test probe) は通番から欠落・順序逆転を、時刻から
+// 片方向遅延を求める。時刻をそのまま比べられるのは送受信が同じ単調時計を
+// 使うときだけ (Linux の同一ホスト上で pty で繋いだ場合など) で、その場合は受信側に
+// -shared を付ける。
+
+static struct {
+    serial_writer_t port;
+    station_prefix_t station;
+    uint64_t period_ticks;
+    uint16_t seq;
+    uint64_t sent;
+    uint64_t dropped;
+    uint64_t start_us;
+    tw_timer_t timer;
+    tw_timer_t report_timer;
+    tw_timer_t stop_timer;
+} probe;
+
+static void probe_step(tw_timer_t* t, void* ctx) {
+    (void)ctx;
+    enq_wire_t f;
+    uint16_t stamp = (uint16_t)((plat_now_us() / PROBE_TICK_US) & ENQ_PROBE_STAMP_MASK);
+    build_frame(&f, &probe.station, ENQ_DATA_PROBE | stamp, probe.seq++);
+    if (send_frame(&probe.port, &f)) probe.sent++;
+    else probe.dropped++;
+    tw_schedule(&wheel, t, t->expires + probe.period_ticks);
+}
+
+static void probe_report(tw_timer_t* t, void* ctx) {
+    (void)ctx;
+    printf("[%s] 📡 プローブ送信 %llu / 破棄 %llu\n", current_time_str(),
+           (unsigned long long)probe.sent, (unsigned long long)probe.dropped);
+    tw_schedule(&wheel, t, t->expires + tw_ms(1000));
+}
+
+// probe <COMポート> [Hz] [秒数]
+static int run_probe_mode(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("使用方法: elevator_enq_sim.exe probe <COMポート> [Hz] [秒数]\n");
+        return 1;
+    }
+    double hz = argc >= 4 ? atof(argv[3]) : 20;
+    double duration_s = argc >= 5 ? atof(argv[4]) : 0;
+    if (hz <= 0) {
+        fprintf(stderr, "❌ 引数が不正です (Hz > 0)\n");
+        return 1;
+    }
+
+    if (!serial_writer_system_init()) return 1;
+    if (!serial_writer_open(&probe.port, argv[2])) return 1;
+
+    frame_tables_init();
+    station_prefix_init(&probe.station, ENQ_PROBE_STATION);
+    probe.period_ticks = (uint64_t)(1e6 / hz / TW_TICK_US);
+    if (probe.period_ticks == 0) probe.period_ticks = 1;
+
+    printf("📡 遅延測定プローブ: 局番号 %d / %.1f Hz (%.1f ms 間隔)\n", ENQ_PROBE_STATION, hz,
+           (double)(probe.period_ticks * TW_TICK_US) / 1000.0);
+    if (hz > WIRE_FPS_PER_PORT) {
+        printf("⚠️ 送信レートが回線上限 (%.1f fps = 9600bps 8E1) を超えています。"
+               "遅延は送信バッファ待ちで伸び続けます\n", WIRE_FPS_PER_PORT);
+    }
 
-        printf("⏰ 10秒待機中...\n");
-        for (int i = 0; i < 10 && running; i++) Sleep(1000);
+    probe.start_us = plat_now_us();
+    tw_init(&wheel, now_tick());
+    tw_timer_init(&probe.timer, probe_step, NULL);
+    tw_schedule(&wheel, &probe.timer, wheel.now);
+    tw_timer_init(&probe.report_timer, probe_report, NULL);
+    tw_schedule(&wheel, &probe.report_timer, wheel.now + tw_ms(1000));
+    if (duration_s > 0) {
+        tw_timer_init(&probe.stop_timer, load_stop, NULL);
+        tw_schedule(&wheel, &probe.stop_timer, wheel.now + tw_ms((uint64_t)(duration_s * 1000)));
     }
 
-    if (hSerial != INVALID_HANDLE_VALUE) {
-        CloseHandle(hSerial);
-        printf("📡 シリアルポート切断完了\n");
+    printf("🚀 プローブ送信開始 (Ctrl+C で終了)\n");
+    run_event_loop();
+
+    printf("📡 プローブ送信 %llu / 破棄 %llu / %.1f 秒\n", (unsigned long long)probe.sent,
+           (unsigned long long)probe.dropped, (double)(plat_now_us() - probe.start_us) / 1e6);
+    print_metrics("");
+    serial_writer_close(&probe.port, 1000);
+    serial_writer_print_stats(&probe.port);
+    serial_writer_system_shutdown();
+    printf("🛑 プローブ終了\n");
+    return 0;
+}
+
+// [COMポート|none] [開始階] [-speed 倍|max] [-hours 時間] [-trace ファイル]
+static int run_scenario_mode(int argc, char* argv[]) {
+    // ポート名取得 (Windows の COM10 以上に必要な "\\.\" は serial_writer_open で補う)
+#ifdef _WIN32
+    const char* port = argc >= 2 ? argv[1] : "COM31";
+#else
+    const char* port = argc >= 2 ? argv[1] : "pty";
+#endif
+    int start_floor = 1;
+    int i = 2;
+    if (argc >= 3) {
+        // 開始階は "-1" (B1F) もあるので、数として読めるかで options と区別する
+        char* end;
+        long v = strtol(argv[2], &end, 10);
+        if (end != argv[2] && *end == '\0') {
+            start_floor = (int)v;
+            i = 3;
+        }
     }
+    double speed = 1, hours = 0;
+    const char* trace_path = NULL;
+    for (; i < argc; i += 2) {
+        const char* opt = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = v != NULL;
+        if (!ok) {
+        } else if (strcmp(opt, "-speed") == 0) {
+            speed = parse_speed(v);
+            ok = speed >= 0;
+        } else if (strcmp(opt, "-hours") == 0) {
+            hours = atof(v);
+            ok = hours >= 0;
+        } else if (strcmp(opt, "-trace") == 0) {
+            trace_path = v;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "❌ オプションが不正です: %s %s\n", opt, v ? v : "");
+            printf("使用方法: elevator_enq_sim.exe [COMポート|none] [開始階] [-speed 倍|max] "
+                   "[-hours 時間] [-trace ファイル] [-seed 数]\n");
+            return 1;
+        }
+    }
+    int no_port = strcmp(port, "none") == 0;
+    FILE* trace = NULL;
+    if (trace_path && (trace = fopen(trace_path, "w")) == NULL) {
+        fprintf(stderr, "❌ 記録ファイル %s を作成できません\n", trace_path);
+        return 1;
+    }
+
+    printf("🏢 エレベーターENQシミュレーター初期化\n");
+    printf("📡 シリアルポート: %s\n", no_port ? "なし (記録のみ)" : port);
+    if (!serial_writer_system_init()) return 1;
+    if (!no_port && !serial_writer_open(&main_port, port)) return 1;
+
+    frame_tables_init();
+    sim_rng_seed(&scenario_rng, sim_seed);
+    sim_clock_init(&scenario_clock, speed,
+                   hours > 0 ? (uint64_t)(hours * 3600.0 * SIM_TICKS_PER_SEC) : 0);
+
+    char floor_s[16];
+    printf("🏢 開始階数: %s\n", floor_to_string(start_floor, floor_s, sizeof(floor_s)));
+    if (speed == 0) printf("⏩ 仮想時刻: 待ちなし (max)");
+    else if (speed != 1) printf("⏩ 仮想時刻: %.1f 倍速", speed);
+    if (speed != 1 && hours > 0) printf(" / %.2f 時間で終了", hours);
+    if (speed != 1) printf("\n");
+    print_seed();
+    printf("🚀 シミュレーション開始 (Ctrl+C で終了)\n");
+    printf("📋 仕様: ①現在階→②行先階→③乗客降客→10秒→④着床\n");
+
+    static car_t car;
+    car_init(&car, 2, start_floor);
+    tw_schedule(&scenario_clock.wheel, &car.timer, 0);
+
+    vdrive_start(&scenario_clock, no_port ? NULL : &main_port, trace);
+    run_event_loop();
+    enq_log_flush();
+
+    if (trace) {
+        fclose(trace);
+        printf("📝 伝文の記録: %s (%llu 伝文)\n", trace_path, (unsigned long long)vdrive.sent);
+    }
+    print_metrics("");
+    if (!no_port) {
+        serial_writer_close(&main_port, speed == 0 ? 2000 : 200);
+        serial_writer_print_stats(&main_port);
+    }
+    serial_writer_system_shutdown();
+    printf("📡 シリアルポート切断完了\n");
     printf("🛑 シミュレーション終了\n");
     return 0;
 }
+
+// 引数は UTF-8 (Windows では wmain で変換してから呼ぶ)
+static int sim_main(int argc, char* argv[]) {
+    if (!plat_init(&running)) return 1;
+    if (!take_seed_option(&argc, argv)) return 1;
+    start_log();
+
+    int rc;
+    if (argc >= 2 && strcmp(argv[1], "load") == 0) {
+        rc = run_load_mode(argc, argv);
+    } else if (argc >= 2 && strcmp(argv[1], "traffic") == 0) {
+        rc = run_traffic_mode(argc, argv);
+    } else if (argc >= 2 && strcmp(argv[1], "replay") == 0) {
+        rc = run_replay_mode(argc, argv);
+    } else if (argc >= 2 && strcmp(argv[1], "probe") == 0) {
+        rc = run_probe_mode(argc, argv);
+    } else {
+        rc = run_scenario_mode(argc, argv);
+    }
+    enq_log_stop();
+    enq_log_stats_t st;
+    enq_log_get_stats(&st);
+    if (st.suppressed || st.dropped) {
+        printf("📝 ログ (%s): 出力 %llu 件 / 間引き %llu 件 / リング溢れ %llu 件\n", enq_log_format_name(),
+               (unsigned long long)st.written, (unsigned long long)st.suppressed,
+               (unsigned long long)st.dropped);
+    }
+    return rc;
+}
+
+// エントリポイント
+#ifdef _WIN32
+// コマンドラインは UTF-16 で受け取り、UTF-8 に直して sim_main に渡す
+int wmain(int argc, wchar_t* argv[]) {
+    char** args = calloc((size_t)argc + 1, sizeof(char*));
+    if (args == NULL) return 1;
+    for (int i = 0; i < argc; i++) {
+        int n = WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, NULL, 0, NULL, NULL);
+        args[i] = malloc(n > 0 ? (size_t)n : 1);
+        if (args[i] == NULL) return 1;
+        if (n <= 0 || WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, args[i], n, NULL, NULL) <= 0) {
+            args[i][0] = '\0';
+        }
+    }
+    return sim_main(argc, args);
+}
+#else
+int main(int argc, char* argv[]) {
+    return sim_main(argc, argv);
+}
+#endif
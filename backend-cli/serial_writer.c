@@ -0,0 +1,576 @@
+// serial_writer.c
+// 非同期のシリアル送信 (Win32: オーバーラップ I/O + 完了ポート / POSIX: 送信スレッド + poll)
+
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include "serial_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+typedef DWORD sw_err_t;
+#define SW_ERR_FMT      "%lu"
+#define SW_ERR_ARG(e)   (e)
+#define SW_WRITE_CALL   "WriteFile"
+#define SW_LOCK(w)      EnterCriticalSection(&(w)->lock)
+#define SW_UNLOCK(w)    LeaveCriticalSection(&(w)->lock)
+
+#define SW_KEY_QUIT 0
+
+static HANDLE iocp = NULL;
+static HANDLE completion_thread_handle = NULL;
+static LARGE_INTEGER qpc_freq;
+
+static uint64_t sw_now_us(void) {
+    LARGE_INTEGER c;
+    QueryPerformanceCounter(&c);
+    return (uint64_t)(c.QuadPart / qpc_freq.QuadPart) * 1000000 +
+           (uint64_t)(c.QuadPart % qpc_freq.QuadPart) * 1000000 / (uint64_t)qpc_freq.QuadPart;
+}
+
+static void sw_sleep_ms(unsigned ms) {
+    Sleep(ms);
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef int sw_err_t;
+#define SW_ERR_FMT      "%s"
+#define SW_ERR_ARG(e)   strerror(e)
+#define SW_WRITE_CALL   "write"
+#define SW_LOCK(w)      pthread_mutex_lock(&(w)->lock)
+#define SW_UNLOCK(w)    pthread_mutex_unlock(&(w)->lock)
+
+static pthread_t sender_thread;
+static int sender_started = 0;
+static int sender_quit = 0;              // list_lock で保護
+static int wake_fds[2] = { -1, -1 };    // 送信スレッドを poll から起こす
+// writers[] の変更 (メインスレッド) と送信スレッドの参照を排他する
+static pthread_mutex_t list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t sw_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t sw_now_us(void) {
+    return sw_now_ns() / 1000;
+}
+
+static void sw_sleep_ms(unsigned ms) {
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+#endif
+
+static serial_writer_t *writers[SW_MAX_PORTS];
+static int num_writers = 0;
+
+// 書き込み1回の完了を統計に反映する (lock 保持中に呼ぶ)。一部しか書けなければ 1
+static int complete_locked(serial_writer_t *w, int ok, size_t written, uint64_t lat) {
+    int short_write = 0;
+    w->stats.writes++;
+    w->stats.lat_sum_us += lat;
+    if (lat > w->stats.lat_max_us) w->stats.lat_max_us = lat;
+    enq_hist_record(&w->write_hist, lat * 1000);
+    if (!ok) {
+        w->stats.errors++;
+    } else {
+        w->stats.bytes += written;
+        w->stats.frames += w->inflight_frames;
+        if (written < w->inflight_len) {
+            w->stats.short_writes++;
+            short_write = 1;
+        }
+    }
+    w->busy = 0;
+    return short_write;
+}
+
+// 蓄積バッファを発行中に切り替える (lock 保持中に呼ぶ)。発行するものがなければ 0
+static int swap_stage_locked(serial_writer_t *w) {
+    if (w->busy || w->stage_len == 0) return 0;
+    w->stage ^= 1;
+    w->inflight_len = w->stage_len;
+    w->inflight_frames = w->stage_frames;
+    w->stage_len = 0;
+    w->stage_frames = 0;
+    if (w->inflight_frames > w->stats.max_batch) w->stats.max_batch = w->inflight_frames;
+    w->submit_us = sw_now_us();
+    w->busy = 1;
+    return 1;
+}
+
+#ifdef _WIN32
+
+// ---- Win32: オーバーラップ I/O + 完了ポート ----
+
+// 蓄積バッファを発行する (lock 保持中に呼ぶ)。
+// 発行自体が失敗したらエラーコードを返す
+static sw_err_t submit_locked(serial_writer_t *w) {
+    if (!swap_stage_locked(w)) return 0;
+    memset(&w->ov, 0, sizeof(w->ov));
+    if (!WriteFile(w->port.h, w->buf[w->stage ^ 1], (DWORD)w->inflight_len, NULL, &w->ov)) {
+        DWORD err = GetLastError();
+        if (err != ERROR_IO_PENDING) {
+            // 完了通知は来ない
+            w->busy = 0;
+            w->stats.errors++;
+            return err;
+        }
+    }
+    return 0;
+}
+
+static DWORD WINAPI completion_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        DWORD n = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED *ov = NULL;
+        BOOL ok = GetQueuedCompletionStatus(iocp, &n, &key, &ov, INFINITE);
+        if (ov == NULL) {
+            if (key == SW_KEY_QUIT) break;
+            continue;
+        }
+
+        serial_writer_t *w = (serial_writer_t *)key;
+        DWORD err = ok ? 0 : GetLastError();
+
+        EnterCriticalSection(&w->lock);
+        uint64_t lat = sw_now_us() - w->submit_us;
+        int short_write = complete_locked(w, ok, n, lat);
+        // 完了待ちの間に溜まった分を続けて発行する
+        DWORD submit_err = submit_locked(w);
+        LeaveCriticalSection(&w->lock);
+
+        // 表示はロックの外で行う
+        if (!ok && err != ERROR_OPERATION_ABORTED) {
+            fprintf(stderr, "❌ %s: 書き込み完了エラー %lu (遅延 %llu us)\n",
+                    w->name, err, (unsigned long long)lat);
+        } else if (short_write) {
+            fprintf(stderr, "⚠️ %s: 書き込みタイムアウト %lu/%zu バイト (遅延 %llu us)\n",
+                    w->name, n, w->inflight_len, (unsigned long long)lat);
+        }
+        if (submit_err) {
+            fprintf(stderr, "❌ %s: WriteFile 発行エラー %lu\n", w->name, submit_err);
+        }
+    }
+    return 0;
+}
+
+int serial_writer_system_init(void) {
+    QueryPerformanceFrequency(&qpc_freq);
+    iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (iocp == NULL) {
+        fprintf(stderr, "❌ CreateIoCompletionPort 失敗: %lu\n", GetLastError());
+        return 0;
+    }
+    completion_thread_handle = CreateThread(NULL, 0, completion_thread, NULL, 0, NULL);
+    if (completion_thread_handle == NULL) {
+        fprintf(stderr, "❌ 完了スレッド起動失敗: %lu\n", GetLastError());
+        CloseHandle(iocp);
+        iocp = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void serial_writer_system_shutdown(void) {
+    if (iocp == NULL) return;
+    PostQueuedCompletionStatus(iocp, 0, SW_KEY_QUIT, NULL);
+    WaitForSingleObject(completion_thread_handle, INFINITE);
+    CloseHandle(completion_thread_handle);
+    CloseHandle(iocp);
+    completion_thread_handle = NULL;
+    iocp = NULL;
+}
+
+static int register_writer(serial_writer_t *w) {
+    if (num_writers >= SW_MAX_PORTS ||
+        CreateIoCompletionPort(w->port.h, iocp, (ULONG_PTR)w, 0) == NULL) {
+        fprintf(stderr, "❌ %s を完了ポートに関連付けできません: %lu\n", w->name, GetLastError());
+        return 0;
+    }
+    InitializeCriticalSection(&w->lock);
+    writers[num_writers++] = w;
+    printf("✅ シリアルポート %s 接続成功 (オーバーラップ I/O)\n", w->name);
+    return 1;
+}
+
+// 発行中の書き込みを取り消す。中止の完了通知は完了スレッドに来る
+static void cancel_inflight(serial_writer_t *w) {
+    CancelIoEx(w->port.h, NULL);
+}
+
+static void unregister_writer(serial_writer_t *w) {
+    for (int i = 0; i < num_writers; i++) {
+        if (writers[i] == w) {
+            writers[i] = writers[--num_writers];
+            break;
+        }
+    }
+}
+
+static void destroy_lock(serial_writer_t *w) {
+    DeleteCriticalSection(&w->lock);
+}
+
+#else
+
+// ---- POSIX: 非ブロッキング write() + 送信スレッド ----
+// 発行は呼び出し元のスレッドで write() を1回試す。書き残しがあれば送信スレッドが
+// POLLOUT を待って続きを書き、書ききるか期限を過ぎたら完了として扱う。
+// 非ブロッキングの write() は短時間で戻るので、lock を持ったまま呼んでよい。
+//
+// 回線速度を模擬するポート (pty / unix の "@bps") は、模擬回線が空く時刻 wire_ns
+// までに送れる分だけを書き、残りは送信スレッドがその時刻に起きて1バイトずつ書く
+
+static void wake_sender(void) {
+    char c = 0;
+    // パイプが満杯なら既に起こされている
+    if (write(wake_fds[1], &c, 1) < 0 && errno != EAGAIN) {
+        fprintf(stderr, "❌ 送信スレッドを起こせません: %s\n", strerror(errno));
+    }
+}
+
+// 模擬回線で今送ってよいバイト数 (模擬しないなら残り全部)
+static size_t wire_allowance(const serial_writer_t *w) {
+    size_t left = w->inflight_len - w->inflight_off;
+    if (w->byte_ns == 0) return left;
+    uint64_t now = sw_now_ns();
+    if (now < w->wire_ns) return 0;
+    uint64_t n = (now - w->wire_ns) / w->byte_ns + 1;
+    return n < left ? (size_t)n : left;
+}
+
+// 発行中のバッファの続きを書けるだけ書く (lock 保持中に呼ぶ)
+static sw_err_t write_some_locked(serial_writer_t *w) {
+    const uint8_t *buf = w->buf[w->stage ^ 1];
+    size_t allowed;
+    while ((allowed = wire_allowance(w)) > 0) {
+        ssize_t n = write(w->port.h, buf + w->inflight_off, allowed);
+        if (n > 0) {
+            w->inflight_off += (size_t)n;
+            w->wire_ns += (uint64_t)n * w->byte_ns;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else {
+            return n < 0 ? errno : EIO;
+        }
+    }
+    return 0;
+}
+
+// 蓄積バッファを発行する (lock 保持中に呼ぶ)。
+// 発行自体が失敗したらエラーコードを返す
+static sw_err_t submit_locked(serial_writer_t *w) {
+    if (!swap_stage_locked(w)) return 0;
+    w->inflight_off = 0;
+    w->deadline_us = w->submit_us + 1000ull * (ENQ_PORT_WRITE_TIMEOUT_MS +
+                     ENQ_PORT_WRITE_TIMEOUT_PER_BYTE_MS * (uint64_t)w->inflight_len);
+    if (w->byte_ns) {
+        // 模擬回線が空いていれば今から送り始める (遅い速度でも送信時間だけ期限を延ばす)
+        uint64_t now = sw_now_ns();
+        if (w->wire_ns < now) w->wire_ns = now;
+        w->deadline_us += (w->wire_ns - now + w->byte_ns * (uint64_t)w->inflight_len) / 1000;
+    }
+    sw_err_t err = write_some_locked(w);
+    if (err) {
+        w->busy = 0;
+        w->stats.errors++;
+        return err;
+    }
+    if (w->inflight_off == w->inflight_len) {
+        // その場で書ききれた
+        complete_locked(w, 1, w->inflight_len, sw_now_us() - w->submit_us);
+    } else {
+        wake_sender();
+    }
+    return 0;
+}
+
+// 書き込み可能・エラー・期限切れになったポートの続きを処理する
+static void service_writer(serial_writer_t *w, short revents) {
+    SW_LOCK(w);
+    if (!w->busy) {
+        SW_UNLOCK(w);
+        return;
+    }
+    sw_err_t err = 0;
+    // 模擬回線は poll せずに時刻で起きるので、送れる時刻になっていれば書く
+    if ((revents & (POLLOUT | POLLERR | POLLHUP)) || w->byte_ns) err = write_some_locked(w);
+    uint64_t now = sw_now_us();
+    int done = w->inflight_off == w->inflight_len;
+    if (!err && !done && now < w->deadline_us) {
+        SW_UNLOCK(w);
+        return;
+    }
+    uint64_t lat = now - w->submit_us;
+    size_t written = w->inflight_off, len = w->inflight_len;
+    int short_write = complete_locked(w, !err, written, lat);
+    // 完了待ちの間に溜まった分を続けて発行する
+    sw_err_t submit_err = submit_locked(w);
+    SW_UNLOCK(w);
+
+    // 表示はロックの外で行う
+    if (err) {
+        fprintf(stderr, "❌ %s: 書き込み完了エラー %s (遅延 %llu us)\n",
+                w->name, strerror(err), (unsigned long long)lat);
+    } else if (short_write) {
+        fprintf(stderr, "⚠️ %s: 書き込みタイムアウト %zu/%zu バイト (遅延 %llu us)\n",
+                w->name, written, len, (unsigned long long)lat);
+    }
+    if (submit_err) {
+        fprintf(stderr, "❌ %s: write 発行エラー %s\n", w->name, strerror(submit_err));
+    }
+}
+
+static int is_registered(const serial_writer_t *w) {
+    for (int i = 0; i < num_writers; i++) {
+        if (writers[i] == w) return 1;
+    }
+    return 0;
+}
+
+static void *sender_main(void *arg) {
+    (void)arg;
+    struct pollfd pfd[SW_MAX_PORTS + 1];
+    serial_writer_t *polled[SW_MAX_PORTS];
+    for (;;) {
+        // 書き残しのあるポートだけを待つ。模擬回線の送信待ちは fd ではなく時刻で待つ
+        int n = 0;
+        uint64_t deadline = UINT64_MAX;  // ns
+        pthread_mutex_lock(&list_lock);
+        if (sender_quit) {
+            pthread_mutex_unlock(&list_lock);
+            break;
+        }
+        for (int i = 0; i < num_writers; i++) {
+            serial_writer_t *w = writers[i];
+            SW_LOCK(w);
+            if (w->busy) {
+                polled[n] = w;
+                pfd[n + 1] = (struct pollfd){ w->port.h, POLLOUT, 0 };
+                uint64_t due = w->deadline_us * 1000;
+                if (w->byte_ns && w->wire_ns > sw_now_ns()) {
+                    pfd[n + 1].fd = -1;  // 回線が空くまでは書かない
+                    if (w->wire_ns < due) due = w->wire_ns;
+                }
+                if (due < deadline) deadline = due;
+                n++;
+            }
+            SW_UNLOCK(w);
+        }
+        pthread_mutex_unlock(&list_lock);
+
+        pfd[0] = (struct pollfd){ wake_fds[0], POLLIN, 0 };
+        // 模擬回線は 9600bps でも1バイト約1.1ms なので ns 単位で待つ
+        uint64_t now = sw_now_ns();
+        uint64_t wait = deadline == UINT64_MAX ? 0 : deadline <= now ? 0 : deadline - now;
+        struct timespec ts = { (time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull) };
+        if (ppoll(pfd, (nfds_t)n + 1, deadline == UINT64_MAX ? NULL : &ts, NULL) < 0 &&
+            errno != EINTR) {
+            fprintf(stderr, "❌ 送信スレッド: poll 失敗: %s\n", strerror(errno));
+            sw_sleep_ms(1);
+        }
+        if (pfd[0].revents & POLLIN) {
+            char buf[64];
+            while (read(wake_fds[0], buf, sizeof(buf)) > 0) {}
+        }
+
+        // 待っている間に閉じられたポートは飛ばす
+        pthread_mutex_lock(&list_lock);
+        for (int k = 0; k < n; k++) {
+            if (is_registered(polled[k])) service_writer(polled[k], pfd[k + 1].revents);
+        }
+        pthread_mutex_unlock(&list_lock);
+    }
+    return NULL;
+}
+
+int serial_writer_system_init(void) {
+    if (pipe2(wake_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        fprintf(stderr, "❌ pipe 失敗: %s\n", strerror(errno));
+        return 0;
+    }
+    sender_quit = 0;
+    int err = pthread_create(&sender_thread, NULL, sender_main, NULL);
+    if (err != 0) {
+        fprintf(stderr, "❌ 送信スレッド起動失敗: %s\n", strerror(err));
+        close(wake_fds[0]);
+        close(wake_fds[1]);
+        wake_fds[0] = wake_fds[1] = -1;
+        return 0;
+    }
+    sender_started = 1;
+    return 1;
+}
+
+void serial_writer_system_shutdown(void) {
+    if (!sender_started) return;
+    pthread_mutex_lock(&list_lock);
+    sender_quit = 1;
+    pthread_mutex_unlock(&list_lock);
+    wake_sender();
+    pthread_join(sender_thread, NULL);
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    wake_fds[0] = wake_fds[1] = -1;
+    sender_started = 0;
+}
+
+static int register_writer(serial_writer_t *w) {
+    if (num_writers >= SW_MAX_PORTS) {
+        fprintf(stderr, "❌ %s: 開けるポートは %d 個までです\n", w->name, SW_MAX_PORTS);
+        return 0;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    if (w->port.baud) w->byte_ns = ENQ_PORT_BITS_PER_BYTE * 1000000000ull / w->port.baud;
+    pthread_mutex_lock(&list_lock);
+    writers[num_writers++] = w;
+    pthread_mutex_unlock(&list_lock);
+    if (w->port.kind == ENQ_PORT_PTY) {
+        printf("✅ 疑似端末を作成しました: 受信側は %s を開いてください\n", w->name);
+        fflush(stdout);  // 相手がパスを読めるよう、パイプ越しでもすぐに出す
+    } else if (w->port.kind == ENQ_PORT_SOCKET) {
+        printf("✅ %s 接続成功 (回線速度の制限なし)\n", w->name);
+    } else {
+        printf("✅ シリアルポート %s 接続成功 (非ブロッキング I/O)\n", w->name);
+    }
+    if (w->byte_ns) printf("   📏 %u bps の回線を模擬して1バイトずつ送ります\n", w->port.baud);
+    return 1;
+}
+
+// 発行中の書き込みを打ち切る。Win32 の取り消しと同じくエラーとして数える
+static void cancel_inflight(serial_writer_t *w) {
+    SW_LOCK(w);
+    if (w->busy) complete_locked(w, 0, 0, sw_now_us() - w->submit_us);
+    SW_UNLOCK(w);
+}
+
+static void unregister_writer(serial_writer_t *w) {
+    pthread_mutex_lock(&list_lock);
+    for (int i = 0; i < num_writers; i++) {
+        if (writers[i] == w) {
+            writers[i] = writers[--num_writers];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&list_lock);
+}
+
+static void destroy_lock(serial_writer_t *w) {
+    pthread_mutex_destroy(&w->lock);
+}
+
+#endif
+
+int serial_writer_open(serial_writer_t *w, const char *port) {
+    memset(w, 0, sizeof(*w));
+    w->name = w->port.name;
+    if (enq_port_open(&w->port, port, ENQ_PORT_ASYNC) < 0) return 0;
+    if (!register_writer(w)) {
+        enq_port_close(&w->port);
+        return 0;
+    }
+    return 1;
+}
+
+void serial_writer_close(serial_writer_t *w, unsigned drain_ms) {
+    if (w->name == NULL || w->port.h == ENQ_PORT_INVALID) return;  // 開いていない
+
+    serial_writer_flush(w);
+    for (unsigned waited = 0; waited < drain_ms; waited++) {
+        SW_LOCK(w);
+        int idle = !w->busy && w->stage_len == 0;
+        SW_UNLOCK(w);
+        if (idle) break;
+        sw_sleep_ms(1);
+    }
+    // 残りは取り消し、中止の完了を待つ
+    cancel_inflight(w);
+    for (;;) {
+        SW_LOCK(w);
+        int busy = w->busy;
+        SW_UNLOCK(w);
+        if (!busy) break;
+        sw_sleep_ms(1);
+    }
+
+    unregister_writer(w);
+    enq_port_close(&w->port);
+    destroy_lock(w);
+}
+
+int serial_writer_queue(serial_writer_t *w, const void *frame, size_t len) {
+    SW_LOCK(w);
+    int ok = w->stage_len + len <= SW_STAGE_MAX;
+    if (ok) {
+        memcpy(w->buf[w->stage] + w->stage_len, frame, len);
+        w->stage_len += len;
+        w->stage_frames++;
+    } else {
+        w->stats.dropped_frames++;
+    }
+    SW_UNLOCK(w);
+    return ok;
+}
+
+void serial_writer_flush(serial_writer_t *w) {
+    SW_LOCK(w);
+    sw_err_t err = submit_locked(w);
+    SW_UNLOCK(w);
+    if (err) {
+        fprintf(stderr, "❌ %s: " SW_WRITE_CALL " 発行エラー " SW_ERR_FMT "\n",
+                w->name, SW_ERR_ARG(err));
+    }
+}
+
+void serial_writer_flush_all(void) {
+    for (int i = 0; i < num_writers; i++) serial_writer_flush(writers[i]);
+}
+
+size_t serial_writer_pending(serial_writer_t *w) {
+    SW_LOCK(w);
+    size_t n = w->stage_len;
+    SW_UNLOCK(w);
+    return n;
+}
+
+void serial_writer_get_stats(serial_writer_t *w, serial_writer_stats_t *out) {
+    SW_LOCK(w);
+    *out = w->stats;
+    SW_UNLOCK(w);
+}
+
+int serial_writer_list(serial_writer_t **out, int max) {
+    int n = num_writers < max ? num_writers : max;
+    for (int i = 0; i < n; i++) out[i] = writers[i];
+    return n;
+}
+
+void serial_writer_print_stats(serial_writer_t *w) {
+    serial_writer_stats_t st = w->stats;  // 終了後に呼ぶ
+    double lat_avg = st.writes ? (double)st.lat_sum_us / (double)st.writes : 0;
+    double batch_avg = st.writes ? (double)st.frames / (double)st.writes : 0;
+    printf("📡 %s: 書き込み %llu 回 / %llu 伝文 (平均 %.1f, 最大 %llu 伝文/回) / "
+           "完了遅延 平均 %.0fus 最大 %lluus / エラー %llu / タイムアウト %llu / 破棄 %llu\n",
+           w->name, (unsigned long long)st.writes, (unsigned long long)st.frames,
+           batch_avg, (unsigned long long)st.max_batch, lat_avg,
+           (unsigned long long)st.lat_max_us, (unsigned long long)st.errors,
+           (unsigned long long)st.short_writes, (unsigned long long)st.dropped_frames);
+}
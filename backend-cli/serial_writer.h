@@ -0,0 +1,91 @@
+// serial_writer.h
+// 非同期のシリアル送信 (Win32: オーバーラップ I/O + 完了ポート / POSIX: 送信スレッド + poll)
+//
+// スケジューラースレッドは serial_writer_queue() で伝文をポートごとの蓄積バッファに
+// 積むだけで、書き込みの完了を待たない。同じティックで積まれた伝文は
+// serial_writer_flush_all() でまとめて1回の書き込みとして発行される。
+// 前回の書き込みが完了していなければ次の発行は完了スレッドが行うため、
+// 遅い・止まった仮想 COM ペアでもスケジューラーは止まらない
+// (蓄積バッファが溢れた分は破棄して数える)。
+//
+// POSIX では発行時に非ブロッキングの write() を1回試し、書ききれなければ残りを
+// 送信スレッドが POLLOUT を待って書く。Win32 の COMMTIMEOUTS と同じ時間
+// (enq_port.h) で書ききれなければ打ち切ってタイムアウトとして数える。
+// pty / unix に "@bps" を付けると、その速度の回線と同じ間隔で1バイトずつ書く。
+
+#ifndef SERIAL_WRITER_H
+#define SERIAL_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "enq_metrics.h"
+#include "enq_port.h"
+
+#define SW_MAX_PORTS 64
+#define SW_STAGE_MAX 4096  // 1ポートで完了待ちの間に溜められる最大バイト数
+
+typedef struct {
+    uint64_t writes;           // 完了した書き込み数
+    uint64_t frames;           // 書き込んだ伝文数
+    uint64_t bytes;
+    uint64_t errors;           // 完了エラー・発行エラー
+    uint64_t short_writes;     // タイムアウトで一部しか書けなかった回数
+    uint64_t dropped_frames;   // 蓄積バッファ満杯で捨てた伝文数
+    uint64_t max_batch;        // 1回の書き込みにまとめた最大伝文数
+    uint64_t lat_sum_us;       // 発行から完了までの時間の合計
+    uint64_t lat_max_us;
+} serial_writer_stats_t;
+
+typedef struct {
+    enq_port_t port;
+#ifdef _WIN32
+    OVERLAPPED ov;             // 同時に発行する書き込みは1つだけ
+    CRITICAL_SECTION lock;     // 蓄積バッファと統計を保護 (I/O 中は保持しない)
+#else
+    pthread_mutex_t lock;
+    size_t inflight_off;       // 発行中のバッファのうち書き込み済みのバイト数
+    uint64_t deadline_us;      // これを過ぎたら打ち切る
+    uint64_t byte_ns;          // 模擬する回線の1バイトの時間 (0 なら模擬しない)
+    uint64_t wire_ns;          // 模擬回線が次のバイトを送れる時刻
+#endif
+    int busy;                  // 書き込み発行中
+    uint8_t buf[2][SW_STAGE_MAX];
+    int stage;                 // 蓄積中のバッファ番号 (もう一方が発行中)
+    size_t stage_len;
+    size_t stage_frames;
+    size_t inflight_len;
+    size_t inflight_frames;
+    uint64_t submit_us;
+    serial_writer_stats_t stats;
+    enq_hist_t write_hist;     // 発行から完了までの時間 (ns、ロックなしで読める)
+    const char *name;          // port.name ("COM31"、"/dev/ttyUSB0"、pty はスレーブのパス)
+} serial_writer_t;
+
+// 完了ポート (POSIX は送信スレッド) と完了スレッドの起動・停止
+int  serial_writer_system_init(void);
+void serial_writer_system_shutdown(void);
+
+// 9600bps 8E1 で非同期モードで開き、完了ポート (POSIX は送信スレッド) に登録する。
+// port は enq_port_open() の指定 ("COM3"、"/dev/ttyUSB0"、"pty"、"unix:/tmp/enq.sock")
+int  serial_writer_open(serial_writer_t *w, const char *port);
+// 未送信分を最大 drain_ms 待ってから閉じる
+void serial_writer_close(serial_writer_t *w, unsigned drain_ms);
+
+// 伝文を蓄積する。溢れて捨てたら 0
+int  serial_writer_queue(serial_writer_t *w, const void *frame, size_t len);
+// 蓄積分を発行する (書き込み発行中なら完了時に発行される)
+void serial_writer_flush(serial_writer_t *w);
+void serial_writer_flush_all(void);
+// 蓄積中 (未発行) のバイト数
+size_t serial_writer_pending(serial_writer_t *w);
+
+void serial_writer_get_stats(serial_writer_t *w, serial_writer_stats_t *out);
+// 開いているポートを最大 max 個 out に並べる。戻り値は個数
+int  serial_writer_list(serial_writer_t **out, int max);
+void serial_writer_print_stats(serial_writer_t *w);
+
+#endif // SERIAL_WRITER_H
@@ -0,0 +1,68 @@
+// sim_clock.c
+// 仮想時刻の離散イベント実行と種を指定する乱数
+
+#include "sim_clock.h"
+
+void sim_rng_seed(sim_rng_t *r, uint64_t seed) {
+    // 0 は xorshift の不動点なので避ける。近い種でも列が離れるよう一度かき混ぜる
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    r->s = z ? z : 0x9E3779B97F4A7C15ull;
+}
+
+uint64_t sim_rng_next(sim_rng_t *r) {
+    uint64_t x = r->s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    r->s = x;
+    return x * 2685821657736338717ull;
+}
+
+double sim_rng_uniform(sim_rng_t *r) {
+    return (double)(sim_rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+unsigned sim_rng_below(sim_rng_t *r, unsigned n) {
+    return (unsigned)(sim_rng_uniform(r) * n);
+}
+
+void sim_clock_init(sim_clock_t *c, double speed, uint64_t end_tick) {
+    tw_init(&c->wheel, 0);
+    c->speed = speed > 0 ? speed : 0;
+    c->origin_us = 0;
+    c->end_tick = end_tick;
+}
+
+void sim_clock_start(sim_clock_t *c, uint64_t now_us) {
+    // 既に進めた分を差し引いて、現在の仮想時刻が now_us に当たるようにする
+    c->origin_us = now_us;
+    if (c->speed > 0) c->origin_us -= (uint64_t)((double)c->wheel.now * TW_TICK_US / c->speed);
+}
+
+uint64_t sim_clock_next(const sim_clock_t *c) {
+    uint64_t next;
+    if (!tw_next_expiry(&c->wheel, &next)) return UINT64_MAX;
+    return next;
+}
+
+int sim_clock_advance(sim_clock_t *c, uint64_t to_tick) {
+    int done = 0;
+    if (c->end_tick && to_tick >= c->end_tick) {
+        to_tick = c->end_tick - 1;
+        done = 1;
+    }
+    if (to_tick >= c->wheel.now) tw_advance(&c->wheel, to_tick, NULL);
+    return done;
+}
+
+uint64_t sim_clock_target(const sim_clock_t *c, uint64_t now_us) {
+    if (now_us <= c->origin_us) return 0;
+    return (uint64_t)((double)(now_us - c->origin_us) * c->speed / TW_TICK_US);
+}
+
+uint64_t sim_clock_wall_us(const sim_clock_t *c, uint64_t tick) {
+    return c->origin_us + (uint64_t)((double)tick * TW_TICK_US / c->speed);
+}
@@ -0,0 +1,62 @@
+// sim_clock.h
+// 仮想時刻の離散イベント実行と種を指定する乱数 (シナリオ・交通流モデル共通)
+//
+// モデルはイベントを実時刻ではなく仮想ティック (TW_TICK_US 単位) でこの時計の
+// タイマーホイールに予約する。ホイールは満了順に発火する優先度付きキューとして使い、
+// 呼び出し側が sim_clock_advance() で時刻を進める。進め方は2通り:
+//   speed > 0  実時刻に合わせて進める (1 = 実時間、3600 なら実時間1秒で1時間)。
+//              sim_clock_target() が実時刻に対応する仮想ティックを、
+//              sim_clock_wall_us() が次のイベントを処理すべき実時刻を返す
+//   speed == 0 待ちなし。sim_clock_next() のイベントへ続けて進める (回帰試験用)
+// どちらで進めても発火の順序は同じで、乱数も sim_rng_t の種だけで決まるので、
+// 同じ種なら出力 (伝文の並びと仮想時刻) は同一になる。
+// OS 依存の処理は含まない (実時刻は呼び出し側が渡す)。
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <stdint.h>
+
+#include "timer_wheel.h"
+
+#define SIM_TICKS_PER_SEC (1000000 / TW_TICK_US)
+
+// ---- 乱数 (xorshift64*) ----
+// rand() のような共有状態は持たず、モデルごとに種から作る
+
+typedef struct {
+    uint64_t s;
+} sim_rng_t;
+
+void     sim_rng_seed(sim_rng_t *r, uint64_t seed);
+uint64_t sim_rng_next(sim_rng_t *r);
+double   sim_rng_uniform(sim_rng_t *r);              // [0, 1)
+unsigned sim_rng_below(sim_rng_t *r, unsigned n);    // [0, n)
+
+// ---- 仮想時刻 ----
+
+typedef struct {
+    timer_wheel_t wheel;   // 仮想ティックのイベント
+    double speed;          // 実時間に対する倍率 (0 なら待ちなし)
+    uint64_t origin_us;    // 仮想ティック 0 の実時刻 (speed > 0、sim_clock_start で決まる)
+    uint64_t end_tick;     // このティックの手前で終える (0 なら終わりなし)
+} sim_clock_t;
+
+void sim_clock_init(sim_clock_t *c, double speed, uint64_t end_tick);
+// 実時刻 now_us を仮想ティック 0 に合わせる (実時刻で進める場合)
+void sim_clock_start(sim_clock_t *c, uint64_t now_us);
+
+static inline uint64_t sim_clock_now(const sim_clock_t *c) { return c->wheel.now; }
+static inline int sim_clock_paced(const sim_clock_t *c) { return c->speed > 0; }
+
+// 次のイベントの仮想ティック (下限)。何も予約されていなければ UINT64_MAX
+uint64_t sim_clock_next(const sim_clock_t *c);
+// to_tick までのイベントを処理する (end_tick の手前で止める)。
+// 戻り値: end_tick に達した (これ以上進めない) なら 1
+int sim_clock_advance(sim_clock_t *c, uint64_t to_tick);
+// 実時刻 now_us に対応する仮想ティック (speed > 0)
+uint64_t sim_clock_target(const sim_clock_t *c, uint64_t now_us);
+// 仮想ティック tick を処理すべき実時刻 (speed > 0)
+uint64_t sim_clock_wall_us(const sim_clock_t *c, uint64_t tick);
+
+#endif // SIM_CLOCK_H
@@ -0,0 +1,283 @@
+// sim_platform.c
+// シミュレーターの OS 依存部分 (Win32 / POSIX)
+
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include "sim_platform.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+static volatile int *plat_running;
+
+#ifdef _WIN32
+
+// ---- Win32 ----
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+static LARGE_INTEGER qpc_freq;
+static HANDLE hTimer = NULL;
+static HANDLE hStopEvent = NULL;  // Ctrl+C で待機中のループを即座に起こす
+static HANDLE hDumpEvent = NULL;  // Ctrl+Break で計測値を表示する
+
+static void sigint_handler(int sig) {
+    printf("\n🛑 シグナル %d を受信しました。終了処理中...\n", sig);
+    *plat_running = 0;
+    if (hStopEvent) SetEvent(hStopEvent);
+}
+
+// Ctrl+Break: 表示はイベントループで行う (CRT は呼び出し後に既定動作へ戻すので再登録する)
+static void sigbreak_handler(int sig) {
+    if (hDumpEvent) SetEvent(hDumpEvent);
+    signal(sig, sigbreak_handler);
+}
+
+int plat_init(volatile int *running) {
+    plat_running = running;
+
+    // コンソールを UTF-8 モード、VT 処理オン
+    SetConsoleOutputCP(CP_UTF8);
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (GetConsoleMode(hOut, &mode)) {
+        SetConsoleMode(hOut, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+    QueryPerformanceFrequency(&qpc_freq);
+
+    hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                    TIMER_ALL_ACCESS);
+    if (hTimer == NULL) {
+        // 高分解能タイマー非対応の環境 (Windows 10 1803 より前)
+        hTimer = CreateWaitableTimerW(NULL, TRUE, NULL);
+    }
+    if (hTimer == NULL) {
+        fprintf(stderr, "❌ CreateWaitableTimer 失敗: %lu\n", GetLastError());
+        return 0;
+    }
+    hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    hDumpEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    signal(SIGINT, sigint_handler);
+    signal(SIGTERM, sigint_handler);
+    signal(SIGBREAK, sigbreak_handler);
+    return 1;
+}
+
+// QueryPerformanceCounter を µs / ns に変換
+uint64_t plat_now_us(void) {
+    LARGE_INTEGER c;
+    QueryPerformanceCounter(&c);
+    return (uint64_t)(c.QuadPart / qpc_freq.QuadPart) * 1000000 +
+           (uint64_t)(c.QuadPart % qpc_freq.QuadPart) * 1000000 / (uint64_t)qpc_freq.QuadPart;
+}
+
+uint64_t plat_now_ns(void) {
+    LARGE_INTEGER c;
+    QueryPerformanceCounter(&c);
+    return (uint64_t)(c.QuadPart / qpc_freq.QuadPart) * 1000000000 +
+           (uint64_t)(c.QuadPart % qpc_freq.QuadPart) * 1000000000 / (uint64_t)qpc_freq.QuadPart;
+}
+
+int plat_wait_until(uint64_t due_us) {
+    uint64_t now = plat_now_us();
+    if (due_us <= now) return PLAT_WAKE_TIMER;
+    // 相対時刻 (100ns 単位の負値)
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)((due_us - now) * 10);
+    if (!SetWaitableTimer(hTimer, &due, 0, NULL, NULL, FALSE)) {
+        fprintf(stderr, "❌ SetWaitableTimer 失敗: %lu\n", GetLastError());
+        return PLAT_WAKE_ERROR;
+    }
+    HANDLE handles[3] = { hStopEvent, hTimer, hDumpEvent };
+    switch (WaitForMultipleObjects(3, handles, FALSE, INFINITE)) {
+    case WAIT_OBJECT_0:     return PLAT_WAKE_STOP;
+    case WAIT_OBJECT_0 + 1: return PLAT_WAKE_TIMER;
+    case WAIT_OBJECT_0 + 2: return PLAT_WAKE_DUMP;
+    default:                return PLAT_WAKE_ERROR;
+    }
+}
+
+void plat_localtime(time_t t, struct tm *out) {
+    localtime_s(out, &t);
+}
+
+int plat_replace_file(const char *tmp, const char *path) {
+    if (MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING)) return 1;
+    DeleteFileA(tmp);
+    return 0;
+}
+
+int plat_map_file(plat_map_t *m, const char *path) {
+    memset(m, 0, sizeof(*m));
+    wchar_t wpath[1024];
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, 1024) == 0) {
+        fprintf(stderr, "❌ パス %s を変換できません: %lu\n", path, GetLastError());
+        return 0;
+    }
+    m->hFile = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m->hFile == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "❌ %s を開けません: %lu\n", path, GetLastError());
+        return 0;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m->hFile, &size) || size.QuadPart == 0) {
+        fprintf(stderr, "❌ %s が空です\n", path);
+        plat_unmap_file(m);
+        return 0;
+    }
+    m->hMap = CreateFileMappingW(m->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m->hMap == NULL) {
+        fprintf(stderr, "❌ CreateFileMapping 失敗: %lu\n", GetLastError());
+        plat_unmap_file(m);
+        return 0;
+    }
+    m->base = MapViewOfFile(m->hMap, FILE_MAP_READ, 0, 0, 0);
+    if (m->base == NULL) {
+        fprintf(stderr, "❌ MapViewOfFile 失敗: %lu\n", GetLastError());
+        plat_unmap_file(m);
+        return 0;
+    }
+    m->size = (size_t)size.QuadPart;
+    return 1;
+}
+
+void plat_unmap_file(plat_map_t *m) {
+    if (m->base) UnmapViewOfFile(m->base);
+    if (m->hMap) CloseHandle(m->hMap);
+    if (m->hFile && m->hFile != INVALID_HANDLE_VALUE) CloseHandle(m->hFile);
+    memset(m, 0, sizeof(*m));
+}
+
+#else
+
+// ---- POSIX ----
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+static int timer_fd = -1;
+static int signal_fd = -1;
+
+int plat_init(volatile int *running) {
+    plat_running = running;
+
+    // シグナルはブロックして signalfd で受ける (以降に作るスレッドにも引き継がれる)
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0 ||
+        (signal_fd = signalfd(-1, &set, SFD_CLOEXEC)) < 0) {
+        fprintf(stderr, "❌ signalfd 失敗: %s\n", strerror(errno));
+        return 0;
+    }
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        fprintf(stderr, "❌ timerfd_create 失敗: %s\n", strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+uint64_t plat_now_us(void) {
+    return plat_now_ns() / 1000;
+}
+
+uint64_t plat_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int plat_wait_until(uint64_t due_us) {
+    // 絶対時刻で設定する (0 は解除になるので最低 1ns)
+    struct itimerspec its = {0};
+    its.it_value.tv_sec = (time_t)(due_us / 1000000);
+    its.it_value.tv_nsec = (long)(due_us % 1000000) * 1000;
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        fprintf(stderr, "❌ timerfd_settime 失敗: %s\n", strerror(errno));
+        return PLAT_WAKE_ERROR;
+    }
+
+    struct pollfd fds[2] = { { signal_fd, POLLIN, 0 }, { timer_fd, POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "❌ poll 失敗: %s\n", strerror(errno));
+            return PLAT_WAKE_ERROR;
+        }
+        // シグナルを先に見る (停止要求をタイマーより優先する)
+        if (fds[0].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            if (read(signal_fd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+                if (si.ssi_signo == SIGUSR1) return PLAT_WAKE_DUMP;
+                printf("\n🛑 シグナル %u を受信しました。終了処理中...\n", si.ssi_signo);
+                *plat_running = 0;
+                return PLAT_WAKE_STOP;
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) > 0) return PLAT_WAKE_TIMER;
+        }
+    }
+}
+
+void plat_localtime(time_t t, struct tm *out) {
+    localtime_r(&t, out);
+}
+
+int plat_replace_file(const char *tmp, const char *path) {
+    if (rename(tmp, path) == 0) return 1;
+    unlink(tmp);
+    return 0;
+}
+
+int plat_map_file(plat_map_t *m, const char *path) {
+    memset(m, 0, sizeof(*m));
+    m->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (m->fd < 0) {
+        fprintf(stderr, "❌ %s を開けません: %s\n", path, strerror(errno));
+        return 0;
+    }
+    struct stat st;
+    if (fstat(m->fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "❌ %s が空です\n", path);
+        plat_unmap_file(m);
+        return 0;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, m->fd, 0);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "❌ mmap 失敗: %s\n", strerror(errno));
+        plat_unmap_file(m);
+        return 0;
+    }
+    // 先頭から順に読むので先読みを促す
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+    m->base = p;
+    m->size = (size_t)st.st_size;
+    return 1;
+}
+
+void plat_unmap_file(plat_map_t *m) {
+    if (m->base) munmap((void *)m->base, m->size);
+    if (m->fd >= 0) close(m->fd);
+    memset(m, 0, sizeof(*m));
+    m->fd = -1;
+}
+
+#endif
@@ -0,0 +1,63 @@
+// sim_platform.h
+// シミュレーターの OS 依存部分 (Win32 / POSIX)
+//
+// 時計、イベントループの待機、シグナル、ファイルのマップと置き換えをまとめる。
+// シリアルポートは enq_port.h / serial_writer.h が受け持つ。
+//   時計   : Win32 は QueryPerformanceCounter、POSIX は CLOCK_MONOTONIC
+//            (受信側 serial_debug_test と同じ時計なので probe -shared が使える)
+//   待機   : Win32 は高分解能の待機可能タイマーと停止・表示イベント、
+//            POSIX は timerfd と signalfd を poll で待つ
+//   シグナル: Ctrl+C / SIGTERM で停止、表示要求は Ctrl+Break (POSIX は SIGUSR1)
+
+#ifndef SIM_PLATFORM_H
+#define SIM_PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define PLAT_DUMP_KEY "Ctrl+Break"
+#else
+#define PLAT_DUMP_KEY "SIGUSR1"
+#endif
+
+// コンソールを UTF-8 にし、時計とシグナルを準備する。停止シグナルで *running を 0 にする。
+// POSIX ではシグナルをブロックして signalfd で受けるので、スレッドを作る前に呼ぶ
+int plat_init(volatile int *running);
+
+uint64_t plat_now_us(void);
+uint64_t plat_now_ns(void);
+
+enum {
+    PLAT_WAKE_TIMER,  // 予定時刻になった
+    PLAT_WAKE_STOP,   // 停止要求 (*running は 0 になっている)
+    PLAT_WAKE_DUMP,   // 計測値の表示要求
+    PLAT_WAKE_ERROR,
+};
+
+// plat_now_us() の時刻 due_us まで待つ
+int plat_wait_until(uint64_t due_us);
+
+void plat_localtime(time_t t, struct tm *out);
+
+// tmp を path に置き換える (失敗したら tmp を消して 0)
+int plat_replace_file(const char *tmp, const char *path);
+
+// ファイルを読み取り専用でマップする
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+#ifdef _WIN32
+    HANDLE hFile, hMap;
+#else
+    int fd;
+#endif
+} plat_map_t;
+
+// 失敗したら理由を表示して 0 (途中まで開いたものは閉じる)
+int  plat_map_file(plat_map_t *m, const char *path);
+void plat_unmap_file(plat_map_t *m);
+
+#endif // SIM_PLATFORM_H
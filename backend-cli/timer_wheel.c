@@ -0,0 +1,173 @@
+// timer_wheel.c
+// 階層タイマーホイール
+
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#define TW_MASK (TW_SLOTS - 1)
+
+static int ctz64(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1)) { v >>= 1; n++; }
+    return n;
+#endif
+}
+
+static void list_push(tw_list_t *l, tw_timer_t *t) {
+    t->next = NULL;
+    t->prev = l->tail;
+    if (l->tail) l->tail->next = t;
+    else         l->head = t;
+    l->tail = t;
+}
+
+static void list_remove(tw_list_t *l, tw_timer_t *t) {
+    if (t->prev) t->prev->next = t->next;
+    else         l->head = t->next;
+    if (t->next) t->next->prev = t->prev;
+    else         l->tail = t->prev;
+    t->next = t->prev = NULL;
+}
+
+// 満了時刻と現在時刻の上位ビットを比べて段とスロットを決める
+static tw_list_t *place(timer_wheel_t *tw, uint64_t expires, int *level, int *slot) {
+    for (int lv = 0; lv < TW_LEVELS; lv++) {
+        int shift = (lv + 1) * TW_SLOT_BITS;
+        if ((expires >> shift) == (tw->now >> shift)) {
+            *level = lv;
+            *slot = (int)((expires >> (lv * TW_SLOT_BITS)) & TW_MASK);
+            return &tw->slots[lv][*slot];
+        }
+    }
+    *level = TW_LEVELS;
+    *slot = 0;
+    return &tw->overflow;
+}
+
+static void insert(timer_wheel_t *tw, tw_timer_t *t) {
+    tw_list_t *l = place(tw, t->expires, &t->level, &t->slot);
+    list_push(l, t);
+    if (t->level < TW_LEVELS) tw->bitmap[t->level] |= 1ull << t->slot;
+}
+
+// 配置後に now が進んでも所属リストは変わらないため、記録した位置から外す
+static void unlink_timer(timer_wheel_t *tw, tw_timer_t *t) {
+    tw_list_t *l = t->level < TW_LEVELS ? &tw->slots[t->level][t->slot] : &tw->overflow;
+    list_remove(l, t);
+    if (t->level < TW_LEVELS && l->head == NULL) tw->bitmap[t->level] &= ~(1ull << t->slot);
+}
+
+void tw_init(timer_wheel_t *tw, uint64_t start_tick) {
+    memset(tw, 0, sizeof(*tw));
+    tw->now = start_tick;
+}
+
+void tw_timer_init(tw_timer_t *t, tw_callback cb, void *ctx) {
+    memset(t, 0, sizeof(*t));
+    t->cb = cb;
+    t->ctx = ctx;
+}
+
+void tw_schedule(timer_wheel_t *tw, tw_timer_t *t, uint64_t expires) {
+    if (t->pending) tw_cancel(tw, t);
+    if (expires < tw->now) expires = tw->now;
+    t->expires = expires;
+    t->pending = 1;
+    insert(tw, t);
+    tw->count++;
+}
+
+void tw_cancel(timer_wheel_t *tw, tw_timer_t *t) {
+    if (!t->pending) return;
+    unlink_timer(tw, t);
+    t->pending = 0;
+    tw->count--;
+}
+
+// 上位段のスロットを現在時刻基準で再配置する
+static void cascade(timer_wheel_t *tw, int lv) {
+    tw_list_t *l;
+    if (lv < TW_LEVELS) {
+        int slot = (int)((tw->now >> (lv * TW_SLOT_BITS)) & TW_MASK);
+        l = &tw->slots[lv][slot];
+        tw->bitmap[lv] &= ~(1ull << slot);
+    } else {
+        l = &tw->overflow;
+    }
+    tw_timer_t *t = l->head;
+    l->head = l->tail = NULL;
+    while (t) {
+        tw_timer_t *next = t->next;
+        insert(tw, t);
+        t = next;
+    }
+}
+
+size_t tw_advance(timer_wheel_t *tw, uint64_t to_tick, const volatile int *running) {
+    size_t fired = 0;
+
+    while (tw->now <= to_tick) {
+        if (running && !*running) break;
+
+        // 段の境界に来たら上位段から順に降ろす
+        if ((tw->now & TW_MASK) == 0) {
+            int top = 1;
+            while (top <= TW_LEVELS &&
+                   (tw->now & ((1ull << (top * TW_SLOT_BITS)) - 1)) == 0) top++;
+            for (int lv = top - 1; lv >= 1; lv--) cascade(tw, lv);
+        }
+
+        int slot = (int)(tw->now & TW_MASK);
+        tw_list_t *l = &tw->slots[0][slot];
+        while (l->head) {
+            if (running && !*running) return fired;
+            tw_timer_t *t = l->head;
+            list_remove(l, t);
+            if (l->head == NULL) tw->bitmap[0] &= ~(1ull << slot);
+            t->pending = 0;
+            tw->count--;
+            fired++;
+            // コールバック内で同じティックに再登録されたものもこのループで発火する
+            t->cb(t, t->ctx);
+        }
+
+        // 段0の次の使用中スロット、なければ次の境界まで読み飛ばす。
+        // to_tick を越える場合は to_tick の次で止め、境界の処理は次回に回す
+        uint64_t rest = slot == TW_MASK ? 0 : tw->bitmap[0] & (~0ull << (slot + 1));
+        uint64_t next = rest ? (tw->now & ~(uint64_t)TW_MASK) + (uint64_t)ctz64(rest)
+                             : (tw->now | TW_MASK) + 1;
+        tw->now = next < to_tick + 1 ? next : to_tick + 1;
+    }
+    return fired;
+}
+
+int tw_next_expiry(const timer_wheel_t *tw, uint64_t *tick) {
+    if (tw->count == 0) return 0;
+
+    // 上位段の現在スロットが埋まっているのは境界の降ろし待ちのとき (tw_advance が
+    // 境界の手前で止まった) で、段0より早い満了を含みうるので全段の最小を取る
+    uint64_t best = UINT64_MAX;
+    for (int lv = 0; lv < TW_LEVELS; lv++) {
+        int shift = lv * TW_SLOT_BITS;
+        int cur = (int)((tw->now >> shift) & TW_MASK);
+        uint64_t bits = tw->bitmap[lv] & (~0ull << cur);
+        if (bits) {
+            uint64_t base = (tw->now >> (shift + TW_SLOT_BITS)) << (shift + TW_SLOT_BITS);
+            uint64_t t = base + ((uint64_t)ctz64(bits) << shift);
+            if (t < tw->now) t = tw->now;
+            if (t < best) best = t;
+        }
+    }
+    if (best != UINT64_MAX) {
+        *tick = best;
+        return 1;
+    }
+    // オーバーフローのみ: 段3の次の周回
+    int top = TW_LEVELS * TW_SLOT_BITS;
+    *tick = ((tw->now >> top) + 1) << top;
+    return 1;
+}
@@ -0,0 +1,66 @@
+// timer_wheel.h
+// 階層タイマーホイール (4段 x 64スロット)
+//
+// 時刻は呼び出し側が決める「ティック」単位の整数。シミュレーターでは
+// TW_TICK_US (100us) を1ティックとして扱う。
+//   段0: 64ティック, 段1: 4096ティック, 段2: 262144ティック, 段3: 16777216ティック
+// それを超える満了時刻はオーバーフローリストに置き、段3の周回ごとに再配置する。
+// 各段は使用中スロットのビットマップを持ち、次の満了時刻の計算は O(段数)。
+// tw_advance は段0のビットマップで空きスロットを読み飛ばすが、64ティックの境界ごとに
+// 止まって上位段を降ろすので、進めた区間に対して O(ティック数 / 64 + 発火数)。
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TW_LEVELS     4
+#define TW_SLOT_BITS  6
+#define TW_SLOTS      (1 << TW_SLOT_BITS)
+#define TW_TICK_US    100
+
+typedef struct tw_timer tw_timer_t;
+typedef void (*tw_callback)(tw_timer_t *t, void *ctx);
+
+struct tw_timer {
+    tw_timer_t *next, *prev;  // 侵入型リスト (ホイール内部で使用)
+    uint64_t expires;         // 満了ティック
+    tw_callback cb;
+    void *ctx;
+    int pending;              // スケジュール中なら 1
+    int level, slot;          // 所属リスト (段 TW_LEVELS はオーバーフロー)
+};
+
+typedef struct {
+    tw_timer_t *head, *tail;
+} tw_list_t;
+
+typedef struct {
+    uint64_t now;                           // 次に処理するティック
+    uint64_t bitmap[TW_LEVELS];             // 使用中スロット
+    tw_list_t slots[TW_LEVELS][TW_SLOTS];
+    tw_list_t overflow;
+    size_t count;                           // スケジュール中のタイマー数
+} timer_wheel_t;
+
+void tw_init(timer_wheel_t *tw, uint64_t start_tick);
+void tw_timer_init(tw_timer_t *t, tw_callback cb, void *ctx);
+
+// 満了ティックを指定してスケジュールする (既にスケジュール中なら付け替える)。
+// 過去の時刻は次に処理するティックに丸める。
+void tw_schedule(timer_wheel_t *tw, tw_timer_t *t, uint64_t expires);
+void tw_cancel(timer_wheel_t *tw, tw_timer_t *t);
+
+// to_tick までに満了したタイマーを満了順に発火する。コールバック内からの
+// 再スケジュールも可。*running が 0 になったら発火ごとの境界で中断する。
+// 戻り値: 発火したタイマー数
+size_t tw_advance(timer_wheel_t *tw, uint64_t to_tick, const volatile int *running);
+
+// 次に tw_advance() を呼ぶべきティック (満了時刻の下限) を求める。
+// タイマーがなければ 0 を返す。
+int tw_next_expiry(const timer_wheel_t *tw, uint64_t *tick);
+
+static inline uint64_t tw_ms(uint64_t ms) { return ms * 1000 / TW_TICK_US; }
+
+#endif // TIMER_WHEEL_H
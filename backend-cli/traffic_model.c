@@ -0,0 +1,578 @@
+// traffic_model.c
+// 建物の利用者の流れと号機の運行のモデル
+
+#include "traffic_model.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "enq_parser.h"
+
+#define FLOOR_MIN (-64)   // 指定できる階の範囲 (B64F〜999F)
+#define FLOOR_MAX 999
+
+// 号機1台あたりの到着率 (人/時) の既定値。平日の事務所ビル:
+// 8時台の出勤 (上りピーク)、12〜13時台の昼休み、17時台の退勤 (下りピーク)
+static const double default_rate[24] = {
+    2, 2, 2, 2, 2, 3, 10, 60, 180, 90, 40, 40,
+    140, 100, 40, 40, 50, 150, 70, 30, 15, 8, 4, 2,
+};
+
+static void default_mix(int hour, double mix[TM_FLOWS]) {
+    static const double up_peak[TM_FLOWS]   = { 0.80, 0.10, 0.10 };
+    static const double lunch_out[TM_FLOWS] = { 0.25, 0.60, 0.15 };
+    static const double lunch_in[TM_FLOWS]  = { 0.60, 0.25, 0.15 };
+    static const double down_peak[TM_FLOWS] = { 0.10, 0.80, 0.10 };
+    static const double normal[TM_FLOWS]    = { 0.35, 0.35, 0.30 };
+    const double *m = normal;
+    if (hour >= 7 && hour <= 9) m = up_peak;
+    else if (hour == 12) m = lunch_out;
+    else if (hour == 13) m = lunch_in;
+    else if (hour == 17 || hour == 18) m = down_peak;
+    memcpy(mix, m, sizeof(double) * TM_FLOWS);
+}
+
+void traffic_default_config(traffic_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    traffic_parse_floors(cfg, "B1..10");
+    memcpy(cfg->rate, default_rate, sizeof(cfg->rate));
+    for (int h = 0; h < 24; h++) default_mix(h, cfg->mix[h]);
+    cfg->capacity_kg = 1600;  // 24人乗り
+    cfg->floor_ms = 2000;
+    cfg->accel_ms = 2000;
+    cfg->door_ms = 4000;
+    cfg->board_ms = 1200;
+    cfg->refresh_ms = 1000;
+}
+
+// "B2" / "B2F" / "12" / "12F" → -2 / 12。戻り値: 末尾の次 (不正なら NULL)
+static const char *parse_floor(const char *s, int *out) {
+    int neg = 0;
+    if (*s == 'B' || *s == 'b') {
+        neg = 1;
+        s++;
+    }
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || v <= 0) return NULL;
+    if (*end == 'F' || *end == 'f') end++;
+    v = neg ? -v : v;
+    if (v < FLOOR_MIN || v > FLOOR_MAX) return NULL;
+    *out = (int)v;
+    return end;
+}
+
+int traffic_parse_floors(traffic_config_t *cfg, const char *spec) {
+    static uint8_t used[FLOOR_MAX - FLOOR_MIN + 1];
+    memset(used, 0, sizeof(used));
+    const char *p = spec;
+    for (;;) {
+        int a, b;
+        p = parse_floor(p, &a);
+        if (p == NULL) return -1;
+        b = a;
+        if (p[0] == '.' && p[1] == '.') {
+            p = parse_floor(p + 2, &b);
+            if (p == NULL) return -1;
+        }
+        if (b < a) { int t = a; a = b; b = t; }
+        for (int f = a; f <= b; f++) {
+            if (f != 0) used[f - FLOOR_MIN] = 1;
+        }
+        if (*p == '\0') break;
+        if (*p++ != ',') return -1;
+    }
+
+    int n = 0;
+    for (int f = FLOOR_MIN; f <= FLOOR_MAX; f++) {
+        if (!used[f - FLOOR_MIN]) continue;
+        if (n == TM_MAX_FLOORS) return -1;
+        cfg->floors[n++] = f;
+    }
+    if (n < 2) return -1;
+    cfg->num_floors = n;
+    // 玄関階は 1F (なければ最下階)
+    cfg->lobby = 0;
+    for (int i = 0; i < n; i++) {
+        if (cfg->floors[i] == 1) cfg->lobby = i;
+    }
+    return 0;
+}
+
+int traffic_parse_rates(traffic_config_t *cfg, const char *spec) {
+    const char *p = spec;
+    for (;;) {
+        char *end;
+        long h0 = strtol(p, &end, 10), h1 = h0;
+        if (end == p) return -1;
+        p = end;
+        if (*p == '-') {
+            h1 = strtol(p + 1, &end, 10);
+            if (end == p + 1) return -1;
+            p = end;
+        }
+        if (*p++ != '=' || h0 < 0 || h1 > 23 || h1 < h0) return -1;
+        double v = strtod(p, &end);
+        if (end == p || v < 0) return -1;
+        p = end;
+        for (long h = h0; h <= h1; h++) cfg->rate[h] = v;
+        if (*p == '\0') return 0;
+        if (*p++ != ',') return -1;
+    }
+}
+
+int traffic_floor_index(const traffic_config_t *cfg, const char *name) {
+    int f;
+    const char *end = parse_floor(name, &f);
+    if (end == NULL || *end != '\0') return -1;
+    for (int i = 0; i < cfg->num_floors; i++) {
+        if (cfg->floors[i] == f) return i;
+    }
+    return -1;
+}
+
+uint16_t traffic_floor_value(int floor) {
+    return (uint16_t)floor;  // 地下は2の補数 (-1 → FFFF)
+}
+
+// 仮想時計の現在ティック (traffic_now と違い、始めた時点を引かない)
+static uint64_t now_of(const traffic_model_t *m) {
+    return sim_clock_now(m->clock);
+}
+
+// ---- 乱数 ----
+
+static double rng_uniform(traffic_model_t *m) {
+    return sim_rng_uniform(&m->rng);
+}
+
+static unsigned rng_below(traffic_model_t *m, unsigned n) {
+    return sim_rng_below(&m->rng, n);
+}
+
+// ---- 利用者の待ち行列 ----
+
+static int32_t pax_alloc(traffic_model_t *m) {
+    int32_t i = m->free_pax;
+    if (i >= 0) m->free_pax = m->pax[i].next;
+    return i;
+}
+
+static void pax_free(traffic_model_t *m, int32_t i) {
+    m->pax[i].next = m->free_pax;
+    m->free_pax = i;
+}
+
+static void queue_push(traffic_model_t *m, tm_queue_t *q, int32_t i) {
+    m->pax[i].next = -1;
+    if (q->tail >= 0) m->pax[q->tail].next = i;
+    else q->head = i;
+    q->tail = i;
+}
+
+static int32_t queue_pop(traffic_model_t *m, tm_queue_t *q) {
+    int32_t i = q->head;
+    if (i >= 0) {
+        q->head = m->pax[i].next;
+        if (q->head < 0) q->tail = -1;
+    }
+    return i;
+}
+
+// ---- 伝文 ----
+
+static void emit(tm_car_t *c, uint16_t data_num, uint16_t value) {
+    c->m->stats.frames++;
+    c->m->emit(c->m->ctx, c->index, data_num, value);
+}
+
+static void send_current(tm_car_t *c) {
+    emit(c, ENQ_DATA_CURRENT_FLOOR, traffic_floor_value(c->m->cfg.floors[c->floor]));
+}
+
+// 行先階。なし (着床・待機) は 0000
+static void send_target(tm_car_t *c) {
+    emit(c, ENQ_DATA_TARGET_FLOOR,
+         c->target < 0 ? 0 : traffic_floor_value(c->m->cfg.floors[c->target]));
+}
+
+static void send_load(tm_car_t *c) {
+    c->sent_load_kg = c->load_kg;
+    emit(c, ENQ_DATA_LOAD_WEIGHT, (uint16_t)c->load_kg);
+}
+
+// ---- 号機 ----
+
+static uint64_t ms_ticks(unsigned ms) {
+    return tw_ms(ms);
+}
+
+static void car_after(tm_car_t *c, unsigned ms) {
+    tw_schedule(&c->m->clock->wheel, &c->timer, now_of(c->m) + ms_ticks(ms));
+}
+
+static int slot_of(int dir) {
+    return dir > 0 ? 0 : 1;
+}
+
+static int has_stop(const tm_car_t *c, int i) {
+    return c->car_call[i] || c->hall_call[i][0] || c->hall_call[i][1];
+}
+
+// from の先 (dir 方向) で最も近い停止階。なければ -1
+static int stop_beyond(const tm_car_t *c, int from, int dir) {
+    int n = c->m->cfg.num_floors;
+    for (int i = from + dir; i >= 0 && i < n; i += dir) {
+        if (has_stop(c, i)) return i;
+    }
+    return -1;
+}
+
+// 同じく最も遠い停止階 (折り返す階)。なければ from
+static int farthest_beyond(const tm_car_t *c, int from, int dir) {
+    int n = c->m->cfg.num_floors, far = from;
+    for (int i = from + dir; i >= 0 && i < n; i += dir) {
+        if (has_stop(c, i)) far = i;
+    }
+    return far;
+}
+
+// 走行中の号機がこの階で止まるか: かご内の行先、進行方向の乗り場呼び、
+// この先に止まる所がなければ逆方向の乗り場呼びでも止まる
+static int should_stop(const tm_car_t *c) {
+    int i = c->floor, s = slot_of(c->dir);
+    if (c->car_call[i] || c->hall_call[i][s]) return 1;
+    return c->hall_call[i][1 - s] && stop_beyond(c, i, c->dir) < 0;
+}
+
+// 進行方向で最も近い停止階を行先として送る (変わったときだけ)
+static void update_target(tm_car_t *c) {
+    int t = stop_beyond(c, c->floor, c->dir);
+    if (t >= 0 && t != c->target) {
+        c->target = t;
+        send_target(c);
+    }
+}
+
+static void dispatch(traffic_model_t *m, int floor, int s, int exclude);
+
+// 乗り場の待ち行列から定員まで乗せる (先頭が乗れなければそこで打ち切る)。
+// 残った人の呼びは他の号機に回す
+static int board_from(tm_car_t *c, int s) {
+    traffic_model_t *m = c->m;
+    int i = c->floor, n = 0;
+    tm_queue_t *q = &m->waiting[i][s];
+    while (q->head >= 0 && c->load_kg + m->pax[q->head].weight_kg <= m->cfg.capacity_kg) {
+        int32_t k = queue_pop(m, q);
+        tm_passenger_t *p = &m->pax[k];
+        p->t_board = now_of(m);
+        uint64_t wait_ms = (p->t_board - p->t_arrive) * TW_TICK_US / 1000;
+        m->stats.wait_sum_ms += wait_ms;
+        if (wait_ms > m->stats.wait_max_ms) m->stats.wait_max_ms = wait_ms;
+        m->stats.boarded++;
+        queue_push(m, &c->onboard, k);
+        c->load_kg += p->weight_kg;
+        c->riders++;
+        c->car_call[p->dest] = 1;
+        n++;
+    }
+    c->hall_call[i][s] = 0;
+    m->hall_owner[i][s] = -1;
+    if (q->head >= 0) dispatch(m, i, s, c->index);
+    return n;
+}
+
+// 降ろす。戻り値: 降りた人数
+static int alight(tm_car_t *c) {
+    traffic_model_t *m = c->m;
+    int i = c->floor, n = 0;
+    int32_t prev = -1, k = c->onboard.head;
+    while (k >= 0) {
+        tm_passenger_t *p = &m->pax[k];
+        int32_t next = p->next;
+        if (p->dest == i) {
+            if (prev >= 0) m->pax[prev].next = next;
+            else c->onboard.head = next;
+            if (c->onboard.tail == k) c->onboard.tail = prev;
+            c->load_kg -= p->weight_kg;
+            c->riders--;
+            m->stats.delivered++;
+            m->stats.ride_sum_ms += (now_of(m) - p->t_board) * TW_TICK_US / 1000;
+            pax_free(m, k);
+            n++;
+        } else {
+            prev = k;
+        }
+        k = next;
+    }
+    c->car_call[i] = 0;
+    return n;
+}
+
+// 戸を開けて乗り降りさせ、戸閉までの時間を予約する
+static void doors_open(tm_car_t *c) {
+    int i = c->floor, d = c->dir;
+    c->state = TM_DOORS;
+    int n = alight(c);
+    // 進む方向: この先に止まる所か同じ方向の呼びがあればそのまま、なければ逆方向の呼び
+    int up = c->hall_call[i][0], down = c->hall_call[i][1];
+    if (d == 0) d = up ? 1 : down ? -1 : 0;
+    else if (!c->hall_call[i][slot_of(d)] && stop_beyond(c, i, d) < 0 &&
+             c->hall_call[i][slot_of(-d)])
+        d = -d;
+    c->dir = d;
+    if (d != 0 && c->hall_call[i][slot_of(d)]) n += board_from(c, slot_of(d));
+    car_after(c, c->m->cfg.door_ms + c->m->cfg.board_ms * (unsigned)n);
+}
+
+static void start_trip(tm_car_t *c) {
+    c->state = TM_MOVING;
+    update_target(c);
+    car_after(c, c->m->cfg.accel_ms + c->m->cfg.floor_ms);
+}
+
+// 待機から動き出す (近い方の呼びへ)。呼びがなければ待機のまま
+static int car_depart(tm_car_t *c) {
+    int i = c->floor;
+    int up = stop_beyond(c, i, 1), down = stop_beyond(c, i, -1);
+    if (up < 0 && down < 0) return 0;
+    if (up >= 0 && (down < 0 || up - i <= i - down)) c->dir = 1;
+    else c->dir = -1;
+    start_trip(c);
+    return 1;
+}
+
+// 割り当てのない呼び (定員で乗れなかった人) を待機中の号機に回す
+static void dispatch_pending(traffic_model_t *m) {
+    for (int i = 0; i < m->cfg.num_floors; i++) {
+        for (int s = 0; s < 2; s++) {
+            if (m->hall_owner[i][s] < 0 && m->waiting[i][s].head >= 0) dispatch(m, i, s, -1);
+        }
+    }
+}
+
+static void car_timer(tw_timer_t *t, void *ctx) {
+    tm_car_t *c = ctx;
+    (void)t;
+    switch (c->state) {
+    case TM_MOVING:
+        c->floor += c->dir;
+        send_current(c);
+        if (should_stop(c)) {
+            // 着床: 行先を消す (0000)
+            c->m->stats.stops++;
+            c->target = -1;
+            send_target(c);
+            doors_open(c);
+        } else {
+            update_target(c);
+            car_after(c, c->m->cfg.floor_ms);
+        }
+        break;
+    case TM_DOORS: {
+        if (c->load_kg != c->sent_load_kg) send_load(c);
+        int i = c->floor, d = c->dir;
+        // 戸開中にこの階の呼びが割り当てられたら開け直す。逆方向の呼びも、
+        // この先に止まる所がなければ折り返して拾う (残すと待機中に抱えたままになる)
+        int here = c->hall_call[i][0] || c->hall_call[i][1];
+        if ((d != 0 && c->hall_call[i][slot_of(d)]) ||
+            (here && (d == 0 || stop_beyond(c, i, d) < 0))) {
+            doors_open(c);
+            break;
+        }
+        if (d != 0 && stop_beyond(c, i, d) >= 0) {
+            start_trip(c);
+        } else if (d != 0 && stop_beyond(c, i, -d) >= 0) {
+            c->dir = -d;
+            start_trip(c);
+        } else if (!car_depart(c)) {
+            c->state = TM_IDLE;
+            c->dir = 0;
+            dispatch_pending(c->m);
+        }
+        break;
+    }
+    case TM_IDLE:
+        // 呼びが割り当てられた
+        if (c->hall_call[c->floor][0] || c->hall_call[c->floor][1]) doors_open(c);
+        else car_depart(c);
+        break;
+    }
+}
+
+static void car_refresh(tw_timer_t *t, void *ctx) {
+    tm_car_t *c = ctx;
+    send_current(c);
+    send_target(c);
+    send_load(c);
+    if (c->m->cfg.refresh_ms) tw_schedule(&c->m->clock->wheel, t, t->expires + ms_ticks(c->m->cfg.refresh_ms));
+}
+
+// 乗り場呼びに着くまでの見込み (階数換算)。同じ方向で手前にいれば距離、
+// 逆方向や通り過ぎた後なら折り返しまでの距離を足す。停止予定と満員も重く見る
+static double call_cost(const tm_car_t *c, int floor, int s) {
+    const traffic_config_t *cfg = &c->m->cfg;
+    int pos = c->floor, d = c->dir;
+    double cost;
+    if (c->state == TM_IDLE || d == 0) {
+        cost = abs(floor - pos);
+    } else {
+        int call_dir = s == 0 ? 1 : -1;
+        int ahead = (floor - pos) * d > 0 || (floor == pos && c->state == TM_DOORS);
+        if (ahead && call_dir == d) {
+            cost = abs(floor - pos);
+        } else {
+            int far = farthest_beyond(c, pos, d);
+            cost = abs(far - pos) + abs(far - floor);
+            if (call_dir == d) cost += cfg->num_floors;  // もう一度折り返す
+        }
+    }
+    int stops = 0;
+    for (int i = 0; i < cfg->num_floors; i++) stops += has_stop(c, i);
+    double stop_floors = (double)(cfg->door_ms + cfg->accel_ms) / (double)cfg->floor_ms;
+    cost += stops * stop_floors;
+    if (c->load_kg + 80 > cfg->capacity_kg) cost += 2.0 * cfg->num_floors;
+    return cost;
+}
+
+static void dispatch(traffic_model_t *m, int floor, int s, int exclude) {
+    int best = -1;
+    double best_cost = 0;
+    for (int k = 0; k < m->num_cars; k++) {
+        if (k == exclude) continue;
+        double cost = call_cost(&m->cars[k], floor, s);
+        if (best < 0 || cost < best_cost) {
+            best = k;
+            best_cost = cost;
+        }
+    }
+    if (best < 0) return;  // 1台しかない: 戸閉後に dispatch_pending で拾う
+    tm_car_t *c = &m->cars[best];
+    c->hall_call[floor][s] = 1;
+    m->hall_owner[floor][s] = (int16_t)best;
+    if (c->state == TM_IDLE && !c->timer.pending) tw_schedule(&m->clock->wheel, &c->timer, now_of(m));
+    else if (c->state == TM_MOVING) update_target(c);
+}
+
+// ---- 利用者の到着 ----
+
+static int hour_of(const traffic_model_t *m, uint64_t tick) {
+    return (int)((m->day_ticks + tick - m->start_tick) / TM_TICKS_PER_HOUR % 24);
+}
+
+// 玄関階以外の階を1つ選ぶ (except も除く)
+static int other_floor(traffic_model_t *m, int except) {
+    int n = m->cfg.num_floors, lobby = m->cfg.lobby;
+    for (;;) {
+        int f = (int)rng_below(m, (unsigned)(n - 1));
+        if (f >= lobby) f++;
+        if (f != except) return f;
+    }
+}
+
+static void spawn(traffic_model_t *m, int hour) {
+    const double *mix = m->cfg.mix[hour];
+    double total = mix[0] + mix[1] + mix[2];
+    double u = rng_uniform(m) * (total > 0 ? total : 1);
+    int flow = u < mix[0] ? TM_FLOW_UP : u < mix[0] + mix[1] ? TM_FLOW_DOWN : TM_FLOW_INTER;
+    if (flow == TM_FLOW_INTER && m->cfg.num_floors < 3) flow = TM_FLOW_UP;
+
+    int origin, dest, lobby = m->cfg.lobby;
+    switch (flow) {
+    case TM_FLOW_UP:   origin = lobby; dest = other_floor(m, -1); break;
+    case TM_FLOW_DOWN: origin = other_floor(m, -1); dest = lobby; break;
+    default:           origin = other_floor(m, -1); dest = other_floor(m, origin); break;
+    }
+
+    int32_t k = pax_alloc(m);
+    if (k < 0) {
+        m->stats.overflow++;
+        return;
+    }
+    tm_passenger_t *p = &m->pax[k];
+    p->origin = (uint16_t)origin;
+    p->dest = (uint16_t)dest;
+    p->weight_kg = (uint16_t)(45 + rng_below(m, 31) + rng_below(m, 31));  // 45〜105kg (平均75kg)
+    p->t_arrive = now_of(m);
+    m->stats.arrived++;
+    int s = dest > origin ? 0 : 1;
+    queue_push(m, &m->waiting[origin][s], k);
+    if (m->hall_owner[origin][s] < 0) dispatch(m, origin, s, -1);
+}
+
+// 時刻で変わる到着率のポアソン過程を間引き法で作る:
+// 最大の到着率で候補を作り、その時刻の到着率との比で採用する
+static void arrival_step(tw_timer_t *t, void *ctx) {
+    traffic_model_t *m = ctx;
+    int hour = hour_of(m, now_of(m));
+    double rate = m->cfg.rate[hour] * m->num_cars / (double)TM_TICKS_PER_HOUR;
+    if (rng_uniform(m) * m->rate_max < rate) spawn(m, hour);
+
+    double gap = -log(1.0 - rng_uniform(m)) / m->rate_max;
+    if (gap > (double)TM_TICKS_PER_HOUR) gap = (double)TM_TICKS_PER_HOUR;
+    tw_schedule(&m->clock->wheel, t, now_of(m) + 1 + (uint64_t)gap);
+}
+
+void traffic_init(traffic_model_t *m, const traffic_config_t *cfg, sim_clock_t *clock,
+                  int num_cars, unsigned start_sec, uint64_t seed,
+                  traffic_emit_fn emit_fn, void *ctx) {
+    memset(m, 0, sizeof(*m));
+    m->cfg = *cfg;
+    if (num_cars > TM_MAX_CARS) num_cars = TM_MAX_CARS;
+    m->num_cars = num_cars;
+    m->day_ticks = (uint64_t)(start_sec % 86400) * TM_TICKS_PER_SEC;
+    m->clock = clock;
+    m->start_tick = sim_clock_now(clock);
+    sim_rng_seed(&m->rng, seed);
+    m->emit = emit_fn;
+    m->ctx = ctx;
+
+    for (int32_t i = 0; i < TM_MAX_PASSENGERS; i++) m->pax[i].next = i + 1 < TM_MAX_PASSENGERS ? i + 1 : -1;
+    m->free_pax = 0;
+    for (int i = 0; i < TM_MAX_FLOORS; i++) {
+        for (int s = 0; s < 2; s++) {
+            m->waiting[i][s].head = m->waiting[i][s].tail = -1;
+            m->hall_owner[i][s] = -1;
+        }
+    }
+
+    // 号機はすべて玄関階で待機から始め、状態の送信は号機ごとにずらす
+    unsigned period = cfg->refresh_ms ? cfg->refresh_ms : 1000;
+    for (int k = 0; k < num_cars; k++) {
+        tm_car_t *c = &m->cars[k];
+        c->m = m;
+        c->index = k;
+        c->state = TM_IDLE;
+        c->floor = cfg->lobby;
+        c->target = -1;
+        c->onboard.head = c->onboard.tail = -1;
+        tw_timer_init(&c->timer, car_timer, c);
+        tw_timer_init(&c->refresh, car_refresh, c);
+        tw_schedule(&clock->wheel, &c->refresh,
+                    m->start_tick + ms_ticks(period) * (uint64_t)k / (uint64_t)num_cars);
+    }
+
+    for (int h = 0; h < 24; h++) {
+        double r = cfg->rate[h] * num_cars / (double)TM_TICKS_PER_HOUR;
+        if (r > m->rate_max) m->rate_max = r;
+    }
+    tw_timer_init(&m->arrival, arrival_step, m);
+    if (m->rate_max > 0) tw_schedule(&clock->wheel, &m->arrival, m->start_tick);
+}
+
+uint64_t traffic_now(const traffic_model_t *m) {
+    return sim_clock_now(m->clock) - m->start_tick;
+}
+
+void traffic_clock(const traffic_model_t *m, char *buf, size_t len) {
+    uint64_t sec = (m->day_ticks + traffic_now(m)) / TM_TICKS_PER_SEC;
+    unsigned day = (unsigned)(sec / 86400) + 1, s = (unsigned)(sec % 86400);
+    snprintf(buf, len, "%u日目 %02u:%02u:%02u", day, s / 3600, s / 60 % 60, s % 60);
+}
+
+void traffic_counts(const traffic_model_t *m, unsigned *waiting, unsigned *riding) {
+    *waiting = (unsigned)(m->stats.arrived - m->stats.boarded);
+    *riding = (unsigned)(m->stats.boarded - m->stats.delivered);
+}
@@ -0,0 +1,134 @@
+// traffic_model.h
+// 建物の利用者の流れと号機の運行のモデル (仮想時刻で動く)
+//
+// 乗り場に利用者が時刻帯ごとの到着率 (出勤の上りピーク・昼休み・退勤の下りピーク) で
+// ポアソン到着し、最も早く着けそうな号機に乗り場呼びが割り当てられる。号機は
+// 同じ方向の呼びを順に拾う乗合全自動 (コレクティブ) で走り、停止ごとに降りる人・
+// 乗る人 (定員内) の体重で荷重が変わる。状態が変わるたび (階の通過・行先・荷重) と
+// refresh_ms ごとの再送で、号機の伝文 (データ番号と値) を emit に渡す。
+//
+// 時刻は呼び出し側の仮想時計 (sim_clock.h) のティックで、実時間に合わせるか、
+// 早送りか、待ち時間なしで進めるかは時計の進め方で決まる。乱数は traffic_init に
+// 渡す種だけで決まるので、同じ種と設定なら伝文の並びは毎回同じになる。
+// OS 依存の処理は含まない。
+
+#ifndef TRAFFIC_MODEL_H
+#define TRAFFIC_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim_clock.h"
+
+#define TM_MAX_FLOORS      128
+#define TM_MAX_CARS        256
+#define TM_MAX_PASSENGERS  65536  // 待ち・乗車中の合計 (溢れた到着は数えて捨てる)
+#define TM_TICKS_PER_SEC   SIM_TICKS_PER_SEC
+#define TM_TICKS_PER_HOUR  (3600ull * TM_TICKS_PER_SEC)
+
+// 乗り場から見た利用者の流れ
+enum { TM_FLOW_UP, TM_FLOW_DOWN, TM_FLOW_INTER, TM_FLOWS };  // 玄関→上階 / 上階→玄関 / 階間
+
+typedef struct {
+    int floors[TM_MAX_FLOORS];     // 下から順の階 (-2 = B2F, -1 = B1F, 1 = 1F, ...)。0 階はない
+    int num_floors;
+    int lobby;                     // 玄関階 (floors の番号)
+    double rate[24];               // 時刻ごとの到着率 (人/時、号機1台あたり)
+    double mix[24][TM_FLOWS];      // 時刻ごとの流れの割合 (合計で正規化する)
+    unsigned capacity_kg;          // 定員 (荷重がこれを超える人は次の号機を待つ)
+    unsigned floor_ms;             // 1階分の走行時間
+    unsigned accel_ms;             // 発車・停止の加減速で余分にかかる時間
+    unsigned door_ms;              // 戸開・戸閉
+    unsigned board_ms;             // 1人の乗り降り
+    unsigned refresh_ms;           // 状態を送り直す間隔 (0 なら変化時だけ)
+} traffic_config_t;
+
+typedef struct {
+    uint64_t arrived;              // 乗り場に来た人
+    uint64_t delivered;            // 行先階で降りた人
+    uint64_t overflow;             // 人数の上限で捨てた到着
+    uint64_t stops;                // 停止 (着床) 回数
+    uint64_t frames;               // emit した伝文
+    uint64_t wait_sum_ms, wait_max_ms;  // 乗り場に来てから乗るまで
+    uint64_t ride_sum_ms;          // 乗ってから降りるまで
+    uint64_t boarded;
+} traffic_stats_t;
+
+typedef struct traffic_model traffic_model_t;
+
+// 号機 car の伝文を送る (data_num は 0x0001〜0x0003)
+typedef void (*traffic_emit_fn)(void *ctx, int car, uint16_t data_num, uint16_t value);
+
+typedef struct {
+    int32_t next;                  // 待ち行列・乗車中の並び (-1 で終わり)
+    uint16_t origin, dest;         // floors の番号
+    uint16_t weight_kg;
+    uint64_t t_arrive;             // 乗り場に来た仮想ティック
+    uint64_t t_board;
+} tm_passenger_t;
+
+typedef struct {
+    int32_t head, tail;
+} tm_queue_t;
+
+typedef enum { TM_IDLE, TM_MOVING, TM_DOORS } tm_car_state_t;
+
+typedef struct {
+    tw_timer_t timer;              // 走行 (1階ごと) と戸開閉
+    tw_timer_t refresh;
+    traffic_model_t *m;
+    int index;
+    tm_car_state_t state;
+    int floor;                     // floors の番号
+    int dir;                       // +1 上り / -1 下り / 0 方向なし
+    int target;                    // 最後に送った行先 (floors の番号、-1 なら なし)
+    unsigned load_kg;
+    unsigned sent_load_kg;
+    int riders;
+    tm_queue_t onboard;
+    uint8_t car_call[TM_MAX_FLOORS];      // かご内の行先
+    uint8_t hall_call[TM_MAX_FLOORS][2];  // 割り当てられた乗り場呼び ([0] 上り / [1] 下り)
+} tm_car_t;
+
+struct traffic_model {
+    traffic_config_t cfg;
+    sim_clock_t *clock;            // 仮想時刻 (呼び出し側の時計に予約する)
+    uint64_t start_tick;           // 始めた時点の仮想ティック
+    uint64_t day_ticks;            // その時刻 (0時からのティック)
+    tm_car_t cars[TM_MAX_CARS];
+    int num_cars;
+    tm_passenger_t pax[TM_MAX_PASSENGERS];
+    int32_t free_pax;
+    tm_queue_t waiting[TM_MAX_FLOORS][2];
+    int16_t hall_owner[TM_MAX_FLOORS][2]; // 乗り場呼びを割り当てた号機 (-1 なら未割り当て)
+    tw_timer_t arrival;
+    double rate_max;               // 間引き法の上限 (人/ティック)
+    sim_rng_t rng;
+    traffic_emit_fn emit;
+    void *ctx;
+    traffic_stats_t stats;
+};
+
+void traffic_default_config(traffic_config_t *cfg);
+// 階の並び: "B2..40" (範囲) や "B1,1,2,3,5" (列挙)、組み合わせも可。戻り値: 成功 0 / 不正 -1
+int  traffic_parse_floors(traffic_config_t *cfg, const char *spec);
+// 到着率の上書き: "8=180,12-13=140" (時=人/時、1台あたり)。戻り値: 成功 0 / 不正 -1
+int  traffic_parse_rates(traffic_config_t *cfg, const char *spec);
+// 階 ("B1"、"1"、-1 など) の floors の番号。なければ -1
+int  traffic_floor_index(const traffic_config_t *cfg, const char *name);
+// 階 → ENQ のデータ値 (B1F = FFFF、B2F = FFFE ...)
+uint16_t traffic_floor_value(int floor);
+
+// num_cars 台を玄関階に置き、clock の現在ティックから始める。start_sec はその時刻
+// (0時からの秒)。モデルは大きい (数MB) ので静的領域に置く
+void traffic_init(traffic_model_t *m, const traffic_config_t *cfg, sim_clock_t *clock,
+                  int num_cars, unsigned start_sec, uint64_t seed,
+                  traffic_emit_fn emit, void *ctx);
+// 始めてからの仮想ティック
+uint64_t traffic_now(const traffic_model_t *m);
+// 現在の時刻 ("2日目 08:15:30" の形)
+void traffic_clock(const traffic_model_t *m, char *buf, size_t len);
+// 待っている人・乗っている人
+void traffic_counts(const traffic_model_t *m, unsigned *waiting, unsigned *riding);
+
+#endif // TRAFFIC_MODEL_H
@@ -277,30 +277,26 @@ class SerialENQReceiver:
                 time.sleep(1)
 
     def _parse_enq_messages(self, buffer: bytearray):
-        """ENQメッセージ解析"""
-        while len(buffer) >= 16:
-            # ENQメッセージの検索
-            enq_pos = -1
-            for i in range(len(buffer) - 15):
-                if buffer[i] == 0x05:  # ENQ
-                    if i + 16 <= len(buffer):
-                        # ENQメッセージの妥当性チェック
-                        enq_candidate = buffer[i:i + 16]
-                        if self._validate_enq_message(enq_candidate):
-                            enq_pos = i
-                            break
-            
-            if enq_pos >= 0:
-                # ENQメッセージを抽出
-                enq_message = buffer[enq_pos:enq_pos + 16]
-                buffer[:] = buffer[enq_pos + 16:]
-                self._parse_enq_message(enq_message)
-            else:
-                # 有効なENQメッセージが見つからない場合、1バイト破棄
-                if len(buffer) > 0:
-                    buffer.pop(0)
-                else:
-                    break
+        """ENQメッセージ解析（読み出し位置を進めるだけで再走査しない。残すのは途中までの候補15バイト以下）"""
+        pos = 0
+        while True:
+            enq_pos = buffer.find(0x05, pos)  # ENQ
+            if enq_pos < 0:
+                pos = len(buffer)
+                break
+            if enq_pos + 16 > len(buffer):
+                # 途中までの候補は次の受信で完成させる
+                pos = enq_pos
+                break
+            enq_message = bytes(buffer[enq_pos:enq_pos + 16])
+            if not self._validate_enq_message(enq_message):
+                # 偽のENQ: 1バイト進めて次のENQを探す
+                pos = enq_pos + 1
+                continue
+            pos = enq_pos + 16
+            self._parse_enq_message(enq_message)
+        # 消費済み領域はまとめて切り詰める
+        del buffer[:pos]
 
     def _validate_enq_message(self, data: bytes) -> bool:
         """ENQメッセージの妥当性チェック"""
@@ -571,37 +571,36 @@ class SerialENQReceiver:
         logger.info("📥 シリアル生データ受信スレッド終了")
 
     def _extract_enq_messages(self, buffer: bytearray):
-        """ENQメッセージ抽出・キューイング"""
-        while len(buffer) >= 16:
-            enq_pos = -1
-            for i in range(len(buffer) - 15):
-                if buffer[i] == 0x05:  # ENQ
-                    if i + 16 <= len(buffer):
-                        enq_candidate = buffer[i:i + 16]
-                        if self._validate_enq_message(enq_candidate):
-                            enq_pos = i
-                            break
-            
-            if enq_pos >= 0:
-                enq_message = buffer[enq_pos:enq_pos + 16]
-                buffer[:] = buffer[enq_pos + 16:]
-                
-                # メッセージをキューに追加
+        """ENQメッセージ抽出・キューイング（読み出し位置を進めるだけで再走査しない。残すのは途中までの候補15バイト以下）"""
+        pos = 0
+        while True:
+            enq_pos = buffer.find(0x05, pos)  # ENQ
+            if enq_pos < 0:
+                pos = len(buffer)
+                break
+            if enq_pos + 16 > len(buffer):
+                # 途中までの候補は次の受信で完成させる
+                pos = enq_pos
+                break
+            enq_message = bytes(buffer[enq_pos:enq_pos + 16])
+            if not self._validate_enq_message(enq_message):
+                # 偽のENQ: 1バイト進めて次のENQを探す
+                pos = enq_pos + 1
+                continue
+            pos = enq_pos + 16
+            # メッセージをキューに追加
+            try:
+                self.message_queue.put_nowait(enq_message)
+            except queue.Full:
+                logger.warning("⚠️ メッセージキューが満杯です")
+                # 古いメッセージを破棄
                 try:
+                    self.message_queue.get_nowait()
                     self.message_queue.put_nowait(enq_message)
-                except queue.Full:
-                    logger.warning("⚠️ メッセージキューが満杯です")
-                    # 古いメッセージを破棄
-                    try:
-                        self.message_queue.get_nowait()
-                        self.message_queue.put_nowait(enq_message)
-                    except queue.Empty:
-                        pass
-            else:
-                if len(buffer) > 0:
-                    buffer.pop(0)
-                else:
-                    break
+                except queue.Empty:
+                    pass
+        # 消費済み領域はまとめて切り詰める
+        del buffer[:pos]
 
     def _process_messages(self):
         """メッセージ処理スレッド"""
@@ -17,12 +17,21 @@ import time
 import logging
 import signal
 import sys
+import os
 import socket
+import math
+import itertools
+from collections import deque
 from datetime import datetime
 from typing import Optional
 from enum import IntEnum
 from PIL import Image, ImageDraw, ImageFont
 import termios
+import ctypes
+
+from enq_parser import ENQParser
+import enq_render
+import enq_state
 
 # ── 設定 ───────────────────────────────────
 SERIAL_PORT = "/dev/ttyUSB0"  # Raspberry Pi（RS422アダプター）
@@ -38,6 +47,18 @@ SERIAL_CONFIG = {
 
 # RTSP配信設定
 WIDTH, HEIGHT, FPS = 640, 480, 15
+BACKGROUND = (20, 30, 50)  # 濃紺背景
+TITLE = "エレベーター監視システム（ENQ受信専用）"
+
+RTSP_CONFIG = {
+    # adaptive: 表示内容が変わったときだけ送出し、変化がなければ keepalive 秒ごとに再送
+    # fixed   : 常に FPS で送出（従来動作）
+    'pacing': 'adaptive',
+    'keepalive': 1.0,
+    # auto: v4l2h264enc（Raspberry Pi のハードウェアエンコーダー）があれば使い、なければ x264enc
+    'encoder': 'auto',
+}
+KEYFRAME_INTERVAL = 2.0  # キーフレーム間隔（秒）。途中から接続したクライアントの待ち時間
 RTSP_PORT = 8554
 RTSP_PATH = "/elevator"
 
@@ -62,14 +83,19 @@ class ElevatorState:
         self.load_weight = 0
         self.is_moving = False
         self.last_update = datetime.now()
-        self.communication_log = []
+        # 固定長のリング（溢れた古い行は append で自動的に落ちる）
         self.max_log_entries = 10
+        self.communication_log = deque(maxlen=self.max_log_entries)
         self.connection_status = "切断中"
         
         # 着床検出用
         self.arrival_detected = False
         self.last_arrival_time = None
 
+        # 表示内容の変化通知（配信側のフレーム送出に使う）
+        self.version = 0
+        self.changed = threading.Condition()
+
     def update_current_floor(self, floor_str: str):
         """現在階更新"""
         old_floor = self.current_floor
@@ -125,6 +151,7 @@ class ElevatorState:
                     logger.info(f"🏁 即座着床: {self.current_floor} (同一階)")
                     self.arrival_detected = True
                     self.last_arrival_time = datetime.now()
+                    self.notify_change()
         
         self.last_update = datetime.now()
 
@@ -138,15 +165,32 @@ class ElevatorState:
             logger.info(f"⚖️ 荷重変更: {old_weight}kg → {weight}kg")
             self.add_communication_log(f"荷重: {weight}kg")
 
+    def recent_logs(self, n: int) -> tuple:
+        """最新 n 件の通信ログ（古い順）"""
+        log = self.communication_log
+        return tuple(itertools.islice(log, max(len(log) - n, 0), None))
+
     def add_communication_log(self, message: str):
         """通信ログ追加"""
         timestamp = datetime.now().strftime("%H:%M:%S")
         log_entry = f"[{timestamp}] {message}"
         self.communication_log.append(log_entry)
-        
-        # ログ数制限
-        if len(self.communication_log) > self.max_log_entries:
-            self.communication_log.pop(0)
+
+        # 表示に出る変化はすべてログを伴う
+        self.notify_change()
+
+    def notify_change(self):
+        """表示内容の変化を配信スレッドへ通知"""
+        with self.changed:
+            self.version += 1
+            self.changed.notify_all()
+
+    def wait_change(self, version: int, timeout: float) -> int:
+        """version から変化するか timeout 秒経つまで待ち、現在の version を返す"""
+        with self.changed:
+            if self.version == version and timeout > 0:
+                self.changed.wait(timeout)
+            return self.version
 
     def set_connection_status(self, status: str):
         """接続状態更新"""
@@ -181,6 +225,87 @@ def pil_to_gst_buffer(img: Image.Image):
     buf.duration = Gst.util_uint64_scale_int(1, Gst.SECOND, FPS)
     return buf
 
+class FramePacer:
+    """フレーム送出タイミング
+
+    fixed   : 1/FPS ごとに必ず送出
+    adaptive: 状態変化・時刻表示の秒の切り替わりで起きて描画し、内容が変わったときだけ
+              送出する（連続した変化は FPS で間引く）。変化がなくても keepalive 秒ごとに
+              同じ内容を送り、デコーダーとクライアントの接続を維持する
+    """
+
+    def __init__(self, elevator_state: ElevatorState, mode: str, fps: int, keepalive: float):
+        self.state = elevator_state
+        self.adaptive = mode == 'adaptive'
+        self.interval = 1.0 / fps
+        self.keepalive = keepalive
+        self.version = elevator_state.version
+        self.last_push = 0.0
+        self.pushed_frames = 0
+        self.skipped_frames = 0
+
+    def wait(self):
+        """次に描画すべき時刻まで待つ"""
+        if not self.adaptive:
+            time.sleep(self.interval)
+            return
+        now = time.time()
+        deadline = min(math.floor(now) + 1.0, self.last_push + self.keepalive)
+        self.version = self.state.wait_change(self.version, deadline - now)
+        remain = self.last_push + self.interval - time.time()
+        if remain > 0:
+            time.sleep(remain)
+
+    def should_push(self, changed: bool) -> bool:
+        if not self.adaptive or changed or time.time() - self.last_push >= self.keepalive:
+            return True
+        self.skipped_frames += 1
+        return False
+
+    def pushed(self):
+        self.last_push = time.time()
+        self.pushed_frames += 1
+
+def select_encoder(requested: str) -> str:
+    """使用する H.264 エンコーダー（'v4l2' / 'x264'）"""
+    if requested in ('auto', 'v4l2') and Gst.ElementFactory.find('v4l2h264enc') is not None:
+        return 'v4l2'
+    if requested == 'v4l2':
+        logger.warning("⚠️ v4l2h264enc が見つからないため x264enc を使用します")
+    return 'x264'
+
+def build_launch_string(encoder: str, pacing: str) -> str:
+    """RTSP メディアの GStreamer パイプライン"""
+    # adaptive ではフレームがまばらなので、キーフレーム間隔はフレーム数ではなく
+    # キープアライブ間隔から決める
+    if pacing == 'adaptive':
+        gop = max(1, int(KEYFRAME_INTERVAL / RTSP_CONFIG['keepalive']))
+    else:
+        gop = int(FPS * KEYFRAME_INTERVAL)
+
+    source = (
+        '( appsrc name=src is-live=true block=true format=time '
+        f' caps=video/x-raw,format=RGB,width={WIDTH},height={HEIGHT},framerate={FPS}/1 '
+        ' do-timestamp=true '
+    )
+    if encoder == 'v4l2':
+        # ISP で色変換し、変換結果を dmabuf のまま エンコーダーへ渡す
+        encode = (
+            ' ! v4l2convert capture-io-mode=dmabuf '
+            f' ! video/x-raw,format=I420,width={WIDTH},height={HEIGHT},framerate={FPS}/1 '
+            ' ! v4l2h264enc output-io-mode=dmabuf-import '
+            f' extra-controls="controls,video_bitrate=800000,repeat_sequence_header=1,h264_i_frame_period={gop}" '
+            ' ! video/x-h264,level=(string)4,profile=(string)constrained-baseline '
+            ' ! h264parse '
+        )
+    else:
+        encode = (
+            ' ! videoconvert '
+            f' ! video/x-raw,format=I420,width={WIDTH},height={HEIGHT},framerate={FPS}/1 '
+            f' ! x264enc tune=zerolatency bitrate=800 speed-preset=ultrafast key-int-max={gop} '
+        )
+    return source + encode + ' ! rtph264pay name=pay0 pt=96 config-interval=1 )'
+
 class ElevatorRTSPFactory(GstRtspServer.RTSPMediaFactory):
     """エレベーター映像配信ファクトリー（ENQ受信専用）"""
     
@@ -191,15 +316,9 @@ class ElevatorRTSPFactory(GstRtspServer.RTSPMediaFactory):
         self.set_shared(True)
         
         # GStreamerパイプライン設定
-        self.launch_str = (
-            '( appsrc name=src is-live=true block=true format=time '
-            f' caps=video/x-raw,format=RGB,width={WIDTH},height={HEIGHT},framerate={FPS}/1 '
-            ' do-timestamp=true '
-            ' ! videoconvert '
-            f' ! video/x-raw,format=I420,width={WIDTH},height={HEIGHT},framerate={FPS}/1 '
-            ' ! x264enc tune=zerolatency bitrate=800 speed-preset=ultrafast '
-            ' ! rtph264pay name=pay0 pt=96 config-interval=1 )'
-        )
+        self.encoder = select_encoder(RTSP_CONFIG['encoder'])
+        self.launch_str = build_launch_string(self.encoder, RTSP_CONFIG['pacing'])
+        logger.info(f"🎞️ エンコーダー: {self.encoder} / フレーム送出: {RTSP_CONFIG['pacing']}")
 
     def do_create_element(self, url):
         """パイプライン要素作成"""
@@ -210,44 +329,182 @@ class ElevatorRTSPFactory(GstRtspServer.RTSPMediaFactory):
 
     def push_frames(self):
         """フレーム生成・配信（ENQ受信専用）"""
-        # 日本語フォント設定
+        fonts = self._load_fonts()
+        self.pacer = FramePacer(self.elevator_state, RTSP_CONFIG['pacing'], FPS, RTSP_CONFIG['keepalive'])
+        if enq_render.available() and hasattr(fonts[0], 'getmetrics'):
+            logger.info("🖼️ ネイティブ描画（差分更新）で配信します")
+            self._push_frames_native(*fonts)
+        else:
+            self._push_frames_pil(*fonts)
+
+    def _load_fonts(self):
+        """日本語フォント読み込み → (large, medium, small)"""
         font_paths = [
             "/usr/share/fonts/truetype/ipafont-mincho/ipam.ttf",  # Linux
             "/System/Library/Fonts/Hiragino Sans GB.ttc",        # macOS
             "C:/Windows/Fonts/msgothic.ttc"                      # Windows
         ]
-        
-        font_large = None
-        font_medium = None
-        font_small = None
-        
+
         for font_path in font_paths:
             try:
-                font_large = ImageFont.truetype(font_path, 48)
-                font_medium = ImageFont.truetype(font_path, 32)
-                font_small = ImageFont.truetype(font_path, 20)
-                break
+                return (ImageFont.truetype(font_path, 48),
+                        ImageFont.truetype(font_path, 32),
+                        ImageFont.truetype(font_path, 20))
             except (IOError, OSError):
                 continue
-        
-        if font_large is None:
-            font_large = ImageFont.load_default()
-            font_medium = ImageFont.load_default()
-            font_small = ImageFont.load_default()
 
+        default = ImageFont.load_default()
+        return default, default, default
+
+    def _status_style(self, status_type):
+        """状態表示の (文字色, 背景色, 枠色)"""
+        if status_type == "moving":
+            return 'yellow', (100, 100, 0), 'orange'      # 移動中（黄色背景）
+        return 'lightgreen', (0, 100, 0), 'lightgreen'    # 停止中（緑色背景）
+
+    def _detail_lines(self):
+        """詳細情報（荷重・最終更新・着床）"""
+        details = [
+            f"荷重: {self.elevator_state.load_weight}kg",
+            f"最終更新: {self.elevator_state.last_update.strftime('%H:%M:%S')}"
+        ]
+        if self.elevator_state.arrival_detected and self.elevator_state.last_arrival_time:
+            arrival_time = self.elevator_state.last_arrival_time.strftime('%H:%M:%S')
+            details.append(f"最終着床: {arrival_time}")
+        return details
+
+    def _push_frames_native(self, font_large, font_medium, font_small):
+        """ネイティブ描画: 変化したウィジェットだけを描き直し、差分だけをプールのバッファへ転送"""
+        r = enq_render.NativeRenderer(WIDTH, HEIGHT, BACKGROUND)
+        large, medium, small = r.add_font(font_large), r.add_font(font_medium), r.add_font(font_small)
+
+        def centered(cy, font, color):
+            h = r.line_height(font)
+            return r.add_widget(0, cy - h // 2, WIDTH, h, font, enq_render.ALIGN_CENTER, color, BACKGROUND)
+
+        # PIL 版と同じ配置。詳細は常に3行分を確保するので、ログは着床の有無で動かない
+        title = centered(40, medium, 'white')
+        clock = centered(80, small, 'lightgray')
+        connection = centered(110, small, 'lightgreen')
+        status = r.add_widget(50, 140, WIDTH - 99, 71, large, enq_render.ALIGN_CENTER,
+                              *self._status_style("stopped"), border_width=3)
+        details = [centered(250 + 25 * i, small, 'lightblue') for i in range(3)]
+        log_y = 250 + 25 * 3 + 15
+        header = r.add_widget(20, log_y, WIDTH - 40, r.line_height(small), small,
+                              enq_render.ALIGN_LEFT, 'white', BACKGROUND)
+        logs = [r.add_widget(20, log_y + 25 + 18 * i, WIDTH - 40, 18, small,
+                             enq_render.ALIGN_LEFT, 'lightgray', BACKGROUND) for i in range(6)]
+        r.set_text(title, TITLE)
+        r.set_text(header, "ENQ受信ログ:")
+
+        # appsrc へ渡すバッファはプールから使い回す。バッファごとに保持している
+        # フレーム番号を覚えておき、そこからの差分矩形だけをコピーする
+        caps = Gst.Caps.from_string(
+            f'video/x-raw,format=RGB,width={WIDTH},height={HEIGHT},framerate={FPS}/1')
+        pool = Gst.BufferPool.new()
+        config = pool.get_config()
+        Gst.BufferPool.config_set_params(config, caps, r.frame_size, 4, 8)
+        pool.set_config(config)
+        pool.set_active(True)
+        held = {}  # マップ先アドレス → そのバッファのフレーム番号
+        pushed_frame = -1
+
+        try:
+            while True:
+                try:
+                    self.pacer.wait()
+                    state = self.elevator_state
+                    r.set_text(clock, datetime.now().strftime("%Y年%m月%d日 %H:%M:%S"))
+
+                    connection_color = 'lightgreen' if state.connection_status == "接続中" else 'red'
+                    r.set_style(connection, connection_color, BACKGROUND)
+                    r.set_text(connection, f"接続状態: {state.connection_status}")
+
+                    status_type, status_text = state.get_display_status()
+                    r.set_style(status, *self._status_style(status_type))
+                    r.set_text(status, status_text)
+
+                    lines = self._detail_lines()
+                    for i, widget in enumerate(details):
+                        r.set_text(widget, lines[i] if i < len(lines) else "")
+
+                    entries = state.recent_logs(6)  # 最新6件
+                    for i, widget in enumerate(logs):
+                        r.set_text(widget, entries[i] if i < len(entries) else "")
+
+                    frame = r.commit()
+                    if not self.pacer.should_push(frame != pushed_frame):
+                        continue
+
+                    ret, buf = pool.acquire_buffer(None)
+                    if ret != Gst.FlowReturn.OK:
+                        break
+                    if not self._update_pool_buffer(r, buf, frame, held):
+                        buf.fill(0, r.tobytes())
+                    buf.duration = Gst.util_uint64_scale_int(1, Gst.SECOND, FPS)
+
+                    ret = self.appsrc.emit('push-buffer', buf)
+                    if ret != Gst.FlowReturn.OK:
+                        break
+                    pushed_frame = frame
+                    self.pacer.pushed()
+
+                except Exception as e:
+                    logger.error(f"❌ フレーム生成エラー: {e}")
+                    time.sleep(1.0)
+        finally:
+            pool.set_active(False)
+
+    def _update_pool_buffer(self, r, buf, frame, held):
+        """書き込みマップできれば差分だけ更新して True（できなければ False）"""
+        ok, info = buf.map(Gst.MapFlags.WRITE)
+        if not ok:
+            return False
+        try:
+            try:
+                view = (ctypes.c_uint8 * r.frame_size).from_buffer(info.data)
+            except TypeError:
+                return False  # 読み取り専用のコピーしか得られない PyGObject
+            address = ctypes.addressof(view)
+            r.copy_to(address, r.frame_size, held.get(address, 0))
+            held[address] = frame
+            del view
+            return True
+        finally:
+            buf.unmap(info)
+
+    def _push_frames_pil(self, font_large, font_medium, font_small):
+        """PIL で毎フレーム全画面を描画（ネイティブ描画が使えない場合）"""
+        last_content = None
+        last_buf = None
         while True:
             try:
-                # 背景画像作成
-                img = Image.new('RGB', (WIDTH, HEIGHT), (20, 30, 50))  # 濃紺背景
-                draw = ImageDraw.Draw(img)
-                
+                self.pacer.wait()
+
                 # 現在時刻
                 now = datetime.now()
                 timestamp = now.strftime("%Y年%m月%d日 %H:%M:%S")
+
+                # 表示内容が前回と同じなら描き直さない（キープアライブは前回の画像を再送）
+                content = (timestamp, self.elevator_state.connection_status,
+                           self.elevator_state.get_display_status(), tuple(self._detail_lines()),
+                           self.elevator_state.recent_logs(6))
+                if not self.pacer.should_push(content != last_content):
+                    continue
+                if content == last_content and last_buf is not None:
+                    buf = last_buf.copy_deep()
+                    if self.appsrc.emit('push-buffer', buf) != Gst.FlowReturn.OK:
+                        break
+                    self.pacer.pushed()
+                    continue
+                last_content = content
+
+                # 背景画像作成
+                img = Image.new('RGB', (WIDTH, HEIGHT), BACKGROUND)
+                draw = ImageDraw.Draw(img)
                 
                 # タイトル
-                title = "エレベーター監視システム（ENQ受信専用）"
-                self._draw_centered_text(draw, title, font_medium, WIDTH//2, 40, 'white')
+                self._draw_centered_text(draw, TITLE, font_medium, WIDTH//2, 40, 'white')
                 
                 # 現在時刻表示
                 self._draw_centered_text(draw, timestamp, font_small, WIDTH//2, 80, 'lightgray')
@@ -262,17 +519,7 @@ class ElevatorRTSPFactory(GstRtspServer.RTSPMediaFactory):
                 
                 # 状態判定
                 status_type, status_text = self.elevator_state.get_display_status()
-                
-                if status_type == "moving":
-                    # 移動中（黄色背景）
-                    status_color = 'yellow'
-                    status_bg = (100, 100, 0)
-                    status_border = 'orange'
-                else:
-                    # 停止中（緑色背景）
-                    status_color = 'lightgreen'
-                    status_bg = (0, 100, 0)
-                    status_border = 'lightgreen'
+                status_color, status_bg, status_border = self._status_style(status_type)
                 
                 # 状態背景
                 status_rect = [50, y_pos-10, WIDTH-50, y_pos+60]
@@ -284,17 +531,7 @@ class ElevatorRTSPFactory(GstRtspServer.RTSPMediaFactory):
                 y_pos += 100
                 
                 # 詳細情報
-                details = [
-                    f"荷重: {self.elevator_state.load_weight}kg",
-                    f"最終更新: {self.elevator_state.last_update.strftime('%H:%M:%S')}"
-                ]
-                
-                # 着床情報表示
-                if self.elevator_state.arrival_detected and self.elevator_state.last_arrival_time:
-                    arrival_time = self.elevator_state.last_arrival_time.strftime('%H:%M:%S')
-                    details.append(f"最終着床: {arrival_time}")
-                
-                for detail in details:
+                for detail in self._detail_lines():
                     self._draw_centered_text(draw, detail, font_small, WIDTH//2, y_pos, 'lightblue')
                     y_pos += 25
                 
@@ -303,17 +540,17 @@ class ElevatorRTSPFactory(GstRtspServer.RTSPMediaFactory):
                 draw.text((20, y_pos), "ENQ受信ログ:", font=font_small, fill='white')
                 y_pos += 25
                 
-                for log_entry in self.elevator_state.communication_log[-6:]:  # 最新6件
+                for log_entry in self.elevator_state.recent_logs(6):  # 最新6件
                     draw.text((20, y_pos), log_entry, font=font_small, fill='lightgray')
                     y_pos += 18
                 
                 # フレームバッファに送信
                 buf = pil_to_gst_buffer(img)
+                last_buf = buf
                 ret = self.appsrc.emit('push-buffer', buf)
                 if ret != Gst.FlowReturn.OK:
                     break
-                
-                time.sleep(1.0 / FPS)
+                self.pacer.pushed()
                 
             except Exception as e:
                 logger.error(f"❌ フレーム生成エラー: {e}")
@@ -333,40 +570,9 @@ class SerialENQReceiver:
         self.elevator_state = elevator_state
         self.serial_conn: Optional[serial.Serial] = None
         self.running = False
-        # 重複チェック用の辞書を追加
-        self.last_messages = {
-            DataNumbers.CURRENT_FLOOR: None,  # 現在階
-            DataNumbers.TARGET_FLOOR: None,   # 行先階
-            DataNumbers.LOAD_WEIGHT: None     # 荷重
-        }
-        self.duplicate_timeout = 0.8  # 重複判定のタイムアウト（秒）を調整
-        self.receive_buffer = bytearray()  # 受信バッファを追加
-
-    def _is_duplicate_message(self, data_num: int, data_value: int) -> bool:
-        """重複メッセージチェック"""
-        current_time = time.time()
-        last_message = self.last_messages.get(data_num)
-        
-        if last_message is None:
-            # 初回メッセージ
-            self.last_messages[data_num] = (data_value, current_time)
-            return False
-        
-        last_value, last_time = last_message
-        
-        # タイムアウトチェック
-        if current_time - last_time > self.duplicate_timeout:
-            # タイムアウトした場合は新しいメッセージとして扱う
-            self.last_messages[data_num] = (data_value, current_time)
-            return False
-        
-        # 値が同じ場合は重複と判定
-        if last_value == data_value:
-            return True
-        
-        # 値が異なる場合は新しいメッセージとして扱う
-        self.last_messages[data_num] = (data_value, current_time)
-        return False
+        # ストリーミングパーサー（受信バッファを内包）。同じ値の繰り返し（送信側は各値を
+        # 5回送る）はパーサー内の重複抑制表で捨て、変化と 0.8 秒ごとの再通知だけを受け取る
+        self.parser = ENQParser(changes_only=True)
 
     def initialize(self):
         """初期化"""
@@ -392,7 +598,9 @@ class SerialENQReceiver:
         
         # 受信バッファをクリア
         self.serial_conn.reset_input_buffer()
-        self.receive_buffer.clear()
+        # 再接続でも __init__ の設定 (changes_only) を保ったまま、途中の伝文と重複抑制の記録を捨てる
+        # (切断中に変わったかもしれないので、再接続後の最初の値は必ず通す)
+        self.parser.reset()
         
         fd = self.serial_conn.fileno()
         attrs = termios.tcgetattr(fd)
@@ -410,6 +618,7 @@ class SerialENQReceiver:
             return
         
         logger.info("🔍 シリアルENQ受信開始（受信専用モード）")
+        logger.info(f"🧩 ENQパーサー: {'ネイティブ (libenq_parser.so)' if self.parser.native else 'Python'}")
         self.running = True
         threading.Thread(target=self._receive_enq, daemon=True).start()
 
@@ -432,24 +641,16 @@ class SerialENQReceiver:
                         time.sleep(5)
                         continue
 
-                # 1バイトずつ読み込んでバッファに蓄積
-                data = self.serial_conn.read(1)
+                # 到着済みのバイトをまとめて読み込む（最低1バイト待つ）
+                data = self.serial_conn.read(max(1, self.serial_conn.in_waiting))
                 
                 if len(data) == 0:
                     # タイムアウト - 正常な状態
                     continue
                 
-                # 受信バッファに追加
-                self.receive_buffer.extend(data)
-                
-                # バッファが十分に大きくなったら解析を試行
-                if len(self.receive_buffer) >= 16:
-                    self._parse_enq_messages(self.receive_buffer)
-                
-                # バッファサイズ制限（メモリリーク防止）
-                if len(self.receive_buffer) > 1024:
-                    logger.warning("⚠️ 受信バッファが大きくなりすぎました。クリアします。")
-                    self.receive_buffer.clear()
+                # パーサーに投入し、揃ったフレームを処理
+                for frame in self.parser.feed(data):
+                    self._parse_enq_message(frame)
                 
                 # エラーカウンターリセット
                 consecutive_errors = 0
@@ -477,98 +678,11 @@ class SerialENQReceiver:
                 else:
                     time.sleep(1)
 
-    def _parse_enq_messages(self, buffer: bytearray):
-        """ENQメッセージ解析"""
-        while len(buffer) >= 16:
-            # ENQメッセージの検索
-            enq_pos = -1
-            for i in range(len(buffer) - 15):
-                if buffer[i] == 0x05:  # ENQ
-                    if i + 16 <= len(buffer):
-                        # ENQメッセージの妥当性チェック
-                        enq_candidate = buffer[i:i + 16]
-                        if self._validate_enq_message(enq_candidate):
-                            enq_pos = i
-                            break
-            
-            if enq_pos >= 0:
-                # ENQメッセージを抽出
-                enq_message = buffer[enq_pos:enq_pos + 16]
-                buffer[:] = buffer[enq_pos + 16:]
-                self._parse_enq_message(enq_message)
-            else:
-                # 有効なENQメッセージが見つからない場合、1バイト破棄
-                if len(buffer) > 0:
-                    buffer.pop(0)
-                else:
-                    break
-
-    def _validate_enq_message(self, data: bytes) -> bool:
-        """ENQメッセージの妥当性チェック"""
-        if len(data) != 16 or data[0] != 0x05:
-            return False
-        
+    def _parse_enq_message(self, frame):
+        """ENQメッセージ解析（ENQParser で検証済みのフレーム）"""
         try:
-            # 局番号部分（1-4バイト目）がASCII数字かチェック
-            station = data[1:5]
-            if not all(48 <= b <= 57 for b in station):  # '0'-'9'
-                return False
-            
-            # コマンド部分（5バイト目）が'W'かチェック
-            if data[5] != 0x57:  # 'W'
-                return False
-            
-            # データ番号部分（6-9バイト目）がHEX文字かチェック
-            data_num_bytes = data[6:10]
-            if not all(self._is_hex_char(b) for b in data_num_bytes):
-                return False
-            
-            # データ値部分（10-13バイト目）がHEX文字かチェック
-            data_value_bytes = data[10:14]
-            if not all(self._is_hex_char(b) for b in data_value_bytes):
-                return False
-            
-            return True
-            
-        except:
-            return False
-
-    def _is_hex_char(self, byte_val: int) -> bool:
-        """HEX文字かどうかチェック"""
-        return (48 <= byte_val <= 57) or (65 <= byte_val <= 70) or (97 <= byte_val <= 102)  # 0-9, A-F, a-f
-
-    def _parse_enq_message(self, data: bytes):
-        """ENQメッセージ解析"""
-        try:
-            station = data[1:5].decode('ascii')
-            command = chr(data[5])
-            data_num_str = data[6:10].decode('ascii')
-            data_value_str = data[10:14].decode('ascii')
-            checksum = data[14:16].decode('ascii')
-
-            data_num = int(data_num_str, 16)
-            data_value = int(data_value_str, 16)
-
-            # 重複チェック
-            if self._is_duplicate_message(data_num, data_value):
-                # 重複メッセージはデバッグレベルでログ出力（通常は表示されない）
-                if data_num == DataNumbers.CURRENT_FLOOR:
-                    floor = "B1F" if data_value == 0xFFFF else f"{data_value}F"
-                    description = f"現在階数: {floor}"
-                elif data_num == DataNumbers.TARGET_FLOOR:
-                    if data_value == 0x0000:
-                        description = "行先階: なし"
-                    else:
-                        floor = "B1F" if data_value == 0xFFFF else f"{data_value}F"
-                        description = f"行先階: {floor}"
-                elif data_num == DataNumbers.LOAD_WEIGHT:
-                    description = f"荷重: {data_value}kg"
-                else:
-                    description = f"不明データ(0x{data_num:04X}): {data_value}"
-
-                timestamp = datetime.now().strftime("%Y年%m月%d日 %H:%M:%S")
-                logger.debug(f"[{timestamp}] 🔄 重複メッセージを破棄: {description}")
-                return
+            data_num = frame.data_num
+            data_value = frame.data_value
 
             # ターミナル出力
             timestamp = datetime.now().strftime("%Y年%m月%d日 %H:%M:%S")
@@ -599,7 +713,7 @@ class SerialENQReceiver:
             logger.info(f"[{timestamp}] {log_message}")
 
         except Exception as e:
-            logger.error(f"❌ ENQメッセージ解析エラー: {e}, データ: {data.hex()}")
+            logger.error(f"❌ ENQメッセージ解析エラー: {e}, フレーム: {frame}")
 
     def _test_serial_connection(self) -> bool:
         """シリアル接続テスト"""
@@ -640,6 +754,88 @@ class SerialENQReceiver:
         self._close_serial()
         logger.info("📡 シリアルポート切断完了")
 
+class SharedStateENQReceiver:
+    """共有メモリ（serial_debug_test publish）から状態を受け取る受信クラス
+
+    シリアルポートは受信プロセスが持つので、このプロセスはセグメントを読むだけ。
+    SerialENQReceiver と同じインターフェース。
+    """
+
+    def __init__(self, elevator_state: ElevatorState, station: Optional[int] = None):
+        self.elevator_state = elevator_state
+        self.station = station
+        self.shared: Optional[enq_state.SharedState] = None
+        self.running = False
+        self.last_car = None
+
+    def initialize(self):
+        """初期化"""
+        logger.info(f"🧠 共有メモリから状態を受信: /dev/shm{enq_state.SHM_NAME}")
+        return self._attach()
+
+    def _attach(self) -> bool:
+        try:
+            self.shared = enq_state.SharedState()
+            logger.info(f"✅ 共有メモリ接続成功（受信プロセス pid {self.shared.writer_pid}）")
+            return True
+        except (OSError, ValueError) as e:
+            logger.error(f"❌ 共有メモリ接続失敗: {e}")
+            self.shared = None
+            self.elevator_state.set_connection_status("切断中")
+            return False
+
+    def start_receiving(self):
+        """受信開始"""
+        if self.running:
+            return
+        self.running = True
+        threading.Thread(target=self._receive_state, daemon=True).start()
+
+    def stop_receiving(self):
+        self.running = False
+
+    def _receive_state(self):
+        generation = None
+        while self.running:
+            if self.shared is None:
+                time.sleep(2.0)
+                self._attach()
+                continue
+            # 受信プロセスが終了・再起動したら古いセグメントを捨てて付け直す
+            if self.shared.stale():
+                self.shared.close()
+                self.shared = None
+                logger.warning("⚠️ 受信プロセスが終了しました")
+                continue
+
+            now = self.shared.wait(generation, 1.0) if generation is not None else self.shared.generation
+            if now == generation:
+                continue
+            generation = now
+            car = self.shared.find(self.station)
+            if car is None:
+                continue
+            self.elevator_state.set_connection_status("接続中")
+            self._apply(car)
+
+    def _apply(self, car):
+        """前回から変わった項目だけ ElevatorState に反映"""
+        last = self.last_car
+        if car.flags & enq_state.CAR_HAVE_CURRENT and (last is None or last.current_floor != car.current_floor):
+            self.elevator_state.update_current_floor(enq_state.floor_name(car.current_floor))
+        if car.flags & enq_state.CAR_HAVE_TARGET and (last is None or last.target_floor != car.target_floor):
+            self.elevator_state.update_target_floor(
+                "なし" if car.target_floor == 0 else enq_state.floor_name(car.target_floor))
+        if car.flags & enq_state.CAR_HAVE_LOAD and (last is None or last.load != car.load):
+            self.elevator_state.update_load(car.load)
+        self.last_car = car
+
+    def shutdown(self):
+        self.stop_receiving()
+        if self.shared is not None:
+            self.shared.close()
+            self.shared = None
+
 class ElevatorRTSPServer:
     """エレベーターRTSPサーバー"""
     
@@ -683,6 +879,15 @@ def main():
     parser = argparse.ArgumentParser(description='エレベーターENQ受信専用RTSP映像配信システム')
     parser.add_argument('--port', default=SERIAL_PORT, help='シリアルポート')
     parser.add_argument('--rtsp-port', type=int, default=RTSP_PORT, help='RTSPポート番号')
+    parser.add_argument('--pacing', choices=['adaptive', 'fixed'], default=RTSP_CONFIG['pacing'],
+                        help='フレーム送出（adaptive: 変化時のみ + キープアライブ / fixed: 常に一定FPS）')
+    parser.add_argument('--keepalive', type=float, default=RTSP_CONFIG['keepalive'],
+                        help='adaptive 時に変化がなくても再送する間隔（秒）')
+    parser.add_argument('--encoder', choices=['auto', 'v4l2', 'x264'], default=RTSP_CONFIG['encoder'],
+                        help='H.264 エンコーダー（auto: v4l2h264enc があれば使用）')
+    parser.add_argument('--state-shm', action='store_true',
+                        help='シリアルを直接読まず、serial_debug_test publish の共有メモリから状態を受け取る')
+    parser.add_argument('--station', type=int, default=None, help='--state-shm で表示する局番号（省略時は最初の号機）')
     parser.add_argument('--debug', action='store_true', help='デバッグモード')
     args = parser.parse_args()
     
@@ -692,6 +897,9 @@ def main():
     
     # 設定更新
     SERIAL_CONFIG['port'] = args.port
+    RTSP_CONFIG['pacing'] = args.pacing
+    RTSP_CONFIG['keepalive'] = max(0.1, args.keepalive)
+    RTSP_CONFIG['encoder'] = args.encoder
     rtsp_port = args.rtsp_port
     
     # シグナルハンドラー設定
@@ -711,9 +919,12 @@ def main():
     elevator_state = ElevatorState()
     
     # シリアルENQ受信初期化
-    receiver = SerialENQReceiver(elevator_state)
+    if args.state_shm:
+        receiver = SharedStateENQReceiver(elevator_state, args.station)
+    else:
+        receiver = SerialENQReceiver(elevator_state)
     if not receiver.initialize():
-        logger.warning("⚠️ 初期シリアル接続に失敗しましたが、自動復帰機能で継続します")
+        logger.warning("⚠️ 初期接続に失敗しましたが、自動復帰機能で継続します")
     
     # RTSPサーバー初期化
     rtsp_server = ElevatorRTSPServer(elevator_state, rtsp_port)
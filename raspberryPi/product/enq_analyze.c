@@ -0,0 +1,870 @@
+// enq_analyze.c
+// キャプチャファイルのオフライン解析 (並列デコード)
+// ビルド例: gcc -O2 -pthread enq_analyze.c enq_parser.c enq_simd.c enq_capture.c enq_arena.c -o enq_analyze
+//
+// 使用方法:
+//   enq_analyze [-threads N] [-chunk MB] [-simd 実装] [-check] <キャプチャ...>
+//   キャプチャは serial_debug_test capture で記録したファイル。複数指定したときは
+//   指定順に時系列として扱い、号機 (ポート名, 局番号) ごとに集計をまとめる。
+//   -check を付けると集計の後に先頭からの順読みと比べ、違えば終了コード 1 を返す。
+//
+// 号機ごとに運行回数 (行先階が消えた回数 = 着床)、階ごとの停止時間 (着床から次の
+// 行先階が付くまで)、荷重の分布、チェックサム不一致の割合を出し、ポートごとに
+// 形式エラーと同期外れで捨てたバイト数を出す。
+//
+// ファイル全体をメモリマップし、ブロック (enq_capture_format.h) の並びを
+// 約 -chunk MB ずつのチャンクに分けて全コアで並列にデコードする。
+// チャンクは最初にスレッドごとに連続した範囲として配り、自分の分がなくなった
+// スレッドは残りの多いスレッドの末尾から取る (ワークスティーリング)。
+//
+// チャンクの境目ではポートごとのバイト列が伝文の途中で切れる。パーサーはチェック
+// サム欄も HEX 文字か確かめる (ENQ_PARSER_STRICT_LAYOUT、値は照合しない) ので、
+// 受け付けるフレームに ENQ (0x05) は含まれず、どの 0x05 も必ず候補の先頭として
+// 検証される。そこで各チャンクはポートごとに最初の 0x05 まで読み飛ばして同期し、
+// 読み飛ばした先頭 (の最大15バイト) と、末尾で途中になった伝文の候補をチャンクに
+// 残しておく。集計時に境目ごとに前のチャンクの残りへ次のチャンクの先頭を足して、
+// 同期した 0x05 に届くまで解析し直す (途中の候補はそこまでで必ず決着する)。
+// パーサーが境目をまたいで持つ状態は途中の候補だけなので、これで1スレッドで先頭から
+// 読んだときと同じフレーム列・エラー数になる。-check はファイルごとに1本のパーサーで
+// 先頭から読み直し、ポート別・号機別の数が一致するか確かめる。
+//
+// 荷重の分布やフレーム数は足し合わせるだけで合成できる。運行回数と停止時間は
+// 号機の状態の続きが要るので、チャンクは行先階の変化 (数は伝文よりずっと少ない)
+// だけを時刻付きで残し、全チャンクの終了後にチャンク順に並べて状態を辿る。
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "enq_capture.h"
+#include "enq_parser.h"
+
+#define ANA_MAX_FILES    256
+#define ANA_MAX_THREADS  256
+#define ANA_MAX_CARS     1024   // チャンクごと・全体とも、号機 (ポート, 局番号) の上限
+#define ANA_CAR_HASH     2048   // 号機の探索表 (2のべき乗、ANA_MAX_CARS の2倍)
+#define ANA_LOAD_BIN_KG  100
+#define ANA_LOAD_BINS    32     // 最後のビンは 3100kg 以上
+#define ANA_MAX_FLOORS   16     // 号機ごとに停止時間を分けて数える階の数
+#define ANA_DEFAULT_CHUNK_MB 4
+#define ANA_PARSER_FLAGS ENQ_PARSER_STRICT_LAYOUT
+
+// 行先階の変化 (チャンク内で直前と違う値になった時刻)
+typedef struct {
+    uint64_t t_ns;
+    uint16_t value;
+} ana_change_t;
+
+// チャンク内の号機1台分
+typedef struct {
+    uint32_t key;              // (ポート + 1) << 16 | 局番号
+    uint64_t frames;
+    uint64_t bad_checksum;     // チェックサム不一致 (値は使わない)
+    uint64_t load_hist[ANA_LOAD_BINS];
+    ana_change_t *targets;     // 行先階の変化 (malloc)
+    size_t num_targets, cap_targets;
+} ana_car_t;
+
+typedef struct {
+    uint64_t bytes;            // このチャンクのレコードのバイト数
+    uint64_t frames;
+    uint64_t resync_bytes;     // 同期外れで捨てたバイト (チャンク先頭の読み飛ばしは含まない)
+    uint64_t layout_errors;
+    uint64_t checksum_errors;
+    // 境目の継ぎ合わせ用
+    uint64_t skip;             // 最初の 0x05 より前のバイト数 (なければ bytes と同じ)
+    uint8_t  head[ENQ_FRAME_LEN - 1];  // 先頭の最大15バイト (読み飛ばしたかどうかによらない)
+    uint64_t head_t_ns[ENQ_FRAME_LEN - 1];  // そのバイトを含むレコードの時刻
+    uint8_t  nhead;
+    uint8_t  tail[ENQ_FRAME_LEN - 1];  // 末尾で途中になった候補 (0x05 から)
+    uint8_t  ntail;
+} ana_port_t;
+
+typedef struct {
+    int file;                  // files[] の番号
+    size_t first_block, end_block;
+    uint64_t bytes;            // ブロックの合計 (走査レートの分子)
+    ana_port_t ports[ENQCAP_MAX_PORTS];
+    ana_car_t *cars;           // malloc (ANA_MAX_CARS)
+    size_t num_cars;
+    uint64_t dropped_frames;   // 号機数の上限を超えて数えられなかったフレーム
+} ana_chunk_t;
+
+typedef struct {
+    const char *path;
+    enqcap_reader_t r;
+    size_t first_chunk, num_chunks;
+} ana_file_t;
+
+static ana_file_t files[ANA_MAX_FILES];
+static int num_files;
+static ana_chunk_t *chunks;
+static size_t num_chunks;
+
+// ---- ワークスティーリング ----
+// スレッドごとに [lo, hi) のチャンクを持ち、自分は lo から順に (ファイル上で連続して
+// 読むため)、他のスレッドは hi の側から取る。取り合うのはチャンク単位 (数 MB) なので
+// ロックの競合は無視できる
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t lo, hi;
+} ana_deque_t;
+
+static ana_deque_t deques[ANA_MAX_THREADS];
+static int num_threads;
+
+typedef struct {
+    int id;
+    pthread_t th;
+    enq_parser_t parsers[ENQCAP_MAX_PORTS];
+    uint16_t hash[ANA_CAR_HASH];       // cars の番号 + 1 (0 は空き)
+    uint64_t chunks_done;
+    uint64_t steals;
+} ana_worker_t;
+
+static int take_own(ana_deque_t *d, size_t *out) {
+    pthread_mutex_lock(&d->lock);
+    int ok = d->lo < d->hi;
+    if (ok) *out = d->lo++;
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static int steal(int self, size_t *out) {
+    for (;;) {
+        // 残りの最も多いスレッドを選ぶ (ロックなしの目安。取るときに確かめ直す)
+        int victim = -1;
+        size_t best = 0;
+        for (int i = 0; i < num_threads; i++) {
+            if (i == self) continue;
+            size_t lo = __atomic_load_n(&deques[i].lo, __ATOMIC_RELAXED);
+            size_t hi = __atomic_load_n(&deques[i].hi, __ATOMIC_RELAXED);
+            if (hi > lo && hi - lo > best) {
+                best = hi - lo;
+                victim = i;
+            }
+        }
+        if (victim < 0) return 0;
+        ana_deque_t *d = &deques[victim];
+        pthread_mutex_lock(&d->lock);
+        int ok = d->lo < d->hi;
+        if (ok) *out = --d->hi;
+        pthread_mutex_unlock(&d->lock);
+        if (ok) return 1;
+    }
+}
+
+// ---- チャンクのデコード ----
+
+typedef struct {
+    ana_worker_t *wk;
+    ana_chunk_t *c;
+    uint16_t port;
+    uint64_t t_ns;             // フレームを完成させたレコードの時刻
+} ana_frame_ctx_t;
+
+static ana_car_t *find_car(ana_worker_t *wk, ana_chunk_t *c, uint32_t key) {
+    uint32_t h = (key * 2654435761u) & (ANA_CAR_HASH - 1);
+    for (;;) {
+        uint16_t idx = wk->hash[h];
+        if (idx == 0) break;
+        if (c->cars[idx - 1].key == key) return &c->cars[idx - 1];
+        h = (h + 1) & (ANA_CAR_HASH - 1);
+    }
+    if (c->num_cars == ANA_MAX_CARS) return NULL;
+    ana_car_t *car = &c->cars[c->num_cars++];
+    memset(car, 0, sizeof(*car));
+    car->key = key;
+    wk->hash[h] = (uint16_t)c->num_cars;
+    return car;
+}
+
+static void add_target(ana_car_t *car, uint64_t t_ns, uint16_t value) {
+    if (car->num_targets > 0 && car->targets[car->num_targets - 1].value == value) return;
+    if (car->num_targets == car->cap_targets) {
+        size_t cap = car->cap_targets ? car->cap_targets * 2 : 16;
+        ana_change_t *v = realloc(car->targets, cap * sizeof(*v));
+        if (v == NULL) return;  // 数えられない変化は捨てる (運行回数が少なく出る)
+        car->targets = v;
+        car->cap_targets = cap;
+    }
+    car->targets[car->num_targets++] = (ana_change_t){ t_ns, value };
+}
+
+static void on_frame(const enq_frame_t *f, void *ctx) {
+    ana_frame_ctx_t *fc = ctx;
+    if (enq_frame_is_probe(f)) return;
+    ana_car_t *car = find_car(fc->wk, fc->c, ((uint32_t)(fc->port + 1) << 16) | f->station);
+    if (car == NULL) {
+        fc->c->dropped_frames++;
+        return;
+    }
+    car->frames++;
+    if (!f->checksum_ok) {
+        car->bad_checksum++;
+        return;
+    }
+    switch (f->data_num) {
+    case ENQ_DATA_TARGET_FLOOR:
+        add_target(car, fc->t_ns, f->value);
+        break;
+    case ENQ_DATA_LOAD_WEIGHT: {
+        unsigned bin = f->value / ANA_LOAD_BIN_KG;
+        car->load_hist[bin < ANA_LOAD_BINS ? bin : ANA_LOAD_BINS - 1]++;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// レコード1件をポートのパーサーに通す
+static void push_record(ana_frame_ctx_t *fc, const enqcap_record_t *rec,
+                        const uint8_t *data, size_t len) {
+    fc->port = rec->port;
+    fc->t_ns = rec->t_ns;
+    enq_parser_push(&fc->wk->parsers[rec->port], data, len, on_frame, fc);
+}
+
+static void decode_chunk(ana_worker_t *wk, ana_chunk_t *c) {
+    const enqcap_reader_t *r = &files[c->file].r;
+    unsigned port_count = r->hdr.port_count;
+    uint8_t synced[ENQCAP_MAX_PORTS] = {0};
+    for (unsigned p = 0; p < port_count; p++) {
+        // チェックサム不一致も数えるため値は照合しない
+        enq_parser_init(&wk->parsers[p], ANA_PARSER_FLAGS);
+    }
+    memset(wk->hash, 0, sizeof(wk->hash));
+    c->num_cars = 0;
+
+    ana_frame_ctx_t fc = { .wk = wk, .c = c };
+    enqcap_cursor_t cur = { .r = r };
+    enqcap_record_t rec;
+    enqcap_cursor_enter(&cur, c->first_block);
+    while (cur.block < c->end_block && enqcap_next(&cur, &rec)) {
+        if (cur.block >= c->end_block) break;  // 次のチャンクのレコード
+        if (rec.port >= port_count) continue;
+        ana_port_t *ps = &c->ports[rec.port];
+        while (ps->nhead < sizeof(ps->head) && ps->nhead < ps->bytes + rec.len) {
+            ps->head[ps->nhead] = rec.data[ps->nhead - ps->bytes];
+            ps->head_t_ns[ps->nhead++] = rec.t_ns;
+        }
+        ps->bytes += rec.len;
+        const uint8_t *data = rec.data;
+        size_t len = rec.len;
+        if (!synced[rec.port]) {
+            // 前のチャンクから続く伝文の残りかもしれないので、集計時に継ぎ合わせる
+            const uint8_t *enq = memchr(data, ENQ_CODE, len);
+            if (enq == NULL) {
+                ps->skip += len;
+                continue;
+            }
+            ps->skip += (size_t)(enq - data);
+            len -= (size_t)(enq - data);
+            data = enq;
+            synced[rec.port] = 1;
+        }
+        push_record(&fc, &rec, data, len);
+    }
+
+    for (unsigned p = 0; p < port_count; p++) {
+        const enq_parser_t *pp = &wk->parsers[p];
+        const enq_parser_stats_t *st = enq_parser_stats(pp);
+        ana_port_t *ps = &c->ports[p];
+        ps->frames = st->frames;
+        ps->resync_bytes = st->resync_bytes;
+        ps->layout_errors = st->layout_errors;
+        ps->checksum_errors = st->checksum_errors;
+        // 残りは 0x05 から始まる16バイト未満の候補 (ミラー領域があるので連続して読める)
+        size_t pending = (size_t)(pp->tail - pp->head);
+        if (pending > sizeof(ps->tail)) pending = sizeof(ps->tail);
+        memcpy(ps->tail, pp->buf + (pp->head & ENQ_RING_MASK), pending);
+        ps->ntail = (uint8_t)pending;
+    }
+}
+
+static void *worker_main(void *arg) {
+    ana_worker_t *wk = arg;
+    size_t idx;
+    for (;;) {
+        if (!take_own(&deques[wk->id], &idx)) {
+            if (!steal(wk->id, &idx)) break;
+            wk->steals++;
+        }
+        decode_chunk(wk, &chunks[idx]);
+        wk->chunks_done++;
+    }
+    return NULL;
+}
+
+// ---- チャンク分け ----
+
+static int plan_chunks(size_t chunk_bytes) {
+    size_t cap = 0;
+    for (int i = 0; i < num_files; i++) {
+        ana_file_t *f = &files[i];
+        f->first_chunk = num_chunks;
+        size_t b = 0;
+        while (b < f->r.num_blocks) {
+            size_t first = b;
+            uint64_t bytes = 0;
+            // ブロックの大きさは次のブロックの位置 (最後は索引またはファイル末尾) との差
+            while (b < f->r.num_blocks && (bytes == 0 || bytes < chunk_bytes)) {
+                uint64_t end = b + 1 < f->r.num_blocks ? f->r.blocks[b + 1].offset : f->r.size;
+                bytes += end - f->r.blocks[b].offset;
+                b++;
+            }
+            if (num_chunks == cap) {
+                cap = cap ? cap * 2 : 256;
+                ana_chunk_t *v = realloc(chunks, cap * sizeof(*v));
+                if (v == NULL) return 0;
+                chunks = v;
+            }
+            ana_chunk_t *c = &chunks[num_chunks++];
+            memset(c, 0, sizeof(*c));
+            c->file = i;
+            c->first_block = first;
+            c->end_block = b;
+            c->bytes = bytes;
+        }
+        f->num_chunks = num_chunks - f->first_chunk;
+    }
+    for (size_t i = 0; i < num_chunks; i++) {
+        chunks[i].cars = malloc(ANA_MAX_CARS * sizeof(ana_car_t));
+        if (chunks[i].cars == NULL) return 0;
+    }
+    return 1;
+}
+
+// ---- 集計 (チャンク順) ----
+
+typedef struct {
+    uint16_t value;            // 階 (行先階の値)
+    uint64_t stops;
+    uint64_t dwell_sum_ns;
+    uint64_t dwell_max_ns;
+} ana_floor_t;
+
+typedef struct {
+    char port[ENQCAP_PORT_NAME_LEN + 1];
+    uint16_t station;
+    uint64_t frames, bad_checksum;
+    uint64_t load_hist[ANA_LOAD_BINS];
+    uint64_t trips;            // 着床 (行先階あり → なし)
+    uint64_t retargets;        // 走行中の行先変更
+    ana_floor_t floors[ANA_MAX_FLOORS];
+    int num_floors;
+    // 行先階の状態 (ファイルごとに始め直す)
+    int state_file;
+    int have_target;
+    uint16_t target;
+    int stopped;               // 着床して次の行先を待っている
+    uint16_t stop_floor;
+    uint64_t stop_ns;
+    uint64_t check_frames, check_bad;  // -check で先頭から読み直した数
+} ana_total_car_t;
+
+typedef struct {
+    char name[ENQCAP_PORT_NAME_LEN + 1];
+    ana_port_t st;
+    enq_parser_stats_t check;  // -check で先頭から読み直した統計
+} ana_total_port_t;
+
+static ana_total_car_t total_cars[ANA_MAX_CARS];
+static size_t num_total_cars;
+static ana_total_port_t total_ports[ENQCAP_MAX_PORTS * 4];
+static size_t num_total_ports;
+static uint64_t total_dropped;
+
+static void port_label(const enqcap_reader_t *r, unsigned port, char out[ENQCAP_PORT_NAME_LEN + 1]) {
+    const char *name = enqcap_port_name(r, port);
+    if (name == NULL) {
+        snprintf(out, ENQCAP_PORT_NAME_LEN + 1, "#%u", port);
+        return;
+    }
+    memcpy(out, name, ENQCAP_PORT_NAME_LEN);
+    out[ENQCAP_PORT_NAME_LEN] = '\0';
+}
+
+static ana_total_port_t *total_port(const char *name) {
+    for (size_t i = 0; i < num_total_ports; i++) {
+        if (strcmp(total_ports[i].name, name) == 0) return &total_ports[i];
+    }
+    if (num_total_ports == sizeof(total_ports) / sizeof(total_ports[0])) return NULL;
+    ana_total_port_t *p = &total_ports[num_total_ports++];
+    memset(p, 0, sizeof(*p));
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    return p;
+}
+
+static ana_total_car_t *total_car(const char *port, uint16_t station) {
+    for (size_t i = 0; i < num_total_cars; i++) {
+        if (total_cars[i].station == station && strcmp(total_cars[i].port, port) == 0)
+            return &total_cars[i];
+    }
+    if (num_total_cars == ANA_MAX_CARS) return NULL;
+    ana_total_car_t *t = &total_cars[num_total_cars++];
+    memset(t, 0, sizeof(*t));
+    snprintf(t->port, sizeof(t->port), "%s", port);
+    t->station = station;
+    t->state_file = -1;
+    return t;
+}
+
+static void record_stop(ana_total_car_t *t, uint16_t floor, uint64_t dwell_ns) {
+    ana_floor_t *fl = NULL;
+    for (int i = 0; i < t->num_floors; i++) {
+        if (t->floors[i].value == floor) fl = &t->floors[i];
+    }
+    if (fl == NULL) {
+        if (t->num_floors == ANA_MAX_FLOORS) return;
+        fl = &t->floors[t->num_floors++];
+        fl->value = floor;
+    }
+    fl->stops++;
+    fl->dwell_sum_ns += dwell_ns;
+    if (dwell_ns > fl->dwell_max_ns) fl->dwell_max_ns = dwell_ns;
+}
+
+// 行先階の変化を1件ずつ辿る
+//   あり → なし   : 着床 (運行1回)。その階で停止開始
+//   なし → あり   : 出発。停止時間を確定する
+//   あり → 別の階 : 行先変更
+static void apply_target(ana_total_car_t *t, const ana_change_t *ch) {
+    if (t->have_target && ch->value == t->target) return;  // チャンクの境目の繰り返し
+    if (t->have_target && t->target != 0 && ch->value == 0) {
+        t->trips++;
+        t->stopped = 1;
+        t->stop_floor = t->target;
+        t->stop_ns = ch->t_ns;
+    } else if (ch->value != 0 && t->stopped) {
+        record_stop(t, t->stop_floor, ch->t_ns - t->stop_ns);
+        t->stopped = 0;
+    } else if (t->have_target && t->target != 0 && ch->value != 0) {
+        t->retargets++;
+    }
+    t->have_target = 1;
+    t->target = ch->value;
+}
+
+// 号機の集計先。ファイルが変わったら行先階の状態を始め直す
+// (別のファイルとの間は記録が途切れているので繋げない)
+static ana_total_car_t *state_car(int file, const char *port, uint16_t station) {
+    ana_total_car_t *t = total_car(port, station);
+    if (t && t->state_file != file) {
+        t->state_file = file;
+        t->have_target = 0;
+        t->stopped = 0;
+    }
+    return t;
+}
+
+// ---- 境目の継ぎ合わせ ----
+// ポートごとに、前のチャンクの末尾の候補を持ったパーサーを1つずつ持ち、
+// 次のチャンクの先頭の最大15バイトを足して決着させる
+
+static enq_parser_t seams[ENQCAP_MAX_PORTS];
+static int seam_file = -1;
+
+typedef struct {
+    int file;
+    const char *port;
+    uint64_t t_ns;
+} ana_seam_ctx_t;
+
+static void on_seam_frame(const enq_frame_t *f, void *ctx) {
+    const ana_seam_ctx_t *sc = ctx;
+    if (enq_frame_is_probe(f)) return;
+    ana_total_car_t *t = state_car(sc->file, sc->port, f->station);
+    if (t == NULL) {
+        total_dropped++;
+        return;
+    }
+    t->frames++;
+    if (!f->checksum_ok) {
+        t->bad_checksum++;
+    } else if (f->data_num == ENQ_DATA_TARGET_FLOOR) {
+        apply_target(t, &(ana_change_t){ sc->t_ns, f->value });
+    } else if (f->data_num == ENQ_DATA_LOAD_WEIGHT) {
+        unsigned bin = f->value / ANA_LOAD_BIN_KG;
+        t->load_hist[bin < ANA_LOAD_BINS ? bin : ANA_LOAD_BINS - 1]++;
+    }
+}
+
+// 継ぎ合わせで数えた分をポートの集計に足し、次のファイルに備えて空にする
+static void flush_seams(void) {
+    if (seam_file < 0) return;
+    const enqcap_reader_t *r = &files[seam_file].r;
+    char name[ENQCAP_PORT_NAME_LEN + 1];
+    for (unsigned p = 0; p < r->hdr.port_count; p++) {
+        port_label(r, p, name);
+        ana_total_port_t *tp = total_port(name);
+        const enq_parser_stats_t *st = enq_parser_stats(&seams[p]);
+        if (tp) {
+            tp->st.frames += st->frames;
+            tp->st.resync_bytes += st->resync_bytes;
+            tp->st.layout_errors += st->layout_errors;
+            tp->st.checksum_errors += st->checksum_errors;
+        }
+        enq_parser_init(&seams[p], ANA_PARSER_FLAGS);
+    }
+    seam_file = -1;
+}
+
+// チャンク c の先頭とポート p の境目を決着させる。戻り値は c の先頭で読み飛ばした
+// うち同期外れとして数えるバイト数
+static uint64_t join_seam(const ana_chunk_t *c, unsigned p, const char *name) {
+    const ana_port_t *ps = &c->ports[p];
+    enq_parser_t *sp = &seams[p];
+    int synced = ps->skip < ps->bytes;
+    uint64_t used = 0;  // 継ぎ合わせに使った先頭のバイト数 (読み飛ばした分のうち)
+    if (ps->bytes > 0 && sp->tail > sp->head) {
+        uint64_t sync_pos = sp->tail + ps->skip;  // このチャンクが同期した 0x05 が入る位置
+        ana_seam_ctx_t sc = { c->file, name, 0 };
+        // 1バイトずつ足し、候補がなくなるか同期した 0x05 に届いたら止める
+        // (そこから先はチャンクが数えている)。0x05 を含む候補はその位置までで必ず
+        // 不正になるので、先頭の15バイトより先と 0x05 より後は詰め物の 0x05 で足りる
+        while (sp->tail > sp->head && sp->head < sync_pos) {
+            uint8_t b = ENQ_CODE;
+            if (used < ps->skip) {
+                if (used == ps->nhead) break;  // 0x05 のないチャンクの終わり: 次の境目に持ち越す
+                sc.t_ns = ps->head_t_ns[used];
+                b = ps->head[used++];
+            } else if (!synced) {
+                break;
+            }
+            enq_parser_push(sp, &b, 1, on_seam_frame, &sc);
+        }
+    }
+    // このチャンクで同期できていれば、末尾の候補が次の境目の持ち越しになる
+    if (synced) {
+        sp->head = sp->tail = 0;
+        enq_parser_feed(sp, ps->tail, ps->ntail);
+    }
+    return ps->skip - used;
+}
+
+static void merge_chunk(const ana_chunk_t *c) {
+    const enqcap_reader_t *r = &files[c->file].r;
+    char name[ENQCAP_PORT_NAME_LEN + 1];
+    if (seam_file != c->file) {
+        flush_seams();
+        seam_file = c->file;
+    }
+    // 境目で完成したフレームはこのチャンクのフレームより前なので先に数える
+    for (unsigned p = 0; p < r->hdr.port_count; p++) {
+        port_label(r, p, name);
+        uint64_t lost = join_seam(c, p, name);
+        ana_total_port_t *tp = total_port(name);
+        if (tp == NULL) continue;
+        tp->st.bytes += c->ports[p].bytes;
+        tp->st.frames += c->ports[p].frames;
+        tp->st.resync_bytes += c->ports[p].resync_bytes + lost;
+        tp->st.layout_errors += c->ports[p].layout_errors;
+        tp->st.checksum_errors += c->ports[p].checksum_errors;
+    }
+    total_dropped += c->dropped_frames;
+    for (size_t i = 0; i < c->num_cars; i++) {
+        const ana_car_t *car = &c->cars[i];
+        port_label(r, (car->key >> 16) - 1, name);
+        ana_total_car_t *t = state_car(c->file, name, (uint16_t)(car->key & 0xFFFF));
+        if (t == NULL) {
+            total_dropped += car->frames;
+            continue;
+        }
+        t->frames += car->frames;
+        t->bad_checksum += car->bad_checksum;
+        for (int b = 0; b < ANA_LOAD_BINS; b++) t->load_hist[b] += car->load_hist[b];
+        for (size_t k = 0; k < car->num_targets; k++) apply_target(t, &car->targets[k]);
+    }
+}
+
+// ---- 自己検査 (-check) ----
+// ファイルごとにポート1本ずつのパーサーで先頭から読み直し、チャンクに分けて
+// 継ぎ合わせた集計と比べる
+
+typedef struct {
+    const enqcap_reader_t *r;
+    uint16_t port;
+} ana_check_ctx_t;
+
+static void on_check_frame(const enq_frame_t *f, void *ctx) {
+    const ana_check_ctx_t *cc = ctx;
+    if (enq_frame_is_probe(f)) return;
+    char name[ENQCAP_PORT_NAME_LEN + 1];
+    port_label(cc->r, cc->port, name);
+    ana_total_car_t *t = total_car(name, f->station);
+    if (t == NULL) return;
+    t->check_frames++;
+    if (!f->checksum_ok) t->check_bad++;
+}
+
+// 一致すれば 1
+static int check_sequential(void) {
+    static enq_parser_t parsers[ENQCAP_MAX_PORTS];
+    char name[ENQCAP_PORT_NAME_LEN + 1];
+    for (int i = 0; i < num_files; i++) {
+        const enqcap_reader_t *r = &files[i].r;
+        for (unsigned p = 0; p < r->hdr.port_count; p++) enq_parser_init(&parsers[p], ANA_PARSER_FLAGS);
+        ana_check_ctx_t cc = { .r = r };
+        enqcap_cursor_t cur = { .r = r };
+        enqcap_record_t rec;
+        enqcap_cursor_enter(&cur, 0);
+        while (enqcap_next(&cur, &rec)) {
+            if (rec.port >= r->hdr.port_count) continue;
+            cc.port = rec.port;
+            enq_parser_push(&parsers[rec.port], rec.data, rec.len, on_check_frame, &cc);
+        }
+        for (unsigned p = 0; p < r->hdr.port_count; p++) {
+            port_label(r, p, name);
+            ana_total_port_t *tp = total_port(name);
+            if (tp == NULL) continue;
+            const enq_parser_stats_t *st = enq_parser_stats(&parsers[p]);
+            tp->check.frames += st->frames;
+            tp->check.resync_bytes += st->resync_bytes;
+            tp->check.layout_errors += st->layout_errors;
+            tp->check.checksum_errors += st->checksum_errors;
+        }
+    }
+
+    int ok = 1;
+    for (size_t i = 0; i < num_total_ports; i++) {
+        const ana_total_port_t *tp = &total_ports[i];
+        if (tp->st.frames != tp->check.frames || tp->st.resync_bytes != tp->check.resync_bytes ||
+            tp->st.layout_errors != tp->check.layout_errors ||
+            tp->st.checksum_errors != tp->check.checksum_errors) {
+            printf("❌ %s: フレーム %llu/%llu 形式エラー %llu/%llu チェックサム不一致 %llu/%llu "
+                   "破棄 %llu/%llu (チャンク/順読み)\n", tp->name,
+                   (unsigned long long)tp->st.frames, (unsigned long long)tp->check.frames,
+                   (unsigned long long)tp->st.layout_errors, (unsigned long long)tp->check.layout_errors,
+                   (unsigned long long)tp->st.checksum_errors,
+                   (unsigned long long)tp->check.checksum_errors,
+                   (unsigned long long)tp->st.resync_bytes, (unsigned long long)tp->check.resync_bytes);
+            ok = 0;
+        }
+    }
+    for (size_t i = 0; i < num_total_cars; i++) {
+        const ana_total_car_t *t = &total_cars[i];
+        if (t->frames != t->check_frames || t->bad_checksum != t->check_bad) {
+            printf("❌ %s 局%04u: フレーム %llu/%llu 故障 %llu/%llu (チャンク/順読み)\n", t->port,
+                   t->station, (unsigned long long)t->frames, (unsigned long long)t->check_frames,
+                   (unsigned long long)t->bad_checksum, (unsigned long long)t->check_bad);
+            ok = 0;
+        }
+    }
+    if (ok) printf("✅ チャンク分けの集計は先頭からの順読みと一致\n");
+    return ok;
+}
+
+// ---- 表示 ----
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static double ratio(uint64_t n, uint64_t d) {
+    return d ? (double)n / (double)d : 0;
+}
+
+// 荷重の分布から分位点 (ビンの上端、kg)
+static unsigned load_quantile(const uint64_t *hist, uint64_t n, double q) {
+    uint64_t want = (uint64_t)((double)n * q);
+    uint64_t acc = 0;
+    for (int b = 0; b < ANA_LOAD_BINS; b++) {
+        acc += hist[b];
+        if (acc > want) return (unsigned)(b + 1) * ANA_LOAD_BIN_KG;
+    }
+    return ANA_LOAD_BINS * ANA_LOAD_BIN_KG;
+}
+
+static int cmp_car(const void *a, const void *b) {
+    const ana_total_car_t *x = a, *y = b;
+    int c = strcmp(x->port, y->port);
+    if (c) return c;
+    return (int)x->station - (int)y->station;
+}
+
+static int cmp_floor(const void *a, const void *b) {
+    const ana_floor_t *x = a, *y = b;
+    // 地下 (B1F = 0xFFFF、B2F = 0xFFFE ...) を先頭にする
+    int vx = x->value >= ENQ_FLOOR_BASEMENT_MIN ? x->value - 0x10000 : x->value;
+    int vy = y->value >= ENQ_FLOOR_BASEMENT_MIN ? y->value - 0x10000 : y->value;
+    return vx - vy;
+}
+
+static void print_report(uint64_t elapsed_ns, uint64_t scanned, double hours) {
+    uint64_t frames = 0;
+    printf("\n🔌 ポート別\n");
+    for (size_t i = 0; i < num_total_ports; i++) {
+        const ana_port_t *s = &total_ports[i].st;
+        frames += s->frames;
+        printf("  %-20s %llu バイト / %llu フレーム / 形式エラー %llu / チェックサム不一致 %llu "
+               "(%.3f%%) / 破棄 %llu バイト\n",
+               total_ports[i].name, (unsigned long long)s->bytes, (unsigned long long)s->frames,
+               (unsigned long long)s->layout_errors, (unsigned long long)s->checksum_errors,
+               100.0 * ratio(s->checksum_errors, s->frames), (unsigned long long)s->resync_bytes);
+    }
+
+    qsort(total_cars, num_total_cars, sizeof(total_cars[0]), cmp_car);
+    printf("\n🛗 号機別 (%zu 台)\n", num_total_cars);
+    for (size_t i = 0; i < num_total_cars; i++) {
+        ana_total_car_t *t = &total_cars[i];
+        uint64_t loads = 0, load_sum = 0;
+        for (int b = 0; b < ANA_LOAD_BINS; b++) {
+            loads += t->load_hist[b];
+            load_sum += t->load_hist[b] * (uint64_t)(b * ANA_LOAD_BIN_KG + ANA_LOAD_BIN_KG / 2);
+        }
+        printf("  %s 局%04u: %llu フレーム / 運行 %llu 回 (%.1f 回/時, 行先変更 %llu) / "
+               "故障フレーム %.3f%%\n",
+               t->port, t->station, (unsigned long long)t->frames, (unsigned long long)t->trips,
+               hours > 0 ? (double)t->trips / hours : 0, (unsigned long long)t->retargets,
+               100.0 * ratio(t->bad_checksum, t->frames));
+        if (loads > 0) {
+            printf("    荷重: 平均 %.0fkg / p50 %ukg 以下 / p90 %ukg 以下 (%llu 件, %dkg 刻み)\n",
+                   (double)load_sum / (double)loads, load_quantile(t->load_hist, loads, 0.5),
+                   load_quantile(t->load_hist, loads, 0.9), (unsigned long long)loads,
+                   ANA_LOAD_BIN_KG);
+        }
+        qsort(t->floors, (size_t)t->num_floors, sizeof(t->floors[0]), cmp_floor);
+        for (int k = 0; k < t->num_floors; k++) {
+            const ana_floor_t *fl = &t->floors[k];
+            char floor[8];
+            enq_floor_name(fl->value, floor, sizeof(floor));
+            printf("    停止 %-4s %llu 回 / 平均 %.2f 秒 / 最大 %.2f 秒\n", floor,
+                   (unsigned long long)fl->stops, (double)fl->dwell_sum_ns / 1e9 / (double)fl->stops,
+                   (double)fl->dwell_max_ns / 1e9);
+        }
+    }
+    if (total_dropped) {
+        printf("⚠️ 号機数の上限 (%d) を超えたため %llu フレームを数えていません\n",
+               ANA_MAX_CARS, (unsigned long long)total_dropped);
+    }
+
+    double secs = (double)elapsed_ns / 1e9;
+    printf("\n⏱️ %.2f 秒で %.1f MB を解析 (%.2f GB/s, %.1f M フレーム/秒)\n", secs,
+           (double)scanned / 1e6, (double)scanned / secs / 1e9, (double)frames / secs / 1e6);
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double chunk_mb = ANA_DEFAULT_CHUNK_MB;
+    const char *simd = NULL;
+    int check = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-chunk") == 0 && i + 1 < argc) {
+            chunk_mb = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-simd") == 0 && i + 1 < argc) {
+            simd = argv[++i];
+        } else if (strcmp(argv[i], "-check") == 0) {
+            check = 1;
+        } else {
+            break;
+        }
+    }
+    if (i >= argc || threads <= 0 || chunk_mb <= 0) {
+        printf("使用方法: %s [-threads N] [-chunk MB] [-simd scalar|sse2|avx2|neon] [-check] "
+               "<キャプチャ...>\n", argv[0]);
+        return 1;
+    }
+    if (threads > ANA_MAX_THREADS) threads = ANA_MAX_THREADS;
+    if (simd) {
+        int ok = 0;
+        for (int k = ENQ_SIMD_SCALAR; k <= ENQ_SIMD_NEON; k++) {
+            if (strcmp(simd, enq_simd_name((enq_simd_t)k)) == 0) ok = enq_simd_select((enq_simd_t)k);
+        }
+        if (!ok) {
+            fprintf(stderr, "❌ SIMD 実装 %s はこの環境では使えません\n", simd);
+            return 1;
+        }
+    }
+
+    double hours = 0;
+    uint64_t scanned = 0;
+    for (; i < argc && num_files < ANA_MAX_FILES; i++) {
+        ana_file_t *f = &files[num_files];
+        f->path = argv[i];
+        if (enqcap_open_mapped(&f->r, f->path) < 0) {
+            fprintf(stderr, "❌ %s を読めません: %s\n", f->path, strerror(errno));
+            return 1;
+        }
+        // 全スレッドで別々の位置から読むので、順読みではなくファイル全体の先読みを頼む
+        madvise((void *)f->r.base, f->r.size, MADV_WILLNEED);
+        uint64_t first, last;
+        double span = enqcap_time_range(&f->r, &first, &last) ? (double)(last - first) / 1e9 : 0;
+        hours += span / 3600;
+        scanned += f->r.size;
+        printf("📂 %s: %.1f MB / %zu ブロック / %.0f 秒分 / %u ポート%s%s\n", f->path,
+               (double)f->r.size / 1e6, f->r.num_blocks, span, f->r.hdr.port_count,
+               f->r.indexed ? "" : " (索引なし)", f->r.truncated ? " (末尾が不完全)" : "");
+        num_files++;
+    }
+    if (!plan_chunks((size_t)(chunk_mb * 1e6))) {
+        fprintf(stderr, "❌ メモリ不足\n");
+        return 1;
+    }
+    for (unsigned p = 0; p < ENQCAP_MAX_PORTS; p++) enq_parser_init(&seams[p], ANA_PARSER_FLAGS);
+    if ((size_t)threads > num_chunks) threads = num_chunks ? (int)num_chunks : 1;
+    num_threads = threads;
+    printf("⚙️ %d スレッド / %zu チャンク (約 %g MB) / SIMD %s\n", threads, num_chunks,
+           chunk_mb, enq_simd_name(enq_simd_active()));
+
+    // パーサーの重複抑制表はキャッシュライン境界に揃える
+    ana_worker_t *workers = aligned_alloc(_Alignof(ana_worker_t),
+                                          (size_t)threads * sizeof(*workers));
+    if (workers) memset(workers, 0, (size_t)threads * sizeof(*workers));
+    if (workers == NULL) {
+        fprintf(stderr, "❌ メモリ不足\n");
+        return 1;
+    }
+    uint64_t t0 = monotonic_ns();
+    for (int k = 0; k < threads; k++) {
+        pthread_mutex_init(&deques[k].lock, NULL);
+        deques[k].lo = num_chunks * (size_t)k / (size_t)threads;
+        deques[k].hi = num_chunks * (size_t)(k + 1) / (size_t)threads;
+    }
+    int started = 0;
+    for (int k = 0; k < threads; k++) {
+        workers[k].id = k;
+        int rc = pthread_create(&workers[k].th, NULL, worker_main, &workers[k]);
+        if (rc != 0) {
+            // 起動できた分だけで続ける (残りのチャンクは盗まれる)
+            fprintf(stderr, "⚠️ スレッド起動失敗: %s\n", strerror(rc));
+            break;
+        }
+        started++;
+    }
+    if (started == 0) worker_main(&workers[0]);
+    uint64_t steals = 0;
+    for (int k = 0; k < started; k++) {
+        pthread_join(workers[k].th, NULL);
+        steals += workers[k].steals;
+    }
+    for (size_t c = 0; c < num_chunks; c++) merge_chunk(&chunks[c]);
+    flush_seams();
+    uint64_t elapsed = monotonic_ns() - t0;
+    printf("🧵 盗んだチャンク %llu 件\n", (unsigned long long)steals);
+
+    print_report(elapsed, scanned, hours);
+    int status = check && !check_sequential() ? 1 : 0;
+
+    for (size_t c = 0; c < num_chunks; c++) {
+        for (size_t k = 0; k < chunks[c].num_cars; k++) free(chunks[c].cars[k].targets);
+        free(chunks[c].cars);
+    }
+    free(chunks);
+    free(workers);
+    for (int k = 0; k < num_files; k++) enqcap_close_mapped(&files[k].r);
+    return status;
+}
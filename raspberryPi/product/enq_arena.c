@@ -0,0 +1,34 @@
+// enq_arena.c
+// アドレス空間を先に予約し、使う分だけ伸ばす領域 (POSIX)
+
+#include "enq_arena.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+int enq_arena_init(enq_arena_t *a, size_t reserve) {
+    memset(a, 0, sizeof(*a));
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    reserve = (reserve + page - 1) & ~(page - 1);
+    // 書き込むまで物理ページは割り当てられず、スワップの予約もしない
+    void *p = mmap(NULL, reserve, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return -1;
+    a->base = p;
+    a->reserved = reserve;
+    return 0;
+}
+
+void *enq_arena_alloc(enq_arena_t *a, size_t size, size_t align) {
+    if (a->base == NULL) return NULL;
+    size_t off = (a->used + align - 1) & ~(align - 1);
+    if (off > a->reserved || size > a->reserved - off) return NULL;
+    a->used = off + size;
+    return a->base + off;
+}
+
+void enq_arena_destroy(enq_arena_t *a) {
+    if (a->base) munmap(a->base, a->reserved);
+    memset(a, 0, sizeof(*a));
+}
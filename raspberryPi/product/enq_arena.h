@@ -0,0 +1,31 @@
+// enq_arena.h
+// アドレス空間を先に予約し、使う分だけ伸ばす領域 (POSIX)
+//
+// 開いたときに上限までのアドレス空間を匿名マップ (MAP_NORESERVE) で予約し、
+// enq_arena_alloc() は使用量を進めるだけで返す。malloc/realloc を通らないので
+// 定常運転中にヒープを確保せず、伸ばしても既存のデータは動かない (ポインタが変わらない)。
+// 物理メモリは書き込んだページの分だけ使われる。直前の確保と続けて確保すれば
+// 連続した配列として伸ばせる (キャプチャ・イベントファイルの索引はこの使い方)。
+// ロックはないので、1つの領域は1つのスレッドだけが使う。
+
+#ifndef ENQ_ARENA_H
+#define ENQ_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint8_t *base;     // NULL なら未初期化 (enq_arena_alloc は常に NULL を返す)
+    size_t reserved;   // 予約した大きさ (ページ単位に切り上げ)
+    size_t used;
+} enq_arena_t;
+
+// reserve バイトのアドレス空間を予約する。戻り値: 成功 0 / 失敗 -1 (errno)
+int  enq_arena_init(enq_arena_t *a, size_t reserve);
+// size バイトを align (2のべき乗) 境界で確保する。予約を超えるなら NULL
+void *enq_arena_alloc(enq_arena_t *a, size_t size, size_t align);
+// 使用量を 0 に戻す (触ったページは持ったまま再利用する)
+static inline void enq_arena_reset(enq_arena_t *a) { a->used = 0; }
+void enq_arena_destroy(enq_arena_t *a);
+
+#endif // ENQ_ARENA_H
@@ -0,0 +1,425 @@
+// enq_bench.c
+// ENQ伝文処理のマイクロベンチマーク
+// ビルド例: gcc -O2 enq_bench.c enq_parser.c enq_simd.c -o enq_bench
+//
+// 使用方法:
+//   enq_bench [-n 伝文数] [-noise ノイズ率] [-t 最小秒数] [-seed 値] [-simd 実装] [名前...]
+//   名前を指定するとその項目だけ実行する (既定は全項目)
+//   -simd all で使える SIMD 実装ごとに全項目を繰り返す
+//
+// 合成した伝文列とストリームに対して各処理を繰り返し、最小秒数以上かかるまで
+// 回した平均から ns/伝文、MB/s、M伝文/s を出す。ノイズ率はストリーム中の
+// ゴミバイトの割合で、ゴミは ENQ で始まる途中までの伝文とランダムなバイトの
+// 混合 (再同期の経路を通す)。
+//
+// worst_* は再同期の最悪入力で、ENQ だけが続く列・チェックサムだけが違う伝文
+// (検証あり)・ランダムなゴミ。どれも有効な伝文を含まないので、ns/伝文 は
+// 16バイトあたりの時間。起動時に各入力を 1倍長と 8倍長で解析し、時間の比が
+// ほぼ 8 (入力長に対して線形) であることを確認する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "enq_parser.h"
+
+// 計測対象の結果を捨てないための置き場
+static volatile uint64_t sink;
+
+typedef struct {
+    uint16_t station, data_num, value;
+} frame_spec_t;
+
+static size_t num_frames = 100000;
+static double noise_ratio = 0.1;
+static double min_time = 0.5;
+static unsigned seed = 1;
+
+static frame_spec_t *specs;
+static uint8_t *frames;            // num_frames x 16 バイト
+static uint8_t *clean_stream;      // frames をそのまま連結
+static size_t clean_len;
+static uint8_t *noisy_stream;
+static size_t noisy_len;
+static uint8_t *worst_stream;      // 最悪入力の作業領域 (clean_len * WORST_SCALE)
+static int worst_made = -1;        // worst_stream に今ある入力 (worst_kind_t)
+static enq_parser_t parser;
+
+#define READ_CHUNK 256  // モニターの read() 1回分
+#define WORST_SCALE 8   // 線形性の確認で比べる入力長の比
+
+// 1回の処理量
+typedef struct {
+    uint64_t frames;
+    uint64_t bytes;
+} work_t;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift32 (再現性のため rand() は使わない)
+static uint32_t rng_state;
+static uint32_t rng(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+// ---- 入力データ生成 ----
+
+static const int floors[] = { -1, 1, 2, 3 };
+
+static void make_frames(void) {
+    specs = malloc(num_frames * sizeof(*specs));
+    frames = malloc(num_frames * ENQ_FRAME_LEN);
+    for (size_t i = 0; i < num_frames; i++) {
+        frame_spec_t *s = &specs[i];
+        s->station = (uint16_t)(1 + rng() % 64);
+        s->data_num = (uint16_t)(ENQ_DATA_CURRENT_FLOOR + rng() % 3);
+        int floor = floors[rng() % 4];
+        switch (s->data_num) {
+        case ENQ_DATA_CURRENT_FLOOR:
+            s->value = enq_floor_value(floor);
+            break;
+        case ENQ_DATA_TARGET_FLOOR:
+            s->value = rng() % 5 == 0 ? 0 : enq_floor_value(floor);
+            break;
+        default:
+            s->value = (uint16_t)(rng() % 2000);
+            break;
+        }
+        enq_frame_encode(frames + i * ENQ_FRAME_LEN, s->station, s->data_num, s->value);
+    }
+    clean_len = num_frames * ENQ_FRAME_LEN;
+    clean_stream = frames;
+}
+
+// 伝文の間にゴミを挟んだストリーム。ゴミの平均長は 16r/(1-r) バイト
+static void make_noisy_stream(void) {
+    double gap_avg = noise_ratio >= 1 ? 0 : ENQ_FRAME_LEN * noise_ratio / (1 - noise_ratio);
+    size_t cap = clean_len + (size_t)(gap_avg * 2 * (double)num_frames) + 64;
+    noisy_stream = malloc(cap);
+    size_t n = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+        size_t gap = gap_avg > 0 ? (size_t)(rng() % (uint32_t)(gap_avg * 2 + 1)) : 0;
+        while (gap > 0) {
+            if (rng() % 3 == 0) {
+                // 途中で切れた伝文 (ENQ から始まる偽の候補)。チェックサムを見ない
+                // 既定設定でも偽物と分かるよう、データ番号までで切る
+                size_t k = 1 + rng() % 9;
+                if (k > gap) k = gap;
+                memcpy(noisy_stream + n, frames + (rng() % num_frames) * ENQ_FRAME_LEN, k);
+                n += k;
+                gap -= k;
+            } else {
+                noisy_stream[n++] = (uint8_t)rng();
+                gap--;
+            }
+        }
+        memcpy(noisy_stream + n, frames + i * ENQ_FRAME_LEN, ENQ_FRAME_LEN);
+        n += ENQ_FRAME_LEN;
+    }
+    noisy_len = n;
+}
+
+// 再同期の最悪入力を len バイト作る
+typedef enum { WORST_ENQ, WORST_CHECKSUM, WORST_GARBAGE } worst_kind_t;
+
+static void make_worst(worst_kind_t kind, uint8_t *out, size_t len) {
+    switch (kind) {
+    case WORST_ENQ:
+        // どの位置も候補になり、1バイト目で形式エラーになる
+        memset(out, ENQ_CODE, len);
+        break;
+    case WORST_CHECKSUM:
+        // 形式は正しくチェックサムだけ違う。検証ありでは全候補を最後まで見て捨てる
+        for (size_t off = 0; off < len; off += ENQ_FRAME_LEN) {
+            uint8_t f[ENQ_FRAME_LEN];
+            const frame_spec_t *sp = &specs[(off / ENQ_FRAME_LEN) % num_frames];
+            enq_frame_encode(f, sp->station, sp->data_num, sp->value);
+            f[15] = f[15] == '0' ? '1' : '0';
+            memcpy(out + off, f, len - off < ENQ_FRAME_LEN ? len - off : ENQ_FRAME_LEN);
+        }
+        break;
+    case WORST_GARBAGE:
+        for (size_t i = 0; i < len; i++) out[i] = (uint8_t)rng();
+        break;
+    }
+}
+
+// ---- 計測項目 ----
+
+static work_t bench_checksum(void) {
+    uint64_t acc = 0;
+    for (size_t i = 0; i < num_frames; i++) acc += enq_checksum(frames + i * ENQ_FRAME_LEN + 1, 13);
+    sink += acc;
+    return (work_t){ num_frames, clean_len };
+}
+
+static work_t bench_encode(void) {
+    uint8_t out[ENQ_FRAME_LEN];
+    uint64_t acc = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+        const frame_spec_t *s = &specs[i];
+        enq_frame_encode(out, s->station, s->data_num, s->value);
+        acc += out[15];
+    }
+    sink += acc;
+    return (work_t){ num_frames, clean_len };
+}
+
+// 階数 → データ値 → 伝文 (旧 floor_to_hex + calculate_checksum の経路)
+static work_t bench_encode_floor(void) {
+    uint8_t out[ENQ_FRAME_LEN];
+    uint64_t acc = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+        enq_frame_encode(out, specs[i].station, ENQ_DATA_CURRENT_FLOOR,
+                         enq_floor_value(floors[i & 3]));
+        acc += out[15];
+    }
+    sink += acc;
+    return (work_t){ num_frames, clean_len };
+}
+
+static work_t bench_validate(void) {
+    uint64_t ok = 0;
+    for (size_t i = 0; i < num_frames; i++)
+        ok += enq_frame_validate(frames + i * ENQ_FRAME_LEN, 0) == ENQ_OK;
+    sink += ok;
+    return (work_t){ num_frames, clean_len };
+}
+
+static work_t bench_validate_checksum(void) {
+    uint64_t ok = 0;
+    for (size_t i = 0; i < num_frames; i++)
+        ok += enq_frame_validate(frames + i * ENQ_FRAME_LEN, ENQ_PARSER_VERIFY_CHECKSUM) == ENQ_OK;
+    sink += ok;
+    return (work_t){ num_frames, clean_len };
+}
+
+static work_t bench_decode(void) {
+    enq_frame_t f;
+    uint64_t acc = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+        enq_frame_decode(frames + i * ENQ_FRAME_LEN, &f);
+        acc += f.value + f.checksum_ok;
+    }
+    sink += acc;
+    return (work_t){ num_frames, clean_len };
+}
+
+static void count_frame(const enq_frame_t *f, void *ctx) {
+    (void)f;
+    (*(uint64_t *)ctx)++;
+}
+
+// モニターと同じく READ_CHUNK ずつ投入する
+static work_t parse_stream_flags(const uint8_t *data, size_t len, int flags) {
+    uint64_t found = 0;
+    enq_parser_init(&parser, flags);
+    for (size_t off = 0; off < len; off += READ_CHUNK) {
+        size_t n = len - off < READ_CHUNK ? len - off : READ_CHUNK;
+        enq_parser_push(&parser, data + off, n, count_frame, &found);
+    }
+    sink += found;
+    return (work_t){ found, len };
+}
+
+static work_t parse_stream(const uint8_t *data, size_t len) {
+    return parse_stream_flags(data, len, 0);
+}
+
+static work_t bench_parse_clean(void) { return parse_stream(clean_stream, clean_len); }
+static work_t bench_parse_noisy(void) { return parse_stream(noisy_stream, noisy_len); }
+
+// 最悪入力は伝文を含まないので 16バイトを1伝文と数える
+static work_t parse_worst(worst_kind_t kind, int flags) {
+    if (worst_made != (int)kind) {
+        make_worst(kind, worst_stream, clean_len);
+        worst_made = (int)kind;
+    }
+    work_t w = parse_stream_flags(worst_stream, clean_len, flags);
+    w.frames = clean_len / ENQ_FRAME_LEN;
+    return w;
+}
+
+static work_t bench_worst_enq(void) { return parse_worst(WORST_ENQ, 0); }
+static work_t bench_worst_checksum(void) { return parse_worst(WORST_CHECKSUM, ENQ_PARSER_VERIFY_CHECKSUM); }
+static work_t bench_worst_garbage(void) { return parse_worst(WORST_GARBAGE, 0); }
+
+static work_t bench_dump(void) {
+    char hex[ENQ_FRAME_LEN * 2 + 1];
+    char ascii[ENQ_FRAME_LEN + 1];
+    uint64_t acc = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+        enq_frame_dump(frames + i * ENQ_FRAME_LEN, hex, ascii);
+        acc += (uint8_t)hex[31] + (uint8_t)ascii[15];
+    }
+    sink += acc;
+    return (work_t){ num_frames, clean_len };
+}
+
+static work_t bench_describe(void) {
+    enq_frame_t f;
+    char desc[64];
+    uint64_t acc = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+        enq_frame_decode(frames + i * ENQ_FRAME_LEN, &f);
+        acc += (uint64_t)enq_frame_describe(&f, desc, sizeof(desc));
+    }
+    sink += acc;
+    return (work_t){ num_frames, clean_len };
+}
+
+typedef struct {
+    const char *name;
+    const char *desc;
+    work_t (*run)(void);
+} bench_t;
+
+static const bench_t benches[] = {
+    { "checksum",      "チェックサム (13バイト加算)",    bench_checksum },
+    { "encode",        "伝文組み立て",                   bench_encode },
+    { "encode_floor",  "階数→伝文組み立て",              bench_encode_floor },
+    { "validate",      "形式検証",                       bench_validate },
+    { "validate_cs",   "形式検証 + チェックサム照合",    bench_validate_checksum },
+    { "decode",        "デコード",                       bench_decode },
+    { "parse_clean",   "ストリーム解析 (ノイズなし)",    bench_parse_clean },
+    { "parse_noisy",   "ストリーム解析 (再同期あり)",    bench_parse_noisy },
+    { "worst_enq",     "最悪入力: ENQ の連続",           bench_worst_enq },
+    { "worst_cs",      "最悪入力: チェックサム違い (検証あり)", bench_worst_checksum },
+    { "worst_garbage", "最悪入力: ランダムなゴミ",       bench_worst_garbage },
+    { "dump",          "HEX/ASCII 表示文字列",           bench_dump },
+    { "describe",      "内容の文字列化",                 bench_describe },
+};
+
+static void run_bench(const bench_t *b) {
+    b->run();  // ウォームアップ
+    work_t total = { 0, 0 };
+    uint64_t passes = 0;
+    uint64_t start = monotonic_ns(), elapsed;
+    do {
+        work_t w = b->run();
+        total.frames += w.frames;
+        total.bytes += w.bytes;
+        passes++;
+        elapsed = monotonic_ns() - start;
+    } while ((double)elapsed < min_time * 1e9);
+
+    double sec = (double)elapsed / 1e9;
+    printf("%-13s %9.2f %10.1f %10.2f %8llu  %s\n", b->name,
+           total.frames ? (double)elapsed / (double)total.frames : 0,
+           (double)total.bytes / sec / 1e6, (double)total.frames / sec / 1e6,
+           (unsigned long long)passes, b->desc);
+}
+
+// 1倍長と WORST_SCALE 倍長の解析時間 (3回の最短) の比。線形なら WORST_SCALE 付近
+static double worst_ratio(worst_kind_t kind, int flags) {
+    uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+    size_t lens[2] = { clean_len, clean_len * WORST_SCALE };
+    make_worst(kind, worst_stream, lens[1]);
+    worst_made = -1;
+    for (int rep = 0; rep < 3; rep++) {
+        for (int k = 0; k < 2; k++) {
+            uint64_t t0 = monotonic_ns();
+            parse_stream_flags(worst_stream, lens[k], flags);
+            uint64_t t = monotonic_ns() - t0;
+            if (t < best[k]) best[k] = t;
+        }
+    }
+    return best[0] ? (double)best[1] / (double)best[0] : 0;
+}
+
+static int selected(const char *name, char **names, int count) {
+    if (count == 0) return 1;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    char *names[sizeof(benches) / sizeof(benches[0])];
+    int num_names = 0;
+    const char *simd = NULL;  // NULL なら自動選択のまま
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            num_frames = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-noise") == 0 && i + 1 < argc) {
+            noise_ratio = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-simd") == 0 && i + 1 < argc) {
+            simd = argv[++i];
+        } else if (argv[i][0] == '-') {
+            printf("使用方法: %s [-n 伝文数] [-noise 0.0〜0.95] [-t 最小秒数] [-seed 値] "
+                   "[-simd scalar|sse2|avx2|neon|all] [名前...]\n",
+                   argv[0]);
+            return 1;
+        } else if (num_names < (int)(sizeof(names) / sizeof(names[0]))) {
+            names[num_names++] = argv[i];
+        }
+    }
+    if (num_frames == 0 || noise_ratio < 0 || noise_ratio > 0.95) {
+        fprintf(stderr, "❌ 伝文数は 1 以上、ノイズ率は 0〜0.95 で指定してください\n");
+        return 1;
+    }
+
+    rng_state = seed ? seed : 1;
+    make_frames();
+    make_noisy_stream();
+    worst_stream = malloc(clean_len * WORST_SCALE);
+    if (worst_stream == NULL) {
+        fprintf(stderr, "❌ メモリ不足\n");
+        return 1;
+    }
+
+    // ノイズ入りストリームから全伝文を取り戻せることを先に確認する
+    work_t check = parse_stream(noisy_stream, noisy_len);
+    const enq_parser_stats_t *st = enq_parser_stats(&parser);
+    printf("🧪 ENQ ベンチマーク: %zu 伝文 / ノイズ率 %.1f%% (実測 %.1f%%, %.2f MB) / 最小 %.2f 秒\n",
+           num_frames, noise_ratio * 100,
+           100.0 * (double)(noisy_len - clean_len) / (double)noisy_len,
+           (double)noisy_len / 1e6, min_time);
+    printf("   再同期確認: %llu/%zu 伝文 / 破棄 %llu バイト / 形式エラー %llu 候補\n",
+           (unsigned long long)check.frames, num_frames,
+           (unsigned long long)st->resync_bytes, (unsigned long long)st->layout_errors);
+    printf("   最悪入力の線形性 (%d倍長の時間比): ENQ 連続 x%.1f / チェックサム違い x%.1f / ゴミ x%.1f\n\n",
+           WORST_SCALE, worst_ratio(WORST_ENQ, 0), worst_ratio(WORST_CHECKSUM, ENQ_PARSER_VERIFY_CHECKSUM),
+           worst_ratio(WORST_GARBAGE, 0));
+
+    for (int impl = ENQ_SIMD_SCALAR; impl <= ENQ_SIMD_NEON; impl++) {
+        if (simd == NULL) {
+            impl = enq_simd_active();
+        } else if (strcmp(simd, "all") != 0 && strcmp(simd, enq_simd_name((enq_simd_t)impl)) != 0) {
+            continue;
+        }
+        if (!enq_simd_select((enq_simd_t)impl)) {
+            if (simd && strcmp(simd, "all") == 0) continue;
+            fprintf(stderr, "⚠️ SIMD 実装 %s はこの環境では使えません\n", enq_simd_name((enq_simd_t)impl));
+            continue;
+        }
+        printf("[SIMD: %s]\n", enq_simd_name((enq_simd_t)impl));
+        printf("%-13s %9s %10s %10s %8s\n", "名前", "ns/伝文", "MB/s", "M伝文/s", "回数");
+        for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+            if (selected(benches[i].name, names, num_names)) run_bench(&benches[i]);
+        }
+        printf("\n");
+        if (simd == NULL) break;
+    }
+
+    free(worst_stream);
+    free(noisy_stream);
+    free(frames);
+    free(specs);
+    return 0;
+}
@@ -0,0 +1,177 @@
+// enq_capture.c
+// キャプチャファイルの書き込みとメモリマップ読み出し (POSIX)
+
+#include "enq_capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// 全量を書く (短い書き込みは続きを書く)
+static int write_all(enqcap_writer_t *w, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(w->fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            w->failed = 1;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        w->file_off += (uint64_t)n;
+    }
+    return 0;
+}
+
+int enqcap_writer_open(enqcap_writer_t *w, const char *path,
+                       const char *const *port_names, size_t port_count) {
+    memset(w, 0, sizeof(*w));
+    if (port_count > ENQCAP_MAX_PORTS) port_count = ENQCAP_MAX_PORTS;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (w->fd < 0) return -1;
+    if (enq_arena_init(&w->index, ENQCAP_INDEX_MAX * sizeof(enqcap_index_entry_t)) < 0) goto fail;
+
+    enqcap_file_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, ENQCAP_MAGIC, 8);
+    hdr.version = ENQCAP_VERSION;
+    hdr.port_count = (uint16_t)port_count;
+    hdr.header_size = (uint32_t)(sizeof(hdr) + port_count * ENQCAP_PORT_NAME_LEN);
+    hdr.start_realtime_ns = clock_ns(CLOCK_REALTIME);
+    hdr.start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+
+    if (write_all(w, &hdr, sizeof(hdr)) < 0) goto fail;
+    for (size_t i = 0; i < port_count; i++) {
+        char name[ENQCAP_PORT_NAME_LEN] = {0};
+        strncpy(name, port_names[i], sizeof(name) - 1);
+        if (write_all(w, name, sizeof(name)) < 0) goto fail;
+    }
+    return 0;
+
+fail:
+    {
+        int e = errno;
+        enq_arena_destroy(&w->index);
+        close(w->fd);
+        w->fd = -1;
+        errno = e;
+    }
+    return -1;
+}
+
+int enqcap_writer_flush(enqcap_writer_t *w, uint64_t now_ns, uint64_t age_ns) {
+    if (w->failed) return -1;
+    if (w->block_records == 0) return 0;
+    if (age_ns != 0 && now_ns - w->block_first_ns < age_ns) return 0;
+
+    // 索引は直前の項目の続きに確保するので配列として伸びる
+    enqcap_index_entry_t *e = w->index_full ? NULL :
+        enq_arena_alloc(&w->index, sizeof(*e), _Alignof(enqcap_index_entry_t));
+    if (e) {
+        e->offset = w->file_off;
+        e->first_ns = w->block_first_ns;
+        e->last_ns = w->block_last_ns;
+        w->index_len++;
+    } else {
+        w->index_full = 1;
+    }
+
+    enqcap_block_header_t bh;
+    memset(&bh, 0, sizeof(bh));
+    bh.magic = ENQCAP_BLOCK_MAGIC;
+    bh.payload_len = (uint32_t)w->block_len;
+    bh.records = w->block_records;
+    bh.seq = w->seq++;
+    bh.first_ns = w->block_first_ns;
+    bh.last_ns = w->block_last_ns;
+    memcpy(w->block, &bh, sizeof(bh));
+
+    // ヘッダーとレコードを1回の write() で出す (途中で止まっても壊れるのは末尾だけ)
+    int rc = write_all(w, w->block, sizeof(bh) + w->block_len);
+    w->block_len = 0;
+    w->block_records = 0;
+    return rc;
+}
+
+int enqcap_writer_append(enqcap_writer_t *w, uint64_t t_ns, uint16_t port,
+                         const void *data, size_t len) {
+    if (w->failed) return -1;
+    size_t need = sizeof(enqcap_record_header_t) + len;
+    if (need > ENQCAP_BLOCK_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (w->block_len + need > ENQCAP_BLOCK_MAX && enqcap_writer_flush(w, 0, 0) < 0) return -1;
+
+    enqcap_record_header_t rh = { .t_ns = t_ns, .port = port, .len = (uint16_t)len };
+    uint8_t *p = w->block + sizeof(enqcap_block_header_t) + w->block_len;
+    memcpy(p, &rh, sizeof(rh));
+    memcpy(p + sizeof(rh), data, len);
+    w->block_len += need;
+    if (w->block_records++ == 0) w->block_first_ns = t_ns;
+    w->block_last_ns = t_ns;
+    w->records++;
+    w->bytes += len;
+    return 0;
+}
+
+int enqcap_writer_close(enqcap_writer_t *w) {
+    if (w->fd < 0) return -1;
+    int rc = enqcap_writer_flush(w, 0, 0);
+    // 索引が溢れたら書かない (読む側はブロックを辿り直す)
+    if (rc == 0 && !w->index_full) {
+        enqcap_trailer_t tr;
+        memset(&tr, 0, sizeof(tr));
+        memcpy(tr.magic, ENQCAP_INDEX_MAGIC, 8);
+        tr.count = w->index_len;
+        tr.index_offset = w->file_off;
+        rc = write_all(w, w->index.base, w->index_len * sizeof(enqcap_index_entry_t));
+        if (rc == 0) rc = write_all(w, &tr, sizeof(tr));
+    }
+    if (close(w->fd) < 0) rc = -1;
+    w->fd = -1;
+    enq_arena_destroy(&w->index);
+    return rc;
+}
+
+int enqcap_open_mapped(enqcap_reader_t *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    if (!enqcap_reader_init(r, base, (size_t)st.st_size)) {
+        munmap(base, (size_t)st.st_size);
+        memset(r, 0, sizeof(*r));
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void enqcap_close_mapped(enqcap_reader_t *r) {
+    if (r->base) munmap((void *)r->base, r->size);
+    enqcap_reader_free(r);
+    r->base = NULL;
+    r->size = 0;
+}
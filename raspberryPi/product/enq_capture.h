@@ -0,0 +1,51 @@
+// enq_capture.h
+// キャプチャファイルの書き込みとメモリマップ読み出し (POSIX)
+// 形式は enq_capture_format.h を参照。
+
+#ifndef ENQ_CAPTURE_H
+#define ENQ_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "enq_arena.h"
+#include "enq_capture_format.h"
+
+// 索引に載せるブロック数の上限 (1秒ごとの確定で約12日分)。索引の領域は開くときに
+// アドレス空間だけ予約する (enq_arena.h)。超えたら索引を書かずに閉じ、読む側が
+// ブロックを辿り直す
+#define ENQCAP_INDEX_MAX (1u << 20)
+
+typedef struct {
+    int fd;
+    uint64_t file_off;           // 次に書く位置
+    uint64_t seq;
+    uint8_t  block[sizeof(enqcap_block_header_t) + ENQCAP_BLOCK_MAX];
+    size_t   block_len;          // レコード部の使用量
+    uint32_t block_records;
+    uint64_t block_first_ns;
+    uint64_t block_last_ns;
+    enq_arena_t index;           // 書き出したブロック (終了時に索引として追記)
+    size_t   index_len;
+    int      index_full;         // ENQCAP_INDEX_MAX を超えた (索引は書かない)
+    uint64_t records;
+    uint64_t bytes;              // レコードのデータ部の合計
+    int      failed;             // 書き込みエラー後は何もしない
+} enqcap_writer_t;
+
+// 新規作成 (既存ファイルは上書き)。戻り値: 成功 0 / 失敗 -1 (errno)
+int  enqcap_writer_open(enqcap_writer_t *w, const char *path,
+                        const char *const *port_names, size_t port_count);
+int  enqcap_writer_append(enqcap_writer_t *w, uint64_t t_ns, uint16_t port,
+                          const void *data, size_t len);
+// 書きかけのブロックを確定する。age_ns 以上前に始まったブロックだけ
+// 確定するには now_ns と age_ns を指定する (age_ns == 0 なら常に確定)
+int  enqcap_writer_flush(enqcap_writer_t *w, uint64_t now_ns, uint64_t age_ns);
+// ブロックを確定し、索引を追記して閉じる
+int  enqcap_writer_close(enqcap_writer_t *w);
+
+// 読み出し用にファイル全体を読み取り専用でマップする
+int  enqcap_open_mapped(enqcap_reader_t *r, const char *path);
+void enqcap_close_mapped(enqcap_reader_t *r);
+
+#endif // ENQ_CAPTURE_H
@@ -0,0 +1,253 @@
+// enq_capture_format.h
+// シリアル受信キャプチャのバイナリ形式と読み出し (ヘッダーのみ)
+//
+// モニター (serial_debug_test capture) が書き、シミュレーター (elevator_enq_sim replay)
+// と解析ツールが読む。ファイルは追記のみで、途中で止まっても最後の不完全な
+// ブロック以外は読める。数値はすべてリトルエンディアン (x86 / ARM とも LE)。
+//
+//   ファイルヘッダー  enqcap_file_header_t + ポート名 (ENQCAP_PORT_NAME_LEN x port_count)
+//   ブロック         enqcap_block_header_t + レコード列 (payload_len バイト)
+//   ...
+//   索引 (正常終了時) enqcap_index_entry_t x count + enqcap_trailer_t
+//
+//   レコード         enqcap_record_header_t + data[len]
+//
+// 時刻は記録側の CLOCK_MONOTONIC (ns)。索引がなければブロックヘッダーを
+// payload_len で辿って作り直す (バイト単位の走査は不要)。
+// 読み出し側はファイル全体をメモリマップして使う。ここの関数は
+// マップ済みの領域だけを扱い、OS 依存の処理は含まない。
+
+#ifndef ENQ_CAPTURE_FORMAT_H
+#define ENQ_CAPTURE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENQCAP_MAGIC          "ENQCAP01"
+#define ENQCAP_INDEX_MAGIC    "ENQIDX01"
+#define ENQCAP_VERSION        1
+#define ENQCAP_BLOCK_MAGIC    0x4B4C4245u  // "EBLK"
+#define ENQCAP_BLOCK_MAX      65536        // ブロックのレコード部の上限
+#define ENQCAP_PORT_NAME_LEN  32
+#define ENQCAP_MAX_PORTS      64
+
+typedef struct {
+    char     magic[8];           // ENQCAP_MAGIC
+    uint16_t version;
+    uint16_t port_count;
+    uint32_t header_size;        // ポート名を含むヘッダー全体 (最初のブロックの位置)
+    uint64_t start_realtime_ns;  // 記録開始時の実時刻 (表示用)
+    uint64_t start_mono_ns;      // 同時刻の CLOCK_MONOTONIC
+} enqcap_file_header_t;
+
+typedef struct {
+    uint32_t magic;              // ENQCAP_BLOCK_MAGIC
+    uint32_t payload_len;
+    uint32_t records;
+    uint32_t reserved;
+    uint64_t seq;                // 0 から連番
+    uint64_t first_ns;           // 最初のレコードの時刻
+    uint64_t last_ns;            // 最後のレコードの時刻
+} enqcap_block_header_t;
+
+typedef struct {
+    uint64_t t_ns;
+    uint16_t port;               // ヘッダーのポート名の番号
+    uint16_t len;
+    uint32_t reserved;
+} enqcap_record_header_t;
+
+typedef struct {
+    uint64_t offset;             // ブロックヘッダーのファイル内位置
+    uint64_t first_ns;
+    uint64_t last_ns;
+} enqcap_index_entry_t;
+
+typedef struct {
+    char     magic[8];           // ENQCAP_INDEX_MAGIC
+    uint64_t count;
+    uint64_t index_offset;
+} enqcap_trailer_t;
+
+// ---- 読み出し ----
+
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+    enqcap_file_header_t hdr;
+    enqcap_index_entry_t *blocks;  // 時刻順のブロック一覧 (malloc)
+    size_t num_blocks;
+    int indexed;                   // 索引から読めたら 1、辿り直したら 0
+    int truncated;                 // 末尾に不完全なブロックがあった
+} enqcap_reader_t;
+
+typedef struct {
+    uint64_t t_ns;
+    uint16_t port;
+    uint16_t len;
+    const uint8_t *data;           // マップ領域を直接指す
+} enqcap_record_t;
+
+typedef struct {
+    const enqcap_reader_t *r;
+    size_t block;                  // 現在のブロック番号
+    size_t off;                    // 次のレコードの位置
+    size_t end;                    // 現在のブロックの終端
+} enqcap_cursor_t;
+
+// ポート名 (ヘッダーの後ろに並ぶ)。範囲外なら NULL
+static inline const char *enqcap_port_name(const enqcap_reader_t *r, unsigned port) {
+    if (port >= r->hdr.port_count) return NULL;
+    return (const char *)r->base + sizeof(enqcap_file_header_t) + port * ENQCAP_PORT_NAME_LEN;
+}
+
+// 正常終了時の索引を読む。索引やブロックの位置がファイルに収まらなければ 0
+// (呼び出し側はブロックヘッダーを辿り直す)
+static inline int enqcap_load_index(enqcap_reader_t *r) {
+    enqcap_trailer_t tr;
+    if (r->size < r->hdr.header_size + sizeof(tr)) return 0;
+    memcpy(&tr, r->base + r->size - sizeof(tr), sizeof(tr));
+    if (memcmp(tr.magic, ENQCAP_INDEX_MAGIC, 8) != 0) return 0;
+    if (tr.index_offset < r->hdr.header_size || tr.index_offset > r->size - sizeof(tr) ||
+        tr.count > (r->size - sizeof(tr) - tr.index_offset) / sizeof(enqcap_index_entry_t))
+        return 0;
+    r->blocks = malloc((tr.count ? tr.count : 1) * sizeof(enqcap_index_entry_t));
+    if (r->blocks == NULL) return 0;
+    memcpy(r->blocks, r->base + tr.index_offset, tr.count * sizeof(enqcap_index_entry_t));
+    // ブロックは索引より前に収まっていなければならない
+    uint64_t i = 0;
+    for (; i < tr.count; i++) {
+        uint64_t off = r->blocks[i].offset;
+        enqcap_block_header_t bh;
+        if (off < r->hdr.header_size || off > tr.index_offset ||
+            tr.index_offset - off < sizeof(bh))
+            break;
+        memcpy(&bh, r->base + off, sizeof(bh));
+        if (bh.magic != ENQCAP_BLOCK_MAGIC || bh.payload_len > ENQCAP_BLOCK_MAX ||
+            bh.payload_len > tr.index_offset - off - sizeof(bh))
+            break;
+    }
+    if (i < tr.count) {
+        free(r->blocks);
+        r->blocks = NULL;
+        return 0;
+    }
+    r->num_blocks = tr.count;
+    return 1;
+}
+
+// 索引がないとき (記録中・異常終了) はブロックヘッダーを辿る
+static inline int enqcap_scan_blocks(enqcap_reader_t *r) {
+    size_t cap = 64, n = 0;
+    enqcap_index_entry_t *v = malloc(cap * sizeof(*v));
+    if (v == NULL) return 0;
+    size_t off = r->hdr.header_size;
+    while (off + sizeof(enqcap_block_header_t) <= r->size) {
+        enqcap_block_header_t bh;
+        memcpy(&bh, r->base + off, sizeof(bh));
+        if (bh.magic != ENQCAP_BLOCK_MAGIC) break;  // 索引または壊れた末尾
+        if (bh.payload_len > ENQCAP_BLOCK_MAX ||
+            off + sizeof(bh) + bh.payload_len > r->size) {
+            r->truncated = 1;
+            break;
+        }
+        if (n == cap) {
+            enqcap_index_entry_t *nv = realloc(v, cap * 2 * sizeof(*v));
+            if (nv == NULL) { free(v); return 0; }
+            v = nv;
+            cap *= 2;
+        }
+        v[n].offset = off;
+        v[n].first_ns = bh.first_ns;
+        v[n].last_ns = bh.last_ns;
+        n++;
+        off += sizeof(bh) + bh.payload_len;
+    }
+    r->blocks = v;
+    r->num_blocks = n;
+    return 1;
+}
+
+// マップ済みの領域を検証して索引を用意する。戻り値: 成功なら 1
+static inline int enqcap_reader_init(enqcap_reader_t *r, const void *base, size_t size) {
+    memset(r, 0, sizeof(*r));
+    r->base = base;
+    r->size = size;
+    if (size < sizeof(enqcap_file_header_t)) return 0;
+    memcpy(&r->hdr, base, sizeof(r->hdr));
+    if (memcmp(r->hdr.magic, ENQCAP_MAGIC, 8) != 0 || r->hdr.version != ENQCAP_VERSION ||
+        r->hdr.port_count > ENQCAP_MAX_PORTS || r->hdr.header_size > size ||
+        r->hdr.header_size < sizeof(enqcap_file_header_t) +
+                             (size_t)r->hdr.port_count * ENQCAP_PORT_NAME_LEN)
+        return 0;
+    r->indexed = enqcap_load_index(r);
+    return r->indexed || enqcap_scan_blocks(r);
+}
+
+static inline void enqcap_reader_free(enqcap_reader_t *r) {
+    free(r->blocks);
+    r->blocks = NULL;
+    r->num_blocks = 0;
+}
+
+// 全体の時刻範囲。ブロックがなければ 0
+static inline int enqcap_time_range(const enqcap_reader_t *r, uint64_t *first, uint64_t *last) {
+    if (r->num_blocks == 0) return 0;
+    *first = r->blocks[0].first_ns;
+    *last = r->blocks[r->num_blocks - 1].last_ns;
+    return 1;
+}
+
+static inline void enqcap_cursor_enter(enqcap_cursor_t *c, size_t block) {
+    c->block = block;
+    if (block >= c->r->num_blocks) {
+        c->off = c->end = 0;
+        return;
+    }
+    enqcap_block_header_t bh;
+    memcpy(&bh, c->r->base + c->r->blocks[block].offset, sizeof(bh));
+    c->off = (size_t)c->r->blocks[block].offset + sizeof(bh);
+    c->end = c->off + bh.payload_len;
+}
+
+// t_ns 以降の最初のレコードに位置付ける (ブロック索引の二分探索 + ブロック内走査)
+static inline void enqcap_cursor_seek(enqcap_cursor_t *c, const enqcap_reader_t *r, uint64_t t_ns) {
+    c->r = r;
+    size_t lo = 0, hi = r->num_blocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->blocks[mid].last_ns < t_ns) lo = mid + 1;
+        else hi = mid;
+    }
+    enqcap_cursor_enter(c, lo);
+    while (c->off + sizeof(enqcap_record_header_t) <= c->end) {
+        enqcap_record_header_t rh;
+        memcpy(&rh, r->base + c->off, sizeof(rh));
+        if (rh.t_ns >= t_ns) break;
+        c->off += sizeof(rh) + rh.len;
+    }
+}
+
+// 次のレコード。終端なら 0
+static inline int enqcap_next(enqcap_cursor_t *c, enqcap_record_t *out) {
+    for (;;) {
+        if (c->block >= c->r->num_blocks) return 0;
+        if (c->off + sizeof(enqcap_record_header_t) <= c->end) {
+            enqcap_record_header_t rh;
+            memcpy(&rh, c->r->base + c->off, sizeof(rh));
+            if (c->off + sizeof(rh) + rh.len <= c->end) {
+                out->t_ns = rh.t_ns;
+                out->port = rh.port;
+                out->len = rh.len;
+                out->data = c->r->base + c->off + sizeof(rh);
+                c->off += sizeof(rh) + rh.len;
+                return 1;
+            }
+        }
+        enqcap_cursor_enter(c, c->block + 1);
+    }
+}
+
+#endif // ENQ_CAPTURE_FORMAT_H
@@ -0,0 +1,284 @@
+// enq_events.c
+// デコード済みイベントの列形式ファイルの書き込みとメモリマップ読み出し (POSIX)
+
+#include "enq_events.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 全量を書く (短い書き込みは続きを書く)
+static int write_all(enqevt_writer_t *w, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(w->fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            w->failed = 1;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        w->file_off += (uint64_t)n;
+    }
+    return 0;
+}
+
+static uint64_t pack_key(uint16_t port, uint16_t station, uint16_t data_num) {
+    return ((uint64_t)port << 32 | (uint64_t)station << 16 | data_num) + 1;
+}
+
+static uint32_t hash_key(uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 40);
+}
+
+// 列のビット書き込み (下位ビットから詰める)
+typedef struct {
+    uint8_t *p;
+    size_t len;
+    uint64_t acc;
+    unsigned n;
+} bit_writer_t;
+
+static void bits_put(bit_writer_t *b, uint32_t v, unsigned n) {
+    b->acc |= (uint64_t)v << b->n;
+    b->n += n;
+    while (b->n >= 8) {
+        b->p[b->len++] = (uint8_t)b->acc;
+        b->acc >>= 8;
+        b->n -= 8;
+    }
+}
+
+static size_t bits_end(bit_writer_t *b) {
+    if (b->n) b->p[b->len++] = (uint8_t)b->acc;
+    b->acc = 0;
+    b->n = 0;
+    return b->len;
+}
+
+int enqevt_writer_open(enqevt_writer_t *w, const char *path,
+                       const char *const *port_names, size_t port_count) {
+    memset(w, 0, sizeof(*w));
+    if (port_count > ENQEVT_MAX_PORTS) port_count = ENQEVT_MAX_PORTS;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (w->fd < 0) return -1;
+    if (enq_arena_init(&w->index, ENQEVT_INDEX_MAX * sizeof(enqevt_index_entry_t)) < 0) goto fail;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    enqevt_file_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, ENQEVT_MAGIC, 8);
+    hdr.version = ENQEVT_VERSION;
+    hdr.port_count = (uint16_t)port_count;
+    hdr.header_size = (uint32_t)(sizeof(hdr) + port_count * ENQEVT_PORT_NAME_LEN);
+    hdr.start_realtime_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    hdr.tick_ns = ENQEVT_TICK_NS;
+
+    if (write_all(w, &hdr, sizeof(hdr)) < 0) goto fail;
+    for (size_t i = 0; i < port_count; i++) {
+        char name[ENQEVT_PORT_NAME_LEN] = {0};
+        strncpy(name, port_names[i], sizeof(name) - 1);
+        if (write_all(w, name, sizeof(name)) < 0) goto fail;
+    }
+    return 0;
+
+fail:
+    {
+        int e = errno;
+        enq_arena_destroy(&w->index);
+        close(w->fd);
+        w->fd = -1;
+        errno = e;
+    }
+    return -1;
+}
+
+int enqevt_writer_flush(enqevt_writer_t *w, uint64_t now_ns, uint64_t age_ns) {
+    if (w->failed) return -1;
+    uint32_t n = w->block_events;
+    if (n == 0) return 0;
+    if (age_ns != 0 && now_ns - w->block_first_ns < age_ns) return 0;
+
+
+    // 行を列に並べ直す。値は鍵ごとに直前との差にして、鍵ごとの最大幅を辞書に入れる
+    uint16_t *zz = w->col_value;
+    uint16_t prev[ENQEVT_DICT_MAX];
+    memset(prev, 0, w->dict_len * sizeof(prev[0]));
+    for (uint16_t k = 0; k < w->dict_len; k++) w->dict[k].value_bits = 0;
+    uint64_t max_delta = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint16_t k = w->row_key[i];
+        zz[i] = enqevt_zigzag(prev[k], w->row_value[i]);
+        prev[k] = w->row_value[i];
+        unsigned bits = enqevt_bit_width(zz[i]);
+        if (bits > w->dict[k].value_bits) w->dict[k].value_bits = (uint8_t)bits;
+        if (i > 0 && w->row_tick[i] - w->row_tick[i - 1] > max_delta)
+            max_delta = w->row_tick[i] - w->row_tick[i - 1];
+    }
+
+    enqevt_block_header_t bh;
+    memset(&bh, 0, sizeof(bh));
+    bh.magic = ENQEVT_BLOCK_MAGIC;
+    bh.count = n;
+    bh.dict_len = w->dict_len;
+    bh.ts_bits = (uint8_t)enqevt_bit_width((uint32_t)max_delta);  // append で32ビット以内に分けてある
+    bh.key_bits = (uint8_t)enqevt_bit_width(w->dict_len > 1 ? w->dict_len - 1u : 0u);
+    bh.seq = w->seq++;
+    bh.first_ns = w->row_tick[0] * ENQEVT_TICK_NS;
+    bh.last_ns = w->row_tick[n - 1] * ENQEVT_TICK_NS;
+
+    uint8_t *payload = w->out + sizeof(bh);
+    bh.ts_off = (uint32_t)(w->dict_len * sizeof(enqevt_dict_entry_t));
+    memcpy(payload, w->dict, bh.ts_off);
+    bit_writer_t b = { .p = payload, .len = bh.ts_off };
+    for (uint32_t i = 0; i < n; i++)
+        bits_put(&b, i ? (uint32_t)(w->row_tick[i] - w->row_tick[i - 1]) : 0, bh.ts_bits);
+    bh.key_off = (uint32_t)bits_end(&b);
+    for (uint32_t i = 0; i < n; i++) bits_put(&b, w->row_key[i], bh.key_bits);
+    bh.value_off = (uint32_t)bits_end(&b);
+    for (uint32_t i = 0; i < n; i++) bits_put(&b, zz[i], w->dict[w->row_key[i]].value_bits);
+    bh.payload_len = (uint32_t)bits_end(&b);
+    memcpy(w->out, &bh, sizeof(bh));
+
+    // 索引は直前の項目の続きに確保するので配列として伸びる
+    enqevt_index_entry_t *e = w->index_full ? NULL :
+        enq_arena_alloc(&w->index, sizeof(*e), _Alignof(enqevt_index_entry_t));
+    if (e) {
+        e->offset = w->file_off;
+        e->first_ns = bh.first_ns;
+        e->last_ns = bh.last_ns;
+        e->count = n;
+        e->reserved = 0;
+        w->index_len++;
+    } else {
+        w->index_full = 1;
+    }
+
+    // ヘッダーと列を1回の write() で出す (途中で止まっても壊れるのは末尾だけ)
+    int rc = write_all(w, w->out, sizeof(bh) + bh.payload_len);
+    w->block_bytes += sizeof(bh) + bh.payload_len;
+    w->block_events = 0;
+    w->dict_len = 0;
+    memset(w->dict_slot, 0, sizeof(w->dict_slot));
+    return rc;
+}
+
+// ブロックの辞書の番号 (なければ追加する)。辞書が一杯なら -1
+static int dict_lookup(enqevt_writer_t *w, uint64_t key, uint16_t port,
+                       uint16_t station, uint16_t data_num) {
+    const uint32_t mask = ENQEVT_DICT_MAX * 2 - 1;
+    for (uint32_t h = hash_key(key) & mask;; h = (h + 1) & mask) {
+        uint16_t slot = w->dict_slot[h];
+        if (slot == 0) {
+            if (w->dict_len == ENQEVT_DICT_MAX) return -1;
+            w->dict[w->dict_len] = (enqevt_dict_entry_t){
+                .port = port, .station = station, .data_num = data_num };
+            w->dict_slot[h] = ++w->dict_len;
+            return w->dict_len - 1;
+        }
+        const enqevt_dict_entry_t *d = &w->dict[slot - 1];
+        if (d->port == port && d->station == station && d->data_num == data_num) return slot - 1;
+    }
+}
+
+int enqevt_writer_append(enqevt_writer_t *w, uint64_t t_ns, uint16_t port,
+                         uint16_t station, uint16_t data_num, uint16_t value) {
+    if (w->failed) return -1;
+
+    // 鍵ごとの最後の値と比べる (表が一杯なら比べずに書く)
+    uint64_t key = pack_key(port, station, data_num);
+    enqevt_last_t *last = NULL;
+    for (uint32_t h = hash_key(key) & (ENQEVT_LAST_SLOTS - 1), probes = 0;
+         probes < ENQEVT_LAST_SLOTS; h = (h + 1) & (ENQEVT_LAST_SLOTS - 1), probes++) {
+        if (w->last[h].key == key || w->last[h].key == 0) {
+            last = &w->last[h];
+            break;
+        }
+    }
+    if (last && last->key == key && last->value == value) {
+        w->unchanged++;
+        return 0;
+    }
+
+    // 実時刻が戻っても (NTP の補正など) 時刻列は単調に保つ
+    uint64_t tick = t_ns / ENQEVT_TICK_NS;
+    if (tick < w->last_tick) tick = w->last_tick;
+    // 時刻差が32ビットに収まらない (約50日の空白) ときは、そこでブロックを分ける
+    if (w->block_events > 0 && tick - w->row_tick[w->block_events - 1] > UINT32_MAX &&
+        enqevt_writer_flush(w, 0, 0) < 0)
+        return -1;
+
+    int k = w->block_events < ENQEVT_BLOCK_EVENTS ? dict_lookup(w, key, port, station, data_num) : -1;
+    if (k < 0) {
+        if (enqevt_writer_flush(w, 0, 0) < 0) return -1;
+        k = dict_lookup(w, key, port, station, data_num);
+    }
+    if (w->block_events == 0) w->block_first_ns = t_ns;
+    w->row_tick[w->block_events] = tick;
+    w->row_key[w->block_events] = (uint16_t)k;
+    w->row_value[w->block_events] = value;
+    w->block_events++;
+    w->last_tick = tick;
+    w->events++;
+    if (last) {
+        last->key = key;
+        last->value = value;
+    }
+    return 1;
+}
+
+int enqevt_writer_close(enqevt_writer_t *w) {
+    if (w->fd < 0) return -1;
+    int rc = enqevt_writer_flush(w, 0, 0);
+    // 索引が溢れたら書かない (読む側はブロックを辿り直す)
+    if (rc == 0 && !w->index_full) {
+        enqevt_trailer_t tr;
+        memset(&tr, 0, sizeof(tr));
+        memcpy(tr.magic, ENQEVT_INDEX_MAGIC, 8);
+        tr.count = w->index_len;
+        tr.index_offset = w->file_off;
+        rc = write_all(w, w->index.base, w->index_len * sizeof(enqevt_index_entry_t));
+        if (rc == 0) rc = write_all(w, &tr, sizeof(tr));
+    }
+    if (close(w->fd) < 0) rc = -1;
+    w->fd = -1;
+    enq_arena_destroy(&w->index);
+    return rc;
+}
+
+int enqevt_open_mapped(enqevt_reader_t *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    if (!enqevt_reader_init(r, base, (size_t)st.st_size)) {
+        munmap(base, (size_t)st.st_size);
+        memset(r, 0, sizeof(*r));
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void enqevt_close_mapped(enqevt_reader_t *r) {
+    if (r->base) munmap((void *)r->base, r->size);
+    enqevt_reader_free(r);
+    r->base = NULL;
+    r->size = 0;
+}
@@ -0,0 +1,68 @@
+// enq_events.h
+// デコード済みイベントの列形式ファイルの書き込みとメモリマップ読み出し (POSIX)
+// 形式は enq_events_format.h を参照。
+
+#ifndef ENQ_EVENTS_H
+#define ENQ_EVENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "enq_arena.h"
+#include "enq_events_format.h"
+
+#define ENQEVT_LAST_SLOTS 8192  // 鍵ごとの最後の値の表 (2のべき乗)
+// 索引に載せるブロック数の上限 (5分ごとの確定で約7か月分)。索引の領域は開くときに
+// アドレス空間だけ予約する (enq_arena.h)。超えたら索引を書かずに閉じ、読む側が
+// ブロックを辿り直す
+#define ENQEVT_INDEX_MAX (1u << 16)
+
+typedef struct {
+    uint64_t key;                // (ポート, 局番号, データ番号) + 1。0 なら空き
+    uint16_t value;
+} enqevt_last_t;
+
+typedef struct {
+    int fd;
+    uint64_t file_off;           // 次に書く位置
+    uint64_t seq;
+    // 書きかけのブロック (行として溜め、確定時に列に並べ直す)
+    uint64_t row_tick[ENQEVT_BLOCK_EVENTS];
+    uint16_t row_key[ENQEVT_BLOCK_EVENTS];   // 辞書の番号
+    uint16_t row_value[ENQEVT_BLOCK_EVENTS];
+    uint16_t col_value[ENQEVT_BLOCK_EVENTS]; // 確定時の値列 (鍵ごとの差の zigzag)
+    uint32_t block_events;
+    enqevt_dict_entry_t dict[ENQEVT_DICT_MAX];
+    uint16_t dict_len;
+    uint16_t dict_slot[ENQEVT_DICT_MAX * 2]; // 辞書の探索表 (番号 + 1、0 なら空き)
+    uint64_t block_first_ns;     // 確定判定用 (append に渡された時刻)
+    uint64_t last_tick;          // 時刻を単調に保つ
+    enqevt_last_t last[ENQEVT_LAST_SLOTS];
+    uint8_t  out[sizeof(enqevt_block_header_t) + ENQEVT_PAYLOAD_MAX];
+    enq_arena_t index;           // 書き出したブロック (終了時に索引として追記)
+    size_t   index_len;
+    int      index_full;         // ENQEVT_INDEX_MAX を超えた (索引は書かない)
+    uint64_t events;             // 書いたイベント数
+    uint64_t unchanged;          // 値が変わらず書かなかった数
+    uint64_t block_bytes;        // ブロック (ヘッダー込み) の合計
+    int      failed;             // 書き込みエラー後は何もしない
+} enqevt_writer_t;
+
+// 新規作成 (既存ファイルは上書き)。戻り値: 成功 0 / 失敗 -1 (errno)
+int  enqevt_writer_open(enqevt_writer_t *w, const char *path,
+                        const char *const *port_names, size_t port_count);
+// イベントを1つ追加する。t_ns は実時刻。同じ鍵の直前の値と同じなら書かない
+// (パーサーの重複抑制の再通知もここで落ちる)。戻り値: 追加 1 / 変化なし 0 / 失敗 -1
+int  enqevt_writer_append(enqevt_writer_t *w, uint64_t t_ns, uint16_t port,
+                          uint16_t station, uint16_t data_num, uint16_t value);
+// 書きかけのブロックを確定する。age_ns 以上前に始まったブロックだけ
+// 確定するには now_ns と age_ns を指定する (age_ns == 0 なら常に確定)
+int  enqevt_writer_flush(enqevt_writer_t *w, uint64_t now_ns, uint64_t age_ns);
+// ブロックを確定し、索引を追記して閉じる
+int  enqevt_writer_close(enqevt_writer_t *w);
+
+// 読み出し用にファイル全体を読み取り専用でマップする
+int  enqevt_open_mapped(enqevt_reader_t *r, const char *path);
+void enqevt_close_mapped(enqevt_reader_t *r);
+
+#endif // ENQ_EVENTS_H
@@ -0,0 +1,296 @@
+// enq_events_format.h
+// デコード済みイベントの列形式ファイルと読み出し (ヘッダーのみ)
+//
+// モニター (serial_debug_test publish -events) が重複抑制後の状態変化を書き、
+// enq_events_query が時刻範囲で読む。キャプチャ (enq_capture_format.h) が受信バイトを
+// そのまま残すのに対し、こちらは (時刻, ポート, 局番号, データ番号, 値) だけを
+// 列ごとに詰めて長期間の履歴を小さく保つ。ポートの切断と開き直しは、欠落区間の両端を
+// 回線の断・復帰 (局番号 ENQ_LINK_STATION、enq_parser.h) のイベントとして書く。
+// 配置はキャプチャと同じで、途中で止まっても最後の不完全なブロック以外は読める。
+// 数値はすべてリトルエンディアン。
+//
+//   ファイルヘッダー  enqevt_file_header_t + ポート名 (ENQEVT_PORT_NAME_LEN x port_count)
+//   ブロック         enqevt_block_header_t + payload_len バイト
+//   ...
+//   索引 (正常終了時) enqevt_index_entry_t x count + enqevt_trailer_t
+//
+// ブロックの中身 (payload) は次の順に並ぶ。各列はバイト境界から始まり、
+// ビット列は下位ビットから詰める。ブロックは単独でデコードできる。
+//
+//   辞書     enqevt_dict_entry_t x dict_len。ブロック内に現れた (ポート, 局番号,
+//            データ番号) の組
+//   時刻列   直前のイベントとの差 (tick 単位、最初は 0) を ts_bits ビットずつ
+//   鍵列     辞書の番号を key_bits ビットずつ
+//   値列     同じ鍵の直前の値との差 (16ビットで折り返し、zigzag 符号化、ブロック内の
+//            最初は 0 との差) を、その鍵の辞書項目の value_bits ビットずつ
+//
+// 階 (B1F = 0xFFFF を含む) は隣の階との差が ±1〜2 なので2〜3ビット、荷重は変化幅の
+// ぶんだけになる。時刻は実時刻 (ns) を tick_ns (既定 1ms) に丸めて持ち、ブロックヘッダーと
+// 索引の first_ns / last_ns で時刻範囲の問い合わせが必要なブロックだけを開く。
+
+#ifndef ENQ_EVENTS_FORMAT_H
+#define ENQ_EVENTS_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENQEVT_MAGIC          "ENQEVT01"
+#define ENQEVT_INDEX_MAGIC    "EVTIDX01"
+#define ENQEVT_VERSION        1
+#define ENQEVT_BLOCK_MAGIC    0x4B425645u  // "EVBK"
+#define ENQEVT_BLOCK_EVENTS   4096         // ブロックあたりのイベントの上限
+#define ENQEVT_DICT_MAX       1024         // ブロックあたりの鍵の上限
+#define ENQEVT_TICK_NS        1000000u     // 時刻の単位 (1ms)
+#define ENQEVT_PORT_NAME_LEN  32
+#define ENQEVT_MAX_PORTS      64
+
+typedef struct {
+    char     magic[8];           // ENQEVT_MAGIC
+    uint16_t version;
+    uint16_t port_count;
+    uint32_t header_size;        // ポート名を含むヘッダー全体 (最初のブロックの位置)
+    uint64_t start_realtime_ns;  // 記録開始時の実時刻
+    uint32_t tick_ns;            // 時刻列の単位
+    uint32_t reserved;
+} enqevt_file_header_t;
+
+typedef struct {
+    uint32_t magic;              // ENQEVT_BLOCK_MAGIC
+    uint32_t payload_len;
+    uint32_t count;              // イベント数
+    uint16_t dict_len;
+    uint8_t  ts_bits;            // 時刻列の幅
+    uint8_t  key_bits;           // 鍵列の幅
+    uint32_t ts_off;             // payload 内の各列の位置 (辞書は先頭)
+    uint32_t key_off;
+    uint32_t value_off;
+    uint32_t reserved;
+    uint64_t seq;                // 0 から連番
+    uint64_t first_ns;           // 最初のイベントの実時刻 (tick に丸め済み)
+    uint64_t last_ns;            // 最後のイベントの実時刻
+} enqevt_block_header_t;
+
+typedef struct {
+    uint16_t port;               // ヘッダーのポート名の番号
+    uint16_t station;
+    uint16_t data_num;
+    uint8_t  value_bits;         // この鍵の値列の幅 (0 なら値の差はすべて 0)
+    uint8_t  reserved;
+} enqevt_dict_entry_t;
+
+typedef struct {
+    uint64_t offset;             // ブロックヘッダーのファイル内位置
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint32_t count;
+    uint32_t reserved;
+} enqevt_index_entry_t;
+
+typedef struct {
+    char     magic[8];           // ENQEVT_INDEX_MAGIC
+    uint64_t count;
+    uint64_t index_offset;
+} enqevt_trailer_t;
+
+// 列の大きさの上限 (時刻差は32ビット、値は16ビット)
+#define ENQEVT_PAYLOAD_MAX \
+    (ENQEVT_DICT_MAX * sizeof(enqevt_dict_entry_t) + ENQEVT_BLOCK_EVENTS * (4 + 2 + 2) + 8)
+
+// 16ビットの差の zigzag 符号化 (小さい負の差も小さい値にする)
+static inline uint16_t enqevt_zigzag(uint16_t prev, uint16_t value) {
+    int16_t d = (int16_t)(uint16_t)(value - prev);
+    return (uint16_t)(((uint16_t)d << 1) ^ (uint16_t)(d >> 15));
+}
+
+static inline uint16_t enqevt_unzigzag(uint16_t prev, uint16_t z) {
+    uint16_t d = (uint16_t)((z >> 1) ^ (uint16_t)-(int)(z & 1));
+    return (uint16_t)(prev + d);
+}
+
+// v を表すのに要るビット数 (0 なら 0)
+static inline unsigned enqevt_bit_width(uint32_t v) {
+    unsigned n = 0;
+    while (v) {
+        n++;
+        v >>= 1;
+    }
+    return n;
+}
+
+// ---- 読み出し ----
+
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+    enqevt_file_header_t hdr;
+    enqevt_index_entry_t *blocks;  // 時刻順のブロック一覧 (malloc)
+    size_t num_blocks;
+    int indexed;                   // 索引から読めたら 1、辿り直したら 0
+    int truncated;                 // 末尾に不完全なブロックがあった
+} enqevt_reader_t;
+
+typedef struct {
+    uint64_t t_ns;                 // 実時刻 (tick に丸め済み)
+    uint16_t port;
+    uint16_t station;
+    uint16_t data_num;
+    uint16_t value;
+} enqevt_event_t;
+
+// 列のビット読み出し (範囲外は 0 として読む。長さは呼び出し前に検証する)
+typedef struct {
+    const uint8_t *p;
+    size_t len;
+    uint64_t pos;                  // ビット位置
+} enqevt_bits_t;
+
+static inline uint32_t enqevt_bits_get(enqevt_bits_t *b, unsigned n) {
+    if (n == 0) return 0;
+    size_t byte = (size_t)(b->pos >> 3);
+    unsigned shift = (unsigned)(b->pos & 7);
+    uint64_t v = 0;
+    for (unsigned i = 0; i < 5 && byte + i < b->len; i++) v |= (uint64_t)b->p[byte + i] << (8 * i);
+    b->pos += n;
+    return (uint32_t)((v >> shift) & ((1ull << n) - 1));
+}
+
+// ポート名 (ヘッダーの後ろに並ぶ)。範囲外なら NULL
+static inline const char *enqevt_port_name(const enqevt_reader_t *r, unsigned port) {
+    if (port >= r->hdr.port_count) return NULL;
+    return (const char *)r->base + sizeof(enqevt_file_header_t) + port * ENQEVT_PORT_NAME_LEN;
+}
+
+// 正常終了時の索引を読む
+static inline int enqevt_load_index(enqevt_reader_t *r) {
+    enqevt_trailer_t tr;
+    if (r->size < r->hdr.header_size + sizeof(tr)) return 0;
+    memcpy(&tr, r->base + r->size - sizeof(tr), sizeof(tr));
+    if (memcmp(tr.magic, ENQEVT_INDEX_MAGIC, 8) != 0) return 0;
+    if (tr.index_offset < r->hdr.header_size ||
+        tr.count > (r->size - sizeof(tr) - tr.index_offset) / sizeof(enqevt_index_entry_t))
+        return 0;
+    r->blocks = malloc((tr.count ? tr.count : 1) * sizeof(enqevt_index_entry_t));
+    if (r->blocks == NULL) return 0;
+    memcpy(r->blocks, r->base + tr.index_offset, tr.count * sizeof(enqevt_index_entry_t));
+    r->num_blocks = tr.count;
+    return 1;
+}
+
+// 索引がないとき (記録中・異常終了) はブロックヘッダーを辿る
+static inline int enqevt_scan_blocks(enqevt_reader_t *r) {
+    size_t cap = 64, n = 0;
+    enqevt_index_entry_t *v = malloc(cap * sizeof(*v));
+    if (v == NULL) return 0;
+    size_t off = r->hdr.header_size;
+    while (off + sizeof(enqevt_block_header_t) <= r->size) {
+        enqevt_block_header_t bh;
+        memcpy(&bh, r->base + off, sizeof(bh));
+        if (bh.magic != ENQEVT_BLOCK_MAGIC) break;  // 索引または壊れた末尾
+        if (bh.payload_len > ENQEVT_PAYLOAD_MAX ||
+            off + sizeof(bh) + bh.payload_len > r->size) {
+            r->truncated = 1;
+            break;
+        }
+        if (n == cap) {
+            enqevt_index_entry_t *nv = realloc(v, cap * 2 * sizeof(*v));
+            if (nv == NULL) { free(v); return 0; }
+            v = nv;
+            cap *= 2;
+        }
+        v[n].offset = off;
+        v[n].first_ns = bh.first_ns;
+        v[n].last_ns = bh.last_ns;
+        v[n].count = bh.count;
+        v[n].reserved = 0;
+        n++;
+        off += sizeof(bh) + bh.payload_len;
+    }
+    r->blocks = v;
+    r->num_blocks = n;
+    return 1;
+}
+
+// マップ済みの領域を検証して索引を用意する。戻り値: 成功なら 1
+static inline int enqevt_reader_init(enqevt_reader_t *r, const void *base, size_t size) {
+    memset(r, 0, sizeof(*r));
+    r->base = base;
+    r->size = size;
+    if (size < sizeof(enqevt_file_header_t)) return 0;
+    memcpy(&r->hdr, base, sizeof(r->hdr));
+    if (memcmp(r->hdr.magic, ENQEVT_MAGIC, 8) != 0 || r->hdr.version != ENQEVT_VERSION ||
+        r->hdr.port_count > ENQEVT_MAX_PORTS || r->hdr.header_size > size ||
+        r->hdr.tick_ns == 0 ||
+        r->hdr.header_size < sizeof(enqevt_file_header_t) +
+                             (size_t)r->hdr.port_count * ENQEVT_PORT_NAME_LEN)
+        return 0;
+    r->indexed = enqevt_load_index(r);
+    return r->indexed || enqevt_scan_blocks(r);
+}
+
+static inline void enqevt_reader_free(enqevt_reader_t *r) {
+    free(r->blocks);
+    r->blocks = NULL;
+    r->num_blocks = 0;
+}
+
+// 全体の時刻範囲。ブロックがなければ 0
+static inline int enqevt_time_range(const enqevt_reader_t *r, uint64_t *first, uint64_t *last) {
+    if (r->num_blocks == 0) return 0;
+    *first = r->blocks[0].first_ns;
+    *last = r->blocks[r->num_blocks - 1].last_ns;
+    return 1;
+}
+
+// t_ns 以降のイベントを含みうる最初のブロック (索引の二分探索)。なければ num_blocks
+static inline size_t enqevt_find_block(const enqevt_reader_t *r, uint64_t t_ns) {
+    size_t lo = 0, hi = r->num_blocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->blocks[mid].last_ns < t_ns) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// ブロックを out (ENQEVT_BLOCK_EVENTS 個分) に展開する。戻り値: イベント数 / 壊れていたら -1
+static inline int enqevt_decode_block(const enqevt_reader_t *r, size_t block, enqevt_event_t *out) {
+    if (block >= r->num_blocks) return -1;
+    uint64_t off = r->blocks[block].offset;
+    enqevt_block_header_t bh;
+    if (off + sizeof(bh) > r->size) return -1;
+    memcpy(&bh, r->base + off, sizeof(bh));
+    if (bh.magic != ENQEVT_BLOCK_MAGIC || bh.payload_len > r->size - off - sizeof(bh) ||
+        bh.count > ENQEVT_BLOCK_EVENTS || bh.dict_len > ENQEVT_DICT_MAX ||
+        bh.ts_bits > 32 || bh.key_bits > 16 ||
+        bh.ts_off != bh.dict_len * sizeof(enqevt_dict_entry_t) ||
+        bh.key_off < bh.ts_off || bh.value_off < bh.key_off || bh.value_off > bh.payload_len ||
+        (uint64_t)bh.count * bh.ts_bits > (uint64_t)(bh.key_off - bh.ts_off) * 8 ||
+        (uint64_t)bh.count * bh.key_bits > (uint64_t)(bh.value_off - bh.key_off) * 8)
+        return -1;
+
+    const uint8_t *payload = r->base + off + sizeof(bh);
+    enqevt_dict_entry_t dict[ENQEVT_DICT_MAX];
+    uint16_t prev[ENQEVT_DICT_MAX];
+    memcpy(dict, payload, bh.ts_off);
+    memset(prev, 0, bh.dict_len * sizeof(prev[0]));
+
+    enqevt_bits_t ts = { payload + bh.ts_off, bh.key_off - bh.ts_off, 0 };
+    enqevt_bits_t keys = { payload + bh.key_off, bh.value_off - bh.key_off, 0 };
+    enqevt_bits_t vals = { payload + bh.value_off, bh.payload_len - bh.value_off, 0 };
+    uint64_t t = bh.first_ns;
+    for (uint32_t i = 0; i < bh.count; i++) {
+        t += (uint64_t)enqevt_bits_get(&ts, bh.ts_bits) * r->hdr.tick_ns;
+        uint32_t k = enqevt_bits_get(&keys, bh.key_bits);
+        if (k >= bh.dict_len || dict[k].value_bits > 16 ||
+            vals.pos + dict[k].value_bits > (uint64_t)vals.len * 8)
+            return -1;
+        prev[k] = enqevt_unzigzag(prev[k], (uint16_t)enqevt_bits_get(&vals, dict[k].value_bits));
+        out[i] = (enqevt_event_t){ .t_ns = t, .port = dict[k].port, .station = dict[k].station,
+                                   .data_num = dict[k].data_num, .value = prev[k] };
+    }
+    return (int)bh.count;
+}
+
+#endif // ENQ_EVENTS_FORMAT_H
@@ -0,0 +1,192 @@
+// enq_events_query.c
+// イベントファイル (enq_events_format.h) の時刻範囲の問い合わせ
+// ビルド例: gcc -O2 enq_events_query.c enq_events.c enq_arena.c enq_parser.c enq_simd.c -o enq_events_query
+//
+// 使用方法:
+//   enq_events_query [-from 時刻] [-to 時刻] [-station 局番号] [-data 種類] [-count] <イベントファイル>
+//   時刻は "2026-10-14T08:30[:00]" (ローカル時刻) か、記録の最初のイベントからの秒数 "+3600"。
+//   -from は含み、-to は含まない。-data は current / target / load か16進のデータ番号。
+//   -count はイベントを表示せず件数だけを出す。
+//   モニターが記録した回線の断・復帰 (欠落区間) は -station / -data に関係なく表示し、
+//   復帰には直前の切断からの長さを付ける。
+//
+// 索引の min/max 時刻を二分探索して範囲に重なるブロックだけを展開するので、
+// 長期間のファイルでも読むのは問い合わせた区間の分だけになる。
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "enq_events.h"
+#include "enq_parser.h"
+
+// 時刻の指定を実時刻 (ns) にする。戻り値: 成功 0 / 不正 -1
+static int parse_time(const char *s, uint64_t origin_ns, uint64_t *out) {
+    if (s[0] == '+') {
+        char *end;
+        double sec = strtod(s + 1, &end);
+        if (end == s + 1 || *end != '\0' || sec < 0) return -1;
+        *out = origin_ns + (uint64_t)(sec * 1e9);
+        return 0;
+    }
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(s, "%Y-%m-%dT%H:%M", &tm);
+    if (end == NULL) end = strptime(s, "%Y-%m-%d %H:%M", &tm);
+    if (end == NULL) return -1;
+    if (*end == ':') {
+        end = strptime(end, ":%S", &tm);
+        if (end == NULL) return -1;
+    }
+    if (*end != '\0') return -1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1) return -1;
+    *out = (uint64_t)t * 1000000000ull;
+    return 0;
+}
+
+static int parse_data(const char *s, uint16_t *out) {
+    if (strcmp(s, "current") == 0) *out = ENQ_DATA_CURRENT_FLOOR;
+    else if (strcmp(s, "target") == 0) *out = ENQ_DATA_TARGET_FLOOR;
+    else if (strcmp(s, "load") == 0) *out = ENQ_DATA_LOAD_WEIGHT;
+    else {
+        char *end;
+        unsigned long v = strtoul(s, &end, 16);
+        if (end == s || *end != '\0' || v > 0xFFFF) return -1;
+        *out = (uint16_t)v;
+    }
+    return 0;
+}
+
+// ポートごとの直前の切断時刻 (復帰の表示に欠落の長さを付ける)
+static uint64_t link_down_ns[ENQEVT_MAX_PORTS];
+
+static void print_event(const enqevt_reader_t *r, const enqevt_event_t *e) {
+    time_t sec = (time_t)(e->t_ns / 1000000000ull);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char ts[32];
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm);
+
+    enq_frame_t f = { .station = e->station, .data_num = e->data_num, .value = e->value };
+    char desc[64];
+    enq_frame_describe(&f, desc, sizeof(desc));
+    const char *port = enqevt_port_name(r, e->port);
+    if (enq_frame_is_link(&f)) {
+        uint64_t *down = e->port < ENQEVT_MAX_PORTS ? &link_down_ns[e->port] : NULL;
+        printf("%s.%03u %s %s", ts, (unsigned)(e->t_ns / 1000000ull % 1000), port ? port : "?", desc);
+        if (down && e->value == ENQ_LINK_DOWN) *down = e->t_ns;
+        if (down && e->value == ENQ_LINK_UP && *down) {
+            printf(" (欠落 %.3f 秒)", (double)(e->t_ns - *down) / 1e9);
+            *down = 0;
+        }
+        printf("\n");
+        return;
+    }
+    printf("%s.%03u %s 局%04u %s\n", ts, (unsigned)(e->t_ns / 1000000ull % 1000),
+           port ? port : "?", (unsigned)e->station, desc);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "使用方法: %s [-from 時刻] [-to 時刻] [-station 局番号] [-data 種類] [-count] "
+                    "<イベントファイル>\n", prog);
+    fprintf(stderr, "  時刻: 2026-10-14T08:30[:00] (ローカル時刻) / +秒 (最初のイベントから)\n");
+    fprintf(stderr, "  種類: current / target / load / 16進のデータ番号\n");
+}
+
+int main(int argc, char **argv) {
+    const char *from_s = NULL, *to_s = NULL;
+    int station = -1, data = -1, count_only = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-count") == 0) {
+            count_only = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *v = argv[++i];
+        if (strcmp(argv[i - 1], "-from") == 0) {
+            from_s = v;
+        } else if (strcmp(argv[i - 1], "-to") == 0) {
+            to_s = v;
+        } else if (strcmp(argv[i - 1], "-station") == 0) {
+            station = atoi(v);
+        } else if (strcmp(argv[i - 1], "-data") == 0) {
+            uint16_t d;
+            if (parse_data(v, &d) < 0) {
+                fprintf(stderr, "❌ データ番号が不正です: %s\n", v);
+                return 1;
+            }
+            data = d;
+        } else {
+            fprintf(stderr, "❌ 不明なオプション: %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+    if (i + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    enqevt_reader_t r;
+    if (enqevt_open_mapped(&r, argv[i]) < 0) {
+        fprintf(stderr, "❌ イベントファイル %s を開けません: %s\n", argv[i], strerror(errno));
+        return 1;
+    }
+    uint64_t first = 0, last = 0;
+    enqevt_time_range(&r, &first, &last);
+    uint64_t from = 0, to = UINT64_MAX;
+    const char *bad = from_s && parse_time(from_s, first, &from) < 0 ? from_s
+                    : to_s && parse_time(to_s, first, &to) < 0       ? to_s : NULL;
+    if (bad) {
+        fprintf(stderr, "❌ 時刻の指定が不正です: %s\n", bad);
+        enqevt_close_mapped(&r);
+        return 1;
+    }
+    if (!r.indexed) {
+        fprintf(stderr, "⚠️ 索引がありません (記録中か異常終了)。ブロックを辿って読みます%s\n",
+                r.truncated ? " (末尾の不完全なブロックは無視)" : "");
+    }
+
+    static enqevt_event_t ev[ENQEVT_BLOCK_EVENTS];
+    uint64_t matched = 0, decoded = 0, bytes = 0;
+    size_t touched = 0;
+    for (size_t b = enqevt_find_block(&r, from); b < r.num_blocks && r.blocks[b].first_ns < to; b++) {
+        int n = enqevt_decode_block(&r, b, ev);
+        if (n < 0) {
+            fprintf(stderr, "⚠️ ブロック %zu が壊れています (読み飛ばします)\n", b);
+            continue;
+        }
+        touched++;
+        decoded += (uint64_t)n;
+        enqevt_block_header_t bh;
+        memcpy(&bh, r.base + r.blocks[b].offset, sizeof(bh));
+        bytes += sizeof(bh) + bh.payload_len;
+        for (int k = 0; k < n; k++) {
+            const enqevt_event_t *e = &ev[k];
+            if (e->t_ns < from || e->t_ns >= to) continue;
+            int link = e->station == ENQ_LINK_STATION && e->data_num == ENQ_DATA_LINK;
+            if (!link && station >= 0 && e->station != station) continue;
+            if (!link && data >= 0 && e->data_num != data) continue;
+            matched++;
+            if (!count_only) print_event(&r, e);
+        }
+    }
+
+    uint64_t total = 0;
+    for (size_t b = 0; b < r.num_blocks; b++) total += r.blocks[b].count;
+    printf("🔎 %llu イベント該当 / 展開 %zu/%zu ブロック (%llu イベント, %.1f KB) / "
+           "ファイル全体 %llu イベント %.1f KB (%.2f バイト/イベント)\n",
+           (unsigned long long)matched, touched, r.num_blocks, (unsigned long long)decoded,
+           (double)bytes / 1024.0, (unsigned long long)total, (double)r.size / 1024.0,
+           total ? (double)r.size / (double)total : 0.0);
+    enqevt_close_mapped(&r);
+    return 0;
+}
@@ -0,0 +1,573 @@
+// enq_fanout.c
+// デコード済み ENQ イベントのバイナリ配信 (UDP マルチキャスト + WebSocket)
+// ビルド例: serial_debug_test.c と一緒にリンクする (-pthread)
+
+#define _GNU_SOURCE
+#include "enq_fanout.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define QUEUE_MAX     4096  // 配信待ちレコード数の上限
+#define WS_MAX        32    // WebSocket 同時接続数
+#define WS_REQ_MAX    2048  // ハンドシェイク要求の最大長
+#define WS_HDR_LEN    4     // サーバー→クライアントのフレームヘッダーの最大長 (長さ 126..65535)
+
+#define BATCH_BYTES (sizeof(enq_batch_header_t) + ENQ_BATCH_MAX * sizeof(enq_batch_record_t))
+
+typedef struct {
+    int fd;          // -1 は空き
+    int open;        // ハンドシェイク完了
+    size_t req_len;  // ハンドシェイク前は要求、後は受信中のフレームヘッダー
+    char req[WS_REQ_MAX];
+    uint64_t skip;   // 読み捨て中のペイロードの残りバイト数
+} ws_client_t;
+
+struct enq_fanout {
+    enq_fanout_config_t cfg;
+    pthread_t thread;
+    atomic_int stop;
+
+    pthread_mutex_t lock;
+    enq_batch_record_t queue[QUEUE_MAX];
+    size_t queued;
+    uint32_t dropped;
+
+    int udp_fd;
+    struct sockaddr_in mcast_addr;
+    int listen_fd;
+    ws_client_t clients[WS_MAX];
+
+    uint32_t seq;
+    enq_fanout_stats_t stats;  // 配信スレッドだけが更新 (dropped は lock 下の dropped を使う)
+
+    // 送ったレコードの直近 cfg.backlog 件 (配信スレッドだけが触る)
+    enq_batch_record_t *history;
+    size_t hist_len;           // 有効な件数 (最大 cfg.backlog)
+    size_t hist_next;          // 次に書く位置
+};
+
+// ---- SHA-1 / Base64 (Sec-WebSocket-Accept 用) ----
+
+static uint32_t rol32(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const uint8_t *p) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 |
+               (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    for (int i = 16; i < 80; i++) w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+        else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+        uint32_t t = rol32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol32(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+static void sha1(const uint8_t *data, size_t len, uint8_t out[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) sha1_block(h, data + i);
+
+    uint8_t tail[128] = { 0 };
+    size_t rest = len - i;
+    memcpy(tail, data + i, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = rest + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int k = 0; k < 8; k++) tail[tail_len - 1 - k] = (uint8_t)(bits >> (k * 8));
+    sha1_block(h, tail);
+    if (tail_len == 128) sha1_block(h, tail + 64);
+
+    for (int k = 0; k < 5; k++) {
+        out[k * 4] = (uint8_t)(h[k] >> 24);
+        out[k * 4 + 1] = (uint8_t)(h[k] >> 16);
+        out[k * 4 + 2] = (uint8_t)(h[k] >> 8);
+        out[k * 4 + 3] = (uint8_t)h[k];
+    }
+}
+
+static void base64(const uint8_t *in, size_t len, char *out) {
+    static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = tbl[(v >> 18) & 63];
+        out[o++] = tbl[(v >> 12) & 63];
+        out[o++] = i + 1 < len ? tbl[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < len ? tbl[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+// ---- WebSocket ----
+
+static void ws_close(enq_fanout_t *f, ws_client_t *c) {
+    (void)f;
+    close(c->fd);
+    c->fd = -1;
+    c->open = 0;
+    c->req_len = 0;
+    c->skip = 0;
+}
+
+static void ws_accept(enq_fanout_t *f) {
+    int fd = accept4(f->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    for (int i = 0; i < WS_MAX; i++) {
+        ws_client_t *c = &f->clients[i];
+        if (c->fd < 0) {
+            c->fd = fd;
+            c->open = 0;
+            c->req_len = 0;
+            c->skip = 0;
+            return;
+        }
+    }
+    close(fd);  // 満員
+}
+
+// ヘッダー name の値を out に取り出す (空行で打ち切り、要求は書き換えない)
+static int ws_find_header(const char *req, const char *name, char *out, size_t len) {
+    size_t name_len = strlen(name);
+    const char *line = strstr(req, "\r\n");
+    while (line && line[2] != '\r' && line[2] != '\0') {
+        line += 2;
+        const char *next = strstr(line, "\r\n");
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *v = line + name_len + 1;
+            while (*v == ' ' || *v == '\t') v++;
+            size_t n = next ? (size_t)(next - v) : strlen(v);
+            while (n > 0 && (v[n - 1] == ' ' || v[n - 1] == '\t')) n--;
+            if (n == 0 || n >= len) return -1;
+            memcpy(out, v, n);
+            out[n] = '\0';
+            return 0;
+        }
+        line = next;
+    }
+    return -1;
+}
+
+static void ws_replay(enq_fanout_t *f, ws_client_t *c);
+
+// 101 を返せたら 0、拒否・失敗して閉じたら -1
+static int ws_handshake(enq_fanout_t *f, ws_client_t *c) {
+    static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    char key[64], upgrade[64], concat[128], accept[32], resp[256];
+    uint8_t digest[20];
+
+    // GET + Upgrade: websocket + Sec-WebSocket-Key が揃わない要求は 400
+    if (strncmp(c->req, "GET ", 4) != 0 ||
+        ws_find_header(c->req, "Upgrade", upgrade, sizeof(upgrade)) < 0 ||
+        !strcasestr(upgrade, "websocket") ||
+        ws_find_header(c->req, "Sec-WebSocket-Key", key, sizeof(key)) < 0) {
+        static const char bad[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+        (void)!send(c->fd, bad, sizeof(bad) - 1, MSG_NOSIGNAL);
+        ws_close(f, c);
+        return -1;
+    }
+    int n = snprintf(concat, sizeof(concat), "%s%s", key, guid);
+    sha1((const uint8_t *)concat, (size_t)n, digest);
+    base64(digest, sizeof(digest), accept);
+    n = snprintf(resp, sizeof(resp),
+                 "HTTP/1.1 101 Switching Protocols\r\n"
+                 "Upgrade: websocket\r\n"
+                 "Connection: Upgrade\r\n"
+                 "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    if (send(c->fd, resp, (size_t)n, MSG_NOSIGNAL) != n) {
+        ws_close(f, c);
+        return -1;
+    }
+    c->open = 1;
+    c->req_len = 0;
+    f->stats.ws_clients++;
+    ws_replay(f, c);
+    return c->fd >= 0 ? 0 : -1;
+}
+
+// ハンドシェイク後の受信バイトをフレーム単位に読む。
+// ヘッダー (FIN/opcode, 7/16/64 ビット長, マスク) を c->req に貯め、ペイロードは読み捨てる。
+// close フレームかマスクなしのフレーム (RFC 6455 5.1 違反) で閉じ、そのとき -1 を返す
+static int ws_consume(enq_fanout_t *f, ws_client_t *c, const uint8_t *p, size_t n) {
+    while (n > 0) {
+        if (c->skip > 0) {
+            size_t k = c->skip < n ? (size_t)c->skip : n;
+            c->skip -= k;
+            p += k;
+            n -= k;
+            continue;
+        }
+        uint8_t *h = (uint8_t *)c->req;
+        h[c->req_len++] = *p++;
+        n--;
+        if (c->req_len < 2) continue;
+        if (!(h[1] & 0x80)) {
+            ws_close(f, c);
+            return -1;
+        }
+        size_t ext = (h[1] & 0x7F) == 126 ? 2 : (h[1] & 0x7F) == 127 ? 8 : 0;
+        if (c->req_len < 2 + ext + 4) continue;
+        if ((h[0] & 0x0F) == 0x08) {
+            ws_close(f, c);
+            return -1;
+        }
+        uint64_t len = h[1] & 0x7F;
+        if (ext) {
+            len = 0;
+            for (size_t i = 0; i < ext; i++) len = (len << 8) | h[2 + i];
+        }
+        c->skip = len;
+        c->req_len = 0;
+    }
+    return 0;
+}
+
+// クライアントからの受信。ハンドシェイク後のメッセージ (ping など) は読み捨てる
+static void ws_readable(enq_fanout_t *f, ws_client_t *c) {
+    if (c->open) {
+        uint8_t scratch[512];
+        ssize_t n = recv(c->fd, scratch, sizeof(scratch), 0);
+        if (n > 0) ws_consume(f, c, scratch, (size_t)n);
+        else if (n == 0 || (errno != EAGAIN && errno != EINTR)) ws_close(f, c);
+        return;
+    }
+    ssize_t n = recv(c->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len, 0);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) ws_close(f, c);
+        return;
+    }
+    c->req_len += (size_t)n;
+    c->req[c->req_len] = '\0';
+    char *end = strstr(c->req, "\r\n\r\n");
+    if (end) {
+        // 要求の直後に届いたフレームはハンドシェイク後に読み直す
+        uint8_t rest[WS_REQ_MAX];
+        size_t rest_len = c->req_len - (size_t)(end + 4 - c->req);
+        memcpy(rest, end + 4, rest_len);
+        if (ws_handshake(f, c) == 0) ws_consume(f, c, rest, rest_len);
+    } else if (c->req_len >= sizeof(c->req) - 1) {
+        ws_close(f, c);
+    }
+}
+
+// ---- バッチ送信 ----
+
+// payload にバッチを書き、その長さを返す
+static size_t encode_batch(uint8_t *payload, uint32_t magic, uint32_t seq, uint32_t dropped,
+                           const enq_batch_record_t *recs, size_t count) {
+    enq_batch_header_t h = {
+        .magic = magic,
+        .version = ENQ_BATCH_VERSION,
+        .count = (uint16_t)count,
+        .seq = seq,
+        .dropped = dropped,
+    };
+    memcpy(payload, &h, sizeof(h));
+    memcpy(payload + sizeof(h), recs, count * sizeof(*recs));
+    return sizeof(h) + count * sizeof(*recs);
+}
+
+// ペイロード直前に WebSocket のフレームヘッダーを置き、フレームの先頭を返す
+// (126 未満は2バイト、以上は 16bit 長付き4バイト)
+static uint8_t *ws_wrap(uint8_t *payload, size_t len, size_t *frame_len) {
+    uint8_t *frame;
+    if (len < 126) {
+        frame = payload - 2;
+        frame[1] = (uint8_t)len;
+    } else {
+        frame = payload - 4;
+        frame[1] = 126;
+        frame[2] = (uint8_t)(len >> 8);
+        frame[3] = (uint8_t)len;
+    }
+    frame[0] = 0x82;  // FIN + バイナリ
+    *frame_len = (size_t)(payload - frame) + len;
+    return frame;
+}
+
+static void send_batch(enq_fanout_t *f, const enq_batch_record_t *recs, size_t count,
+                       uint32_t dropped) {
+    // 先頭 WS_HDR_LEN バイトは WebSocket のフレームヘッダー用に空けておく。
+    // UDP はペイロードだけ、WebSocket は直前にヘッダーを付けた同じバッファを送る
+    static uint8_t buf[WS_HDR_LEN + BATCH_BYTES];
+    uint8_t *payload = buf + WS_HDR_LEN;
+
+    size_t len = encode_batch(payload, ENQ_BATCH_MAGIC, f->seq++, dropped, recs, count);
+    f->stats.batches++;
+    f->stats.records += count;
+
+    if (f->udp_fd >= 0 &&
+        sendto(f->udp_fd, payload, len, 0, (const struct sockaddr *)&f->mcast_addr,
+               sizeof(f->mcast_addr)) < 0)
+        f->stats.udp_errors++;
+
+    size_t frame_len;
+    uint8_t *frame = ws_wrap(payload, len, &frame_len);
+    for (int i = 0; i < WS_MAX; i++) {
+        ws_client_t *c = &f->clients[i];
+        if (c->fd < 0 || !c->open) continue;
+        ssize_t n = send(c->fd, frame, frame_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n == (ssize_t)frame_len) {
+            f->stats.ws_sent++;
+        } else {
+            // 送信バッファが詰まったクライアントは待たずに切る (他を遅らせない)
+            f->stats.ws_slow++;
+            ws_close(f, c);
+        }
+    }
+}
+
+static void flush_queue(enq_fanout_t *f) {
+    static enq_batch_record_t local[QUEUE_MAX];
+    pthread_mutex_lock(&f->lock);
+    size_t n = f->queued;
+    memcpy(local, f->queue, n * sizeof(local[0]));
+    f->queued = 0;
+    uint32_t dropped = f->dropped;
+    pthread_mutex_unlock(&f->lock);
+
+    for (size_t i = 0; i < n; i += ENQ_BATCH_MAX) {
+        size_t k = n - i < ENQ_BATCH_MAX ? n - i : ENQ_BATCH_MAX;
+        send_batch(f, local + i, k, dropped);
+    }
+    // 直近の分を残す (後から接続したクライアント用)
+    size_t cap = f->cfg.backlog;
+    for (size_t i = cap ? 0 : n; i < n; i++) {
+        f->history[f->hist_next] = local[i];
+        f->hist_next = f->hist_next + 1 == cap ? 0 : f->hist_next + 1;
+        if (f->hist_len < cap) f->hist_len++;
+    }
+}
+
+// ハンドシェイク直後のクライアントに過去分を古い順に送る。
+// まとめて送れるよう送信バッファを広げておき、それでも詰まるなら切る (配信を遅らせない)
+static void ws_replay(enq_fanout_t *f, ws_client_t *c) {
+    if (f->hist_len == 0) return;
+    int sndbuf = (int)(f->hist_len * sizeof(enq_batch_record_t) * 2 + 65536);
+    setsockopt(c->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    static uint8_t buf[WS_HDR_LEN + BATCH_BYTES];
+    enq_batch_record_t recs[ENQ_BATCH_MAX];
+    size_t cap = f->cfg.backlog;
+    size_t start = (f->hist_next + cap - f->hist_len) % cap;
+    uint32_t seq = 0;
+    for (size_t done = 0; done < f->hist_len; ) {
+        size_t k = 0;
+        for (; k < ENQ_BATCH_MAX && done < f->hist_len; k++, done++) {
+            recs[k] = f->history[(start + done) % cap];
+        }
+        size_t len = encode_batch(buf + WS_HDR_LEN, ENQ_BATCH_REPLAY_MAGIC, seq++, 0, recs, k);
+        size_t frame_len;
+        uint8_t *frame = ws_wrap(buf + WS_HDR_LEN, len, &frame_len);
+        if (send(c->fd, frame, frame_len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)frame_len) {
+            f->stats.ws_slow++;
+            ws_close(f, c);
+            return;
+        }
+        f->stats.ws_replayed += k;
+    }
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static void *fanout_thread(void *arg) {
+    enq_fanout_t *f = arg;
+    struct pollfd pfd[WS_MAX + 1];
+    int owner[WS_MAX + 1];
+    uint64_t next_tick = monotonic_ms() + (uint64_t)f->cfg.tick_ms;
+
+    while (!atomic_load(&f->stop)) {
+        int n = 0;
+        if (f->listen_fd >= 0) {
+            pfd[n] = (struct pollfd){ .fd = f->listen_fd, .events = POLLIN };
+            owner[n++] = -1;
+        }
+        for (int i = 0; i < WS_MAX; i++) {
+            if (f->clients[i].fd < 0) continue;
+            pfd[n] = (struct pollfd){ .fd = f->clients[i].fd, .events = POLLIN };
+            owner[n++] = i;
+        }
+
+        uint64_t now = monotonic_ms();
+        int timeout = next_tick > now ? (int)(next_tick - now) : 0;
+        int r = poll(pfd, (nfds_t)n, timeout);
+        for (int i = 0; r > 0 && i < n; i++) {
+            if (pfd[i].revents == 0) continue;
+            if (owner[i] < 0) ws_accept(f);
+            else if (f->clients[owner[i]].fd == pfd[i].fd) ws_readable(f, &f->clients[owner[i]]);
+        }
+
+        now = monotonic_ms();
+        if (now >= next_tick) {
+            flush_queue(f);
+            next_tick += (uint64_t)f->cfg.tick_ms;
+            if (next_tick <= now) next_tick = now + (uint64_t)f->cfg.tick_ms;  // 遅れは詰めない
+        }
+    }
+    flush_queue(f);
+    return NULL;
+}
+
+// ---- 公開関数 ----
+
+void enq_fanout_default_config(enq_fanout_config_t *cfg) {
+    cfg->mcast_group = ENQ_FANOUT_MCAST_GROUP;
+    cfg->mcast_port = ENQ_FANOUT_MCAST_PORT;
+    cfg->mcast_ttl = 1;
+    cfg->ws_port = ENQ_FANOUT_WS_PORT;
+    cfg->ws_listen_fd = -1;
+    cfg->tick_ms = ENQ_FANOUT_TICK_MS;
+    cfg->backlog = 0;
+}
+
+static int open_udp(enq_fanout_t *f) {
+    f->mcast_addr.sin_family = AF_INET;
+    f->mcast_addr.sin_port = htons(f->cfg.mcast_port);
+    if (inet_pton(AF_INET, f->cfg.mcast_group, &f->mcast_addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (f->udp_fd < 0) return -1;
+    unsigned char ttl = (unsigned char)f->cfg.mcast_ttl, loop = 1;
+    setsockopt(f->udp_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(f->udp_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    return 0;
+}
+
+static int open_ws(enq_fanout_t *f) {
+    if (f->cfg.ws_listen_fd >= 0) {
+        // 受け取ったソケットは待ち受け済み。接続は停止中もカーネルのキューに溜まっている
+        f->listen_fd = f->cfg.ws_listen_fd;
+        int fl = fcntl(f->listen_fd, F_GETFL);
+        if (fl < 0 || fcntl(f->listen_fd, F_SETFL, fl | O_NONBLOCK) < 0) return -1;
+        fcntl(f->listen_fd, F_SETFD, FD_CLOEXEC);
+        return 0;
+    }
+    f->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (f->listen_fd < 0) return -1;
+    int one = 1;
+    setsockopt(f->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(f->cfg.ws_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(f->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(f->listen_fd, 16) < 0)
+        return -1;
+    return 0;
+}
+
+static void close_sockets(enq_fanout_t *f) {
+    for (int i = 0; i < WS_MAX; i++)
+        if (f->clients[i].fd >= 0) ws_close(f, &f->clients[i]);
+    if (f->listen_fd >= 0) close(f->listen_fd);
+    if (f->udp_fd >= 0) close(f->udp_fd);
+}
+
+enq_fanout_t *enq_fanout_start(const enq_fanout_config_t *cfg) {
+    enq_fanout_t *f = calloc(1, sizeof(*f));
+    if (f == NULL) return NULL;
+    f->cfg = *cfg;
+    if (f->cfg.tick_ms <= 0) f->cfg.tick_ms = ENQ_FANOUT_TICK_MS;
+    f->udp_fd = -1;
+    f->listen_fd = -1;
+    for (int i = 0; i < WS_MAX; i++) f->clients[i].fd = -1;
+    pthread_mutex_init(&f->lock, NULL);
+
+    if (cfg->backlog && (f->history = calloc(cfg->backlog, sizeof(*f->history))) == NULL) {
+        pthread_mutex_destroy(&f->lock);
+        free(f);
+        return NULL;
+    }
+    if ((cfg->mcast_group && open_udp(f) < 0) ||
+        ((cfg->ws_port || cfg->ws_listen_fd >= 0) && open_ws(f) < 0)) {
+        int saved = errno;
+        close_sockets(f);
+        pthread_mutex_destroy(&f->lock);
+        free(f->history);
+        free(f);
+        errno = saved;
+        return NULL;
+    }
+    // シグナルは呼び出し側のスレッドで受ける
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(&f->thread, NULL, fanout_thread, f);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        close_sockets(f);
+        pthread_mutex_destroy(&f->lock);
+        free(f->history);
+        free(f);
+        errno = rc;
+        return NULL;
+    }
+    return f;
+}
+
+void enq_fanout_frame(enq_fanout_t *f, uint16_t port, const enq_frame_t *frame,
+                      uint64_t now_realtime_ns) {
+    pthread_mutex_lock(&f->lock);
+    if (f->queued < QUEUE_MAX) {
+        f->queue[f->queued++] = (enq_batch_record_t){
+            .t_ns = now_realtime_ns,
+            .port = port,
+            .station = frame->station,
+            .data_num = frame->data_num,
+            .value = frame->value,
+        };
+    } else {
+        f->dropped++;
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+void enq_fanout_stop(enq_fanout_t *f, enq_fanout_stats_t *stats) {
+    if (f == NULL) return;
+    atomic_store(&f->stop, 1);
+    pthread_join(f->thread, NULL);
+    if (stats) {
+        *stats = f->stats;
+        stats->dropped = f->dropped;
+    }
+    close_sockets(f);
+    pthread_mutex_destroy(&f->lock);
+    free(f->history);
+    free(f);
+}
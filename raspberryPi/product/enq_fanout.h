@@ -0,0 +1,88 @@
+// enq_fanout.h
+// デコード済み ENQ イベントのバイナリ配信 (UDP マルチキャスト + WebSocket)
+//
+// デコードスレッドは enq_fanout_frame() でレコードを積むだけで、送信は配信
+// スレッドが tick ごとにまとめて行う。1バッチは1回だけエンコードし、同じバイト列を
+// マルチキャストの1データグラムとして、また全 WebSocket クライアントへの
+// バイナリメッセージとしてそのまま送る (クライアントごとの JSON 化はしない)。
+//
+// バッチ形式 (リトルエンディアン、Raspberry Pi / x86 のネイティブ順):
+//   enq_batch_header_t (16バイト) + enq_batch_record_t (16バイト) x count
+// 1バッチは ENQ_BATCH_MAX レコードまで (1040 バイト、イーサネットの MTU 内)。
+// tick 内のレコードがそれを超えたら複数バッチに分けて送る。
+// ポートの切断・開き直しは局番号 ENQ_LINK_STATION のレコード (enq_parser.h) として流れる。
+//
+// backlog を指定すると、送ったレコードの直近 backlog 件を配信スレッドが持っておき、
+// 後から接続した WebSocket クライアントには最初に同じ形式で magic だけが
+// ENQ_BATCH_REPLAY_MAGIC のバッチとして送る (seq はリプレイ内の通番、古い順)。
+// 受信側より後に起動した表示・ダッシュボードも起動直後からの経過を受け取れる。
+
+#ifndef ENQ_FANOUT_H
+#define ENQ_FANOUT_H
+
+#include <stdint.h>
+
+#include "enq_parser.h"
+
+#define ENQ_BATCH_MAGIC    0x31425145u  // "EQB1"
+#define ENQ_BATCH_REPLAY_MAGIC 0x31525145u  // "EQR1" (接続時に送る過去分)
+#define ENQ_BATCH_VERSION  1
+#define ENQ_BATCH_MAX      64
+
+#define ENQ_FANOUT_MCAST_GROUP "239.255.80.5"
+#define ENQ_FANOUT_MCAST_PORT  5005
+#define ENQ_FANOUT_WS_PORT     8765
+#define ENQ_FANOUT_TICK_MS     50
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;      // 続くレコード数
+    uint32_t seq;        // バッチ通番 (欠落の検出用)
+    uint32_t dropped;    // 配信が追いつかず捨てたレコードの累計
+} enq_batch_header_t;
+
+typedef struct {
+    uint64_t t_ns;       // 受信時刻 (CLOCK_REALTIME)
+    uint16_t port;       // 受信ポート番号
+    uint16_t station;    // 局番号 (号機)
+    uint16_t data_num;
+    uint16_t value;
+} enq_batch_record_t;
+
+typedef struct {
+    const char *mcast_group;  // NULL ならマルチキャストしない
+    uint16_t mcast_port;
+    int mcast_ttl;
+    uint16_t ws_port;         // 0 なら WebSocket を待ち受けない
+    int ws_listen_fd;         // 待ち受け済みのソケット (systemd のソケット起動など)。-1 なら ws_port で作る
+    int tick_ms;
+    unsigned backlog;         // 後から接続したクライアントに送る直近のレコード数 (0 なら送らない)
+} enq_fanout_config_t;
+
+typedef struct {
+    uint64_t records;         // 送信したレコード数
+    uint64_t batches;         // エンコードしたバッチ数
+    uint64_t dropped;         // キュー満杯で捨てたレコード数
+    uint64_t udp_errors;
+    uint64_t ws_clients;      // 累計接続数
+    uint64_t ws_sent;         // WebSocket へ送ったメッセージ数 (クライアント x バッチ)
+    uint64_t ws_slow;         // 送信が詰まって切断したクライアント数
+    uint64_t ws_replayed;     // 接続時に送った過去分のレコード数 (クライアントごとの合計)
+} enq_fanout_stats_t;
+
+typedef struct enq_fanout enq_fanout_t;
+
+void enq_fanout_default_config(enq_fanout_config_t *cfg);
+
+// ソケットを開いて配信スレッドを起動する。失敗時は NULL (errno)
+enq_fanout_t *enq_fanout_start(const enq_fanout_config_t *cfg);
+
+// 1フレームを次のバッチに積む (デコードスレッドから呼ぶ)
+void enq_fanout_frame(enq_fanout_t *f, uint16_t port, const enq_frame_t *frame,
+                      uint64_t now_realtime_ns);
+
+// 残りを送ってから停止する。stats が NULL でなければ最終統計を返す
+void enq_fanout_stop(enq_fanout_t *f, enq_fanout_stats_t *stats);
+
+#endif // ENQ_FANOUT_H
@@ -0,0 +1,295 @@
+// enq_fuzz.c
+// ENQ パーサーのファズ試験 (libFuzzer / AFL++ / 単体実行)
+// ビルド例:
+//   clang -O1 -g -fsanitize=fuzzer,address,undefined -DENQ_FUZZ_LIBFUZZER enq_fuzz.c enq_parser.c enq_simd.c -o enq_fuzz
+//   afl-clang-fast -O2 enq_fuzz.c enq_parser.c enq_simd.c -o enq_fuzz_afl   # afl-fuzz -i seeds -o out -- ./enq_fuzz_afl
+//   gcc -O2 -g -fsanitize=address,undefined enq_fuzz.c enq_parser.c enq_simd.c -o enq_fuzz
+//
+// 使用方法 (libFuzzer 以外):
+//   enq_fuzz <ファイル...>                 各ファイルを1入力として検査する (クラッシュの再現用)
+//   enq_fuzz -seeds <ディレクトリ>         種の入力 (正常・ノイズ・ENQ の連続など) を書き出す
+//   enq_fuzz -random <回数> [-seed 値]     構造を持ったランダム入力を生成して検査する
+//   AFL++ でビルドすると標準入力から読む (永続モード)
+//
+// 入力の先頭2バイトは設定で、残りがシリアルから来るバイト列:
+//   [0] bit0 = ENQ_PARSER_VERIFY_CHECKSUM、bit1 = ENQ_PARSER_CHANGES_ONLY
+//   [1] 投入の区切り方の種 (1〜257 バイトずつ、モニターの read() 相当)
+// 1つの入力を、選択中の SIMD 実装で区切って投入した結果と、スカラー実装で一度に
+// 投入した結果で比べ、加えて次を確かめる。違反すれば内容を表示して abort() する。
+//   - 取り出したフレームは検証を通り、デコードし直しても同じ値になる
+//   - 区切り方と SIMD 実装で、フレームの並びと統計が変わらない
+//   - 読み捨て・フレーム・重複の合計と残り (ENQ_FRAME_LEN - 1 バイト以下) で投入量と一致する。
+//     保持するのは常にリング 1 本分で、入力長に依らない
+//   - 候補として検証した回数は入力中の ENQ の数を超えない (再同期は入力長に対して線形)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "enq_parser.h"
+#include "enq_simd.h"
+
+#define FUZZ_MAX_INPUT (1u << 20)  // これより長い入力は切り詰める
+
+typedef struct {
+    uint16_t station, data_num, value;
+    uint8_t checksum, checksum_ok;
+} fuzz_frame_t;
+
+typedef struct {
+    fuzz_frame_t *frames;
+    size_t count, cap;
+    int flags;
+    const uint8_t *input;   // 失敗時の表示用
+    size_t input_len;
+} fuzz_run_t;
+
+static enq_parser_t parser;
+
+static void fail(const fuzz_run_t *r, const char *what) {
+    fprintf(stderr, "💥 不変条件違反: %s (flags=%d, %zu バイト)\n", what, r->flags, r->input_len);
+    size_t n = r->input_len < 64 ? r->input_len : 64;
+    for (size_t i = 0; i < n; i++) fprintf(stderr, "%02X%s", r->input[i], i + 1 < n ? " " : "\n");
+    abort();
+}
+
+static void on_frame(const enq_frame_t *f, void *ctx) {
+    fuzz_run_t *r = ctx;
+    if (enq_frame_validate(f->raw, r->flags) != ENQ_OK) fail(r, "検証を通らないフレームを返した");
+    enq_frame_t again;
+    enq_frame_decode(f->raw, &again);
+    if (again.station != f->station || again.data_num != f->data_num ||
+        again.value != f->value || again.checksum_ok != f->checksum_ok)
+        fail(r, "デコード結果が生バイトと合わない");
+    if ((r->flags & ENQ_PARSER_VERIFY_CHECKSUM) && !f->checksum_ok)
+        fail(r, "チェックサム検証ありで不一致のフレームを返した");
+    if (r->count == r->cap) fail(r, "フレーム数が入力長 / 16 を超えた");
+    r->frames[r->count++] = (fuzz_frame_t){ f->station, f->data_num, f->value, f->checksum,
+                                            f->checksum_ok };
+}
+
+// data を投入する。chunk_seed が 0 なら一度に、そうでなければ擬似乱数の長さずつ
+static enq_parser_stats_t run(fuzz_run_t *r, const uint8_t *data, size_t len, uint8_t chunk_seed) {
+    enq_parser_init(&parser, r->flags);
+    // 重複抑制を時刻に依らないようにする (同じ値は refresh まで必ず重複)
+    enq_parser_set_clock(&parser, 1);
+    r->count = 0;
+    uint32_t x = chunk_seed * 2654435761u | 1;
+    for (size_t off = 0; off < len;) {
+        size_t n = len - off;
+        if (chunk_seed) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            size_t c = 1 + x % 257;
+            if (c < n) n = c;
+        }
+        enq_parser_push(&parser, data + off, n, on_frame, r);
+        off += n;
+    }
+    enq_parser_stats_t st = *enq_parser_stats(&parser);
+
+    uint64_t pending = parser.tail - parser.head;
+    if (st.bytes_in != len) fail(r, "投入バイト数が合わない");
+    if (pending >= ENQ_FRAME_LEN) fail(r, "フレーム1本分以上を保持したまま止まった");
+    if (pending > 0 && parser.buf[parser.head & ENQ_RING_MASK] != ENQ_CODE)
+        fail(r, "保持している残りが ENQ で始まらない");
+    if (st.resync_bytes + ENQ_FRAME_LEN * (st.frames + st.duplicates) + pending != len)
+        fail(r, "読み捨て・フレーム・残りの合計が投入量と合わない");
+    if (st.frames != r->count) fail(r, "統計のフレーム数が取り出した数と合わない");
+
+    uint64_t enqs = 0;
+    for (size_t i = 0; i < len; i++) enqs += data[i] == ENQ_CODE;
+    uint64_t tries = st.layout_errors + st.frames + st.duplicates;
+    if (r->flags & ENQ_PARSER_VERIFY_CHECKSUM) tries += st.checksum_errors;
+    if (tries > enqs) fail(r, "検証した候補数が ENQ の数を超えた (再走査している)");
+    return st;
+}
+
+static void check_input(const uint8_t *in, size_t size) {
+    if (size < 2) return;
+    if (size > FUZZ_MAX_INPUT) size = FUZZ_MAX_INPUT;
+    int flags = in[0] & (ENQ_PARSER_VERIFY_CHECKSUM | ENQ_PARSER_CHANGES_ONLY);
+    uint8_t chunk_seed = in[1] ? in[1] : 1;
+    const uint8_t *data = in + 2;
+    size_t len = size - 2;
+
+    size_t cap = len / ENQ_FRAME_LEN;
+    fuzz_run_t a = { malloc((cap + 1) * sizeof(fuzz_frame_t)), 0, cap, flags, in, size };
+    fuzz_run_t b = { malloc((cap + 1) * sizeof(fuzz_frame_t)), 0, cap, flags, in, size };
+    if (a.frames == NULL || b.frames == NULL) {
+        free(a.frames);
+        free(b.frames);
+        return;
+    }
+
+    enq_simd_t active = enq_simd_active();
+    enq_parser_stats_t sa = run(&a, data, len, chunk_seed);
+    enq_simd_select(ENQ_SIMD_SCALAR);
+    enq_parser_stats_t sb = run(&b, data, len, 0);
+    enq_simd_select(active);
+
+    if (memcmp(&sa, &sb, sizeof(sa)) != 0) fail(&a, "区切り方・SIMD 実装で統計が変わった");
+    if (a.count != b.count || memcmp(a.frames, b.frames, a.count * sizeof(fuzz_frame_t)) != 0)
+        fail(&a, "区切り方・SIMD 実装でフレームの並びが変わった");
+    free(a.frames);
+    free(b.frames);
+}
+
+#ifdef ENQ_FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    check_input(data, size);
+    return 0;
+}
+
+#else
+
+// ---- 種の入力と構造を持ったランダム入力 ----
+
+static uint32_t rng_state = 1;
+static uint32_t rng(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+// 正常な伝文・途中で切れた伝文・チェックサム違い・ENQ の連続・ゴミを混ぜる
+static size_t make_random(uint8_t *out, size_t cap) {
+    size_t n = 0;
+    out[n++] = (uint8_t)rng();
+    out[n++] = (uint8_t)rng();
+    size_t target = 2 + rng() % (cap - 2);
+    while (n + ENQ_FRAME_LEN <= target) {
+        uint8_t f[ENQ_FRAME_LEN];
+        enq_frame_encode(f, (uint16_t)(rng() % 8), (uint16_t)(1 + rng() % 3), (uint16_t)(rng() % 4));
+        switch (rng() % 6) {
+        case 0:
+            memcpy(out + n, f, ENQ_FRAME_LEN);
+            n += ENQ_FRAME_LEN;
+            break;
+        case 1: {  // 途中で切れる
+            size_t k = 1 + rng() % (ENQ_FRAME_LEN - 1);
+            memcpy(out + n, f, k);
+            n += k;
+            break;
+        }
+        case 2:  // 1バイト化ける (チェックサム・形式・ENQ の偽物)
+            f[rng() % ENQ_FRAME_LEN] = (uint8_t)(rng() % 3 == 0 ? ENQ_CODE : rng());
+            memcpy(out + n, f, ENQ_FRAME_LEN);
+            n += ENQ_FRAME_LEN;
+            break;
+        case 3: {  // ENQ の連続
+            size_t k = 1 + rng() % 40;
+            if (k > target - n) k = target - n;
+            memset(out + n, ENQ_CODE, k);
+            n += k;
+            break;
+        }
+        default: {  // ランダムなバイト
+            size_t k = 1 + rng() % 24;
+            if (k > target - n) k = target - n;
+            for (size_t i = 0; i < k; i++) out[n++] = (uint8_t)rng();
+            break;
+        }
+        }
+    }
+    return n;
+}
+
+static int write_seed(const char *dir, const char *name, const uint8_t *data, size_t len) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL || fwrite(data, 1, len, fp) != len) {
+        fprintf(stderr, "❌ %s を書けません\n", path);
+        if (fp) fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int write_seeds(const char *dir) {
+    static uint8_t buf[2 + 64 * ENQ_FRAME_LEN];
+    size_t len = 64 * ENQ_FRAME_LEN;
+    int rc = 0;
+
+    // 正常な伝文の連続 (設定ごと)
+    for (int i = 0; i < 64; i++)
+        enq_frame_encode(buf + 2 + i * ENQ_FRAME_LEN, (uint16_t)(i % 4), (uint16_t)(1 + i % 3), (uint16_t)(i / 3));
+    for (int flags = 0; flags < 4; flags++) {
+        char name[32];
+        snprintf(name, sizeof(name), "frames_%d", flags);
+        buf[0] = (uint8_t)flags;
+        buf[1] = 7;
+        rc |= write_seed(dir, name, buf, sizeof(buf));
+    }
+    // チェックサムだけ違う (検証ありで全部捨てる)
+    for (int i = 0; i < 64; i++) buf[2 + i * ENQ_FRAME_LEN + 15] ^= 0x01;
+    buf[0] = ENQ_PARSER_VERIFY_CHECKSUM;
+    rc |= write_seed(dir, "bad_checksum", buf, sizeof(buf));
+    // ENQ だけ
+    memset(buf + 2, ENQ_CODE, len);
+    buf[0] = 0;
+    rc |= write_seed(dir, "all_enq", buf, sizeof(buf));
+    // ランダム
+    rng_state = 12345;
+    for (int i = 0; i < 8; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "mixed_%d", i);
+        rc |= write_seed(dir, name, buf, make_random(buf, sizeof(buf)));
+    }
+    if (rc == 0) printf("🌱 種の入力を %s に書き出しました\n", dir);
+    return rc ? 1 : 0;
+}
+
+static uint8_t input[FUZZ_MAX_INPUT];
+
+static int check_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "❌ %s を開けません\n", path);
+        return 1;
+    }
+    size_t n = fread(input, 1, sizeof(input), fp);
+    fclose(fp);
+    check_input(input, n);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+    // AFL++ の永続モード: 標準入力から1入力ずつ読む
+    (void)argc;
+    (void)argv;
+    while (__AFL_LOOP(10000)) {
+        size_t n = fread(input, 1, sizeof(input), stdin);
+        check_input(input, n);
+    }
+    return 0;
+#else
+    if (argc >= 3 && strcmp(argv[1], "-seeds") == 0) return write_seeds(argv[2]);
+    if (argc >= 3 && strcmp(argv[1], "-random") == 0) {
+        unsigned long runs = strtoul(argv[2], NULL, 10);
+        if (argc >= 5 && strcmp(argv[3], "-seed") == 0) rng_state = (uint32_t)strtoul(argv[4], NULL, 10);
+        if (rng_state == 0) rng_state = 1;
+        static uint8_t buf[2 + 256 * ENQ_FRAME_LEN];
+        for (unsigned long i = 0; i < runs; i++) check_input(buf, make_random(buf, sizeof(buf)));
+        printf("✅ %lu 入力で不変条件を満たしました (SIMD %s)\n", runs, enq_simd_name(enq_simd_active()));
+        return 0;
+    }
+    if (argc < 2) {
+        printf("使用方法: %s <ファイル...> | -seeds <ディレクトリ> | -random <回数> [-seed 値]\n", argv[0]);
+        return 1;
+    }
+    int rc = 0;
+    for (int i = 1; i < argc; i++) rc |= check_file(argv[i]);
+    if (rc == 0) printf("✅ %d ファイルで不変条件を満たしました\n", argc - 1);
+    return rc;
+#endif
+}
+
+#endif // ENQ_FUZZ_LIBFUZZER
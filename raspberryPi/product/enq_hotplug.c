@@ -0,0 +1,152 @@
+// enq_hotplug.c
+// シリアルポートの抜き差しの検出 (Linux: カーネルの uevent)
+// ビルド例: serial_debug_test.c と一緒にリンクする
+
+#define _GNU_SOURCE
+#include "enq_hotplug.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#define UEVENT_BUF 8192  // 1件の通知 (KEY=VALUE の並び) の最大長
+#define UEVENT_GROUP_KERNEL 1
+
+int enq_hotplug_open(void) {
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) return -1;
+    struct sockaddr_nl addr = {
+        .nl_family = AF_NETLINK,
+        .nl_pid = 0,  // カーネルに割り当てさせる
+        .nl_groups = UEVENT_GROUP_KERNEL,
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
+
+int enq_hotplug_match(const char *match, const char *name) {
+    const char *p = match;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        char pat[ENQ_HOTPLUG_PATH_MAX];
+        if (len > 0 && len < sizeof(pat)) {
+            memcpy(pat, p, len);
+            pat[len] = '\0';
+            if (fnmatch(pat, name, 0) == 0) return 1;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    return 0;
+}
+
+int enq_hotplug_read(int fd, const char *match, enq_hotplug_event_t *ev) {
+    char buf[UEVENT_BUF];
+    for (;;) {
+        struct sockaddr_nl src;
+        struct iovec iov = { buf, sizeof(buf) - 1 };
+        struct msghdr msg = { .msg_name = &src, .msg_namelen = sizeof(src),
+                              .msg_iov = &iov, .msg_iovlen = 1 };
+        ssize_t n = recvmsg(fd, &msg, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            // ENOBUFS は取りこぼし (通知が多すぎた)。次の通知から続ける
+            if (errno == ENOBUFS) continue;
+            return -1;
+        }
+        // カーネル以外 (ほかのプロセス) から送られたものは信用しない
+        if (src.nl_pid != 0) continue;
+        buf[n] = '\0';
+
+        // "ACTION@DEVPATH\0ACTION=add\0SUBSYSTEM=tty\0DEVNAME=ttyUSB0\0..."
+        const char *action = NULL, *subsystem = NULL, *devname = NULL;
+        for (size_t off = strlen(buf) + 1; off < (size_t)n; off += strlen(buf + off) + 1) {
+            const char *kv = buf + off;
+            if (strncmp(kv, "ACTION=", 7) == 0) action = kv + 7;
+            else if (strncmp(kv, "SUBSYSTEM=", 10) == 0) subsystem = kv + 10;
+            else if (strncmp(kv, "DEVNAME=", 8) == 0) devname = kv + 8;
+        }
+        if (action == NULL || subsystem == NULL || devname == NULL) continue;
+        if (strcmp(subsystem, "tty") != 0) continue;
+        if (strcmp(action, "add") == 0) ev->action = ENQ_HOTPLUG_ADD;
+        else if (strcmp(action, "remove") == 0) ev->action = ENQ_HOTPLUG_REMOVE;
+        else continue;
+        // DEVNAME は /dev からの相対名 (絶対パスで来ることもある)
+        const char *base = strrchr(devname, '/');
+        if (!enq_hotplug_match(match, base ? base + 1 : devname)) continue;
+        if (devname[0] == '/') snprintf(ev->path, sizeof(ev->path), "%s", devname);
+        else snprintf(ev->path, sizeof(ev->path), "/dev/%s", devname);
+        return 1;
+    }
+}
+
+static int cmp_path(const void *a, const void *b) {
+    return strcmp(a, b);
+}
+
+size_t enq_hotplug_scan(const char *match, char paths[][ENQ_HOTPLUG_PATH_MAX], size_t max) {
+    DIR *d = opendir("/sys/class/tty");
+    if (d == NULL) return 0;
+    size_t n = 0;
+    struct dirent *e;
+    while (n < max && (e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.' || !enq_hotplug_match(match, e->d_name)) continue;
+        char path[ENQ_HOTPLUG_PATH_MAX];
+        if (snprintf(path, sizeof(path), "/dev/%s", e->d_name) >= (int)sizeof(path)) continue;
+        if (access(path, F_OK) != 0) continue;
+        memcpy(paths[n++], path, sizeof(path));
+    }
+    closedir(d);
+    qsort(paths, n, ENQ_HOTPLUG_PATH_MAX, cmp_path);
+    return n;
+}
+
+int enq_hotplug_watch_open(void) {
+    return inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+int enq_hotplug_watch_add(int fd, const char *path) {
+    char dir[ENQ_HOTPLUG_PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) {
+        snprintf(dir, sizeof(dir), ".");
+    } else {
+        size_t n = slash == path ? 1 : (size_t)(slash - path);
+        if (n >= sizeof(dir)) n = sizeof(dir) - 1;
+        memcpy(dir, path, n);
+        dir[n] = '\0';
+    }
+    // by-id のシンボリックリンクは udev が最後に作るので IN_CREATE、権限は IN_ATTRIB で分かる
+    return inotify_add_watch(fd, dir, IN_CREATE | IN_ATTRIB | IN_MOVED_TO) < 0 ? -1 : 0;
+}
+
+int enq_hotplug_watch_drain(int fd) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int count = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return count;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            const struct inotify_event *e = (const struct inotify_event *)(buf + off);
+            off += (ssize_t)(sizeof(*e) + e->len);
+            count++;
+        }
+    }
+}
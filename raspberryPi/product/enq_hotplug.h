@@ -0,0 +1,56 @@
+// enq_hotplug.h
+// シリアルポートの抜き差しの検出 (Linux: カーネルの uevent)
+//
+// 起動時に候補のポートを1つずつ開いて確かめる代わりに、/sys/class/tty に既にある
+// デバイスを名前で選び (開かない)、以降は netlink の uevent (udev が受けるのと同じ
+// カーネルの通知) で tty の追加・削除を受け取る。libudev には依存しない。
+// カーネルの通知は udev の規則 (権限・グループの設定) より先に届くので、追加直後の
+// open() が EACCES / ENOENT になることがある。呼び出し側は少し待って開き直す。
+//
+// 切断したポートの再接続には enq_hotplug_watch_*() を使う。ノードのあるディレクトリを
+// inotify で見張り、ノードの作成と udev による権限の変更 (IN_ATTRIB) のたびに起こすので、
+// 挿し直してから開けるようになるまでの待ちがほぼなくなる (名前の一致も不要)。
+//
+// 名前の指定 (match) は "ttyUSB*,ttyACM*" のような fnmatch のパターンをカンマで並べたもの。
+// /dev からの相対名 (DEVNAME) と比べる。
+
+#ifndef ENQ_HOTPLUG_H
+#define ENQ_HOTPLUG_H
+
+#include <stddef.h>
+
+#define ENQ_HOTPLUG_DEFAULT_MATCH "ttyUSB*,ttyACM*"
+#define ENQ_HOTPLUG_PATH_MAX 64     // "/dev/ttyUSB0" など
+
+typedef enum {
+    ENQ_HOTPLUG_ADD = 1,
+    ENQ_HOTPLUG_REMOVE,
+} enq_hotplug_action_t;
+
+typedef struct {
+    enq_hotplug_action_t action;
+    char path[ENQ_HOTPLUG_PATH_MAX];  // "/dev/ttyUSB0"
+} enq_hotplug_event_t;
+
+// uevent を受ける非ブロッキングのソケットを開く (epoll に登録して使う)。失敗時は -1 (errno)
+int enq_hotplug_open(void);
+
+// 届いている通知を1件取り出す。match に合う tty の追加・削除だけを返し、ほかは読み捨てる。
+// 戻り値: 1 = ev に格納 / 0 = もうない / -1 = エラー (errno)
+int enq_hotplug_read(int fd, const char *match, enq_hotplug_event_t *ev);
+
+// name ("ttyUSB0") が match のどれかに合えば 1
+int enq_hotplug_match(const char *match, const char *name);
+
+// /sys/class/tty から match に合い、/dev にノードがあるものを paths に並べる (名前順)。
+// 戻り値は個数 (max まで)
+size_t enq_hotplug_scan(const char *match, char paths[][ENQ_HOTPLUG_PATH_MAX], size_t max);
+
+// ノードの作成・権限の変更を見張る非ブロッキングの inotify を開く。失敗時は -1 (errno)
+int enq_hotplug_watch_open(void);
+// path ("/dev/ttyUSB0") のあるディレクトリを見張りに加える (同じディレクトリは1つにまとまる)
+int enq_hotplug_watch_add(int fd, const char *path);
+// 届いている通知を読み捨てる。戻り値は件数 (何か変わったので開き直してみる合図)
+int enq_hotplug_watch_drain(int fd);
+
+#endif // ENQ_HOTPLUG_H
@@ -0,0 +1,581 @@
+// enq_log.c
+// 非同期・間引き付きの構造化ログ (Win32 / POSIX)
+// ビルド例: serial_debug_test.c / elevator_enq_sim.c と一緒にリンクする (POSIX は -pthread)
+//
+// リングは Vyukov の有界キュー (スロットごとの通番で空き・公開を判定する)。
+// 積む側は複数スレッドでよく、取り出すのはログスレッドだけ。
+
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include "enq_log.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+enum { FMT_TEXT, FMT_JSON, FMT_BIN };
+static const char *const format_names[] = { "text", "json", "bin" };
+
+#define OUT_BUF_SIZE   (64 * 1024)
+#define REC_OUT_MAX    2048      // 1レコードの出力の上限 (JSON の HEX 展開を含む)
+#define IDLE_SLEEP_MIN 1         // 空のときの待ち (ms)。続けて空なら倍にしていく
+#define IDLE_SLEEP_MAX 50
+#define REPORT_NS      1000000000ull
+
+typedef struct {
+    _Atomic uint64_t seq;
+    enq_log_rec_t rec;
+} log_slot_t;
+
+// カテゴリごとの間引きの状態 (積む側が更新する)
+typedef struct {
+    uint32_t rate;
+    uint32_t sample;
+    int off;
+    _Atomic uint64_t window;      // rate を数えている秒
+    _Atomic uint32_t window_count;
+    _Atomic uint32_t sample_count;
+    _Atomic uint64_t suppressed;
+    _Atomic uint64_t dropped;
+    uint64_t reported_suppressed; // ログスレッドが前回集計した値
+    uint64_t reported_dropped;
+} cat_state_t;
+
+static struct {
+    const enq_log_category_t *cats;
+    unsigned ncats;
+    const enq_log_event_t *events;
+    unsigned nevents;
+    cat_state_t cat[ENQ_LOG_MAX_CATS];
+    int format;
+    char path[512];
+    FILE *out;                    // 出力先 (text の to_stderr は stderr)
+    atomic_int running;           // ログスレッドが取り出している
+    atomic_int stop;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    _Atomic uint64_t logged;
+    _Atomic uint64_t written;
+    char outbuf[OUT_BUF_SIZE];    // ログスレッドだけが使う
+    size_t outlen;
+} g;
+
+static log_slot_t slots[ENQ_LOG_SLOTS];
+static _Alignas(64) _Atomic uint64_t ring_tail;  // 積む側が進める
+static _Alignas(64) _Atomic uint64_t ring_head;  // ログスレッドが進める
+
+static uint64_t realtime_ns(void) {
+#ifdef _WIN32
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);  // 分解能はティック単位 (表示の時刻には十分)
+    uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (t - 116444736000000000ull) * 100;  // 1601年起点の 100ns → UNIX 時刻の ns
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void sleep_ms(unsigned ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts = { 0, (long)ms * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+void enq_log_printf(enq_log_buf_t *o, const char *fmt, ...) {
+    if (o->len + 1 >= o->cap) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    o->len += (size_t)n < o->cap - o->len ? (size_t)n : o->cap - o->len - 1;
+}
+
+// ---- 設定 ----
+
+int enq_log_init(const enq_log_category_t *cats, unsigned ncats,
+                 const enq_log_event_t *events, unsigned nevents) {
+    if (ncats > ENQ_LOG_MAX_CATS || nevents >= ENQ_LOG_EV_SUPPRESSED) return -1;
+    memset(&g.cat, 0, sizeof(g.cat));
+    g.cats = cats;
+    g.ncats = ncats;
+    g.events = events;
+    g.nevents = nevents;
+    g.format = FMT_TEXT;
+    g.path[0] = '\0';
+    for (unsigned i = 0; i < ncats; i++) {
+        g.cat[i].rate = cats[i].rate;
+        g.cat[i].sample = cats[i].sample;
+    }
+    for (unsigned i = 0; i < ENQ_LOG_SLOTS; i++) atomic_init(&slots[i].seq, i);
+    atomic_store(&ring_tail, 0);
+    atomic_store(&ring_head, 0);
+    return 0;
+}
+
+static int find_category(const char *name, size_t len) {
+    for (unsigned i = 0; i < g.ncats; i++) {
+        if (strlen(g.cats[i].name) == len && memcmp(g.cats[i].name, name, len) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// "N/s" / "1/N" / "off" / "all" をカテゴリに適用する
+static int parse_limit(const char *v, cat_state_t *c) {
+    char *end;
+    if (strcmp(v, "off") == 0) {
+        c->off = 1;
+        return 0;
+    }
+    if (strcmp(v, "all") == 0) {
+        c->off = 0;
+        c->rate = 0;
+        c->sample = 0;
+        return 0;
+    }
+    unsigned long a = strtoul(v, &end, 10);
+    if (end == v || *end != '/') return -1;
+    const char *rest = end + 1;
+    if (strcmp(rest, "s") == 0) {
+        c->off = 0;
+        c->rate = (uint32_t)a;
+        return 0;
+    }
+    unsigned long b = strtoul(rest, &end, 10);
+    if (end == rest || *end != '\0' || a != 1 || b == 0) return -1;
+    c->off = 0;
+    c->sample = (uint32_t)b;
+    return 0;
+}
+
+int enq_log_configure(const char *spec) {
+    if (spec == NULL || *spec == '\0') return 0;
+    // 全項目を検証してから適用する
+    cat_state_t cat[ENQ_LOG_MAX_CATS];
+    memcpy(cat, g.cat, sizeof(cat));
+    int format = g.format;
+    char path[sizeof(g.path)];
+    memcpy(path, g.path, sizeof(path));
+
+    const char *p = spec;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        char item[600];
+        if (len == 0 || len >= sizeof(item)) return -1;
+        memcpy(item, p, len);
+        item[len] = '\0';
+        char *eq = strchr(item, '=');
+        if (eq == NULL) {
+            int f = -1;
+            for (int i = 0; i < 3; i++) {
+                if (strcmp(item, format_names[i]) == 0) f = i;
+            }
+            if (f < 0) return -1;
+            format = f;
+        } else if (eq - item == 4 && memcmp(item, "file", 4) == 0) {
+            if (strlen(eq + 1) >= sizeof(path) || eq[1] == '\0') return -1;
+            strcpy(path, eq + 1);
+        } else {
+            int c = find_category(item, (size_t)(eq - item));
+            if (c < 0 || parse_limit(eq + 1, &cat[c]) < 0) return -1;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    if (format == FMT_BIN && path[0] == '\0') return -1;
+
+    memcpy(g.cat, cat, sizeof(cat));
+    g.format = format;
+    memcpy(g.path, path, sizeof(path));
+    return 0;
+}
+
+const char *enq_log_format_name(void) {
+    return format_names[g.format];
+}
+
+// ---- 書式化 (ログスレッド、起動前は呼び出し側) ----
+
+static void put_json_str(enq_log_buf_t *o, const uint8_t *s, size_t n, int kind) {
+    static const char hex[] = "0123456789ABCDEF";
+    if (o->len + 2 + n * 6 >= o->cap) return;
+    char *d = o->buf + o->len;
+    *d++ = '"';
+    for (size_t i = 0; i < n; i++) {
+        uint8_t c = s[i];
+        if (kind == ENQ_LOG_STR_HEX) {
+            *d++ = hex[c >> 4];
+            *d++ = hex[c & 15];
+        } else if (c == '"' || c == '\\') {
+            *d++ = '\\';
+            *d++ = (char)c;
+        } else if (c < 0x20) {
+            memcpy(d, "\\u00", 4);
+            d[4] = hex[c >> 4];
+            d[5] = hex[c & 15];
+            d += 6;
+        } else {
+            *d++ = (char)c;
+        }
+    }
+    *d++ = '"';
+    o->len = (size_t)(d - o->buf);
+}
+
+static const char *category_name(unsigned c) {
+    return c < g.ncats ? g.cats[c].name : "?";
+}
+
+static void format_json(const enq_log_rec_t *r, enq_log_buf_t *o) {
+    enq_log_printf(o, "{\"t\":%llu.%09u", (unsigned long long)(r->t_ns / 1000000000ull),
+                   (unsigned)(r->t_ns % 1000000000ull));
+    if (r->event == ENQ_LOG_EV_SUPPRESSED) {
+        enq_log_printf(o, ",\"cat\":\"%s\",\"ev\":\"suppressed\",\"sampled_out\":%llu,\"dropped\":%llu}\n",
+                       category_name((unsigned)r->arg[0]), (unsigned long long)r->arg[1],
+                       (unsigned long long)r->arg[2]);
+        return;
+    }
+    const enq_log_event_t *ev = &g.events[r->event];
+    enq_log_printf(o, ",\"cat\":\"%s\",\"ev\":\"%s\"", category_name(ev->category), ev->name);
+    for (int i = 0; i < ENQ_LOG_ARGS && ev->keys[i]; i++) {
+        if (ev->signed_mask & (1u << i)) {
+            enq_log_printf(o, ",\"%s\":%lld", ev->keys[i], (long long)(int64_t)r->arg[i]);
+        } else {
+            enq_log_printf(o, ",\"%s\":%llu", ev->keys[i], (unsigned long long)r->arg[i]);
+        }
+    }
+    if (ev->str_key) {
+        enq_log_printf(o, ",\"%s\":", ev->str_key);
+        put_json_str(o, r->str, r->str_len, ev->str_kind);
+    }
+    enq_log_printf(o, "}\n");
+}
+
+static void format_text(const enq_log_rec_t *r, enq_log_buf_t *o) {
+    if (r->event == ENQ_LOG_EV_SUPPRESSED) {
+        enq_log_printf(o, "⏬ ログ %s: 直近1秒で 間引き %llu 件 / 溢れ %llu 件\n",
+                       category_name((unsigned)r->arg[0]), (unsigned long long)r->arg[1],
+                       (unsigned long long)r->arg[2]);
+        return;
+    }
+    g.events[r->event].text(r, o);
+}
+
+static int record_to_stderr(const enq_log_rec_t *r) {
+    unsigned c = r->event == ENQ_LOG_EV_SUPPRESSED ? (unsigned)r->arg[0]
+                                                   : g.events[r->event].category;
+    return g.format == FMT_TEXT && c < g.ncats && g.cats[c].to_stderr;
+}
+
+// 起動前 (または起動に失敗したとき) はその場で書く
+static void emit_now(const enq_log_rec_t *r) {
+    char line[REC_OUT_MAX];
+    enq_log_buf_t o = { line, 0, sizeof(line) };
+    if (g.format == FMT_JSON) format_json(r, &o);
+    else format_text(r, &o);
+    FILE *f = record_to_stderr(r) ? stderr : stdout;
+    fwrite(line, 1, o.len, f);
+    atomic_fetch_add_explicit(&g.written, 1, memory_order_relaxed);
+}
+
+// ---- 積む側 ----
+
+// rate / sample の判定。通すなら 1
+static int admit(cat_state_t *c, uint64_t now_ns) {
+    if (c->off) return 0;
+    if (c->sample > 1 &&
+        atomic_fetch_add_explicit(&c->sample_count, 1, memory_order_relaxed) % c->sample != 0) {
+        return 0;
+    }
+    if (c->rate) {
+        uint64_t sec = now_ns / 1000000000ull;
+        uint64_t w = atomic_load_explicit(&c->window, memory_order_relaxed);
+        if (w != sec && atomic_compare_exchange_strong_explicit(&c->window, &w, sec,
+                                                                memory_order_relaxed,
+                                                                memory_order_relaxed)) {
+            atomic_store_explicit(&c->window_count, 0, memory_order_relaxed);
+        }
+        if (atomic_fetch_add_explicit(&c->window_count, 1, memory_order_relaxed) >= c->rate) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void fill(enq_log_rec_t *r, uint64_t t_ns, unsigned event, const void *str,
+                 size_t str_len, const uint64_t args[ENQ_LOG_ARGS]) {
+    if (str_len > ENQ_LOG_STR_MAX) str_len = ENQ_LOG_STR_MAX;
+    r->t_ns = t_ns;
+    r->event = (uint16_t)event;
+    r->str_len = (uint8_t)str_len;
+    memcpy(r->arg, args, sizeof(r->arg));
+    if (str_len) memcpy(r->str, str, str_len);
+}
+
+int enq_log(unsigned event, const void *str, size_t str_len, const uint64_t args[ENQ_LOG_ARGS]) {
+    if (event >= g.nevents) return 0;
+    cat_state_t *c = &g.cat[g.events[event].category];
+    uint64_t now = realtime_ns();
+    if (!admit(c, now)) {
+        atomic_fetch_add_explicit(&c->suppressed, 1, memory_order_relaxed);
+        return 0;
+    }
+    atomic_fetch_add_explicit(&g.logged, 1, memory_order_relaxed);
+
+    if (!atomic_load_explicit(&g.running, memory_order_acquire)) {
+        enq_log_rec_t r;
+        fill(&r, now, event, str, str_len, args);
+        emit_now(&r);
+        return 1;
+    }
+
+    uint64_t pos = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    log_slot_t *s;
+    for (;;) {
+        s = &slots[pos & (ENQ_LOG_SLOTS - 1)];
+        uint64_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        int64_t dif = (int64_t)(seq - pos);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            // 一周前のレコードがまだ書き出されていない (満杯)
+            atomic_fetch_add_explicit(&c->dropped, 1, memory_order_relaxed);
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+        }
+    }
+    fill(&s->rec, now, event, str, str_len, args);
+    atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+// ---- ログスレッド ----
+
+static void out_flush(void) {
+    if (g.outlen) fwrite(g.outbuf, 1, g.outlen, g.out);
+    g.outlen = 0;
+}
+
+static void write_record(const enq_log_rec_t *r) {
+    if (g.format == FMT_BIN) {
+        if (g.outlen + sizeof(*r) > sizeof(g.outbuf)) out_flush();
+        memcpy(g.outbuf + g.outlen, r, sizeof(*r));
+        g.outlen += sizeof(*r);
+        return;
+    }
+    if (record_to_stderr(r)) {
+        // 標準エラーは件数が少ない (カテゴリで制限する) ので、順序を保ってその場で書く
+        out_flush();
+        fflush(g.out);
+        char line[REC_OUT_MAX];
+        enq_log_buf_t o = { line, 0, sizeof(line) };
+        format_text(r, &o);
+        fwrite(line, 1, o.len, stderr);
+        return;
+    }
+    if (g.outlen + REC_OUT_MAX > sizeof(g.outbuf)) out_flush();
+    enq_log_buf_t o = { g.outbuf + g.outlen, 0, REC_OUT_MAX };
+    if (g.format == FMT_JSON) format_json(r, &o);
+    else format_text(r, &o);
+    g.outlen += o.len;
+}
+
+// 積まれている分を書き出す。戻り値は件数
+static size_t drain(void) {
+    size_t n = 0;
+    uint64_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    for (;;) {
+        log_slot_t *s = &slots[head & (ENQ_LOG_SLOTS - 1)];
+        if (atomic_load_explicit(&s->seq, memory_order_acquire) != head + 1) break;
+        write_record(&s->rec);
+        atomic_store_explicit(&s->seq, head + ENQ_LOG_SLOTS, memory_order_release);
+        head++;
+        n++;
+        atomic_store_explicit(&ring_head, head, memory_order_release);
+    }
+    if (n) {
+        atomic_fetch_add_explicit(&g.written, n, memory_order_relaxed);
+        out_flush();
+        fflush(g.out);
+    }
+    return n;
+}
+
+// 前回から増えた間引き・溢れをカテゴリごとに1レコードにする
+static void report_suppressed(void) {
+    int any = 0;
+    for (unsigned i = 0; i < g.ncats; i++) {
+        cat_state_t *c = &g.cat[i];
+        uint64_t s = atomic_load_explicit(&c->suppressed, memory_order_relaxed);
+        uint64_t d = atomic_load_explicit(&c->dropped, memory_order_relaxed);
+        // off のカテゴリは出さないと決めたものなので報告しない
+        if ((s == c->reported_suppressed || c->off) && d == c->reported_dropped) continue;
+        enq_log_rec_t r;
+        memset(&r, 0, sizeof(r));
+        r.t_ns = realtime_ns();
+        r.event = ENQ_LOG_EV_SUPPRESSED;
+        r.arg[0] = i;
+        r.arg[1] = c->off ? 0 : s - c->reported_suppressed;
+        r.arg[2] = d - c->reported_dropped;
+        c->reported_suppressed = s;
+        c->reported_dropped = d;
+        write_record(&r);
+        any = 1;
+    }
+    if (any) {
+        out_flush();
+        fflush(g.out);
+    }
+}
+
+static void log_thread_main(void) {
+    unsigned idle_ms = IDLE_SLEEP_MIN;
+    uint64_t last_report = realtime_ns();
+    for (;;) {
+        size_t n = drain();
+        uint64_t now = realtime_ns();
+        if (now - last_report >= REPORT_NS) {
+            report_suppressed();
+            last_report = now;
+        }
+        if (n) {
+            idle_ms = IDLE_SLEEP_MIN;
+            continue;
+        }
+        if (atomic_load(&g.stop)) break;
+        sleep_ms(idle_ms);
+        if (idle_ms < IDLE_SLEEP_MAX) idle_ms *= 2;
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI log_thread(LPVOID arg) {
+    (void)arg;
+    log_thread_main();
+    return 0;
+}
+#else
+static void *log_thread(void *arg) {
+    (void)arg;
+    log_thread_main();
+    return NULL;
+}
+#endif
+
+static int write_bin_header(FILE *f) {
+    uint16_t hdr[2] = { (uint16_t)sizeof(enq_log_rec_t), (uint16_t)g.nevents };
+    if (fwrite("ENQLOG1\n", 1, 8, f) != 8 || fwrite(hdr, sizeof(hdr), 1, f) != 1) return -1;
+    for (unsigned i = 0; i < g.nevents; i++) {
+        const enq_log_event_t *ev = &g.events[i];
+        char desc[512];
+        enq_log_buf_t o = { desc, 0, sizeof(desc) };
+        enq_log_printf(&o, "%s\t%s\t", ev->name, category_name(ev->category));
+        for (int k = 0; k < ENQ_LOG_ARGS && ev->keys[k]; k++) {
+            enq_log_printf(&o, "%s%s", k ? "," : "", ev->keys[k]);
+        }
+        uint16_t len = (uint16_t)o.len;
+        if (fwrite(&len, sizeof(len), 1, f) != 1 || fwrite(desc, 1, len, f) != len) return -1;
+    }
+    return 0;
+}
+
+int enq_log_start(void) {
+    g.out = stdout;
+    if (g.path[0]) {
+        // bin は先頭にイベント表を書くので作り直す。text / json は追記する
+        g.out = fopen(g.path, g.format == FMT_BIN ? "wb" : "a");
+        if (g.out == NULL) {
+            g.out = stdout;
+            return -1;
+        }
+        if (g.format == FMT_BIN && write_bin_header(g.out) < 0) {
+            int e = errno;
+            fclose(g.out);
+            g.out = stdout;
+            errno = e;
+            return -1;
+        }
+    }
+    atomic_store(&g.stop, 0);
+#ifdef _WIN32
+    g.thread = CreateThread(NULL, 0, log_thread, NULL, 0, NULL);
+    int err = g.thread == NULL ? EAGAIN : 0;
+#else
+    // シグナルは呼び出し側のスレッド (signalfd やハンドラー) で受けるので、すべてブロックして起動する
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&g.thread, NULL, log_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+    if (err) {
+        if (g.out != stdout) fclose(g.out);
+        g.out = stdout;
+        errno = err;
+        return -1;
+    }
+    atomic_store_explicit(&g.running, 1, memory_order_release);
+    return 0;
+}
+
+void enq_log_flush(void) {
+    if (!atomic_load(&g.running)) {
+        fflush(stdout);
+        return;
+    }
+    uint64_t target = atomic_load(&ring_tail);
+    // 止まった出力先で待ち続けないよう、上限を切る
+    for (int i = 0; i < 2000 && atomic_load(&ring_head) < target; i++) sleep_ms(1);
+}
+
+void enq_log_stop(void) {
+    if (!atomic_load(&g.running)) return;
+    atomic_store(&g.stop, 1);
+#ifdef _WIN32
+    WaitForSingleObject(g.thread, INFINITE);
+    CloseHandle(g.thread);
+#else
+    pthread_join(g.thread, NULL);
+#endif
+    atomic_store(&g.running, 0);
+    // 止めている間に積まれた分 (スレッドが抜けた後) を書き出す
+    drain();
+    report_suppressed();
+    if (g.out != stdout) fclose(g.out);
+    else fflush(stdout);
+    g.out = stdout;
+}
+
+void enq_log_get_stats(enq_log_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->logged = atomic_load_explicit(&g.logged, memory_order_relaxed);
+    out->written = atomic_load_explicit(&g.written, memory_order_relaxed);
+    for (unsigned i = 0; i < g.ncats; i++) {
+        out->suppressed += atomic_load_explicit(&g.cat[i].suppressed, memory_order_relaxed);
+        out->dropped += atomic_load_explicit(&g.cat[i].dropped, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,122 @@
+// enq_log.h
+// 非同期・間引き付きの構造化ログ (シミュレーターと受信側で共用、Win32 / POSIX)
+//
+// 伝文ごとの表示のように頻度の高いログは、呼び出し側では固定長のレコード
+// (enq_log_rec_t: 時刻・イベント番号・整数6個・短いバイト列) をロックフリーの
+// リングに積むだけにする。書式化とコンソール・ファイルへの書き込みはログスレッドが
+// まとめて行うので、遅いコンソール (Windows の仮想端末処理を有効にした conhost など) でも
+// 送受信のループは止まらない。リングが満杯なら積まずに捨てて数える (呼び出し側は待たない)。
+//
+// イベントは enq_log_event_t の表で定義する。名前・カテゴリ・整数のキー名と、
+// 人が読む1行を作る関数を持つ。出力形式は3つ:
+//   text : イベントの text() が作る行 (従来の printf と同じ表示)
+//   json : 1行1レコードの JSON ({"t":時刻,"cat":..,"ev":..,キー:値,...})
+//   bin  : 先頭にイベント表を書き、以降はレコードをそのまま並べる (下記)
+//
+// カテゴリごとに 1秒あたりの上限 (rate) と N 件に1件の間引き (sample) を指定でき、
+// 判定は積む前に呼び出し側で行う (捨てる分は書式化もリングも通らない)。
+// 間引いた件数・溢れた件数は1秒ごとにまとめて1レコードとして出す。
+//
+// 設定は enq_log_configure() に "json,file=/var/log/enq.jsonl,rx=200/s,tx=1/10" の
+// ような文字列で渡す (各プログラムは環境変数 ENQ_LOG から読む):
+//   text | json | bin    出力形式 (既定 text)
+//   file=パス            標準出力の代わりにファイルへ書く (text / json は追記、
+//                        bin は作り直す。bin では必須)
+//   カテゴリ=N/s         1秒あたり N 件まで
+//   カテゴリ=1/N         N 件に1件だけ出す
+//   カテゴリ=off         出さない / カテゴリ=all で制限なし
+//
+// bin 形式: "ENQLOG1\n" / uint16 レコード長 / uint16 イベント数 / イベントごとに
+//   uint16 長さ + "名前\tカテゴリ\tキー,キー,..." を並べ、以降は enq_log_rec_t
+//   (ネイティブのバイト順) が続く。event == ENQ_LOG_EV_SUPPRESSED は間引きの集計。
+
+#ifndef ENQ_LOG_H
+#define ENQ_LOG_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENQ_LOG_ARGS     6
+#define ENQ_LOG_STR_MAX  32     // 伝文16バイトとポート名程度が入る
+#define ENQ_LOG_SLOTS    4096   // リングのスロット数 (2のべき乗)
+#define ENQ_LOG_MAX_CATS 16
+
+// 間引き・溢れの集計 (arg[0] = カテゴリ番号, arg[1] = 間引いた件数, arg[2] = 溢れた件数)
+#define ENQ_LOG_EV_SUPPRESSED 0xFFFFu
+
+typedef struct {
+    uint64_t t_ns;                 // 積んだ時刻 (UNIX 時刻の ns)
+    uint16_t event;                // enq_log_init() に渡した表の番号
+    uint8_t  str_len;
+    uint8_t  pad[5];
+    uint64_t arg[ENQ_LOG_ARGS];
+    uint8_t  str[ENQ_LOG_STR_MAX];
+} enq_log_rec_t;
+
+// text() の書き込み先 (ログスレッドの固定バッファ。溢れた分は切り捨てる)
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} enq_log_buf_t;
+
+void enq_log_printf(enq_log_buf_t *o, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+typedef struct {
+    const char *name;      // 設定と JSON の "cat"
+    int to_stderr;         // text 形式では標準エラーに出す
+    uint32_t rate;         // 既定の 1秒あたりの上限 (0 なら制限なし)
+    uint32_t sample;       // 既定の間引き (N 件に1件、0/1 ならすべて)
+} enq_log_category_t;
+
+#define ENQ_LOG_STR_TEXT 0  // str を JSON の文字列として出す
+#define ENQ_LOG_STR_HEX  1  // str を HEX 文字列として出す (伝文など制御文字を含むもの)
+
+typedef struct {
+    const char *name;                   // JSON の "ev"
+    unsigned category;                  // enq_log_init() に渡したカテゴリ表の番号
+    const char *keys[ENQ_LOG_ARGS];     // arg[i] の JSON のキー (NULL 以降は出さない)
+    unsigned signed_mask;               // ビット i が立っていれば arg[i] を int64_t として出す
+    const char *str_key;                // str の JSON のキー (NULL なら出さない)
+    int str_kind;                       // ENQ_LOG_STR_TEXT / ENQ_LOG_STR_HEX
+    // 人が読む表示 (改行まで書く)。ログスレッドから呼ばれるので、読むのは
+    // レコードの中身と不変のデータだけにすること
+    void (*text)(const enq_log_rec_t *r, enq_log_buf_t *o);
+} enq_log_event_t;
+
+// 表を登録して既定の設定にする (表は終了まで有効であること)。ログスレッドは
+// enq_log_start() で起動する。起動前・失敗時の enq_log() は呼び出し側でその場で書式化する
+int  enq_log_init(const enq_log_category_t *cats, unsigned ncats,
+                  const enq_log_event_t *events, unsigned nevents);
+// 設定文字列を適用する。不正なら -1 (設定は変えない)
+int  enq_log_configure(const char *spec);
+// 出力先を開いてログスレッドを起動する。戻り値: 成功 0 / 失敗 -1 (errno)
+int  enq_log_start(void);
+// 積んだ分をすべて書き出すまで待つ (同期の printf と順序を揃えたいとき)
+void enq_log_flush(void);
+// 残りを書き出してログスレッドを止め、出力先を閉じる
+void enq_log_stop(void);
+
+// 1件積む。間引き・溢れで捨てたら 0。str は ENQ_LOG_STR_MAX まで切り詰める
+int  enq_log(unsigned event, const void *str, size_t str_len, const uint64_t args[ENQ_LOG_ARGS]);
+
+typedef struct {
+    uint64_t logged;       // 積んだ件数
+    uint64_t suppressed;   // rate / sample で捨てた件数
+    uint64_t dropped;      // リング満杯で捨てた件数
+    uint64_t written;      // 書き出した件数
+} enq_log_stats_t;
+
+void enq_log_get_stats(enq_log_stats_t *out);
+const char *enq_log_format_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENQ_LOG_H
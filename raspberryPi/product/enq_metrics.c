@@ -0,0 +1,333 @@
+// enq_metrics.c
+// レイテンシヒストグラムの集計・整形と Prometheus 形式の HTTP エンドポイント
+// ビルド例: serial_debug_test.c と一緒にリンクする (-pthread)。
+//   シミュレーター (MinGW) からは整形部分だけを使う (HTTP サーバーは POSIX のみ)
+
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include "enq_metrics.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- 集計 ----
+
+void enq_hist_snapshot(const enq_hist_t *h, enq_hist_snap_t *out) {
+    uint64_t count = 0;
+    for (unsigned i = 0; i < ENQ_HIST_BUCKETS; i++) {
+        out->bucket[i] = atomic_load_explicit(&h->bucket[i], memory_order_relaxed);
+        count += out->bucket[i];
+    }
+    out->count = count;
+    out->sum_ns = atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+    out->max_ns = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+}
+
+uint64_t enq_hist_bucket_low(unsigned i) {
+    if (i < ENQ_HIST_SUB) return i;
+    unsigned shift = (i >> ENQ_HIST_SUB_BITS) - 1;
+    return (uint64_t)(ENQ_HIST_SUB + (i & (ENQ_HIST_SUB - 1))) << shift;
+}
+
+uint64_t enq_hist_bucket_width(unsigned i) {
+    if (i < ENQ_HIST_SUB) return 1;
+    return 1ull << ((i >> ENQ_HIST_SUB_BITS) - 1);
+}
+
+uint64_t enq_hist_quantile(const enq_hist_snap_t *s, double q) {
+    if (s->count == 0) return 0;
+    if (q < 0) q = 0;
+    if (q > 1) q = 1;
+    // q 番目 (1始まり) のサンプルを含むバケット
+    uint64_t rank = (uint64_t)(q * (double)s->count + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < ENQ_HIST_BUCKETS; i++) {
+        seen += s->bucket[i];
+        if (seen >= rank) {
+            uint64_t mid = enq_hist_bucket_low(i) + enq_hist_bucket_width(i) / 2;
+            return mid < s->max_ns ? mid : s->max_ns;
+        }
+    }
+    return s->max_ns;
+}
+
+// ---- 整形 ----
+
+void enq_metrics_out_init(enq_metrics_out_t *o) {
+    memset(o, 0, sizeof(*o));
+}
+
+void enq_metrics_out_free(enq_metrics_out_t *o) {
+    free(o->buf);
+    memset(o, 0, sizeof(*o));
+}
+
+int enq_metrics_out_reserve(enq_metrics_out_t *o, size_t cap) {
+    if (o->cap >= cap) return 0;
+    char *p = realloc(o->buf, cap);
+    if (p == NULL) return -1;
+    o->buf = p;
+    o->cap = cap;
+    return 0;
+}
+
+void enq_metrics_printf(enq_metrics_out_t *o, const char *fmt, ...) {
+    if (o->truncated) return;
+    for (;;) {
+        size_t room = o->cap - o->len;
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(o->buf ? o->buf + o->len : NULL, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            o->len += (size_t)n;
+            return;
+        }
+        size_t cap = o->cap ? o->cap * 2 : 16384;
+        while (cap - o->len <= (size_t)n) cap *= 2;
+        char *p = realloc(o->buf, cap);
+        if (p == NULL) {
+            o->truncated = 1;
+            return;
+        }
+        o->buf = p;
+        o->cap = cap;
+    }
+}
+
+void enq_metrics_family(enq_metrics_out_t *o, const char *name, const char *type,
+                        const char *help) {
+    enq_metrics_printf(o, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void enq_metrics_value(enq_metrics_out_t *o, const char *name, const char *labels,
+                       uint64_t value) {
+    if (labels) enq_metrics_printf(o, "%s{%s} %llu\n", name, labels, (unsigned long long)value);
+    else        enq_metrics_printf(o, "%s %llu\n", name, (unsigned long long)value);
+}
+
+// Prometheus の le に使う境界 (2^k ns)。バケットの区切りと一致するので集計は正確
+#define LE_FIRST_BITS 10  // 1.024µs
+#define LE_LAST_BITS  35  // 約34秒
+
+void enq_metrics_histogram(enq_metrics_out_t *o, const char *name, const char *labels,
+                           const enq_hist_t *h) {
+    // 4KB 超なのでスタックに置かない (スクレイプと SIGUSR1 の表示が別スレッドでも重ならない)
+    static _Thread_local enq_hist_snap_t s;
+    enq_hist_snapshot(h, &s);
+    const char *sep = labels ? "," : "";
+    if (labels == NULL) labels = "";
+
+    unsigned i = 0;
+    uint64_t cum = 0;
+    for (unsigned k = LE_FIRST_BITS; k <= LE_LAST_BITS; k++) {
+        // 上限が 2^k 以下のバケットは番号 (k - SUB_BITS + 1) * SUB 未満
+        unsigned end = (k - ENQ_HIST_SUB_BITS + 1) << ENQ_HIST_SUB_BITS;
+        for (; i < end; i++) cum += s.bucket[i];
+        enq_metrics_printf(o, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", name, labels, sep,
+                           (double)(1ull << k) / 1e9, (unsigned long long)cum);
+    }
+    enq_metrics_printf(o, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep,
+                       (unsigned long long)s.count);
+    if (*labels) {
+        enq_metrics_printf(o, "%s_sum{%s} %.9f\n", name, labels, (double)s.sum_ns / 1e9);
+        enq_metrics_printf(o, "%s_count{%s} %llu\n", name, labels, (unsigned long long)s.count);
+    } else {
+        enq_metrics_printf(o, "%s_sum %.9f\n", name, (double)s.sum_ns / 1e9);
+        enq_metrics_printf(o, "%s_count %llu\n", name, (unsigned long long)s.count);
+    }
+}
+
+static const struct {
+    const char *label;
+    double q;
+} quantiles[] = { { "0.5", 0.5 }, { "0.9", 0.9 }, { "0.99", 0.99 }, { "0.999", 0.999 } };
+
+void enq_metrics_quantiles(enq_metrics_out_t *o, const char *name, const char *labels,
+                           const enq_hist_t *h) {
+    static _Thread_local enq_hist_snap_t s;
+    enq_hist_snapshot(h, &s);
+    const char *sep = labels ? "," : "";
+    if (labels == NULL) labels = "";
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        enq_metrics_printf(o, "%s{%s%squantile=\"%s\"} %.9f\n", name, labels, sep,
+                           quantiles[i].label, (double)enq_hist_quantile(&s, quantiles[i].q) / 1e9);
+    }
+    enq_metrics_printf(o, "%s{%s%squantile=\"1\"} %.9f\n", name, labels, sep,
+                       (double)s.max_ns / 1e9);
+}
+
+void enq_metrics_format_ns(char *buf, size_t len, uint64_t ns) {
+    if (ns < 1000)            snprintf(buf, len, "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000)    snprintf(buf, len, "%.1fµs", (double)ns / 1e3);
+    else if (ns < 1000000000) snprintf(buf, len, "%.2fms", (double)ns / 1e6);
+    else                      snprintf(buf, len, "%.2fs", (double)ns / 1e9);
+}
+
+void enq_metrics_summary(enq_metrics_out_t *o, const char *label, const enq_hist_t *h) {
+    static _Thread_local enq_hist_snap_t s;
+    enq_hist_snapshot(h, &s);
+    if (s.count == 0) {
+        enq_metrics_printf(o, "  %-9s n=0\n", label);
+        return;
+    }
+    char p50[16], p90[16], p99[16], p999[16], max[16], avg[16];
+    enq_metrics_format_ns(p50, sizeof(p50), enq_hist_quantile(&s, 0.5));
+    enq_metrics_format_ns(p90, sizeof(p90), enq_hist_quantile(&s, 0.9));
+    enq_metrics_format_ns(p99, sizeof(p99), enq_hist_quantile(&s, 0.99));
+    enq_metrics_format_ns(p999, sizeof(p999), enq_hist_quantile(&s, 0.999));
+    enq_metrics_format_ns(max, sizeof(max), s.max_ns);
+    enq_metrics_format_ns(avg, sizeof(avg), s.sum_ns / s.count);
+    enq_metrics_printf(o, "  %-9s n=%llu 平均=%s p50=%s p90=%s p99=%s p99.9=%s 最大=%s\n", label,
+                       (unsigned long long)s.count, avg, p50, p90, p99, p999, max);
+}
+
+// ---- HTTP エンドポイント (POSIX) ----
+
+#ifndef _WIN32
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define HTTP_REQ_MAX     2048
+#define HTTP_TIMEOUT_MS  1000  // 要求行が揃うまで待つ時間
+#define STOP_POLL_MS     200   // 停止要求を確認する間隔
+
+struct enq_metrics_server {
+    pthread_t thread;
+    atomic_int stop;
+    int listen_fd;
+    enq_metrics_render_fn render;
+    void *ctx;
+    enq_metrics_out_t out;  // 本文 (スクレイプごとに作り直す。容量は使い回す)
+};
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                if (poll(&pfd, 1, HTTP_TIMEOUT_MS) <= 0) return -1;
+                continue;
+            }
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// 1接続分: 要求行を読んで応答し、閉じる (keep-alive はしない)
+static void serve_client(enq_metrics_server_t *s, int fd) {
+    char req[HTTP_REQ_MAX];
+    size_t len = 0;
+    while (len < sizeof(req) - 1) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, HTTP_TIMEOUT_MS) <= 0) return;
+        ssize_t r = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (r <= 0) return;
+        len += (size_t)r;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[len] = '\0';
+
+    char hdr[256];
+    if (strncmp(req, "GET /metrics", 12) == 0 || strncmp(req, "GET / ", 6) == 0) {
+        s->out.len = 0;
+        s->out.truncated = 0;
+        s->render(&s->out, s->ctx);
+        int n = snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", s->out.len);
+        if (write_all(fd, hdr, (size_t)n) == 0 && s->out.len) write_all(fd, s->out.buf, s->out.len);
+    } else {
+        static const char not_found[] =
+            "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        write_all(fd, not_found, sizeof(not_found) - 1);
+    }
+}
+
+static void *server_thread(void *arg) {
+    enq_metrics_server_t *s = arg;
+    while (!atomic_load(&s->stop)) {
+        struct pollfd pfd = { .fd = s->listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, STOP_POLL_MS) <= 0) continue;
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        serve_client(s, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+enq_metrics_server_t *enq_metrics_serve(uint16_t port, enq_metrics_render_fn render, void *ctx) {
+    enq_metrics_server_t *s = calloc(1, sizeof(*s));
+    if (s == NULL) return NULL;
+    s->render = render;
+    s->ctx = ctx;
+    // スクレイプのたびに伸ばさないよう先に確保する (失敗しても整形時に伸ばす)
+    enq_metrics_out_reserve(&s->out, ENQ_METRICS_OUT_RESERVE);
+    s->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->listen_fd < 0) {
+        int saved = errno;
+        enq_metrics_out_free(&s->out);
+        free(s);
+        errno = saved;
+        return NULL;
+    }
+    int one = 1;
+    setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(s->listen_fd, 8) < 0) {
+        int saved = errno;
+        close(s->listen_fd);
+        enq_metrics_out_free(&s->out);
+        free(s);
+        errno = saved;
+        return NULL;
+    }
+
+    // シグナルは呼び出し側のスレッドで受ける
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(&s->thread, NULL, server_thread, s);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        close(s->listen_fd);
+        enq_metrics_out_free(&s->out);
+        free(s);
+        errno = rc;
+        return NULL;
+    }
+    return s;
+}
+
+void enq_metrics_serve_stop(enq_metrics_server_t *s) {
+    if (s == NULL) return;
+    atomic_store(&s->stop, 1);
+    pthread_join(s->thread, NULL);
+    close(s->listen_fd);
+    enq_metrics_out_free(&s->out);
+    free(s);
+}
+#endif
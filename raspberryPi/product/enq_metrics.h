@@ -0,0 +1,134 @@
+// enq_metrics.h
+// 受信・送信経路の計測: HDR 形式のレイテンシヒストグラム
+//
+// 値 (ns) を 2 のべき乗ごとの区間に分け、各区間をさらに ENQ_HIST_SUB 個の
+// 等幅バケットに分ける対数線形ヒストグラム (HdrHistogram と同じ考え方)。
+// 分解能は値の 1/ENQ_HIST_SUB 以内で、1ns から約 68 秒までを固定サイズで持つ。
+//
+// 記録はバケットと合計への relaxed な fetch_add だけで、ロックは取らない。
+// 複数スレッドから同時に記録してよく、読む側 (スクレイプ・SIGUSR1) は
+// enq_hist_snapshot() で写し取ってから集計する。集計と整形は enq_metrics.c で
+// 行うので、誰も読まなければ記録以外のコストはかからない。
+//
+// 記録側はこのヘッダーだけで完結する (パーサーの .so や Windows の
+// シミュレーターは enq_metrics.c をリンクしなくても記録できる)。
+
+#ifndef ENQ_METRICS_H
+#define ENQ_METRICS_H
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENQ_HIST_SUB_BITS 4
+#define ENQ_HIST_SUB      (1 << ENQ_HIST_SUB_BITS)
+#define ENQ_HIST_MAX_BITS 36  // 2^36 ns ≒ 68.7 秒 (それ以上は最後のバケットに入れる)
+#define ENQ_HIST_BUCKETS  ((ENQ_HIST_MAX_BITS - ENQ_HIST_SUB_BITS + 1) * ENQ_HIST_SUB)
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t bucket[ENQ_HIST_BUCKETS];
+} enq_hist_t;
+
+// 値 → バケット番号
+//   v < ENQ_HIST_SUB は幅1、以降は [2^e, 2^(e+1)) を ENQ_HIST_SUB 等分する
+static inline unsigned enq_hist_index(uint64_t v) {
+    if (v < ENQ_HIST_SUB) return (unsigned)v;
+    unsigned e = 63u - (unsigned)__builtin_clzll(v);
+    if (e >= ENQ_HIST_MAX_BITS) return ENQ_HIST_BUCKETS - 1;
+    unsigned shift = e - ENQ_HIST_SUB_BITS;
+    return ((shift + 1) << ENQ_HIST_SUB_BITS) | (unsigned)((v >> shift) & (ENQ_HIST_SUB - 1));
+}
+
+static inline void enq_hist_record(enq_hist_t *h, uint64_t ns) {
+    atomic_fetch_add_explicit(&h->bucket[enq_hist_index(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    uint64_t m = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    while (ns > m && !atomic_compare_exchange_weak_explicit(&h->max_ns, &m, ns,
+                                                            memory_order_relaxed,
+                                                            memory_order_relaxed)) {}
+}
+
+// ---- 読む側 (enq_metrics.c) ----
+
+// 集計用の写し。count はバケットの合計なので、写している最中に記録が
+// 入っても分位点とバケットの整合は崩れない
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t bucket[ENQ_HIST_BUCKETS];
+} enq_hist_snap_t;
+
+void enq_hist_snapshot(const enq_hist_t *h, enq_hist_snap_t *out);
+
+// バケット i の下限と幅 (ns)
+uint64_t enq_hist_bucket_low(unsigned i);
+uint64_t enq_hist_bucket_width(unsigned i);
+
+// 分位点 q (0〜1) の推定値 (ns)。バケットの中央値を返し、max を超えない
+uint64_t enq_hist_quantile(const enq_hist_snap_t *s, double q);
+
+// 整形先 (足りなければ伸ばす。確保に失敗したら以降を捨てて truncated を立てる)
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    int truncated;
+} enq_metrics_out_t;
+
+// /metrics の本文用に前もって確保する大きさ (ポート数十本分の系列が収まる)
+#define ENQ_METRICS_OUT_RESERVE (128 * 1024)
+
+void enq_metrics_out_init(enq_metrics_out_t *o);
+void enq_metrics_out_free(enq_metrics_out_t *o);
+// 容量を cap バイト以上にしておく。起動時に呼べば、収まる限り整形中は確保しない。
+// 戻り値: 成功 0 / 失敗 -1
+int  enq_metrics_out_reserve(enq_metrics_out_t *o, size_t cap);
+void enq_metrics_printf(enq_metrics_out_t *o, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Prometheus テキスト形式 (version 0.0.4)
+//   # HELP / # TYPE 行は系列ごとに enq_metrics_family() で1回だけ書く。
+//   labels は 'stage="read"' のような「{}」の中身 (NULL なら付けない)
+void enq_metrics_family(enq_metrics_out_t *o, const char *name, const char *type,
+                        const char *help);
+void enq_metrics_value(enq_metrics_out_t *o, const char *name, const char *labels,
+                       uint64_t value);
+// 秒単位の histogram として _bucket (le は 1µs〜約34秒の 2 のべき乗 ns)、_sum、_count を書く
+void enq_metrics_histogram(enq_metrics_out_t *o, const char *name, const char *labels,
+                           const enq_hist_t *h);
+// 分位点 (p50/p90/p99/p99.9) と最大値を gauge として書く (name は histogram と別名にする)
+void enq_metrics_quantiles(enq_metrics_out_t *o, const char *name, const char *labels,
+                           const enq_hist_t *h);
+
+// ns を桁に合った単位の文字列にする ("850ns" / "12.3µs" / "4.56ms" / "1.23s")
+void enq_metrics_format_ns(char *buf, size_t len, uint64_t ns);
+
+// 人が読む1行の要約 ("read      n=120 p50=12.0µs p90=... max=...")
+void enq_metrics_summary(enq_metrics_out_t *o, const char *label, const enq_hist_t *h);
+
+#ifndef _WIN32
+// /metrics を返す HTTP サーバー (スレッド1本、1接続ずつ応答する)。
+//   スクレイプのたびに render() を呼んで本文を作る。render は別スレッドから
+//   呼ばれるので、読むのはアトミックな値か写しだけにすること
+typedef void (*enq_metrics_render_fn)(enq_metrics_out_t *o, void *ctx);
+typedef struct enq_metrics_server enq_metrics_server_t;
+
+// port で待ち受けを始める。失敗時は NULL (errno)
+enq_metrics_server_t *enq_metrics_serve(uint16_t port, enq_metrics_render_fn render, void *ctx);
+void enq_metrics_serve_stop(enq_metrics_server_t *s);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENQ_METRICS_H
@@ -0,0 +1,234 @@
+// enq_parser.h
+// SEC-3000H ENQ伝文 ストリーミングパーサー
+//
+// 伝文フォーマット (16バイト固定):
+//   [0]     ENQ (0x05)
+//   [1-4]   局番号     10進4桁 (ASCII)
+//   [5]     コマンド   'W'
+//   [6-9]   データ番号 16進4桁 (ASCII)
+//   [10-13] データ     16進4桁 (ASCII)
+//   [14-15] チェックサム 16進2桁 (局番号〜データの加算値 下位1バイト)
+//
+// 任意の長さのバイト列を enq_parser_feed() で投入し、enq_parser_next() で
+// 検証済みフレームを1件ずつ取り出す。フレームはリングバッファ内を直接指す
+// ビューで返すためコピーは発生しない。
+//
+// ENQ_PARSER_CHANGES_ONLY を指定すると、(局番号, データ番号) ごとに最後の値と
+// 時刻を固定サイズの表に持ち、同じ値の繰り返し (送信側は同じ値を5回送る) を
+// パーサー内で捨てる。取り出されるのは値の変化と、refresh 間隔ごとの再通知だけになる。
+
+#ifndef ENQ_PARSER_H
+#define ENQ_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "enq_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENQ_CODE       0x05
+#define ENQ_FRAME_LEN  16
+
+// リング容量 (2のべき乗)。9600bps なら約4秒分。
+#define ENQ_RING_SIZE  4096
+#define ENQ_RING_MASK  (ENQ_RING_SIZE - 1)
+
+// データ番号
+#define ENQ_DATA_CURRENT_FLOOR 0x0001  // 現在階数
+#define ENQ_DATA_TARGET_FLOOR  0x0002  // 行先階
+#define ENQ_DATA_LOAD_WEIGHT   0x0003  // 荷重
+
+// 遅延測定プローブ (シミュレーターの probe モードが送る。enq_probe.h で解析する)
+//   局番号 ENQ_PROBE_STATION、データ番号 0xF000 | 送信時刻 (100µs 単位の下位12ビット)、
+//   データ = 通番 (16ビット、折り返しあり)。実機のデータ番号とは重ならない
+#define ENQ_PROBE_STATION     9999
+#define ENQ_DATA_PROBE        0xF000
+#define ENQ_DATA_PROBE_MASK   0xF000
+#define ENQ_PROBE_STAMP_MASK  0x0FFF
+#define ENQ_PROBE_TICK_NS     100000ull
+#define ENQ_PROBE_PERIOD_NS   (ENQ_PROBE_TICK_NS * (ENQ_PROBE_STAMP_MASK + 1))  // 409.6ms で一周
+
+// 回線の断・復帰 (伝文ではなく、受信側がイベントファイル・配信に書く疑似の項目)
+//   局番号 ENQ_LINK_STATION (伝文には書けない値)、データ番号 ENQ_DATA_LINK、
+//   データ = ENQ_LINK_DOWN (この時刻から欠落) / ENQ_LINK_UP (この時刻から受信を再開)
+#define ENQ_LINK_STATION      0xFFFF
+#define ENQ_DATA_LINK         0xFFFF
+#define ENQ_LINK_UP           0
+#define ENQ_LINK_DOWN         1
+
+// パーサーフラグ
+#define ENQ_PARSER_VERIFY_CHECKSUM 0x01  // チェックサム不一致のフレームを破棄する
+#define ENQ_PARSER_CHANGES_ONLY    0x02  // 同じ値の繰り返しを捨てる (状態変化だけを返す)
+#define ENQ_PARSER_STRICT_LAYOUT   0x04  // チェックサム欄も HEX 文字か確かめる (値は照合しない)
+
+// 重複抑制表: 1セット = 1キャッシュライン (4エントリ)、64セットで256組
+#define ENQ_DEDUPE_WAYS  4
+#define ENQ_DEDUPE_SET_BITS 6
+#define ENQ_DEDUPE_SETS  (1 << ENQ_DEDUPE_SET_BITS)
+// 同じ値でもこの間隔以上空いたら再通知する (0 なら変化時のみ)
+#define ENQ_DEDUPE_REFRESH_NS 800000000ull
+
+// 検証結果
+typedef enum {
+    ENQ_OK = 0,
+    ENQ_ERR_SYNC,       // 先頭が ENQ でない
+    ENQ_ERR_STATION,    // 局番号が10進数字でない
+    ENQ_ERR_COMMAND,    // コマンドが 'W' でない
+    ENQ_ERR_DATA_NUM,   // データ番号がHEX文字でない
+    ENQ_ERR_VALUE,      // データがHEX文字でない
+    ENQ_ERR_CHECKSUM    // チェックサム不一致 (またはHEX文字でない)
+} enq_result_t;
+
+// デコード済みフレーム
+//   raw はリング内の16バイトを直接指す。次回の enq_parser_feed() まで有効。
+typedef struct {
+    const uint8_t *raw;
+    uint16_t station;
+    uint16_t data_num;
+    uint16_t value;
+    uint8_t  checksum;     // 受信したチェックサム
+    uint8_t  checksum_ok;  // 計算値と一致したら 1
+} enq_frame_t;
+
+// 統計カウンター
+typedef struct {
+    uint64_t bytes_in;         // 投入バイト数
+    uint64_t frames;           // 取り出したフレーム数 (重複として捨てた分は含まない)
+    uint64_t resync_bytes;     // 同期外れで破棄したバイト数
+    uint64_t layout_errors;    // ENQ から始まるが形式不正だった候補数
+    uint64_t checksum_errors;  // チェックサム不一致数
+    uint64_t duplicates;       // ENQ_PARSER_CHANGES_ONLY で捨てた繰り返し
+} enq_parser_stats_t;
+
+typedef struct {
+    uint32_t key;    // (局番号 + 1) << 16 | データ番号。0 は空き
+    uint16_t value;  // 最後に通した値
+    uint16_t reserved;
+    uint64_t t_ns;   // 最後に通した時刻 (CLOCK_MONOTONIC)
+} enq_dedupe_entry_t;
+
+typedef struct {
+    _Alignas(64) enq_dedupe_entry_t way[ENQ_DEDUPE_WAYS];
+} enq_dedupe_set_t;
+
+// 区間計測の記録先 (enq_parser_set_timing)。NULL の項目は測らない
+typedef struct {
+    enq_hist_t *validate;  // 候補1件の検証とデコード
+    enq_hist_t *dedupe;    // 重複抑制表の参照・更新 (ENQ_PARSER_CHANGES_ONLY のとき)
+} enq_parser_timing_t;
+
+typedef struct {
+    // 末尾に (ENQ_FRAME_LEN-1) バイトのミラー領域を持ち、
+    // 折り返し位置にかかるフレームも連続したメモリとして参照できる
+    uint8_t buf[ENQ_RING_SIZE + ENQ_FRAME_LEN - 1];
+    uint64_t head;  // 読み出し位置 (単調増加)
+    uint64_t tail;  // 書き込み位置 (単調増加)
+    int flags;
+    enq_parser_stats_t stats;
+    uint64_t refresh_ns;
+    uint64_t clock_ns;             // 0 でなければ重複抑制はこの時刻を使う (enq_parser_set_clock)
+    const enq_parser_timing_t *timing;  // NULL なら時刻を読まない
+    enq_dedupe_set_t dedupe[ENQ_DEDUPE_SETS];
+} enq_parser_t;
+
+void enq_parser_init(enq_parser_t *p, int flags);
+void enq_parser_reset(enq_parser_t *p);
+
+// ヒープ確保版 (Python バインディング用)
+enq_parser_t *enq_parser_new(int flags);
+void enq_parser_free(enq_parser_t *p);
+
+// ENQ_PARSER_CHANGES_ONLY の再通知間隔を変える (0 なら値が変わったときだけ通す)
+void enq_parser_set_refresh(enq_parser_t *p, uint64_t refresh_ns);
+
+// 重複抑制の時刻を呼び出し側が与える (キャプチャを記録時刻どおりに再生するとき)。
+// 以後 enq_parser_set_clock(p, 0) までは CLOCK_MONOTONIC を読まない
+void enq_parser_set_clock(enq_parser_t *p, uint64_t now_ns);
+
+// 検証・重複抑制の所要時間をヒストグラムに記録する (NULL で止める)。
+// timing はパーサーより長く生きていること
+void enq_parser_set_timing(enq_parser_t *p, const enq_parser_timing_t *timing);
+
+// 空き容量 (この長さまでは enq_parser_feed() が全量を受け付ける)
+size_t enq_parser_space(const enq_parser_t *p);
+
+// バイト列を投入する。戻り値は受け付けたバイト数 (空き容量を超えた分は受け付けない)
+size_t enq_parser_feed(enq_parser_t *p, const uint8_t *data, size_t len);
+
+// 次のフレームを取り出す。フレームがあれば 1、データ不足なら 0
+int enq_parser_next(enq_parser_t *p, enq_frame_t *out);
+
+// 取り出したフレームを最大 max 件まで配列に格納する。戻り値は件数
+size_t enq_parser_drain(enq_parser_t *p, enq_frame_t *out, size_t max);
+
+// feed と next をまとめて行い、フレームごとに cb を呼ぶ。任意長の入力を受け付ける。
+// 戻り値はフレーム数
+typedef void (*enq_frame_cb)(const enq_frame_t *frame, void *ctx);
+size_t enq_parser_push(enq_parser_t *p, const uint8_t *data, size_t len,
+                       enq_frame_cb cb, void *ctx);
+
+const enq_parser_stats_t *enq_parser_stats(const enq_parser_t *p);
+
+// 遅延測定プローブのフレームなら 1
+static inline int enq_frame_is_probe(const enq_frame_t *f) {
+    return f->station == ENQ_PROBE_STATION &&
+           (f->data_num & ENQ_DATA_PROBE_MASK) == ENQ_DATA_PROBE;
+}
+
+// 回線の断・復帰の記録なら 1
+static inline int enq_frame_is_link(const enq_frame_t *f) {
+    return f->station == ENQ_LINK_STATION && f->data_num == ENQ_DATA_LINK;
+}
+
+// 16バイトの候補を検証する (flags は ENQ_PARSER_VERIFY_CHECKSUM / ENQ_PARSER_STRICT_LAYOUT)
+enq_result_t enq_frame_validate(const uint8_t *b, int flags);
+
+// 検証済み16バイトをデコードする
+void enq_frame_decode(const uint8_t *b, enq_frame_t *out);
+
+// 局番号〜データ (13バイト) の加算チェックサム
+uint8_t enq_checksum(const uint8_t *data, size_t len);
+
+// フレーム内容を人間可読な文字列にする ("現在階数: 3F" など)
+int enq_frame_describe(const enq_frame_t *f, char *buf, size_t len);
+
+// 16バイトを HEX (32文字) と ASCII (表示不可は '.') の文字列にする
+void enq_frame_dump(const uint8_t *raw, char hex[ENQ_FRAME_LEN * 2 + 1],
+                    char ascii[ENQ_FRAME_LEN + 1]);
+
+// 16バイトの伝文を組み立てる (HEX は大文字、局番号は 0〜9999)
+void enq_frame_encode(uint8_t out[ENQ_FRAME_LEN], uint16_t station,
+                      uint16_t data_num, uint16_t value);
+
+// 地下階として表示するデータ値の下限 (B64F)
+#define ENQ_FLOOR_BASEMENT_MIN 0xFFC0
+
+// 階数 → データ値 (地下は2の補数: B1F は 0xFFFF、B2F は 0xFFFE)
+uint16_t enq_floor_value(int floor);
+// データ値 → 階数表示 ("3F" / "B1F" / "B2F")
+int enq_floor_name(uint16_t value, char *buf, size_t len);
+
+const char *enq_result_str(enq_result_t r);
+
+// 走査・検証・チェックサムの SIMD 実装 (enq_simd.c)。読み込み時に CPU に合わせて
+// 選ばれる。環境変数 ENQ_SIMD=scalar|sse2|avx2|neon で固定できる
+typedef enum {
+    ENQ_SIMD_SCALAR = 0,
+    ENQ_SIMD_SSE2,
+    ENQ_SIMD_AVX2,
+    ENQ_SIMD_NEON
+} enq_simd_t;
+
+// 指定の実装に切り替える。この CPU・ビルドで使えなければ 0
+int enq_simd_select(enq_simd_t impl);
+enq_simd_t enq_simd_active(void);
+const char *enq_simd_name(enq_simd_t impl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENQ_PARSER_H
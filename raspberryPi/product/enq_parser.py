@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+ENQ伝文ストリーミングパーサー (enq_parser.c の Python バインディング)
+
+libenq_parser.so をビルドして同じディレクトリに置くとネイティブ実装を使用する:
+    gcc -O2 -shared -fPIC enq_parser.c enq_simd.c -o libenq_parser.so
+見つからない場合は同じアルゴリズムの Python 実装にフォールバックする。
+
+python3 enq_parser.py で両実装に同じ壊れたストリームを与え、統計とフレームが一致するか確かめる。
+"""
+
+import ctypes
+import os
+import time
+from collections import namedtuple
+
+ENQ_CODE = 0x05
+ENQ_FRAME_LEN = 16
+ENQ_PARSER_VERIFY_CHECKSUM = 0x01
+ENQ_PARSER_CHANGES_ONLY = 0x02
+ENQ_PARSER_STRICT_LAYOUT = 0x04
+
+# 同じ値でもこの間隔以上空いたら再通知する（enq_parser.h の ENQ_DEDUPE_REFRESH_NS）
+DEDUPE_REFRESH = 0.8
+
+# 1回の feed で取り出すフレーム数の上限 (ネイティブ側配列サイズ)
+_DRAIN_BATCH = 64
+
+ENQFrame = namedtuple('ENQFrame', ['station', 'data_num', 'data_value', 'checksum', 'checksum_ok'])
+
+
+class _NativeFrame(ctypes.Structure):
+    _fields_ = [
+        ('raw', ctypes.c_void_p),
+        ('station', ctypes.c_uint16),
+        ('data_num', ctypes.c_uint16),
+        ('value', ctypes.c_uint16),
+        ('checksum', ctypes.c_uint8),
+        ('checksum_ok', ctypes.c_uint8),
+    ]
+
+
+class _NativeStats(ctypes.Structure):
+    _fields_ = [
+        ('bytes_in', ctypes.c_uint64),
+        ('frames', ctypes.c_uint64),
+        ('resync_bytes', ctypes.c_uint64),
+        ('layout_errors', ctypes.c_uint64),
+        ('checksum_errors', ctypes.c_uint64),
+        ('duplicates', ctypes.c_uint64),
+    ]
+
+
+def _load_native():
+    """libenq_parser.so のロード"""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libenq_parser.so')
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.enq_parser_new.restype = ctypes.c_void_p
+    lib.enq_parser_new.argtypes = [ctypes.c_int]
+    lib.enq_parser_free.restype = None
+    lib.enq_parser_free.argtypes = [ctypes.c_void_p]
+    lib.enq_parser_space.restype = ctypes.c_size_t
+    lib.enq_parser_space.argtypes = [ctypes.c_void_p]
+    lib.enq_parser_feed.restype = ctypes.c_size_t
+    lib.enq_parser_feed.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+    lib.enq_parser_drain.restype = ctypes.c_size_t
+    lib.enq_parser_drain.argtypes = [ctypes.c_void_p, ctypes.POINTER(_NativeFrame), ctypes.c_size_t]
+    lib.enq_parser_reset.restype = None
+    lib.enq_parser_reset.argtypes = [ctypes.c_void_p]
+    lib.enq_parser_set_refresh.restype = None
+    lib.enq_parser_set_refresh.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.enq_parser_stats.restype = ctypes.POINTER(_NativeStats)
+    lib.enq_parser_stats.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+_lib = _load_native()
+
+
+class _NativeParser:
+    """ネイティブ実装"""
+
+    def __init__(self, flags: int, refresh: float):
+        self._p = _lib.enq_parser_new(flags)
+        if not self._p:
+            raise MemoryError("enq_parser_new failed")
+        _lib.enq_parser_set_refresh(self._p, int(refresh * 1e9))
+        self._frames = (_NativeFrame * _DRAIN_BATCH)()
+
+    def __del__(self):
+        if getattr(self, '_p', None):
+            _lib.enq_parser_free(self._p)
+            self._p = None
+
+    def feed(self, data: bytes):
+        frames = []
+        # 一度だけ C のバッファに写し、入りきらない残りは位置をずらして渡す
+        # (残りを切り出して渡すと、リングが詰まるたびに全体を写し直すことになる)
+        size = len(data)
+        buf = (ctypes.c_char * size).from_buffer_copy(data)
+        base = ctypes.addressof(buf)
+        off = 0
+        while True:
+            off += _lib.enq_parser_feed(self._p, base + off, size - off)
+            while True:
+                cnt = _lib.enq_parser_drain(self._p, self._frames, _DRAIN_BATCH)
+                for i in range(cnt):
+                    f = self._frames[i]
+                    frames.append(ENQFrame(f.station, f.data_num, f.value, f.checksum, bool(f.checksum_ok)))
+                if cnt < _DRAIN_BATCH:
+                    break
+            if off == size:
+                return frames
+
+    def reset(self):
+        _lib.enq_parser_reset(self._p)
+
+    def stats(self) -> dict:
+        st = _lib.enq_parser_stats(self._p).contents
+        return {name: getattr(st, name) for name, _ in _NativeStats._fields_}
+
+
+def _is_hex(b: int) -> bool:
+    return (48 <= b <= 57) or (65 <= b <= 70) or (97 <= b <= 102)  # 0-9, A-F, a-f
+
+
+def _hex_digit(b: int) -> int:
+    return int(chr(b), 16) if _is_hex(b) else 0
+
+
+class _PyParser:
+    """Python 実装（ネイティブ版と同じく読み出し位置を進めるだけで再走査しない）"""
+
+    def __init__(self, flags: int, refresh: float):
+        self.flags = flags
+        self.refresh = refresh
+        self.last = {}  # (局番号, データ番号) → (値, 通した時刻)
+        self.buf = bytearray()
+        self.pos = 0
+        self._stats = {'bytes_in': 0, 'frames': 0, 'resync_bytes': 0,
+                       'layout_errors': 0, 'checksum_errors': 0, 'duplicates': 0}
+
+    def _is_duplicate(self, frame) -> bool:
+        """直前に通した値の繰り返しなら True（通したときだけ時刻を更新）"""
+        key = (frame.station, frame.data_num)
+        now = time.monotonic()
+        last = self.last.get(key)
+        if last is not None and last[0] == frame.data_value and \
+                (self.refresh == 0 or now - last[1] < self.refresh):
+            return True
+        self.last[key] = (frame.data_value, now)
+        return False
+
+    def _validate(self, b):
+        """(エラー種別, 不正時に進めるバイト数) を返す（enq_parser.c の validate_skip と同じ規則）
+
+        最初の不正位置より前は数字・'W'・HEX 文字と確かめたので ENQ ではなく、そこまで飛ばせる。
+        """
+        verify = self.flags & ENQ_PARSER_VERIFY_CHECKSUM
+        end = ENQ_FRAME_LEN if verify or self.flags & ENQ_PARSER_STRICT_LAYOUT else ENQ_FRAME_LEN - 2
+        for at in range(1, end):
+            c = b[at]
+            ok = 48 <= c <= 57 if at < 5 else c == 0x57 if at == 5 else _is_hex(c)  # 'W'
+            if not ok:
+                return ('checksum' if at >= 14 else 'layout'), at
+        if verify and int(bytes(b[14:16]), 16) != sum(b[1:14]) & 0xFF:
+            return 'checksum', ENQ_FRAME_LEN
+        return '', 1
+
+    def feed(self, data: bytes):
+        frames = []
+        self.buf.extend(data)
+        self._stats['bytes_in'] += len(data)
+        st = self._stats
+        buf = self.buf
+        while True:
+            enq = buf.find(ENQ_CODE, self.pos)
+            if enq < 0:
+                st['resync_bytes'] += len(buf) - self.pos
+                self.pos = len(buf)
+                break
+            st['resync_bytes'] += enq - self.pos
+            self.pos = enq
+            if len(buf) - enq < ENQ_FRAME_LEN:
+                break
+            b = buf[enq:enq + ENQ_FRAME_LEN]
+            err, skip = self._validate(b)
+            if err:
+                # 偽の ENQ: 不正位置の手前まで進めて次の ENQ を探す
+                st['checksum_errors' if err == 'checksum' else 'layout_errors'] += 1
+                st['resync_bytes'] += skip
+                self.pos = enq + skip
+                continue
+            # HEX でない桁は 0 として読む (enq_frame_decode と同じ)
+            checksum = (_hex_digit(b[14]) << 4) | _hex_digit(b[15])
+            checksum_ok = _is_hex(b[14]) and _is_hex(b[15]) and checksum == sum(b[1:14]) & 0xFF
+            if not checksum_ok:
+                st['checksum_errors'] += 1
+            frame = ENQFrame(int(bytes(b[1:5])), int(bytes(b[6:10]), 16),
+                             int(bytes(b[10:14]), 16), checksum, checksum_ok)
+            self.pos = enq + ENQ_FRAME_LEN
+            if self.flags & ENQ_PARSER_CHANGES_ONLY and checksum_ok and self._is_duplicate(frame):
+                st['duplicates'] += 1
+                continue
+            frames.append(frame)
+            st['frames'] += 1
+        # 消費済み領域はまとめて切り詰める（償却 O(1)）
+        if self.pos > 4096 or self.pos == len(buf):
+            del buf[:self.pos]
+            self.pos = 0
+        return frames
+
+    def reset(self):
+        self.buf.clear()
+        self.pos = 0
+        self.last.clear()
+
+    def stats(self) -> dict:
+        return dict(self._stats)
+
+
+class ENQParser:
+    """ENQ伝文パーサー
+
+    feed() に受信したバイト列をそのまま渡すと、揃った検証済みフレームの
+    リスト (ENQFrame) を返す。途中で切れたフレームは次回の feed() で完成する。
+    changes_only=True なら (局番号, データ番号) ごとに同じ値の繰り返しを捨て、
+    値の変化と refresh 秒ごとの再通知だけを返す（refresh=0 なら変化時のみ）。
+    """
+
+    def __init__(self, verify_checksum: bool = False, changes_only: bool = False,
+                 refresh: float = DEDUPE_REFRESH):
+        flags = ENQ_PARSER_VERIFY_CHECKSUM if verify_checksum else 0
+        if changes_only:
+            flags |= ENQ_PARSER_CHANGES_ONLY
+        self._impl = _NativeParser(flags, refresh) if _lib else _PyParser(flags, refresh)
+
+    @property
+    def native(self) -> bool:
+        return isinstance(self._impl, _NativeParser)
+
+    def feed(self, data: bytes):
+        return self._impl.feed(data)
+
+    def reset(self):
+        """途中のバイトと重複抑制の記録を捨てる (再接続時。統計と設定は残す)"""
+        self._impl.reset()
+
+    def stats(self) -> dict:
+        return self._impl.stats()
+
+
+def _self_check(seed: int = 1) -> bool:
+    """ネイティブ版と Python 版に同じ壊れたストリームを与え、フレームと統計を比べる"""
+    import random
+    if not _lib:
+        print("libenq_parser.so が見つからないため比較できません")
+        return False
+    rnd = random.Random(seed)
+    out = bytearray()
+    for _ in range(20000):
+        body = b'%04dW%04X%04X' % (rnd.randrange(10000), rnd.randrange(0x10000), rnd.randrange(4))
+        frame = bytearray(b'\x05' + body + b'%02X' % (sum(body) & 0xFF))
+        r = rnd.random()
+        if r < 0.15:
+            frame[rnd.randrange(1, ENQ_FRAME_LEN)] = rnd.randrange(256)  # 1バイト化け
+        elif r < 0.25:
+            frame = frame[:rnd.randrange(1, ENQ_FRAME_LEN)]               # 途中で切れる
+        elif r < 0.30:
+            frame += bytes(rnd.randrange(256) for _ in range(rnd.randrange(1, 24)))  # 雑音
+        out += frame
+    data = bytes(out)
+
+    ok = True
+    for flags in (0, ENQ_PARSER_VERIFY_CHECKSUM, ENQ_PARSER_STRICT_LAYOUT,
+                  ENQ_PARSER_VERIFY_CHECKSUM | ENQ_PARSER_CHANGES_ONLY):
+        native, py = _NativeParser(flags, 0), _PyParser(flags, 0)
+        got_n, got_p = [], []
+        pos = 0
+        while pos < len(data):
+            n = rnd.randrange(1, 300)
+            got_n += native.feed(data[pos:pos + n])
+            got_p += py.feed(data[pos:pos + n])
+            pos += n
+        same = got_n == got_p and native.stats() == py.stats()
+        print("flags=0x%02X: %s %s" % (flags, "✅ 一致" if same else "❌ 不一致", native.stats()))
+        if not same:
+            print("  Python 版: %s (フレーム %d / %d)" % (py.stats(), len(got_p), len(got_n)))
+            ok = False
+    return ok
+
+
+if __name__ == '__main__':
+    import sys
+    sys.exit(0 if _self_check() else 1)
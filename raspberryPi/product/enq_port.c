@@ -0,0 +1,266 @@
+// enq_port.c
+// シリアルポートを開く処理の共通化 (Win32 / POSIX / 疑似端末)
+// ビルド例: POSIX では enq_tty.c と一緒にリンクする (Win32 は単体)
+
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include "enq_port.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+// ---- Win32 ----
+
+static int port_error(const char *what, const char *name) {
+    fprintf(stderr, "❌ %s: %s 失敗: エラーコード %lu\n", name, what, GetLastError());
+    return -1;
+}
+
+int enq_port_open(enq_port_t *p, const char *spec, int flags) {
+    memset(p, 0, sizeof(*p));
+    p->h = p->peer = ENQ_PORT_INVALID;
+    p->kind = ENQ_PORT_SERIAL;
+    if (strncmp(spec, "pty", 3) == 0 || strncmp(spec, "unix:", 5) == 0) {
+        fprintf(stderr, "❌ %s は Windows では使えません。"
+                        "com0com などの仮想 COM ペアを指定してください\n", spec);
+        return -1;
+    }
+
+    // "COM31" → "\\.\COM31" (COM10 以上はこの形式が必要)
+    const char *label = strncmp(spec, "\\\\.\\", 4) == 0 ? spec + 4 : spec;
+    snprintf(p->name, sizeof(p->name), "%s", label);
+    char path[ENQ_PORT_NAME_MAX + 4];
+    snprintf(path, sizeof(path), "\\\\.\\%s", label);
+    wchar_t wpath[ENQ_PORT_NAME_MAX + 4];
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, ENQ_PORT_NAME_MAX + 4) == 0) {
+        return port_error("MultiByteToWideChar", p->name);
+    }
+
+    p->h = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+                       (flags & ENQ_PORT_ASYNC) ? FILE_FLAG_OVERLAPPED : 0, NULL);
+    if (p->h == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "❌ シリアルポート %s を開けません: エラーコード %lu\n",
+                p->name, GetLastError());
+        return -1;
+    }
+    DCB dcb = {0};
+    dcb.DCBlength = sizeof(dcb);
+    if (!GetCommState(p->h, &dcb)) {
+        port_error("GetCommState", p->name);
+        enq_port_close(p);
+        return -1;
+    }
+    dcb.BaudRate = CBR_9600;
+    dcb.ByteSize = 8;
+    dcb.Parity   = EVENPARITY;
+    dcb.StopBits = ONESTOPBIT;
+    if (!SetCommState(p->h, &dcb)) {
+        port_error("SetCommState", p->name);
+        enq_port_close(p);
+        return -1;
+    }
+    // 書き込みタイムアウトは完了時刻の上限になる (遅延統計に現れる)
+    COMMTIMEOUTS timeouts = {0};
+    timeouts.ReadIntervalTimeout         = 50;
+    timeouts.ReadTotalTimeoutConstant    = 50;
+    timeouts.ReadTotalTimeoutMultiplier  = 10;
+    timeouts.WriteTotalTimeoutConstant   = ENQ_PORT_WRITE_TIMEOUT_MS;
+    timeouts.WriteTotalTimeoutMultiplier = ENQ_PORT_WRITE_TIMEOUT_PER_BYTE_MS;
+    SetCommTimeouts(p->h, &timeouts);
+    return 0;
+}
+
+void enq_port_close(enq_port_t *p) {
+    if (p->h != NULL && p->h != INVALID_HANDLE_VALUE) CloseHandle(p->h);
+    p->h = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+// ---- POSIX ----
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "enq_tty.h"
+
+#define SOCKET_BUF_BYTES (1 << 20)  // 送受信とも 1MB (メモリ速度でも read/write の回数を抑える)
+
+// 末尾の "@9600" を取り除いて baud に入れる。戻り値: 成功 0 / 不正 -1
+// (数字以外が続く "@" はパスの一部として残す)
+static int split_baud(const char *spec, char *base, size_t len, unsigned *baud) {
+    const char *opt = strrchr(spec, '@');
+    char *end = NULL;
+    unsigned long v = opt ? strtoul(opt + 1, &end, 10) : 0;
+    if (opt && (end == opt + 1 || *end != '\0')) opt = NULL;
+    size_t n = opt ? (size_t)(opt - spec) : strlen(spec);
+    if (n >= len) n = len - 1;
+    memcpy(base, spec, n);
+    base[n] = '\0';
+    *baud = 0;
+    if (opt == NULL) return 0;
+    if (v == 0 || v > 100000000ul) return -1;
+    *baud = (unsigned)v;
+    return 0;
+}
+
+// SIGINT / SIGTERM が保留されているか (ブロックして signalfd で受ける呼び出し元用)
+static int stop_pending(void) {
+    sigset_t pending;
+    return sigpending(&pending) == 0 &&
+           (sigismember(&pending, SIGINT) || sigismember(&pending, SIGTERM));
+}
+
+// 相手が待ち受けていれば接続し、いなければ待ち受けて1つだけ受け付ける
+static int open_socket(enq_port_t *p, const char *path, int async) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "❌ ソケットのパスが長すぎます: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    p->h = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (p->h < 0) {
+        fprintf(stderr, "❌ ソケットを作成できません: %s\n", strerror(errno));
+        return -1;
+    }
+    if (connect(p->h, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (errno != ENOENT && errno != ECONNREFUSED) {
+            fprintf(stderr, "❌ %s に接続できません: %s\n", path, strerror(errno));
+            return -1;
+        }
+        // 待ち受ける側になる (前回の残りのソケットファイルは消す)
+        int lfd = p->h;
+        p->h = ENQ_PORT_INVALID;
+        unlink(path);
+        if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0) {
+            fprintf(stderr, "❌ %s で待ち受けできません: %s\n", path, strerror(errno));
+            close(lfd);
+            return -1;
+        }
+        printf("🔌 %s で相手の接続を待っています...\n", path);
+        fflush(stdout);
+        struct pollfd pfd = { lfd, POLLIN, 0 };
+        for (;;) {
+            int r = poll(&pfd, 1, 200);
+            if (r > 0) break;
+            if ((r < 0 && errno != EINTR) || stop_pending()) {
+                int err = r < 0 && errno != EINTR ? errno : EINTR;
+                close(lfd);
+                unlink(path);
+                errno = err;
+                return -1;
+            }
+        }
+        p->h = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        int err = errno;
+        close(lfd);
+        unlink(path);
+        if (p->h < 0) {
+            fprintf(stderr, "❌ %s: accept 失敗: %s\n", path, strerror(err));
+            return -1;
+        }
+    }
+    int buf = SOCKET_BUF_BYTES;
+    setsockopt(p->h, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+    setsockopt(p->h, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    if (async && fcntl(p->h, F_SETFL, O_NONBLOCK) < 0) {
+        fprintf(stderr, "❌ %s: fcntl 失敗: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int open_pty(enq_port_t *p, int oflags, const enq_tty_read_t *r) {
+    p->h = posix_openpt(oflags);
+    if (p->h < 0 || grantpt(p->h) < 0 || unlockpt(p->h) < 0 ||
+        ptsname_r(p->h, p->name, sizeof(p->name)) != 0) {
+        fprintf(stderr, "❌ 疑似端末を作成できません: %s\n", strerror(errno));
+        return -1;
+    }
+    // マスター側の termios 設定はスレーブ側に効く。相手が開く前からエコーや
+    // 行編集なしで溜まるよう raw にしておく
+    if (enq_tty_configure(p->h, r) < 0) {
+        fprintf(stderr, "❌ %s: termios 設定に失敗: %s\n", p->name, strerror(errno));
+        return -1;
+    }
+    // 最後にスレーブを閉じた側がいるとマスターはハングアップ扱い (read が EIO) になるので、
+    // こちらでも開いておき、相手の開閉に関係なく回線を保つ
+    p->peer = open(p->name, O_RDWR | O_NOCTTY);
+    if (p->peer < 0) {
+        fprintf(stderr, "❌ %s を開けません: %s\n", p->name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int enq_port_open(enq_port_t *p, const char *spec, int flags) {
+    memset(p, 0, sizeof(*p));
+    p->h = p->peer = ENQ_PORT_INVALID;
+    int async = (flags & ENQ_PORT_ASYNC) != 0;
+    int oflags = O_RDWR | O_NOCTTY | (async ? O_NONBLOCK : 0);
+    const enq_tty_read_t r = async ? ENQ_TTY_POLL_DEFAULT : ENQ_TTY_BLOCKING_DEFAULT;
+
+    char base[ENQ_PORT_NAME_MAX];
+    if (split_baud(spec, base, sizeof(base), &p->baud) < 0) {
+        fprintf(stderr, "❌ %s: @ の後の回線速度が不正です\n", spec);
+        return -1;
+    }
+    if (strcmp(base, "pty") == 0) {
+        p->kind = ENQ_PORT_PTY;
+        if (open_pty(p, oflags, &r) < 0) {
+            enq_port_close(p);
+            return -1;
+        }
+        return 0;
+    }
+    if (strncmp(base, "unix:", 5) == 0) {
+        p->kind = ENQ_PORT_SOCKET;
+        snprintf(p->name, sizeof(p->name), "%s", base);
+        if (open_socket(p, base + 5, async) < 0) {
+            int err = errno;
+            enq_port_close(p);
+            errno = err;
+            return -1;
+        }
+        return 0;
+    }
+    if (p->baud) {
+        // 実回線は termios の速度で送られる
+        fprintf(stderr, "❌ %s: 回線速度 (@bps) は pty と unix: にだけ指定できます\n", spec);
+        return -1;
+    }
+
+    p->kind = ENQ_PORT_SERIAL;
+    snprintf(p->name, sizeof(p->name), "%s", spec);
+    // O_NONBLOCK 付きで開き、モデム制御線 (DCD) を待たずに戻る
+    p->h = open(spec, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (p->h < 0) {
+        fprintf(stderr, "❌ シリアルポート %s を開けません: %s\n", spec, strerror(errno));
+        return -1;
+    }
+    if ((!async && fcntl(p->h, F_SETFL, 0) < 0) || enq_tty_configure(p->h, &r) < 0) {
+        fprintf(stderr, "❌ %s: termios 設定に失敗: %s\n", spec, strerror(errno));
+        enq_port_close(p);
+        return -1;
+    }
+    return 0;
+}
+
+void enq_port_close(enq_port_t *p) {
+    if (p->h >= 0) close(p->h);
+    if (p->peer >= 0) close(p->peer);
+    p->h = p->peer = ENQ_PORT_INVALID;
+}
+
+#endif
@@ -0,0 +1,67 @@
+// enq_port.h
+// シリアルポートを開く処理の共通化 (Win32 / POSIX / 疑似端末)
+//
+// シミュレーター (送信側) とモニター (受信側) が同じ指定でポートを開けるようにする。
+// 開いた後の読み書きはそれぞれのやり方 (Win32 はオーバーラップ I/O、POSIX は
+// epoll/poll と非ブロッキング read/write) で h を直接使う。
+//
+// 指定 (spec):
+//   "COM3" / "\\.\COM3"  Win32 の COM ポート (COM10 以上に必要な "\\.\" は補う)
+//   "/dev/ttyUSB0" など  POSIX の tty
+//   "pty"                POSIX: 新しい疑似端末を作ってマスター側を開く。相手側は
+//                        name に入るスレーブのパス ("/dev/pts/3" など) を開く。
+//                        シミュレーターとモニターを1台の Linux で繋ぐときに使う
+//   "unix:/tmp/enq.sock" POSIX: UNIX ドメインソケットで直結する (回線速度の上限なし)。
+//                        先に開いた側が待ち受け、後から開いた側が接続する。
+//                        生成から解析・公開までをメモリ速度で通す負荷試験用
+// pty と unix は末尾に "@9600" を付けると、送信側 (serial_writer) が
+// その速度 (8E1 で1バイト11ビット) で1バイトずつ送り、実回線の間隔を模擬する。
+//
+// 回線は 9600bps 8E1 raw に設定する (unix は設定なし)。POSIX の読み出し方
+// (VMIN/VTIME) は既定値 (enq_tty.h) で、モニターは開いた後に自分の設定で上書きする。
+
+#ifndef ENQ_PORT_H
+#define ENQ_PORT_H
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE enq_port_handle_t;
+#define ENQ_PORT_INVALID INVALID_HANDLE_VALUE
+#else
+typedef int enq_port_handle_t;
+#define ENQ_PORT_INVALID (-1)
+#endif
+
+#define ENQ_PORT_NAME_MAX 128
+#define ENQ_PORT_BITS_PER_BYTE 11  // 8E1 (スタート + 8 + パリティ + ストップ)
+
+// 書き込みのタイムアウト (定数 + 1バイトあたり)。Win32 は COMMTIMEOUTS に設定し、
+// POSIX の送信側 (serial_writer) は同じ値で打ち切りを判定する
+#define ENQ_PORT_WRITE_TIMEOUT_MS          50
+#define ENQ_PORT_WRITE_TIMEOUT_PER_BYTE_MS 10
+
+typedef enum {
+    ENQ_PORT_SERIAL,
+    ENQ_PORT_PTY,     // 疑似端末のマスター側
+    ENQ_PORT_SOCKET,  // UNIX ドメインソケット (termios なし)
+} enq_port_kind_t;
+
+typedef struct {
+    enq_port_handle_t h;
+    enq_port_handle_t peer;        // pty: スレーブ側 (相手が開くまで回線を保つため開いておく)
+    enq_port_kind_t kind;
+    unsigned baud;                 // 送信側で模擬する回線速度 (0 なら模擬しない)
+    char name[ENQ_PORT_NAME_MAX];  // 表示・ラベル用 ("COM31"、"/dev/ttyUSB0")。pty はスレーブのパス
+} enq_port_t;
+
+// Win32: FILE_FLAG_OVERLAPPED で開く / POSIX: O_NONBLOCK で開き、VMIN=1 VTIME=0 にする
+// (指定しなければブロッキングで VMIN=16 VTIME=5)
+#define ENQ_PORT_ASYNC 0x01
+
+// 開いて回線を設定する。失敗したら理由を標準エラーに表示して -1。
+// unix で待ち受けた側は相手が接続するまで戻らない (SIGINT/SIGTERM が保留されたら
+// errno = EINTR で -1)
+int  enq_port_open(enq_port_t *p, const char *spec, int flags);
+void enq_port_close(enq_port_t *p);
+
+#endif // ENQ_PORT_H
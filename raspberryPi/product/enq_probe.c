@@ -0,0 +1,131 @@
+// enq_probe.c
+// 遅延測定プローブの受信側解析
+// ビルド例: serial_debug_test.c と一緒にリンクする (enq_metrics.c も必要)
+
+#include "enq_probe.h"
+
+#include <string.h>
+
+#define P_NS ENQ_PROBE_PERIOD_NS
+
+void enq_probe_init(enq_probe_t *p, int shared_clock) {
+    memset(p, 0, sizeof(*p));
+    p->shared_clock = shared_clock;
+}
+
+static void add(_Atomic uint64_t *v, int64_t d) {
+    // 書き手はデコードスレッドだけなので load + store でよい
+    atomic_store_explicit(v, atomic_load_explicit(v, memory_order_relaxed) + (uint64_t)d,
+                          memory_order_relaxed);
+}
+
+static int test_seen(const enq_probe_t *p, uint64_t seq) {
+    unsigned i = (unsigned)(seq % ENQ_PROBE_WINDOW);
+    return (p->seen[i / 64] >> (i % 64)) & 1;
+}
+
+static void set_seen(enq_probe_t *p, uint64_t seq, int on) {
+    unsigned i = (unsigned)(seq % ENQ_PROBE_WINDOW);
+    if (on) p->seen[i / 64] |= 1ull << (i % 64);
+    else    p->seen[i / 64] &= ~(1ull << (i % 64));
+}
+
+// 通番を反映する。新しく受け付けたら 1 (重複なら 0)
+static int track_seq(enq_probe_t *p, uint16_t seq16) {
+    if (p->started) {
+        int d = (int16_t)(uint16_t)(seq16 - (uint16_t)p->highest);
+        if (d > 0) {
+            // 間の通番は (いったん) 欠落として数え、窓から外れる分の印を消す
+            uint64_t from = p->highest + 1;
+            p->highest += (uint64_t)d;
+            if (d >= ENQ_PROBE_WINDOW) memset(p->seen, 0, sizeof(p->seen));
+            else for (uint64_t s = from; s <= p->highest; s++) set_seen(p, s, 0);
+            set_seen(p, p->highest, 1);
+            add(&p->lost, d - 1);
+            return 1;
+        }
+        if (-d < ENQ_PROBE_WINDOW && (uint64_t)-d <= p->highest) {
+            uint64_t seq = p->highest - (uint64_t)-d;
+            if (test_seen(p, seq)) {
+                add(&p->duplicates, 1);
+                return 0;
+            }
+            set_seen(p, seq, 1);
+            add(&p->reordered, 1);
+            add(&p->lost, -1);
+            return 1;
+        }
+        // 窓より古い: 送信側が通番を振り直した
+        add(&p->restarts, 1);
+        memset(p->seen, 0, sizeof(p->seen));
+    }
+    p->started = 1;
+    // 展開した通番は下位16ビットが一致する値から始める
+    p->highest = (uint64_t)seq16 + 65536u;
+    set_seen(p, p->highest, 1);
+    return 1;
+}
+
+void enq_probe_frame(enq_probe_t *p, const enq_frame_t *f, uint64_t recv_ns) {
+    if (!track_seq(p, f->value)) return;
+    add(&p->received, 1);
+
+    // 送信時刻は 409.6ms を法とした値しか分からないので、差も法 P で求める
+    uint64_t sent = (uint64_t)(f->data_num & ENQ_PROBE_STAMP_MASK) * ENQ_PROBE_TICK_NS;
+    uint64_t raw = (recv_ns % P_NS + P_NS - sent) % P_NS;
+    if (p->shared_clock) {
+        enq_hist_record(&p->latency, raw);
+        return;
+    }
+
+    // 最初の標本を P/2 に置き、前後 ±204.8ms の変動を折り返しなしで表す
+    if (p->warm_n == 0) p->first_raw = raw;
+    uint64_t v = (raw + P_NS - p->first_raw + P_NS / 2) % P_NS;
+    if (p->warm_n < ENQ_PROBE_WARMUP) {
+        p->warm[p->warm_n++] = v;
+        if (p->warm_n == ENQ_PROBE_WARMUP) enq_probe_finish(p);
+        return;
+    }
+    // ヒストグラムは値の大きさに比例した分解能なので、基準を引いてから記録する
+    if (v < p->base) p->base = v;
+    enq_hist_record(&p->latency, v - p->base);
+}
+
+void enq_probe_finish(enq_probe_t *p) {
+    if (p->shared_clock || p->warm_n == 0 || p->base != 0) return;
+    uint64_t base = p->warm[0];
+    for (unsigned i = 1; i < p->warm_n; i++) if (p->warm[i] < base) base = p->warm[i];
+    // v は P/2 前後に置いているので 0 にはならず、base != 0 で決定済みを表せる
+    p->base = base;
+    for (unsigned i = 0; i < p->warm_n; i++) enq_hist_record(&p->latency, p->warm[i] - base);
+    p->warm_n = ENQ_PROBE_WARMUP;
+}
+
+void enq_probe_summary(const enq_probe_t *p, enq_metrics_out_t *o) {
+    static _Thread_local enq_hist_snap_t s;
+    enq_hist_snapshot(&p->latency, &s);
+
+    uint64_t received = atomic_load(&p->received), lost = atomic_load(&p->lost);
+    double loss = received + lost ? 100.0 * (double)lost / (double)(received + lost) : 0;
+    enq_metrics_printf(o, "受信 %llu / 欠落 %llu (%.2f%%) / 順序逆転 %llu / 重複 %llu",
+                       (unsigned long long)received, (unsigned long long)lost, loss,
+                       (unsigned long long)atomic_load(&p->reordered),
+                       (unsigned long long)atomic_load(&p->duplicates));
+    uint64_t restarts = atomic_load(&p->restarts);
+    if (restarts) enq_metrics_printf(o, " / 送信側再起動 %llu", (unsigned long long)restarts);
+    if (s.count == 0) {
+        enq_metrics_printf(o, p->shared_clock || received == 0 ? "\n" : " / 基準を測定中\n");
+        return;
+    }
+
+    char p50[16], p90[16], p99[16], p999[16], min[16], max[16];
+    enq_metrics_format_ns(p50, sizeof(p50), enq_hist_quantile(&s, 0.5));
+    enq_metrics_format_ns(p90, sizeof(p90), enq_hist_quantile(&s, 0.9));
+    enq_metrics_format_ns(p99, sizeof(p99), enq_hist_quantile(&s, 0.99));
+    enq_metrics_format_ns(p999, sizeof(p999), enq_hist_quantile(&s, 0.999));
+    enq_metrics_format_ns(min, sizeof(min), enq_hist_quantile(&s, 0));
+    enq_metrics_format_ns(max, sizeof(max), s.max_ns);
+    enq_metrics_printf(o, " / %s 最小=%s p50=%s p90=%s p99=%s p99.9=%s 最大=%s\n",
+                       p->shared_clock ? "片方向遅延" : "遅延変動 (最小からの差)",
+                       min, p50, p90, p99, p999, max);
+}
@@ -0,0 +1,61 @@
+// enq_probe.h
+// 遅延測定プローブの受信側解析 (片方向遅延・欠落・順序逆転)
+//
+// シミュレーターの probe モードは局番号 ENQ_PROBE_STATION の伝文に通番と
+// 送信時刻の下位12ビット (100µs 単位、409.6ms で一周) を載せて送る (enq_parser.h)。
+// 受信側はフレームが揃った時刻 (最後のバイトを read() した時刻、CLOCK_MONOTONIC) との
+// 差を 409.6ms を法として求める。したがって遅延は 409.6ms 未満である必要がある。
+//
+//   時計共有あり: 送信側の単調時計と受信側の CLOCK_MONOTONIC が同じ時計のとき
+//                 (同一ホスト上で仮想シリアル / pty で繋いだ場合)。差がそのまま片方向遅延
+//   時計共有なし: 時計のずれは未知なので、最小値からの差 (遅延変動) だけを示す。
+//                 最初の ENQ_PROBE_WARMUP 件の最小値を基準にし、それより小さい値が
+//                 来たら基準を下げる (それまでの標本はその分だけ小さく出る)
+//
+// 欠落と順序逆転は通番で判定する。直近 ENQ_PROBE_WINDOW 個より古い通番が来たら
+// 送信側の再起動とみなして数え直す。更新はデコードスレッドだけが行い、
+// 統計値はアトミックなので別スレッド (スクレイプ) から読んでよい。
+
+#ifndef ENQ_PROBE_H
+#define ENQ_PROBE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "enq_metrics.h"
+#include "enq_parser.h"
+
+#define ENQ_PROBE_WINDOW 1024  // 順序逆転・重複を判定する通番の幅 (64の倍数)
+#define ENQ_PROBE_WARMUP 16    // 時計共有なしで基準を決めるまでに貯める標本数
+
+typedef struct {
+    int shared_clock;
+    _Atomic uint64_t received;    // 受信したプローブ数 (重複を除く)
+    _Atomic uint64_t lost;        // 飛んだ通番の数 (後から届いたら戻す)
+    _Atomic uint64_t reordered;   // 後続より遅れて届いた数
+    _Atomic uint64_t duplicates;
+    _Atomic uint64_t restarts;    // 送信側の再起動とみなした回数
+    enq_hist_t latency;           // 片方向遅延 (時計共有なしなら基準からの差)
+
+    // 以下はデコードスレッド専用
+    int started;
+    uint64_t highest;             // 受信した最大の通番 (折り返しを展開した値)
+    uint64_t seen[ENQ_PROBE_WINDOW / 64];
+    uint64_t first_raw;           // 時計共有なし: 最初の標本 (差はこれを P/2 に置いて測る)
+    uint64_t base;                // 時計共有なし: 基準 (最小値)
+    uint64_t warm[ENQ_PROBE_WARMUP];
+    unsigned warm_n;              // ENQ_PROBE_WARMUP を超えたら基準が決まっている
+} enq_probe_t;
+
+void enq_probe_init(enq_probe_t *p, int shared_clock);
+
+// プローブのフレームを1件反映する。recv_ns はフレームが揃った時刻 (CLOCK_MONOTONIC)
+void enq_probe_frame(enq_probe_t *p, const enq_frame_t *f, uint64_t recv_ns);
+
+// 基準決め用に貯めている標本を記録する (終了時、標本が ENQ_PROBE_WARMUP 件に満たないとき用)
+void enq_probe_finish(enq_probe_t *p);
+
+// 1行の要約 ("受信 120 / 欠落 0 / ... / 遅延 p50=... p99=... 最大=...")
+void enq_probe_summary(const enq_probe_t *p, enq_metrics_out_t *o);
+
+#endif // ENQ_PROBE_H
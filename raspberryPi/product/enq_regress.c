@@ -0,0 +1,563 @@
+// enq_regress.c
+// キャプチャの回帰試験 (並列): パーサー・重複抑制・号機状態の結果をゴールデンと比べる
+// ビルド例: gcc -O2 -pthread enq_regress.c enq_parser.c enq_simd.c enq_capture.c enq_arena.c enq_state.c -o enq_regress
+//
+// 使用方法:
+//   enq_regress [-threads N] [-golden ディレクトリ] [-update] [-perf ファイル] [-tolerance %]
+//               <キャプチャのディレクトリ>
+//   ディレクトリ内のキャプチャ (先頭が ENQCAP01 のファイル) をすべて処理し、ファイルごとに
+//   名前 + ".golden" のゴールデン (既定はキャプチャと同じディレクトリ) と比べる。
+//   -update はゴールデンを今の結果で書き直す (記録を加えたとき・意図して出力を変えたとき)。
+//   -perf はファイルごとの処理速度 (MB/s) の基準。あれば基準より -tolerance % (既定 30)
+//   以上遅いファイルを性能の低下として数え、-update と一緒なら今の速度で書き直す。
+//   終了コード: 0 すべて一致 / 1 不一致・読めない・ゴールデンなし / 2 性能の低下だけ
+//
+// 各キャプチャはモニター (serial_debug_test publish) と同じ流れで処理する。
+// ポートごとのパーサー (ENQ_PARSER_CHANGES_ONLY、再通知は既定の間隔) に記録順に
+// バイト列を入れ、重複抑制の時刻には記録時刻を使う (enq_parser_set_clock)。
+// 出てきたフレームを号機の状態 (enq_car_state_apply) に反映し、1フレーム1行で
+//   <最初のレコードからの ms> <ポート> <局番号> <データ番号>=<値> ok|NG <表示> | <号機の状態>
+// を出す。末尾にはポートごとのパーサー統計と号機ごとの最終状態を付ける。
+// 結果は記録の内容だけで決まるので、ゴールデンとはバイト単位で比べ、違えば
+// 最初に違う行と違う行数 (行番号の位置で比べる) を表示する。
+//
+// ファイル単位の作業をスレッドプールで分ける。大きいファイルから順に取るので、
+// 最後に大きいファイルだけが残って待つことは少ない。速度はファイルごとの
+// デコード (出力の組み立てを含み、比較は含まない) にかかったスレッドの CPU 時間で測るので、
+// スレッド数がコア数より多くても基準とは比べられる。
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "enq_capture.h"
+#include "enq_parser.h"
+#include "enq_state.h"
+
+#define REG_MAX_FILES     4096
+#define REG_MAX_THREADS   256
+#define REG_MAX_CARS      1024   // ファイルごとの号機 (ポート, 局番号) の上限
+#define REG_CAR_HASH      2048   // 号機の探索表 (2のべき乗)
+#define REG_PERF_MIN_NS   10000000ull  // これより短く終わったファイルは速度を比べない
+#define REG_SHOW_LINE     160    // 不一致の行を表示する長さ
+
+typedef enum {
+    REG_PASS,
+    REG_DIFF,         // ゴールデンと違う
+    REG_NO_GOLDEN,
+    REG_UPDATED,      // -update で書き直した
+    REG_ERROR,        // 読めない・書けない
+} reg_status_t;
+
+typedef struct {
+    char *p;
+    size_t len, cap;
+    int failed;
+} reg_buf_t;
+
+typedef struct {
+    char path[PATH_MAX];
+    char golden[PATH_MAX];
+    const char *name;           // path のファイル名部分
+    uint64_t size;
+    // 結果
+    reg_status_t status;
+    char error[128];
+    uint64_t records, bytes, frames;
+    uint64_t decode_ns;
+    size_t diff_lines, first_diff;   // first_diff は 1 始まり
+    char expected[REG_SHOW_LINE + 1], actual[REG_SHOW_LINE + 1];
+    double baseline_mbps;       // -perf の基準 (なければ 0)
+    int slow;
+} reg_file_t;
+
+typedef struct {
+    uint32_t key;               // (ポート + 1) << 16 | 局番号。0 は空き
+    enq_car_state_t state;
+} reg_car_t;
+
+// 1ファイルを処理する間の状態 (スレッドごとに1つ)
+typedef struct {
+    enq_parser_t parsers[ENQCAP_MAX_PORTS];
+    reg_car_t cars[REG_CAR_HASH];
+    uint32_t order[REG_MAX_CARS];    // 号機を最初に見た順
+    size_t num_cars;
+    uint64_t dropped_cars;           // 上限を超えて状態を持てなかったフレーム
+    reg_buf_t out;
+    uint64_t origin_ns;
+    uint16_t port;
+    reg_file_t *file;
+} reg_worker_t;
+
+static reg_file_t files[REG_MAX_FILES];
+static reg_file_t *by_size[REG_MAX_FILES];
+static size_t num_files;
+static _Atomic size_t next_file;
+static int update;
+
+static uint64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// ---- 出力の組み立て ----
+
+static void buf_printf(reg_buf_t *b, const char *fmt, ...) {
+    if (b->failed) return;
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->p + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            b->failed = 1;
+            return;
+        }
+        if ((size_t)n < b->cap - b->len) {
+            b->len += (size_t)n;
+            return;
+        }
+        size_t cap = b->cap * 2 > b->len + (size_t)n + 1 ? b->cap * 2 : b->len + (size_t)n + 1;
+        char *p = realloc(b->p, cap);
+        if (p == NULL) {
+            b->failed = 1;
+            return;
+        }
+        b->p = p;
+        b->cap = cap;
+    }
+}
+
+static reg_car_t *find_car(reg_worker_t *wk, uint16_t port, uint16_t station) {
+    uint32_t key = ((uint32_t)(port + 1) << 16) | station;
+    for (uint32_t h = (key * 2654435761u) & (REG_CAR_HASH - 1);; h = (h + 1) & (REG_CAR_HASH - 1)) {
+        reg_car_t *c = &wk->cars[h];
+        if (c->key == key) return c;
+        if (c->key != 0) continue;
+        if (wk->num_cars == REG_MAX_CARS) return NULL;
+        c->key = key;
+        memset(&c->state, 0, sizeof(c->state));
+        c->state.port = port;
+        c->state.station = station;
+        wk->order[wk->num_cars++] = h;
+        return c;
+    }
+}
+
+static void format_state(const enq_car_state_t *s, char *buf, size_t len) {
+    char cur[16] = "-", tgt[16] = "-";
+    if (s->flags & ENQ_CAR_HAVE_CURRENT) enq_floor_name(s->current_floor, cur, sizeof(cur));
+    if ((s->flags & ENQ_CAR_HAVE_TARGET) && s->target_floor != 0)
+        enq_floor_name(s->target_floor, tgt, sizeof(tgt));
+    char load[16] = "-";
+    if (s->flags & ENQ_CAR_HAVE_LOAD) snprintf(load, sizeof(load), "%ukg", (unsigned)s->load);
+    snprintf(buf, len, "cur=%s tgt=%s load=%s%s", cur, tgt, load,
+             (s->flags & ENQ_CAR_MOVING) ? " moving" : "");
+}
+
+static void on_frame(const enq_frame_t *f, void *ctx) {
+    reg_worker_t *wk = ctx;
+    uint64_t t = wk->file->records ? wk->parsers[wk->port].clock_ns - wk->origin_ns : 0;
+    char desc[64], state[80];
+    enq_frame_describe(f, desc, sizeof(desc));
+    if (enq_frame_is_probe(f)) {
+        snprintf(state, sizeof(state), "probe");
+    } else {
+        reg_car_t *c = find_car(wk, wk->port, f->station);
+        if (c) {
+            enq_car_state_apply(&c->state, f, t);
+            format_state(&c->state, state, sizeof(state));
+        } else {
+            wk->dropped_cars++;
+            snprintf(state, sizeof(state), "(号機数の上限)");
+        }
+    }
+    buf_printf(&wk->out, "%llu.%06u %u %04u %04X=%04X %s %s | %s\n",
+               (unsigned long long)(t / 1000000ull), (unsigned)(t % 1000000ull), wk->port,
+               f->station, f->data_num, f->value, f->checksum_ok ? "ok" : "NG", desc, state);
+    wk->file->frames++;
+}
+
+// キャプチャを読んで結果を wk->out に組み立てる。戻り値: 成功 0 / 読めない -1
+static int decode_file(reg_worker_t *wk, reg_file_t *f) {
+    enqcap_reader_t r;
+    if (enqcap_open_mapped(&r, f->path) < 0) {
+        snprintf(f->error, sizeof(f->error), "キャプチャを読めません: %s", strerror(errno));
+        return -1;
+    }
+    wk->file = f;
+    wk->out.len = 0;
+    wk->out.failed = 0;
+    wk->num_cars = 0;
+    wk->dropped_cars = 0;
+    memset(wk->cars, 0, sizeof(wk->cars));
+    for (unsigned p = 0; p < r.hdr.port_count; p++) enq_parser_init(&wk->parsers[p], ENQ_PARSER_CHANGES_ONLY);
+
+    buf_printf(&wk->out, "# %s: %u ポート%s%s\n", f->name, r.hdr.port_count,
+               r.indexed ? "" : " (索引なし)", r.truncated ? " (末尾が不完全)" : "");
+    enqcap_cursor_t cur;
+    enqcap_cursor_seek(&cur, &r, 0);
+    enqcap_record_t rec;
+    while (enqcap_next(&cur, &rec)) {
+        if (rec.port >= r.hdr.port_count) continue;
+        if (f->records++ == 0) wk->origin_ns = rec.t_ns;
+        f->bytes += rec.len;
+        wk->port = rec.port;
+        // 記録時刻で重複抑制する (0 は「時刻を与えない」なので避ける)
+        enq_parser_set_clock(&wk->parsers[rec.port], rec.t_ns ? rec.t_ns : 1);
+        enq_parser_push(&wk->parsers[rec.port], rec.data, rec.len, on_frame, wk);
+    }
+
+    for (unsigned p = 0; p < r.hdr.port_count; p++) {
+        const enq_parser_stats_t *st = enq_parser_stats(&wk->parsers[p]);
+        buf_printf(&wk->out, "# port %u %s: bytes=%llu frames=%llu duplicates=%llu resync=%llu "
+                   "layout=%llu checksum=%llu\n", p, enqcap_port_name(&r, p),
+                   (unsigned long long)st->bytes_in, (unsigned long long)st->frames,
+                   (unsigned long long)st->duplicates, (unsigned long long)st->resync_bytes,
+                   (unsigned long long)st->layout_errors, (unsigned long long)st->checksum_errors);
+    }
+    for (size_t k = 0; k < wk->num_cars; k++) {
+        const enq_car_state_t *s = &wk->cars[wk->order[k]].state;
+        char state[80];
+        format_state(s, state, sizeof(state));
+        buf_printf(&wk->out, "# car %u %04u: %s frames=%llu changes=%llu\n", s->port, s->station,
+                   state, (unsigned long long)s->frames, (unsigned long long)s->changes);
+    }
+    if (wk->dropped_cars) {
+        buf_printf(&wk->out, "# over_car_limit=%llu\n", (unsigned long long)wk->dropped_cars);
+    }
+    enqcap_close_mapped(&r);
+    if (wk->out.failed) {
+        snprintf(f->error, sizeof(f->error), "メモリ不足");
+        return -1;
+    }
+    return 0;
+}
+
+// ---- ゴールデンとの比較 ----
+
+static void copy_line(char *dst, const char *p, const char *end) {
+    size_t n = 0;
+    while (p < end && *p != '\n' && n < REG_SHOW_LINE) dst[n++] = *p++;
+    dst[n] = '\0';
+}
+
+// 行の位置で比べ、違う行の数と最初に違う行を記録する
+static void diff_lines(reg_file_t *f, const char *a, size_t alen, const char *b, size_t blen) {
+    const char *ap = a, *ae = a + alen, *bp = b, *be = b + blen;
+    for (size_t line = 1; ap < ae || bp < be; line++) {
+        const char *an = ap < ae ? memchr(ap, '\n', (size_t)(ae - ap)) : NULL;
+        const char *bn = bp < be ? memchr(bp, '\n', (size_t)(be - bp)) : NULL;
+        if (an == NULL) an = ae;
+        if (bn == NULL) bn = be;
+        size_t al = (size_t)(an - ap), bl = (size_t)(bn - bp);
+        if (ap >= ae || bp >= be || al != bl || memcmp(ap, bp, al) != 0) {
+            if (f->diff_lines++ == 0) {
+                f->first_diff = line;
+                copy_line(f->expected, ap, ae);
+                copy_line(f->actual, bp, be);
+            }
+        }
+        ap = an < ae ? an + 1 : ae;
+        bp = bn < be ? bn + 1 : be;
+    }
+}
+
+static int read_file(const char *path, char **out, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return -1;
+    struct stat st;
+    if (fstat(fileno(fp), &st) < 0) {
+        fclose(fp);
+        return -1;
+    }
+    *len = (size_t)st.st_size;
+    *out = malloc(*len ? *len : 1);
+    if (*out == NULL || fread(*out, 1, *len, fp) != *len) {
+        free(*out);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int write_file(const char *path, const char *data, size_t len) {
+    // 途中で止まっても古いゴールデンが壊れないよう一時ファイルから置き換える
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) return -1;
+    int ok = fwrite(data, 1, len, fp) == len;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void check_file(reg_worker_t *wk, reg_file_t *f) {
+    uint64_t t0 = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    if (decode_file(wk, f) < 0) {
+        f->status = REG_ERROR;
+        return;
+    }
+    f->decode_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+
+    if (update) {
+        if (write_file(f->golden, wk->out.p, wk->out.len) < 0) {
+            snprintf(f->error, sizeof(f->error), "ゴールデンを書けません: %s", strerror(errno));
+            f->status = REG_ERROR;
+        } else {
+            f->status = REG_UPDATED;
+        }
+        return;
+    }
+    char *golden;
+    size_t glen;
+    if (read_file(f->golden, &golden, &glen) < 0) {
+        f->status = REG_NO_GOLDEN;
+        return;
+    }
+    if (glen == wk->out.len && memcmp(golden, wk->out.p, glen) == 0) {
+        f->status = REG_PASS;
+    } else {
+        f->status = REG_DIFF;
+        diff_lines(f, golden, glen, wk->out.p, wk->out.len);
+    }
+    free(golden);
+}
+
+static void *worker_main(void *arg) {
+    reg_worker_t *wk = arg;
+    for (;;) {
+        size_t i = atomic_fetch_add_explicit(&next_file, 1, memory_order_relaxed);
+        if (i >= num_files) break;
+        check_file(wk, by_size[i]);
+    }
+    return NULL;
+}
+
+// ---- ファイル一覧・速度の基準 ----
+
+static int is_capture(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return 0;
+    char magic[8];
+    int ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+             memcmp(magic, ENQCAP_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return ok;
+}
+
+static int cmp_name(const void *a, const void *b) {
+    // 同じディレクトリなのでパスの順 = ファイル名の順
+    return strcmp(((const reg_file_t *)a)->path, ((const reg_file_t *)b)->path);
+}
+
+static int cmp_size_desc(const void *a, const void *b) {
+    const reg_file_t *x = *(reg_file_t *const *)a, *y = *(reg_file_t *const *)b;
+    return x->size < y->size ? 1 : x->size > y->size ? -1 : 0;
+}
+
+static int list_captures(const char *dir, const char *golden_dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return -1;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        if (num_files == REG_MAX_FILES) {
+            fprintf(stderr, "⚠️ ファイル数の上限 (%d) を超えた分は読みません\n", REG_MAX_FILES);
+            break;
+        }
+        reg_file_t *f = &files[num_files];
+        snprintf(f->path, sizeof(f->path), "%s/%s", dir, e->d_name);
+        struct stat st;
+        if (stat(f->path, &st) < 0 || !S_ISREG(st.st_mode) || !is_capture(f->path)) continue;
+        f->size = (uint64_t)st.st_size;
+        snprintf(f->golden, sizeof(f->golden), "%s/%s.golden", golden_dir, e->d_name);
+        num_files++;
+    }
+    closedir(d);
+    qsort(files, num_files, sizeof(files[0]), cmp_name);
+    for (size_t i = 0; i < num_files; i++) {
+        // qsort で並びが変わるので name はここで決める
+        files[i].name = strrchr(files[i].path, '/') + 1;
+        by_size[i] = &files[i];
+    }
+    qsort(by_size, num_files, sizeof(by_size[0]), cmp_size_desc);
+    return 0;
+}
+
+static double file_mbps(const reg_file_t *f) {
+    return f->decode_ns ? (double)f->size / 1e6 / ((double)f->decode_ns / 1e9) : 0;
+}
+
+// 1行 "<MB/s> <ファイル名>"
+static void load_perf(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return;
+    char line[PATH_MAX + 64];
+    while (fgets(line, sizeof(line), fp)) {
+        char *end;
+        double mbps = strtod(line, &end);
+        if (end == line || *end != ' ') continue;
+        char *name = end + 1;
+        name[strcspn(name, "\n")] = '\0';
+        for (size_t i = 0; i < num_files; i++) {
+            if (strcmp(files[i].name, name) == 0) files[i].baseline_mbps = mbps;
+        }
+    }
+    fclose(fp);
+}
+
+static int save_perf(const char *path) {
+    reg_buf_t b = {0};
+    for (size_t i = 0; i < num_files; i++) {
+        if (files[i].status != REG_ERROR) buf_printf(&b, "%.1f %s\n", file_mbps(&files[i]), files[i].name);
+    }
+    int rc = b.failed ? -1 : write_file(path, b.p ? b.p : "", b.len);
+    free(b.p);
+    return rc;
+}
+
+static void usage(const char *prog) {
+    printf("使用方法: %s [-threads N] [-golden ディレクトリ] [-update] [-perf ファイル] "
+           "[-tolerance %%] <キャプチャのディレクトリ>\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *golden_dir = NULL, *perf_path = NULL;
+    double tolerance = 30;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-golden") == 0 && i + 1 < argc) {
+            golden_dir = argv[++i];
+        } else if (strcmp(argv[i], "-update") == 0) {
+            update = 1;
+        } else if (strcmp(argv[i], "-perf") == 0 && i + 1 < argc) {
+            perf_path = argv[++i];
+        } else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if (i + 1 != argc || threads <= 0 || tolerance < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads > REG_MAX_THREADS) threads = REG_MAX_THREADS;
+    const char *dir = argv[i];
+    if (list_captures(dir, golden_dir ? golden_dir : dir) < 0) {
+        fprintf(stderr, "❌ ディレクトリ %s を読めません: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    if (num_files == 0) {
+        fprintf(stderr, "❌ %s にキャプチャがありません\n", dir);
+        return 1;
+    }
+    if (perf_path && !update) load_perf(perf_path);
+    if ((size_t)threads > num_files) threads = (int)num_files;
+
+    uint64_t total_bytes = 0;
+    for (size_t k = 0; k < num_files; k++) total_bytes += files[k].size;
+    printf("🧪 %zu ファイル (%.1f MB) / %d スレッド / SIMD %s%s\n", num_files,
+           (double)total_bytes / 1e6, threads, enq_simd_name(enq_simd_active()),
+           update ? " / ゴールデンを書き直します" : "");
+
+    // パーサーの重複抑制表はキャッシュライン境界に揃える
+    reg_worker_t *workers = aligned_alloc(_Alignof(reg_worker_t), (size_t)threads * sizeof(*workers));
+    if (workers == NULL) {
+        fprintf(stderr, "❌ メモリ不足\n");
+        return 1;
+    }
+    memset(workers, 0, (size_t)threads * sizeof(*workers));
+    uint64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    pthread_t th[REG_MAX_THREADS];
+    int started = 0;
+    for (int k = 0; k < threads; k++) {
+        int rc = pthread_create(&th[k], NULL, worker_main, &workers[k]);
+        if (rc != 0) {
+            // 起動できた分だけで続ける
+            fprintf(stderr, "⚠️ スレッド起動失敗: %s\n", strerror(rc));
+            break;
+        }
+        started++;
+    }
+    if (started == 0) worker_main(&workers[0]);
+    for (int k = 0; k < started; k++) pthread_join(th[k], NULL);
+    uint64_t elapsed = clock_ns(CLOCK_MONOTONIC) - t0;
+
+    size_t pass = 0, fail = 0, slow = 0, updated = 0;
+    uint64_t frames = 0;
+    for (size_t k = 0; k < num_files; k++) {
+        reg_file_t *f = &files[k];
+        double mbps = file_mbps(f);
+        frames += f->frames;
+        if (f->baseline_mbps > 0 && f->decode_ns >= REG_PERF_MIN_NS &&
+            mbps < f->baseline_mbps * (1 - tolerance / 100)) {
+            f->slow = 1;
+            slow++;
+        }
+        char speed[96] = "";
+        if (f->status != REG_ERROR) {
+            snprintf(speed, sizeof(speed), " / %.1f MB/s (%.2f M フレーム/秒)", mbps,
+                     f->decode_ns ? (double)f->frames / ((double)f->decode_ns / 1e9) / 1e6 : 0);
+        }
+        switch (f->status) {
+        case REG_PASS:
+            pass++;
+            printf("✅ %s: %llu フレーム%s", f->name, (unsigned long long)f->frames, speed);
+            break;
+        case REG_UPDATED:
+            updated++;
+            printf("📝 %s: %llu フレーム%s (ゴールデン更新)", f->name,
+                   (unsigned long long)f->frames, speed);
+            break;
+        case REG_DIFF:
+            fail++;
+            printf("❌ %s: %zu 行が不一致 (最初は %zu 行目)%s\n", f->name, f->diff_lines,
+                   f->first_diff, speed);
+            printf("   期待: %s\n   結果: %s", f->expected, f->actual);
+            break;
+        case REG_NO_GOLDEN:
+            fail++;
+            printf("❓ %s: ゴールデン %s がありません (-update で作成)%s", f->name, f->golden, speed);
+            break;
+        case REG_ERROR:
+            fail++;
+            printf("💥 %s: %s", f->name, f->error);
+            break;
+        }
+        if (f->slow) printf(" 🐢 基準 %.1f MB/s より遅い", f->baseline_mbps);
+        printf("\n");
+    }
+    if (perf_path && update && save_perf(perf_path) < 0) {
+        fprintf(stderr, "❌ 速度の基準 %s を書けません: %s\n", perf_path, strerror(errno));
+        fail++;
+    }
+
+    double secs = (double)elapsed / 1e9;
+    printf("\n⏱️ %.2f 秒で %.1f MB / %llu フレーム (%.1f MB/s, %d スレッド)\n", secs,
+           (double)total_bytes / 1e6, (unsigned long long)frames,
+           secs > 0 ? (double)total_bytes / 1e6 / secs : 0, threads);
+    printf("📋 一致 %zu / 不一致・エラー %zu / 更新 %zu / 性能の低下 %zu\n", pass, fail, updated, slow);
+    for (int k = 0; k < threads; k++) free(workers[k].out.p);
+    free(workers);
+    return fail ? 1 : slow ? 2 : 0;
+}
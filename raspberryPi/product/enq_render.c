@@ -0,0 +1,380 @@
+// enq_render.c
+// RTSP 配信画面のネイティブ描画 (差分更新)
+// ビルド例:
+//   gcc -O2 -shared -fPIC enq_render.c -o libenq_render.so   # Python から ctypes で使う
+
+#include "enq_render.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GLYPH_SLOTS 4096  // ハッシュ表 (2のべき乗、ENQ_RENDER_MAX_GLYPHS の2倍)
+
+typedef struct {
+    uint32_t key;        // (font << 24) | codepoint、0 は空き
+    uint16_t ax, ay;     // アトラス内の位置
+    uint16_t w, h;
+    int16_t  left, top;
+    int16_t  advance;
+} glyph_t;
+
+typedef struct {
+    int x, y, w, h;
+} rect_t;
+
+typedef struct {
+    rect_t   box;
+    int      font;
+    int      align;
+    uint32_t fg, bg, border;
+    int      border_width;
+    char     text[ENQ_RENDER_TEXT_MAX];
+} widget_t;
+
+typedef struct {
+    uint64_t frame;
+    int      count;
+    rect_t   rects[ENQ_RENDER_RECTS];
+} history_t;
+
+struct enq_renderer {
+    int width, height;
+    uint32_t background;
+    uint8_t *fb;                          // RGB24, 行の詰めなし
+
+    uint8_t atlas[ENQ_RENDER_ATLAS_H][ENQ_RENDER_ATLAS_W];
+    int shelf_x, shelf_y, shelf_h;        // 棚詰めの現在位置
+    glyph_t glyphs[GLYPH_SLOTS];
+    int num_glyphs;
+    int ascent[ENQ_RENDER_MAX_FONTS], descent[ENQ_RENDER_MAX_FONTS];
+
+    widget_t widgets[ENQ_RENDER_MAX_WIDGETS];
+    int num_widgets;
+
+    rect_t pending[ENQ_RENDER_RECTS];     // 次の commit で確定する差分
+    int num_pending;
+    history_t history[ENQ_RENDER_HISTORY];
+    uint64_t frame;
+};
+
+// ---- 汎用 ----
+
+static uint32_t next_codepoint(const uint8_t **s) {
+    const uint8_t *p = *s;
+    uint32_t c = *p++;
+    int extra = c < 0x80 ? 0 : (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 :
+                (c & 0xF8) == 0xF0 ? 3 : -1;
+    if (extra < 0) {
+        *s = p;
+        return 0xFFFD;
+    }
+    if (extra > 0) c &= 0x3F >> extra;
+    for (int i = 0; i < extra; i++) {
+        if ((*p & 0xC0) != 0x80) {
+            *s = p;
+            return 0xFFFD;
+        }
+        c = (c << 6) | (*p++ & 0x3F);
+    }
+    *s = p;
+    return c;
+}
+
+static uint32_t glyph_key(int font, uint32_t cp) {
+    return ((uint32_t)(font + 1) << 24) | (cp & 0xFFFFFF);
+}
+
+static glyph_t *glyph_slot(const enq_renderer_t *r, uint32_t key) {
+    uint32_t h = (key * 2654435761u) & (GLYPH_SLOTS - 1);
+    for (;;) {
+        const glyph_t *g = &r->glyphs[h];
+        if (g->key == key || g->key == 0) return (glyph_t *)g;
+        h = (h + 1) & (GLYPH_SLOTS - 1);
+    }
+}
+
+static const glyph_t *find_glyph(const enq_renderer_t *r, int font, uint32_t cp) {
+    const glyph_t *g = glyph_slot(r, glyph_key(font, cp));
+    return g->key ? g : NULL;
+}
+
+static rect_t clip_rect(const enq_renderer_t *r, rect_t a) {
+    if (a.x < 0) { a.w += a.x; a.x = 0; }
+    if (a.y < 0) { a.h += a.y; a.y = 0; }
+    if (a.x + a.w > r->width)  a.w = r->width - a.x;
+    if (a.y + a.h > r->height) a.h = r->height - a.y;
+    if (a.w < 0) a.w = 0;
+    if (a.h < 0) a.h = 0;
+    return a;
+}
+
+static void mark_dirty(enq_renderer_t *r, rect_t a) {
+    a = clip_rect(r, a);
+    if (a.w == 0 || a.h == 0) return;
+    if (r->num_pending < ENQ_RENDER_RECTS) {
+        r->pending[r->num_pending++] = a;
+        return;
+    }
+    // 溢れたら全部を外接矩形1つにまとめる
+    rect_t u = a;
+    for (int i = 0; i < r->num_pending; i++) {
+        rect_t b = r->pending[i];
+        int x1 = u.x + u.w > b.x + b.w ? u.x + u.w : b.x + b.w;
+        int y1 = u.y + u.h > b.y + b.h ? u.y + u.h : b.y + b.h;
+        u.x = u.x < b.x ? u.x : b.x;
+        u.y = u.y < b.y ? u.y : b.y;
+        u.w = x1 - u.x;
+        u.h = y1 - u.y;
+    }
+    r->pending[0] = u;
+    r->num_pending = 1;
+}
+
+// ---- 描画 ----
+
+static void fill_rect(enq_renderer_t *r, rect_t a, uint32_t color) {
+    a = clip_rect(r, a);
+    uint8_t c0 = (uint8_t)(color >> 16), c1 = (uint8_t)(color >> 8), c2 = (uint8_t)color;
+    for (int y = a.y; y < a.y + a.h; y++) {
+        uint8_t *p = r->fb + ((size_t)y * (size_t)r->width + (size_t)a.x) * 3;
+        for (int x = 0; x < a.w; x++, p += 3) {
+            p[0] = c0;
+            p[1] = c1;
+            p[2] = c2;
+        }
+    }
+}
+
+// グリフをクリップ矩形内に合成する
+static void blit_glyph(enq_renderer_t *r, const glyph_t *g, int x0, int y0, rect_t clip,
+                       uint32_t fg) {
+    unsigned f0 = (fg >> 16) & 0xFF, f1 = (fg >> 8) & 0xFF, f2 = fg & 0xFF;
+    for (int gy = 0; gy < g->h; gy++) {
+        int y = y0 + gy;
+        if (y < clip.y || y >= clip.y + clip.h) continue;
+        const uint8_t *src = &r->atlas[g->ay + gy][g->ax];
+        for (int gx = 0; gx < g->w; gx++) {
+            int x = x0 + gx;
+            unsigned a = src[gx];
+            if (a == 0 || x < clip.x || x >= clip.x + clip.w) continue;
+            uint8_t *p = r->fb + ((size_t)y * (size_t)r->width + (size_t)x) * 3;
+            if (a == 255) {
+                p[0] = (uint8_t)f0;
+                p[1] = (uint8_t)f1;
+                p[2] = (uint8_t)f2;
+            } else {
+                unsigned na = 255 - a;
+                p[0] = (uint8_t)((f0 * a + p[0] * na + 127) / 255);
+                p[1] = (uint8_t)((f1 * a + p[1] * na + 127) / 255);
+                p[2] = (uint8_t)((f2 * a + p[2] * na + 127) / 255);
+            }
+        }
+    }
+}
+
+static int text_width(const enq_renderer_t *r, int font, const char *text) {
+    int w = 0;
+    const uint8_t *s = (const uint8_t *)text;
+    while (*s) {
+        const glyph_t *g = find_glyph(r, font, next_codepoint(&s));
+        // 未登録のグリフは半角分の空白
+        w += g ? g->advance : (r->ascent[font] + r->descent[font]) / 2;
+    }
+    return w;
+}
+
+static void draw_widget(enq_renderer_t *r, const widget_t *w) {
+    fill_rect(r, w->box, w->bg);
+    int bw = w->border_width;
+    if (bw > 0) {
+        const rect_t *b = &w->box;
+        fill_rect(r, (rect_t){ b->x, b->y, b->w, bw }, w->border);
+        fill_rect(r, (rect_t){ b->x, b->y + b->h - bw, b->w, bw }, w->border);
+        fill_rect(r, (rect_t){ b->x, b->y, bw, b->h }, w->border);
+        fill_rect(r, (rect_t){ b->x + b->w - bw, b->y, bw, b->h }, w->border);
+    }
+
+    rect_t clip = clip_rect(r, (rect_t){ w->box.x + bw, w->box.y + bw,
+                                         w->box.w - 2 * bw, w->box.h - 2 * bw });
+    int line_h = r->ascent[w->font] + r->descent[w->font];
+    int pen_x = w->box.x + bw;
+    if (w->align == ENQ_ALIGN_CENTER)
+        pen_x = w->box.x + (w->box.w - text_width(r, w->font, w->text)) / 2;
+    int top = w->box.y + (w->box.h - line_h) / 2;
+
+    const uint8_t *s = (const uint8_t *)w->text;
+    while (*s) {
+        const glyph_t *g = find_glyph(r, w->font, next_codepoint(&s));
+        if (g == NULL) {
+            pen_x += line_h / 2;
+            continue;
+        }
+        blit_glyph(r, g, pen_x + g->left, top + g->top, clip, w->fg);
+        pen_x += g->advance;
+    }
+    mark_dirty(r, w->box);
+}
+
+// ---- 公開関数 ----
+
+enq_renderer_t *enq_render_new(int width, int height, uint32_t background) {
+    if (width <= 0 || height <= 0) return NULL;
+    enq_renderer_t *r = calloc(1, sizeof(*r));
+    if (r == NULL) return NULL;
+    r->fb = malloc((size_t)width * (size_t)height * 3);
+    if (r->fb == NULL) {
+        free(r);
+        return NULL;
+    }
+    r->width = width;
+    r->height = height;
+    r->background = background;
+    fill_rect(r, (rect_t){ 0, 0, width, height }, background);
+    mark_dirty(r, (rect_t){ 0, 0, width, height });
+    return r;
+}
+
+void enq_render_free(enq_renderer_t *r) {
+    if (r == NULL) return;
+    free(r->fb);
+    free(r);
+}
+
+int enq_render_set_font(enq_renderer_t *r, int font, int ascent, int descent) {
+    if (font < 0 || font >= ENQ_RENDER_MAX_FONTS) return -1;
+    r->ascent[font] = ascent;
+    r->descent[font] = descent;
+    return 0;
+}
+
+int enq_render_add_glyph(enq_renderer_t *r, int font, uint32_t codepoint,
+                         int width, int height, int left, int top, int advance,
+                         const uint8_t *alpha) {
+    if (font < 0 || font >= ENQ_RENDER_MAX_FONTS || width < 0 || height < 0 ||
+        width > ENQ_RENDER_ATLAS_W || height > ENQ_RENDER_ATLAS_H)
+        return -1;
+    glyph_t *g = glyph_slot(r, glyph_key(font, codepoint));
+    if (g->key) return 0;  // 登録済み
+    if (r->num_glyphs >= ENQ_RENDER_MAX_GLYPHS) return -1;
+
+    // 棚詰め: 横に並べ、入らなければ次の段へ
+    if (r->shelf_x + width > ENQ_RENDER_ATLAS_W) {
+        r->shelf_y += r->shelf_h;
+        r->shelf_x = 0;
+        r->shelf_h = 0;
+    }
+    if (r->shelf_y + height > ENQ_RENDER_ATLAS_H) return -1;  // アトラス満杯
+
+    g->key = glyph_key(font, codepoint);
+    g->ax = (uint16_t)r->shelf_x;
+    g->ay = (uint16_t)r->shelf_y;
+    g->w = (uint16_t)width;
+    g->h = (uint16_t)height;
+    g->left = (int16_t)left;
+    g->top = (int16_t)top;
+    g->advance = (int16_t)advance;
+    for (int y = 0; y < height; y++)
+        memcpy(&r->atlas[g->ay + y][g->ax], alpha + (size_t)y * (size_t)width, (size_t)width);
+
+    r->shelf_x += width;
+    if (height > r->shelf_h) r->shelf_h = height;
+    r->num_glyphs++;
+    return 1;
+}
+
+size_t enq_render_missing_glyphs(const enq_renderer_t *r, int font, const char *utf8,
+                                 uint32_t *out, size_t max) {
+    if (font < 0 || font >= ENQ_RENDER_MAX_FONTS) return 0;
+    size_t n = 0;
+    const uint8_t *s = (const uint8_t *)utf8;
+    while (*s && n < max) {
+        uint32_t cp = next_codepoint(&s);
+        if (find_glyph(r, font, cp) == NULL) out[n++] = cp;
+    }
+    return n;
+}
+
+int enq_render_add_widget(enq_renderer_t *r, int x, int y, int w, int h, int font, int align,
+                          uint32_t fg, uint32_t bg, uint32_t border, int border_width) {
+    if (r->num_widgets >= ENQ_RENDER_MAX_WIDGETS || font < 0 || font >= ENQ_RENDER_MAX_FONTS)
+        return -1;
+    widget_t *wd = &r->widgets[r->num_widgets];
+    memset(wd, 0, sizeof(*wd));
+    wd->box = (rect_t){ x, y, w, h };
+    wd->font = font;
+    wd->align = align;
+    wd->fg = fg;
+    wd->bg = bg;
+    wd->border = border;
+    wd->border_width = border_width;
+    draw_widget(r, wd);
+    return r->num_widgets++;
+}
+
+int enq_render_set_text(enq_renderer_t *r, int widget, const char *utf8) {
+    if (widget < 0 || widget >= r->num_widgets) return 0;
+    widget_t *w = &r->widgets[widget];
+    if (strncmp(w->text, utf8, sizeof(w->text) - 1) == 0) return 0;
+    strncpy(w->text, utf8, sizeof(w->text) - 1);
+    w->text[sizeof(w->text) - 1] = '\0';
+    draw_widget(r, w);
+    return 1;
+}
+
+int enq_render_set_style(enq_renderer_t *r, int widget, uint32_t fg, uint32_t bg,
+                         uint32_t border) {
+    if (widget < 0 || widget >= r->num_widgets) return 0;
+    widget_t *w = &r->widgets[widget];
+    if (w->fg == fg && w->bg == bg && w->border == border) return 0;
+    w->fg = fg;
+    w->bg = bg;
+    w->border = border;
+    draw_widget(r, w);
+    return 1;
+}
+
+uint64_t enq_render_commit(enq_renderer_t *r) {
+    if (r->num_pending == 0) return r->frame;
+    r->frame++;
+    history_t *h = &r->history[r->frame % ENQ_RENDER_HISTORY];
+    h->frame = r->frame;
+    h->count = r->num_pending;
+    memcpy(h->rects, r->pending, sizeof(rect_t) * (size_t)r->num_pending);
+    r->num_pending = 0;
+    return r->frame;
+}
+
+size_t enq_render_copy_to(const enq_renderer_t *r, uint8_t *dst, size_t size,
+                          uint64_t have_frame) {
+    size_t frame_size = enq_render_frame_size(r);
+    if (size < frame_size || have_frame == r->frame) return 0;
+
+    if (have_frame == 0 || have_frame > r->frame || r->frame - have_frame > ENQ_RENDER_HISTORY) {
+        memcpy(dst, r->fb, frame_size);
+        return frame_size;
+    }
+
+    size_t copied = 0;
+    size_t stride = (size_t)r->width * 3;
+    for (uint64_t f = have_frame + 1; f <= r->frame; f++) {
+        const history_t *h = &r->history[f % ENQ_RENDER_HISTORY];
+        for (int i = 0; i < h->count; i++) {
+            const rect_t *a = &h->rects[i];
+            size_t row = (size_t)a->w * 3;
+            for (int y = a->y; y < a->y + a->h; y++) {
+                size_t off = (size_t)y * stride + (size_t)a->x * 3;
+                memcpy(dst + off, r->fb + off, row);
+            }
+            copied += row * (size_t)a->h;
+        }
+    }
+    return copied;
+}
+
+const uint8_t *enq_render_pixels(const enq_renderer_t *r) {
+    return r->fb;
+}
+
+size_t enq_render_frame_size(const enq_renderer_t *r) {
+    return (size_t)r->width * (size_t)r->height * 3;
+}
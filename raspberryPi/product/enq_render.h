@@ -0,0 +1,81 @@
+// enq_render.h
+// RTSP 配信画面のネイティブ描画 (差分更新)
+//
+// 640x480 などの RGB24 フレームバッファを保持し続け、画面は固定配置の
+// 「ウィジェット」(文字列1行 + 背景 + 枠) の集まりとして扱う。文字列や色が
+// 変わったウィジェットだけを描き直し、その矩形をフレームごとの差分として記録する。
+// グリフは呼び出し側 (Python の PIL) が一度だけラスタライズしてアトラスに登録し、
+// 以降は 8bit のアルファをフレームバッファへ合成するだけで描く。
+//
+// enq_render_copy_to() は「そのバッファが持っているフレーム番号」から現在までの
+// 差分矩形だけを転送するので、appsrc のバッファプールを使い回すときに毎回
+// 全画面をコピーせずに済む。
+
+#ifndef ENQ_RENDER_H
+#define ENQ_RENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENQ_RENDER_MAX_FONTS    4
+#define ENQ_RENDER_MAX_WIDGETS  32
+#define ENQ_RENDER_TEXT_MAX     128   // ウィジェット1つの文字列 (UTF-8 バイト数)
+#define ENQ_RENDER_ATLAS_W      1024
+#define ENQ_RENDER_ATLAS_H      1024
+#define ENQ_RENDER_MAX_GLYPHS   2048
+#define ENQ_RENDER_HISTORY      16    // 差分を保持するフレーム数
+#define ENQ_RENDER_RECTS        16    // 1フレームの差分矩形数 (超えたら外接矩形にまとめる)
+
+#define ENQ_ALIGN_LEFT   0
+#define ENQ_ALIGN_CENTER 1
+
+typedef struct enq_renderer enq_renderer_t;
+
+// 色は 0xRRGGBB
+enq_renderer_t *enq_render_new(int width, int height, uint32_t background);
+void enq_render_free(enq_renderer_t *r);
+
+// フォントの行の高さ (PIL の getmetrics() の ascent / descent)
+int enq_render_set_font(enq_renderer_t *r, int font, int ascent, int descent);
+
+// グリフを登録する。alpha は width x height の被覆率 (0〜255)。
+// left / top は描画原点 (行の上端 = ascent の位置) からのオフセット
+int enq_render_add_glyph(enq_renderer_t *r, int font, uint32_t codepoint,
+                         int width, int height, int left, int top, int advance,
+                         const uint8_t *alpha);
+
+// utf8 のうち未登録のグリフのコードポイントを最大 max 件返す (重複あり)
+size_t enq_render_missing_glyphs(const enq_renderer_t *r, int font, const char *utf8,
+                                 uint32_t *out, size_t max);
+
+// ウィジェットを追加する。戻り値はウィジェット番号 (失敗時 -1)
+int enq_render_add_widget(enq_renderer_t *r, int x, int y, int w, int h, int font, int align,
+                          uint32_t fg, uint32_t bg, uint32_t border, int border_width);
+
+// 文字列・色を変える。変化があれば描き直して 1 を返す
+int enq_render_set_text(enq_renderer_t *r, int widget, const char *utf8);
+int enq_render_set_style(enq_renderer_t *r, int widget, uint32_t fg, uint32_t bg,
+                         uint32_t border);
+
+// 描き直した分を1フレームとして確定する。戻り値は現在のフレーム番号
+// (差分がなければ番号は進まない)
+uint64_t enq_render_commit(enq_renderer_t *r);
+
+// dst (width x height x 3, 詰めて並んだ RGB24) を have_frame の内容から現在の
+// フレームへ更新する。have_frame == 0 または履歴より古ければ全画面をコピーする。
+// 戻り値はコピーしたバイト数
+size_t enq_render_copy_to(const enq_renderer_t *r, uint8_t *dst, size_t size,
+                          uint64_t have_frame);
+
+const uint8_t *enq_render_pixels(const enq_renderer_t *r);
+size_t enq_render_frame_size(const enq_renderer_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENQ_RENDER_H
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+RTSP 配信画面のネイティブ描画 (enq_render.c の Python バインディング)
+
+libenq_render.so をビルドして同じディレクトリに置くと使用できる:
+    gcc -O2 -shared -fPIC enq_render.c -o libenq_render.so
+グリフは PIL のフォントで1文字ずつ一度だけラスタライズしてアトラスに登録し、
+以降の描画・差分転送はネイティブ側で行う。ライブラリが見つからない場合や
+TrueType フォントが使えない場合は available() / NativeRenderer.create() が
+False / None を返すので、呼び出し側で PIL の全画面描画にフォールバックする。
+"""
+
+import ctypes
+import os
+
+from PIL import ImageColor
+
+ALIGN_LEFT = 0
+ALIGN_CENTER = 1
+
+# missing_glyphs で一度に受け取るコードポイント数 (ENQ_RENDER_TEXT_MAX と同じ)
+_MISSING_BATCH = 128
+
+
+def _load_native():
+    """libenq_render.so のロード"""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libenq_render.so')
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    p, i, u32, u64, sz = ctypes.c_void_p, ctypes.c_int, ctypes.c_uint32, ctypes.c_uint64, ctypes.c_size_t
+    lib.enq_render_new.restype = p
+    lib.enq_render_new.argtypes = [i, i, u32]
+    lib.enq_render_free.restype = None
+    lib.enq_render_free.argtypes = [p]
+    lib.enq_render_set_font.restype = i
+    lib.enq_render_set_font.argtypes = [p, i, i, i]
+    lib.enq_render_add_glyph.restype = i
+    lib.enq_render_add_glyph.argtypes = [p, i, u32, i, i, i, i, i, ctypes.c_char_p]
+    lib.enq_render_missing_glyphs.restype = sz
+    lib.enq_render_missing_glyphs.argtypes = [p, i, ctypes.c_char_p, ctypes.POINTER(u32), sz]
+    lib.enq_render_add_widget.restype = i
+    lib.enq_render_add_widget.argtypes = [p, i, i, i, i, i, i, u32, u32, u32, i]
+    lib.enq_render_set_text.restype = i
+    lib.enq_render_set_text.argtypes = [p, i, ctypes.c_char_p]
+    lib.enq_render_set_style.restype = i
+    lib.enq_render_set_style.argtypes = [p, i, u32, u32, u32]
+    lib.enq_render_commit.restype = u64
+    lib.enq_render_commit.argtypes = [p]
+    lib.enq_render_copy_to.restype = sz
+    lib.enq_render_copy_to.argtypes = [p, p, sz, u64]
+    lib.enq_render_pixels.restype = ctypes.POINTER(ctypes.c_uint8)
+    lib.enq_render_pixels.argtypes = [p]
+    lib.enq_render_frame_size.restype = sz
+    lib.enq_render_frame_size.argtypes = [p]
+    return lib
+
+
+_lib = _load_native()
+
+
+def available() -> bool:
+    return _lib is not None
+
+
+def rgb(color) -> int:
+    """PIL の色指定 ('lightgreen' / (r, g, b)) → 0xRRGGBB"""
+    if isinstance(color, str):
+        color = ImageColor.getrgb(color)
+    r, g, b = color[:3]
+    return (r << 16) | (g << 8) | b
+
+
+class NativeRenderer:
+    """固定配置のウィジェットを差分描画するフレームバッファ"""
+
+    def __init__(self, width: int, height: int, background):
+        if _lib is None:
+            raise OSError("libenq_render.so not found")
+        self._r = _lib.enq_render_new(width, height, rgb(background))
+        if not self._r:
+            raise MemoryError("enq_render_new failed")
+        self.width = width
+        self.height = height
+        self.frame_size = _lib.enq_render_frame_size(self._r)
+        self._fonts = []
+        self._widget_font = []
+        self._missing = (ctypes.c_uint32 * _MISSING_BATCH)()
+
+    @classmethod
+    def create(cls, width: int, height: int, background):
+        """ライブラリがなければ None"""
+        if _lib is None:
+            return None
+        return cls(width, height, background)
+
+    def __del__(self):
+        if getattr(self, '_r', None):
+            _lib.enq_render_free(self._r)
+            self._r = None
+
+    def add_font(self, font) -> int:
+        """PIL の FreeTypeFont を登録してフォント番号を返す"""
+        if not hasattr(font, 'getmetrics') or len(self._fonts) >= 4:
+            raise ValueError("TrueType フォントが必要です")
+        ascent, descent = font.getmetrics()
+        index = len(self._fonts)
+        _lib.enq_render_set_font(self._r, index, ascent, descent)
+        self._fonts.append(font)
+        return index
+
+    def line_height(self, font: int) -> int:
+        ascent, descent = self._fonts[font].getmetrics()
+        return ascent + descent
+
+    def add_widget(self, x, y, w, h, font, align, fg, bg, border=None, border_width=0) -> int:
+        wid = _lib.enq_render_add_widget(self._r, x, y, w, h, font, align, rgb(fg), rgb(bg),
+                                         rgb(border if border is not None else bg), border_width)
+        if wid < 0:
+            raise ValueError("ウィジェットを追加できません")
+        self._widget_font.append(font)
+        return wid
+
+    def _ensure_glyphs(self, font: int, data: bytes):
+        n = _lib.enq_render_missing_glyphs(self._r, font, data, self._missing, _MISSING_BATCH)
+        if n == 0:
+            return
+        pil_font = self._fonts[font]
+        for cp in set(self._missing[:n]):
+            ch = chr(cp)
+            mask, (left, top) = pil_font.getmask2(ch, mode='L')
+            w, h = mask.size
+            alpha = bytes(mask)
+            advance = int(round(pil_font.getlength(ch)))
+            _lib.enq_render_add_glyph(self._r, font, cp, w, h, left, top, advance, alpha)
+
+    def set_text(self, widget: int, text: str) -> bool:
+        data = text.encode('utf-8')
+        self._ensure_glyphs(self._widget_font[widget], data)
+        return bool(_lib.enq_render_set_text(self._r, widget, data))
+
+    def set_style(self, widget: int, fg, bg, border=None) -> bool:
+        return bool(_lib.enq_render_set_style(self._r, widget, rgb(fg), rgb(bg),
+                                              rgb(border if border is not None else bg)))
+
+    def commit(self) -> int:
+        return _lib.enq_render_commit(self._r)
+
+    def copy_to(self, address: int, size: int, have_frame: int) -> int:
+        """address の RGB24 バッファを have_frame から現在のフレームへ更新する"""
+        return _lib.enq_render_copy_to(self._r, address, size, have_frame)
+
+    def tobytes(self) -> bytes:
+        return ctypes.string_at(_lib.enq_render_pixels(self._r), self.frame_size)
@@ -0,0 +1,279 @@
+// enq_simd.c
+// ENQ伝文の SIMD カーネルと実行時選択
+
+#include "enq_simd.h"
+#include "enq_parser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__SSE2__)
+#define ENQ_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(ENQ_HAVE_SSE2)
+#define ENQ_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__aarch64__)
+#define ENQ_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// ---- スカラー ----
+
+// 位置ごとに要求する文字クラス
+#define NEED_ENQ   0x01
+#define NEED_DIGIT 0x02
+#define NEED_W     0x04
+#define NEED_HEX   0x08
+
+static const uint8_t class_of[256] = {
+    [ENQ_CODE] = NEED_ENQ, ['W'] = NEED_W,
+    ['0'] = NEED_DIGIT | NEED_HEX, ['1'] = NEED_DIGIT | NEED_HEX,
+    ['2'] = NEED_DIGIT | NEED_HEX, ['3'] = NEED_DIGIT | NEED_HEX,
+    ['4'] = NEED_DIGIT | NEED_HEX, ['5'] = NEED_DIGIT | NEED_HEX,
+    ['6'] = NEED_DIGIT | NEED_HEX, ['7'] = NEED_DIGIT | NEED_HEX,
+    ['8'] = NEED_DIGIT | NEED_HEX, ['9'] = NEED_DIGIT | NEED_HEX,
+    ['A'] = NEED_HEX, ['B'] = NEED_HEX, ['C'] = NEED_HEX,
+    ['D'] = NEED_HEX, ['E'] = NEED_HEX, ['F'] = NEED_HEX,
+    ['a'] = NEED_HEX, ['b'] = NEED_HEX, ['c'] = NEED_HEX,
+    ['d'] = NEED_HEX, ['e'] = NEED_HEX, ['f'] = NEED_HEX,
+};
+
+static const uint8_t need_at[ENQ_FRAME_LEN] = {
+    NEED_ENQ,
+    NEED_DIGIT, NEED_DIGIT, NEED_DIGIT, NEED_DIGIT,
+    NEED_W,
+    NEED_HEX, NEED_HEX, NEED_HEX, NEED_HEX,
+    NEED_HEX, NEED_HEX, NEED_HEX, NEED_HEX,
+    NEED_HEX, NEED_HEX,
+};
+
+static size_t scan_scalar(const uint8_t *p, size_t n) {
+    const uint8_t *hit = memchr(p, ENQ_CODE, n);
+    return hit ? (size_t)(hit - p) : n;
+}
+
+static uint32_t check_scalar(const uint8_t *b, int verify_checksum) {
+    int len = verify_checksum ? ENQ_FRAME_LEN : ENQ_FRAME_LEN - 2;
+    for (int i = 0; i < len; i++) {
+        if (!(class_of[b[i]] & need_at[i])) return 1u << i;
+    }
+    return 0;
+}
+
+static uint8_t sum13_scalar(const uint8_t *b) {
+    unsigned sum = 0;
+    for (int i = 1; i <= 13; i++) sum += b[i];
+    return (uint8_t)sum;
+}
+
+static const enq_kernels_t kernels_scalar = {
+    "scalar", scan_scalar, check_scalar, sum13_scalar,
+};
+
+// ---- 位置マスク (SIMD 共通) ----
+// 各レーンで「その位置がこのクラスを要求するなら 0xFF」
+
+#define L0 0x00
+#define LF 0xFF
+static const uint8_t lane_enq[16]   = { LF,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0 };
+static const uint8_t lane_digit[16] = { L0,LF,LF,LF,LF,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0 };
+static const uint8_t lane_w[16]     = { L0,L0,L0,L0,L0,LF,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0 };
+static const uint8_t lane_hex[2][16] = {
+    { L0,L0,L0,L0,L0,L0,LF,LF,LF,LF,LF,LF,LF,LF,L0,L0 },  // チェックサムを見ない
+    { L0,L0,L0,L0,L0,L0,LF,LF,LF,LF,LF,LF,LF,LF,LF,LF },
+};
+// 検査しない位置 (チェックサムを見ないときの 14, 15)
+static const uint8_t lane_any[2][16] = {
+    { L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,LF,LF },
+    { L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0,L0 },
+};
+static const uint8_t lane_sum[16]   = { L0,LF,LF,LF,LF,LF,LF,LF,LF,LF,LF,LF,LF,LF,L0,L0 };
+#undef L0
+#undef LF
+
+// ---- SSE2 ----
+#ifdef ENQ_HAVE_SSE2
+
+#define LOADV(a) _mm_loadu_si128((const __m128i *)(a))
+
+// lo <= x <= hi (符号なし)
+static inline __m128i in_range_sse2(__m128i x, char lo, char hi) {
+    __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(lo)), x);
+    __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(hi)), x);
+    return _mm_and_si128(ge, le);
+}
+
+static size_t scan_sse2(const uint8_t *p, size_t n) {
+    const __m128i enq = _mm_set1_epi8(ENQ_CODE);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(LOADV(p + i), enq));
+        if (m) return i + (size_t)__builtin_ctz((unsigned)m);
+    }
+    return i + scan_scalar(p + i, n - i);
+}
+
+static uint32_t check_sse2(const uint8_t *b, int verify_checksum) {
+    int v = verify_checksum ? 1 : 0;
+    __m128i x = LOADV(b);
+    __m128i digit = in_range_sse2(x, '0', '9');
+    __m128i hex = _mm_or_si128(digit,
+                               in_range_sse2(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'f'));
+    __m128i ok = _mm_and_si128(digit, LOADV(lane_digit));
+    ok = _mm_or_si128(ok, _mm_and_si128(hex, LOADV(lane_hex[v])));
+    ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(ENQ_CODE)), LOADV(lane_enq)));
+    ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('W')), LOADV(lane_w)));
+    ok = _mm_or_si128(ok, LOADV(lane_any[v]));
+    return ~(uint32_t)_mm_movemask_epi8(ok) & 0xFFFF;
+}
+
+static uint8_t sum13_sse2(const uint8_t *b) {
+    __m128i x = _mm_and_si128(LOADV(b), LOADV(lane_sum));
+    __m128i s = _mm_sad_epu8(x, _mm_setzero_si128());
+    return (uint8_t)(_mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4));
+}
+
+static const enq_kernels_t kernels_sse2 = {
+    "sse2", scan_sse2, check_sse2, sum13_sse2,
+};
+
+#endif // ENQ_HAVE_SSE2
+
+// ---- AVX2 (走査のみ。検証とチェックサムは16バイトなので SSE2 と共通) ----
+#ifdef ENQ_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const uint8_t *p, size_t n) {
+    const __m256i enq = _mm256_set1_epi8(ENQ_CODE);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, enq));
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+    return i + scan_sse2(p + i, n - i);
+}
+
+static const enq_kernels_t kernels_avx2 = {
+    "avx2", scan_avx2, check_sse2, sum13_sse2,
+};
+
+#endif // ENQ_HAVE_AVX2
+
+// ---- NEON ----
+#ifdef ENQ_HAVE_NEON
+
+static size_t scan_neon(const uint8_t *p, size_t n) {
+    const uint8x16_t enq = vdupq_n_u8(ENQ_CODE);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(p + i), enq);
+        // 1バイトを4ビットに縮めて 64bit マスクにする
+        uint64_t m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (m) return i + (size_t)(__builtin_ctzll(m) >> 2);
+    }
+    return i + scan_scalar(p + i, n - i);
+}
+
+static uint32_t check_neon(const uint8_t *b, int verify_checksum) {
+    static const uint8_t bit_weight[16] = { 1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128 };
+    int v = verify_checksum ? 1 : 0;
+    uint8x16_t x = vld1q_u8(b);
+    uint8x16_t digit = vandq_u8(vcgeq_u8(x, vdupq_n_u8('0')), vcleq_u8(x, vdupq_n_u8('9')));
+    uint8x16_t lower = vorrq_u8(x, vdupq_n_u8(0x20));
+    uint8x16_t hex = vorrq_u8(digit,
+                              vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')), vcleq_u8(lower, vdupq_n_u8('f'))));
+    uint8x16_t ok = vandq_u8(digit, vld1q_u8(lane_digit));
+    ok = vorrq_u8(ok, vandq_u8(hex, vld1q_u8(lane_hex[v])));
+    ok = vorrq_u8(ok, vandq_u8(vceqq_u8(x, vdupq_n_u8(ENQ_CODE)), vld1q_u8(lane_enq)));
+    ok = vorrq_u8(ok, vandq_u8(vceqq_u8(x, vdupq_n_u8('W')), vld1q_u8(lane_w)));
+    ok = vorrq_u8(ok, vld1q_u8(lane_any[v]));
+    uint8x16_t bad = vandq_u8(vmvnq_u8(ok), vld1q_u8(bit_weight));
+    return (uint32_t)vaddv_u8(vget_low_u8(bad)) | ((uint32_t)vaddv_u8(vget_high_u8(bad)) << 8);
+}
+
+static uint8_t sum13_neon(const uint8_t *b) {
+    return (uint8_t)vaddlvq_u8(vandq_u8(vld1q_u8(b), vld1q_u8(lane_sum)));
+}
+
+static const enq_kernels_t kernels_neon = {
+    "neon", scan_neon, check_neon, sum13_neon,
+};
+
+#endif // ENQ_HAVE_NEON
+
+// ---- 実行時選択 ----
+
+const enq_kernels_t *enq_kernels = &kernels_scalar;
+
+static const enq_kernels_t *kernels_for(enq_simd_t impl) {
+    switch (impl) {
+    case ENQ_SIMD_SCALAR: return &kernels_scalar;
+#ifdef ENQ_HAVE_SSE2
+    case ENQ_SIMD_SSE2:   return &kernels_sse2;
+#endif
+#ifdef ENQ_HAVE_AVX2
+    case ENQ_SIMD_AVX2:   return __builtin_cpu_supports("avx2") ? &kernels_avx2 : NULL;
+#endif
+#ifdef ENQ_HAVE_NEON
+    case ENQ_SIMD_NEON:   return &kernels_neon;
+#endif
+    default:              return NULL;
+    }
+}
+
+static enq_simd_t best_available(void) {
+    static const enq_simd_t order[] = { ENQ_SIMD_AVX2, ENQ_SIMD_NEON, ENQ_SIMD_SSE2 };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        if (kernels_for(order[i])) return order[i];
+    }
+    return ENQ_SIMD_SCALAR;
+}
+
+// ライブラリ読み込み時 (Python の ctypes からも) に一度だけ選ぶ
+__attribute__((constructor))
+static void enq_simd_init(void) {
+#ifdef ENQ_HAVE_AVX2
+    __builtin_cpu_init();
+#endif
+    enq_simd_t impl = best_available();
+    const char *env = getenv("ENQ_SIMD");
+    if (env) {
+        for (int i = ENQ_SIMD_SCALAR; i <= ENQ_SIMD_NEON; i++) {
+            if (strcmp(env, enq_simd_name((enq_simd_t)i)) == 0 && kernels_for((enq_simd_t)i)) {
+                impl = (enq_simd_t)i;
+            }
+        }
+    }
+    enq_kernels = kernels_for(impl);
+}
+
+int enq_simd_select(enq_simd_t impl) {
+    const enq_kernels_t *k = kernels_for(impl);
+    if (k == NULL) return 0;
+    enq_kernels = k;
+    return 1;
+}
+
+enq_simd_t enq_simd_active(void) {
+    for (int i = ENQ_SIMD_SCALAR; i <= ENQ_SIMD_NEON; i++) {
+        if (kernels_for((enq_simd_t)i) == enq_kernels) return (enq_simd_t)i;
+    }
+    return ENQ_SIMD_SCALAR;
+}
+
+const char *enq_simd_name(enq_simd_t impl) {
+    switch (impl) {
+    case ENQ_SIMD_SCALAR: return "scalar";
+    case ENQ_SIMD_SSE2:   return "sse2";
+    case ENQ_SIMD_AVX2:   return "avx2";
+    case ENQ_SIMD_NEON:   return "neon";
+    default:              return "?";
+    }
+}
@@ -0,0 +1,31 @@
+// enq_simd.h
+// ENQ伝文の SIMD カーネル (enq_parser.c 内部用)
+//
+// 16バイトの伝文はちょうど SSE / NEON レジスタ1本に収まるため、文字クラスの
+// 検証は1回の比較マスク、チェックサムは水平加算で行う。実装は起動時に CPU を
+// 見て選び、環境変数 ENQ_SIMD (scalar / sse2 / avx2 / neon) で固定もできる。
+//   x86-64 : SSE2 (常に利用可) / AVX2 (走査のみ 32 バイト幅、実行時判定)
+//   AArch64: NEON (Raspberry Pi 4 の 64bit OS)
+//   その他 : スカラー
+
+#ifndef ENQ_SIMD_H
+#define ENQ_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *name;
+    // p[0..n) で最初の ENQ (0x05) の位置。なければ n
+    size_t   (*scan)(const uint8_t *p, size_t n);
+    // 16バイトの候補の不正位置マスク (ビット i = b[i] が不正)。0 なら形式は正しい。
+    // 最下位の立ったビットが最初の不正位置 (それより後ろは省略されることがある)。
+    // verify_checksum が 0 なら b[14..15] は見ない
+    uint32_t (*check)(const uint8_t *b, int verify_checksum);
+    // b[1..13] の加算チェックサム
+    uint8_t  (*sum13)(const uint8_t *b);
+} enq_kernels_t;
+
+extern const enq_kernels_t *enq_kernels;
+
+#endif // ENQ_SIMD_H
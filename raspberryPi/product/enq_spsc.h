@@ -0,0 +1,150 @@
+// enq_spsc.h
+// シリアル読み出しスレッド → デコードスレッド 受け渡し用
+// ロックフリー Single-Producer / Single-Consumer リング
+//
+// 生産者 (I/O スレッド) は enq_spsc_reserve() で空きスロットを得て read() の
+// 結果を直接書き込み、enq_spsc_commit() で公開する。満杯なら NULL が返るので
+// 読み捨ててオーバーランとして数える (読み出しは決してブロックしない)。
+// 受信チャンクは enq_spsc_reserve_data() で取り、末尾の ENQ_SPSC_CONTROL_SLOTS は
+// 制御通知 (ポートの切断・開き直し) のために残しておく。
+// 消費者 (デコードスレッド) は enq_spsc_peek() / enq_spsc_release() で取り出し、
+// 空のときは enq_spsc_wait() で eventfd を待つ。
+
+#ifndef ENQ_SPSC_H
+#define ENQ_SPSC_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#define ENQ_SPSC_SLOTS 256  // スロット数 (2のべき乗)
+#define ENQ_SPSC_CHUNK 256  // 1スロットあたりの最大バイト数
+#define ENQ_SPSC_CONTROL_SLOTS 16  // 受信チャンクでは使わない (制御通知用の) スロット数
+
+// 受信チャンク。len == 0 は制御通知 (ポート切断など) に使う
+typedef struct {
+    uint16_t port;     // ポート番号 (呼び出し側の配列インデックス)
+    uint16_t len;
+    uint32_t flags;
+    uint64_t t_ns;     // 受信時刻 (CLOCK_MONOTONIC)
+    uint8_t  data[ENQ_SPSC_CHUNK];
+} enq_chunk_t;
+
+// 制御通知フラグ
+#define ENQ_CHUNK_PORT_CLOSED 0x01  // t_ns: 切断を検出した時刻
+#define ENQ_CHUNK_PORT_OPENED 0x02  // t_ns: 切断後に開き直した時刻 (最初に開いたときは送らない)
+
+typedef struct {
+    // head/tail は別キャッシュラインに置いて false sharing を避ける
+    _Alignas(64) _Atomic uint64_t head;        // 消費者が進める
+    _Alignas(64) _Atomic uint64_t tail;        // 生産者が進める
+    _Alignas(64) _Atomic uint64_t high_water;  // 最大使用スロット数
+    _Atomic uint64_t overruns;                 // 満杯で捨てたチャンク数
+    _Atomic uint64_t overrun_bytes;            // 満杯で捨てたバイト数
+    _Atomic int waiting;                       // 消費者が eventfd 待ち中なら 1
+    int efd;
+    enq_chunk_t slots[ENQ_SPSC_SLOTS];
+} enq_spsc_t;
+
+static inline int enq_spsc_init(enq_spsc_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    return r->efd < 0 ? -1 : 0;
+}
+
+static inline void enq_spsc_destroy(enq_spsc_t *r) {
+    if (r->efd >= 0) close(r->efd);
+    r->efd = -1;
+}
+
+// ---- 生産者側 ----
+
+static inline enq_chunk_t *enq_spsc_reserve(enq_spsc_t *r) {
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head >= ENQ_SPSC_SLOTS) return NULL;
+    return &r->slots[tail & (ENQ_SPSC_SLOTS - 1)];
+}
+
+// 受信チャンク用: 制御通知の分の空きを残して満杯とみなす
+static inline enq_chunk_t *enq_spsc_reserve_data(enq_spsc_t *r) {
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head >= ENQ_SPSC_SLOTS - ENQ_SPSC_CONTROL_SLOTS) return NULL;
+    return &r->slots[tail & (ENQ_SPSC_SLOTS - 1)];
+}
+
+// 消費者を起こす (待機中のときだけ eventfd に書く)
+static inline void enq_spsc_wake(enq_spsc_t *r) {
+    // tail の公開と waiting の読み出しの順序を保証する (enq_spsc_wait と対)
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&r->waiting, memory_order_relaxed) &&
+        atomic_exchange_explicit(&r->waiting, 0, memory_order_relaxed)) {
+        uint64_t one = 1;
+        ssize_t w = write(r->efd, &one, sizeof(one));
+        (void)w;
+    }
+}
+
+// 待機状態に関係なく起こす (終了時用)
+static inline void enq_spsc_kick(enq_spsc_t *r) {
+    uint64_t one = 1;
+    ssize_t w = write(r->efd, &one, sizeof(one));
+    (void)w;
+}
+
+static inline void enq_spsc_commit(enq_spsc_t *r) {
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed) + 1;
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+
+    uint64_t used = tail - atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (used > atomic_load_explicit(&r->high_water, memory_order_relaxed))
+        atomic_store_explicit(&r->high_water, used, memory_order_relaxed);
+
+    enq_spsc_wake(r);
+}
+
+static inline void enq_spsc_overrun(enq_spsc_t *r, size_t bytes) {
+    atomic_fetch_add_explicit(&r->overruns, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->overrun_bytes, bytes, memory_order_relaxed);
+}
+
+// ---- 消費者側 ----
+
+static inline enq_chunk_t *enq_spsc_peek(enq_spsc_t *r) {
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head == tail) return NULL;
+    return &r->slots[head & (ENQ_SPSC_SLOTS - 1)];
+}
+
+static inline void enq_spsc_release(enq_spsc_t *r) {
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+// リングが空の間、最大 timeout_ms 待つ (-1 で無期限)。
+// 戻り値: データありなら 1、タイムアウトなら 0
+static inline int enq_spsc_wait(enq_spsc_t *r, int timeout_ms) {
+    atomic_store_explicit(&r->waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    // 待機フラグを立てた後に再確認し、取りこぼしを防ぐ
+    if (enq_spsc_peek(r)) {
+        atomic_store_explicit(&r->waiting, 0, memory_order_relaxed);
+        return 1;
+    }
+    struct pollfd pfd = { .fd = r->efd, .events = POLLIN };
+    int n = poll(&pfd, 1, timeout_ms);
+    if (n > 0) {
+        uint64_t v;
+        ssize_t rd = read(r->efd, &v, sizeof(v));
+        (void)rd;
+    }
+    atomic_store_explicit(&r->waiting, 0, memory_order_relaxed);
+    return enq_spsc_peek(r) != NULL;
+}
+
+#endif // ENQ_SPSC_H
@@ -0,0 +1,194 @@
+// enq_state.c
+// デコード済みエレベーター状態の共有メモリ公開 (POSIX shm + seqlock)
+// ビルド例: serial_debug_test.c などと一緒にリンクする (古い glibc では -lrt も必要)
+
+#define _GNU_SOURCE
+#include "enq_state.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+static const char *shm_name(const char *name) {
+    return name ? name : ENQ_STATE_SHM_NAME;
+}
+
+int enq_state_publish_open(enq_state_writer_t *w, const char *name) {
+    memset(w, 0, sizeof(*w));
+    snprintf(w->name, sizeof(w->name), "%s", shm_name(name));
+
+    // 前回の受信プロセスが残したセグメントは使い回さず作り直す。古いものを
+    // マップしたままの読者は inode の変化で再接続を判断できる
+    shm_unlink(w->name);
+    int fd = shm_open(w->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, sizeof(enq_state_shm_t)) < 0) {
+        close(fd);
+        return -1;
+    }
+    void *p = mmap(NULL, sizeof(enq_state_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+
+    // magic を最後に書くので、読者は初期化途中のセグメントを受け付けない
+    enq_state_shm_t *s = p;
+    memset(s, 0, sizeof(*s));
+    s->version = ENQ_STATE_VERSION;
+    s->header_size = (uint32_t)offsetof(enq_state_shm_t, cars);
+    s->car_size = sizeof(enq_car_state_t);
+    s->max_cars = ENQ_STATE_MAX_CARS;
+    s->writer_pid = (uint32_t)getpid();
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    s->start_realtime_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    atomic_thread_fence(memory_order_release);
+    memcpy(s->magic, ENQ_STATE_MAGIC, sizeof(s->magic));
+
+    w->shm = s;
+    return 0;
+}
+
+void enq_state_publish_close(enq_state_writer_t *w, int unlink_segment) {
+    if (w->shm == NULL) return;
+    munmap(w->shm, sizeof(enq_state_shm_t));
+    w->shm = NULL;
+    if (unlink_segment) shm_unlink(w->name);
+}
+
+// (port, station) のスロット。なければ割り当てる (満杯なら NULL)
+static enq_car_state_t *car_slot(enq_state_shm_t *s, uint16_t port, uint16_t station) {
+    uint32_t n = atomic_load_explicit(&s->num_cars, memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++) {
+        enq_car_state_t *c = &s->cars[i];
+        if (c->port == port && c->station == station) return c;
+    }
+    if (n >= ENQ_STATE_MAX_CARS) return NULL;
+    enq_car_state_t *c = &s->cars[n];
+    c->port = port;
+    c->station = station;
+    // スロットの中身が見えてから num_cars を進める
+    atomic_store_explicit(&s->num_cars, n + 1, memory_order_release);
+    return c;
+}
+
+static uint16_t moving_flag(const enq_car_state_t *c) {
+    return (c->flags & ENQ_CAR_HAVE_TARGET) && c->target_floor != 0 &&
+           c->target_floor != c->current_floor ? ENQ_CAR_MOVING : 0;
+}
+
+int enq_car_state_apply(enq_car_state_t *c, const enq_frame_t *f, uint64_t now_realtime_ns) {
+    uint16_t before_flags = c->flags;
+    uint16_t before_current = c->current_floor, before_target = c->target_floor;
+    uint16_t before_load = c->load;
+    switch (f->data_num) {
+        case ENQ_DATA_CURRENT_FLOOR:
+            c->current_floor = f->value;
+            c->flags |= ENQ_CAR_HAVE_CURRENT;
+            break;
+        case ENQ_DATA_TARGET_FLOOR:
+            c->target_floor = f->value;
+            c->flags |= ENQ_CAR_HAVE_TARGET;
+            break;
+        case ENQ_DATA_LOAD_WEIGHT:
+            c->load = f->value;
+            c->flags |= ENQ_CAR_HAVE_LOAD;
+            break;
+        default:
+            break;
+    }
+    c->flags = (uint16_t)((c->flags & ~ENQ_CAR_MOVING) | moving_flag(c));
+    int changed = c->flags != before_flags || c->current_floor != before_current ||
+                  c->target_floor != before_target || c->load != before_load;
+    c->updated_ns = now_realtime_ns;
+    c->frames++;
+    if (changed) {
+        c->changed_ns = now_realtime_ns;
+        c->changes++;
+    }
+    return changed;
+}
+
+void enq_state_publish_frame(enq_state_writer_t *w, uint16_t port, const enq_frame_t *f,
+                             uint64_t now_realtime_ns) {
+    enq_car_state_t *c = car_slot(w->shm, port, f->station);
+    if (c == NULL) return;
+
+    uint32_t seq = atomic_load_explicit(&c->seq, memory_order_relaxed);
+    atomic_store_explicit(&c->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    int changed = enq_car_state_apply(c, f, now_realtime_ns);
+    atomic_store_explicit(&c->seq, seq + 2, memory_order_release);
+
+    if (changed) {
+        // 読者は読み取り専用マップなので待ち手の有無は分からない。
+        // 変化は階の移動などに限られるので毎回 FUTEX_WAKE してよい
+        atomic_fetch_add_explicit(&w->shm->generation, 1, memory_order_release);
+        syscall(SYS_futex, &w->shm->generation, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+// ---- 読み出し側 ----
+
+const enq_state_shm_t *enq_state_attach(const char *name) {
+    int fd = shm_open(shm_name(name), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(enq_state_shm_t)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(enq_state_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+
+    const enq_state_shm_t *s = p;
+    if (memcmp(s->magic, ENQ_STATE_MAGIC, sizeof(s->magic)) != 0 ||
+        s->version != ENQ_STATE_VERSION || s->car_size != sizeof(enq_car_state_t) ||
+        s->header_size != offsetof(enq_state_shm_t, cars)) {
+        munmap(p, sizeof(enq_state_shm_t));
+        errno = EPROTO;
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return s;
+}
+
+void enq_state_detach(const enq_state_shm_t *s) {
+    if (s) munmap((void *)s, sizeof(enq_state_shm_t));
+}
+
+int enq_state_read(const enq_state_shm_t *s, uint32_t slot, enq_car_state_t *out) {
+    if (slot >= atomic_load_explicit(&s->num_cars, memory_order_acquire)) return -1;
+    const enq_car_state_t *c = &s->cars[slot];
+    for (;;) {
+        uint32_t s0 = atomic_load_explicit(&c->seq, memory_order_acquire);
+        if (s0 & 1) continue;  // 書き込み中 (数十 ns で終わる)
+        memcpy(out, c, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&c->seq, memory_order_relaxed) == s0) return 0;
+    }
+}
+
+uint32_t enq_state_wait(const enq_state_shm_t *s, uint32_t gen, int timeout_ms) {
+    uint32_t now = enq_state_generation(s);
+    if (now != gen) return now;
+
+    struct timespec ts, *tp = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        tp = &ts;
+    }
+    // 値が gen のままのときだけ眠る (変化済みなら即 EAGAIN)
+    syscall(SYS_futex, &s->generation, FUTEX_WAIT, gen, tp, NULL, 0);
+    return enq_state_generation(s);
+}
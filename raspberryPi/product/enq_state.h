@@ -0,0 +1,100 @@
+// enq_state.h
+// デコード済みエレベーター状態の共有メモリ公開 (POSIX shm + seqlock)
+//
+// 受信プロセス (serial_debug_test publish) が /dev/shm/enq_state に号機ごとの
+// スロットを持ち、フレームを受けるたびにその号機の状態を seqlock で更新する。
+// RTSP 配信・ログ・ダッシュボードなどの読者はセグメントを読み取り専用で
+// マップするだけで、シリアルポートにも受信プロセスにも触れずに状態を読める。
+//
+//   スロット : (ポート, 局番号) ごとに1つ、64バイト = 1キャッシュライン
+//   seq      : スロットの seqlock。奇数なら書き込み中、読む前後で一致すれば一貫
+//   generation: どれかの号機の表示内容 (階・行先・荷重・移動中) が変わると +1。
+//              読者は enq_state_wait() でこの値を futex 待ちできる
+//
+// 書き込みは1スレッド (デコードスレッド) のみ。読者はいくつでもよい。
+
+#ifndef ENQ_STATE_H
+#define ENQ_STATE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "enq_parser.h"
+
+#define ENQ_STATE_SHM_NAME  "/enq_state"
+#define ENQ_STATE_MAGIC     "ENQSTAT1"
+#define ENQ_STATE_VERSION   1
+#define ENQ_STATE_MAX_CARS  64
+
+// enq_car_state_t.flags
+#define ENQ_CAR_HAVE_CURRENT 0x0001  // 現在階を受信済み
+#define ENQ_CAR_HAVE_TARGET  0x0002  // 行先階を受信済み
+#define ENQ_CAR_HAVE_LOAD    0x0004  // 荷重を受信済み
+#define ENQ_CAR_MOVING       0x0008  // 行先階があり現在階と異なる
+
+// 号機1台分の状態
+typedef struct {
+    _Alignas(64) _Atomic uint32_t seq;
+    uint16_t port;            // 受信ポート番号 (publish に渡した順)
+    uint16_t station;         // 局番号
+    uint16_t current_floor;   // データ番号 0001 の値 (0xFFFF = B1F)
+    uint16_t target_floor;    // データ番号 0002 の値 (0 = なし)
+    uint16_t load;            // 荷重 (kg)
+    uint16_t flags;           // ENQ_CAR_*
+    uint64_t updated_ns;      // 最終受信時刻 (CLOCK_REALTIME)
+    uint64_t changed_ns;      // 表示内容が最後に変わった時刻 (CLOCK_REALTIME)
+    uint64_t frames;          // 受信フレーム数
+    uint64_t changes;         // 表示内容の変化回数
+} enq_car_state_t;
+
+// セグメント全体
+typedef struct {
+    char     magic[8];            // ENQ_STATE_MAGIC (初期化完了後に書く)
+    uint32_t version;
+    uint32_t header_size;         // offsetof(enq_state_shm_t, cars)
+    uint32_t car_size;            // sizeof(enq_car_state_t)
+    uint32_t max_cars;
+    uint32_t writer_pid;
+    _Atomic uint32_t num_cars;          // 使用中スロット数 (増えるだけ)
+    _Alignas(64) _Atomic uint32_t generation;  // futex ワード
+    uint64_t start_realtime_ns;
+    enq_car_state_t cars[ENQ_STATE_MAX_CARS];
+} enq_state_shm_t;
+
+// ---- 書き込み側 (受信プロセス) ----
+
+typedef struct {
+    enq_state_shm_t *shm;
+    char name[64];
+} enq_state_writer_t;
+
+// セグメントを作成 (既存のものは削除して新しく作る)。name が NULL なら ENQ_STATE_SHM_NAME
+int enq_state_publish_open(enq_state_writer_t *w, const char *name);
+// 号機1台の状態にフレームを反映する更新規則 (共有メモリを使わない。seq は触らない)。
+// 戻り値: 表示内容 (階・行先・荷重・移動中) が変わったら 1
+int  enq_car_state_apply(enq_car_state_t *c, const enq_frame_t *f, uint64_t now_realtime_ns);
+// 1フレームを反映する。表示内容が変わったら generation を進めて待ち手を起こす
+void enq_state_publish_frame(enq_state_writer_t *w, uint16_t port, const enq_frame_t *f,
+                             uint64_t now_realtime_ns);
+// unlink_segment が 0 でなければ shm も削除する
+void enq_state_publish_close(enq_state_writer_t *w, int unlink_segment);
+
+// ---- 読み出し側 ----
+
+// 読み取り専用でマップする。形式が違えば NULL (errno = EPROTO)
+const enq_state_shm_t *enq_state_attach(const char *name);
+void enq_state_detach(const enq_state_shm_t *s);
+
+// slot 番目の号機を一貫したスナップショットとして out に読む。未使用スロットなら -1
+int enq_state_read(const enq_state_shm_t *s, uint32_t slot, enq_car_state_t *out);
+
+// generation が gen から変わるか timeout_ms (負なら無期限) 経つまで待ち、
+// 現在の generation を返す
+uint32_t enq_state_wait(const enq_state_shm_t *s, uint32_t gen, int timeout_ms);
+
+static inline uint32_t enq_state_generation(const enq_state_shm_t *s) {
+    return atomic_load_explicit(&s->generation, memory_order_acquire);
+}
+
+#endif // ENQ_STATE_H
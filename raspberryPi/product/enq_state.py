@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+共有メモリのエレベーター状態の読者 (enq_state.h と同じレイアウト)
+
+受信プロセス (serial_debug_test publish) が /dev/shm/enq_state に公開した状態を
+読み取り専用でマップして読む。スロットごとの seqlock で一貫した値だけを返す。
+Python からは futex を待てないので、generation の変化はポーリングで待つ。
+"""
+
+import mmap
+import os
+import struct
+import time
+from collections import namedtuple
+
+SHM_NAME = "/enq_state"
+MAGIC = b"ENQSTAT1"
+VERSION = 1
+
+CAR_HAVE_CURRENT = 0x0001
+CAR_HAVE_TARGET = 0x0002
+CAR_HAVE_LOAD = 0x0004
+CAR_MOVING = 0x0008
+
+_HEADER = struct.Struct('<8sIIIIII')   # magic .. num_cars
+_GENERATION_OFFSET = 64
+_CAR = struct.Struct('<IHHHHHHQQQQ')   # seq .. changes (スロットは _Alignas(64) で car_size 間隔)
+_CAR_SIZE = 64
+
+CarState = namedtuple('CarState', ['port', 'station', 'current_floor', 'target_floor', 'load',
+                                   'flags', 'updated_ns', 'changed_ns', 'frames', 'changes'])
+
+
+class SharedState:
+    """enq_state セグメントの読み取り専用ビュー"""
+
+    def __init__(self, name: str = SHM_NAME):
+        self.path = '/dev/shm' + name
+        fd = os.open(self.path, os.O_RDONLY)
+        try:
+            self._inode = os.fstat(fd).st_ino
+            self._map = mmap.mmap(fd, 0, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        magic, version, header_size, car_size, max_cars, pid, _ = _HEADER.unpack_from(self._map, 0)
+        if magic != MAGIC or version != VERSION or car_size != _CAR_SIZE or \
+                header_size + max_cars * car_size > len(self._map):
+            self._map.close()
+            raise ValueError(f"{name}: 共有メモリの形式が違います")
+        self._cars_offset = header_size
+        self._car_size = car_size
+        self.max_cars = max_cars
+        self.writer_pid = pid
+
+    def close(self):
+        self._map.close()
+
+    def stale(self) -> bool:
+        """セグメントが削除・作り直しされていれば True"""
+        try:
+            return os.stat(self.path).st_ino != self._inode
+        except OSError:
+            return True
+
+    @property
+    def generation(self) -> int:
+        return struct.unpack_from('<I', self._map, _GENERATION_OFFSET)[0]
+
+    @property
+    def num_cars(self) -> int:
+        return _HEADER.unpack_from(self._map, 0)[6]
+
+    def read(self, slot: int) -> CarState:
+        """slot 番目の号機 (seqlock で一貫したスナップショット)
+
+        まだ使われていないスロット (num_cars 以上) は IndexError。
+        """
+        if not 0 <= slot < self.max_cars:
+            raise IndexError(slot)
+        offset = self._cars_offset + slot * self._car_size
+        while True:
+            # num_cars はスロットの中身を書いてから進むので、先に読んで同じ読み取りの中で確かめる
+            if slot >= self.num_cars:
+                raise IndexError(slot)
+            values = _CAR.unpack_from(self._map, offset)
+            seq = values[0]
+            if seq & 1:
+                continue
+            if struct.unpack_from('<I', self._map, offset)[0] == seq:
+                return CarState(*values[1:])
+
+    def cars(self):
+        return [self.read(i) for i in range(self.num_cars)]
+
+    def find(self, station: int = None):
+        """局番号の号機 (None なら最初の号機)。なければ None"""
+        for car in self.cars():
+            if station is None or car.station == station:
+                return car
+        return None
+
+    def wait(self, generation: int, timeout: float, poll: float = 0.02) -> int:
+        """generation が変わるか timeout 秒経つまで待ち、現在の generation を返す"""
+        deadline = time.monotonic() + timeout
+        while True:
+            now = self.generation
+            if now != generation or time.monotonic() >= deadline:
+                return now
+            time.sleep(poll)
+
+
+def floor_name(value: int) -> str:
+    # 地下は2の補数 (B1F = 0xFFFF、B2F = 0xFFFE ...)
+    return f"B{0x10000 - value}F" if value >= 0xFFC0 else f"{value}F"
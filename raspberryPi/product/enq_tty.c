@@ -0,0 +1,343 @@
+// enq_tty.c
+// シリアルポートの termios 設定と読み出し方の選択・自動調整 (Linux)
+// ビルド例: serial_debug_test.c と一緒にリンクする (-pthread、enq_parser.c / enq_metrics.c も必要)
+
+#define _GNU_SOURCE
+#include "enq_tty.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "enq_metrics.h"
+#include "enq_parser.h"
+
+const char *const enq_tty_error_names[ENQ_TTY_ERR_COUNT] = {
+    "frame", "parity", "overrun", "buf_overrun", "break",
+};
+const char *const enq_tty_error_labels[ENQ_TTY_ERR_COUNT] = {
+    "フレーミング", "パリティ", "オーバーラン", "バッファ溢れ", "ブレーク",
+};
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int enq_tty_low_latency(int fd) {
+    struct serial_struct ss;
+    if (ioctl(fd, TIOCGSERIAL, &ss) < 0) return -1;
+    return (ss.flags & ASYNC_LOW_LATENCY) ? 1 : 0;
+}
+
+int enq_tty_configure(int fd, const enq_tty_read_t *r) {
+    struct termios tio, cur;
+    if (tcgetattr(fd, &tio) < 0) return -1;
+    cur = tio;
+    // ボーレート設定
+    cfsetispeed(&tio, B9600);
+    cfsetospeed(&tio, B9600);
+    // 8bit, Even parity, 1 stop bit
+    tio.c_cflag &= ~CSIZE;
+    tio.c_cflag |= CS8;
+    tio.c_cflag |= PARENB;   // parity enable
+    tio.c_cflag &= ~PARODD;  // even
+    tio.c_cflag &= ~CSTOPB;  // 1 stop bit
+    // raw モード
+    tio.c_lflag = 0;
+    tio.c_iflag = 0;
+    tio.c_oflag = 0;
+    tio.c_cc[VMIN]  = r->vmin;
+    tio.c_cc[VTIME] = r->vtime;
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+        // pty はパリティを保持せず、設定し直すと EINVAL を返すことがある。
+        // 回線設定はドライバーが受け付けた値のままにして、読み出し方だけを変える
+        if (errno != EINVAL) return -1;
+        tio.c_cflag = cur.c_cflag;
+        if (tcsetattr(fd, TCSANOW, &tio) < 0) return -1;
+    }
+
+    if (r->low_latency) {
+        struct serial_struct ss;
+        if (ioctl(fd, TIOCGSERIAL, &ss) == 0 && !(ss.flags & ASYNC_LOW_LATENCY)) {
+            ss.flags |= ASYNC_LOW_LATENCY;
+            ioctl(fd, TIOCSSERIAL, &ss);
+        }
+    }
+    return 0;
+}
+
+int enq_tty_parse(const char *spec, enq_tty_read_t *out) {
+    enq_tty_read_t r = *out;
+    char buf[128];
+    if (strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (strcmp(tok, "lowlat") == 0) {
+            r.low_latency = 1;
+            continue;
+        }
+        char *eq = strchr(tok, '=');
+        if (eq == NULL) return -1;
+        *eq = '\0';
+        char *end;
+        long v = strtol(eq + 1, &end, 10);
+        if (*end != '\0' || end == eq + 1) return -1;
+        if (strcmp(tok, "vmin") == 0 && v >= 0 && v <= 255) {
+            r.vmin = (uint8_t)v;
+        } else if (strcmp(tok, "vtime") == 0 && v >= 0 && v <= 255) {
+            r.vtime = (uint8_t)v;
+        } else if (strcmp(tok, "chunk") == 0 && v >= 1 && v <= ENQ_TTY_CHUNK_MAX) {
+            r.chunk = (uint16_t)v;
+        } else {
+            return -1;
+        }
+    }
+    *out = r;
+    return 0;
+}
+
+void enq_tty_format(const enq_tty_read_t *r, char *buf, size_t len) {
+    snprintf(buf, len, "vmin=%u,vtime=%u,chunk=%u%s", r->vmin, r->vtime, r->chunk,
+             r->low_latency ? ",lowlat" : "");
+}
+
+int enq_tty_errors(int fd, uint64_t out[ENQ_TTY_ERR_COUNT]) {
+    struct serial_icounter_struct ic;
+    if (ioctl(fd, TIOCGICOUNT, &ic) < 0) return -1;
+    out[ENQ_TTY_ERR_FRAME]       = (uint64_t)ic.frame;
+    out[ENQ_TTY_ERR_PARITY]      = (uint64_t)ic.parity;
+    out[ENQ_TTY_ERR_OVERRUN]     = (uint64_t)ic.overrun;
+    out[ENQ_TTY_ERR_BUF_OVERRUN] = (uint64_t)ic.buf_overrun;
+    out[ENQ_TTY_ERR_BREAK]       = (uint64_t)ic.brk;
+    return 0;
+}
+
+// ---- 自動調整 ----
+
+// ブロッキング read() の候補 (VTIME == 0 で VMIN > 1 は、到着が途切れると戻らないので除く)
+static const enq_tty_read_t blocking_candidates[] = {
+    { 16, 5, 0, ENQ_TTY_CHUNK_MAX },
+    { 16, 1, 0, ENQ_TTY_CHUNK_MAX },
+    {  8, 1, 0, ENQ_TTY_CHUNK_MAX },
+    {  1, 0, 0, ENQ_TTY_CHUNK_MAX },
+    {  1, 0, 0, ENQ_FRAME_LEN },
+};
+
+// epoll 待ちの候補 (VMIN が起床1回あたりのバイト数)
+static const enq_tty_read_t poll_candidates[] = {
+    {  1, 0, 0, ENQ_TTY_CHUNK_MAX },
+    {  8, 0, 0, ENQ_TTY_CHUNK_MAX },
+    { 16, 0, 0, ENQ_TTY_CHUNK_MAX },
+    { 16, 0, 0, ENQ_FRAME_LEN },
+};
+
+#define WATCH_MARKS   8192     // 1回の試行で記録する到着の上限
+#define WATCH_SLEEP_NS 200000  // 受信キューを見る間隔
+#define TRIAL_FRAMES  4096
+#define TRIAL_MIN_FRAMES 3     // これより少ない試行は判定に使わない
+
+// 受信キューの見張り: 読み出し済み + キュー内 = 到着済みバイト数 (の下限) が
+// 増えた時刻を記録する。読み出し済みは read() の後で更新するので多めには数えない
+typedef struct {
+    int fd;
+    atomic_int stop;
+    _Atomic uint64_t consumed;
+    _Atomic size_t n;
+    struct {
+        uint64_t bytes;
+        uint64_t t_ns;
+    } mark[WATCH_MARKS];
+} watch_t;
+
+static void *watch_thread(void *arg) {
+    watch_t *w = arg;
+    uint64_t last = 0;
+    const struct timespec pause = { 0, WATCH_SLEEP_NS };
+    while (!atomic_load_explicit(&w->stop, memory_order_relaxed)) {
+        uint64_t consumed = atomic_load_explicit(&w->consumed, memory_order_acquire);
+        int inq = 0;
+        if (ioctl(w->fd, TIOCINQ, &inq) == 0) {
+            uint64_t bytes = consumed + (uint64_t)inq;
+            size_t n = atomic_load_explicit(&w->n, memory_order_relaxed);
+            if (bytes > last && n < WATCH_MARKS) {
+                w->mark[n].bytes = bytes;
+                w->mark[n].t_ns = mono_ns();
+                atomic_store_explicit(&w->n, n + 1, memory_order_release);
+                last = bytes;
+            }
+        }
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+// ストリーム位置 end (この手前までのバイト) が揃った時刻。記録がなければ 0
+static uint64_t watch_arrival(const watch_t *w, size_t n, uint64_t end) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (w->mark[mid].bytes < end) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n ? w->mark[lo].t_ns : 0;
+}
+
+typedef struct {
+    uint64_t end;    // 伝文の直後のストリーム位置
+    uint64_t t_ns;   // その伝文を読み終えた時刻
+} trial_frame_t;
+
+static watch_t watch;
+static trial_frame_t trial_frames[TRIAL_FRAMES];
+static enq_parser_t trial_parser;
+static enq_hist_t trial_hist;
+static enq_hist_snap_t trial_snap;
+
+// 読んだバイトを投入し、揃った伝文を t_ns に読み終えたものとして記録する
+static size_t trial_feed(const uint8_t *data, size_t len, uint64_t t_ns, size_t nf) {
+    size_t off = 0;
+    while (off < len) {
+        off += enq_parser_feed(&trial_parser, data + off, len - off);
+        enq_frame_t f;
+        while (enq_parser_next(&trial_parser, &f)) {
+            if (nf < TRIAL_FRAMES) trial_frames[nf++] = (trial_frame_t){ trial_parser.head, t_ns };
+        }
+    }
+    return nf;
+}
+
+static int run_trial(int fd, int use_poll, unsigned trial_ms, enq_tty_trial_t *out) {
+    const enq_tty_read_t *r = &out->read;
+    if (enq_tty_configure(fd, r) < 0) return -1;
+    int fl = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, use_poll ? (fl | O_NONBLOCK) : (fl & ~O_NONBLOCK));
+    tcflush(fd, TCIFLUSH);
+    enq_parser_init(&trial_parser, 0);
+
+    watch.fd = fd;
+    atomic_store(&watch.stop, 0);
+    atomic_store(&watch.consumed, 0);
+    atomic_store(&watch.n, 0);
+    // シグナルは呼び出し側のスレッドで受ける
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pthread_t th;
+    int rc = pthread_create(&th, NULL, watch_thread, &watch);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+
+    // ブロッキングの候補も、試行を時間で打ち切れるよう poll() で最初のバイトを待つ
+    // (VTIME > 0 か VMIN == 1 なので、poll() が戻るのは read() が進める状態のとき)
+    uint8_t buf[ENQ_TTY_CHUNK_MAX];
+    uint64_t consumed = 0, syscalls = 0;
+    size_t nf = 0;
+    uint64_t cpu0 = thread_cpu_ns(), t0 = mono_ns(), deadline = t0 + (uint64_t)trial_ms * 1000000ull;
+    for (uint64_t now = t0; now < deadline; now = mono_ns()) {
+        struct pollfd p = { .fd = fd, .events = POLLIN };
+        int timeout = (int)((deadline - now + 999999) / 1000000);
+        int pr = poll(&p, 1, timeout);
+        if (use_poll) syscalls++;
+        if (pr <= 0) continue;
+        ssize_t n = read(fd, buf, r->chunk);
+        syscalls++;
+        uint64_t t = mono_ns();
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+            continue;
+        }
+        consumed += (uint64_t)n;
+        atomic_store_explicit(&watch.consumed, consumed, memory_order_release);
+        nf = trial_feed(buf, (size_t)n, t, nf);
+    }
+    out->cpu_ns = thread_cpu_ns() - cpu0;
+    out->elapsed_ns = mono_ns() - t0;
+    out->syscalls = syscalls;
+
+    // 打ち切り時にキューに残っていた分は今読み終えたものとする (遅延の下限)
+    fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        nf = trial_feed(buf, (size_t)n, mono_ns(), nf);
+    }
+    fcntl(fd, F_SETFL, fl);
+
+    atomic_store(&watch.stop, 1);
+    pthread_join(th, NULL);
+
+    memset(&trial_hist, 0, sizeof(trial_hist));
+    size_t marks = atomic_load_explicit(&watch.n, memory_order_acquire);
+    for (size_t i = 0; i < nf; i++) {
+        uint64_t arrived = watch_arrival(&watch, marks, trial_frames[i].end);
+        // 見張りの間隔より早く読まれた分は到着の記録が後になる (遅延 0 とみなす)
+        uint64_t lat = arrived && trial_frames[i].t_ns > arrived ? trial_frames[i].t_ns - arrived : 0;
+        enq_hist_record(&trial_hist, lat);
+    }
+    enq_hist_snapshot(&trial_hist, &trial_snap);
+    out->frames = nf;
+    out->p50_ns = enq_hist_quantile(&trial_snap, 0.5);
+    out->p99_ns = enq_hist_quantile(&trial_snap, 0.99);
+    out->max_ns = trial_snap.max_ns;
+    out->ok = nf >= TRIAL_MIN_FRAMES && out->p99_ns <= ENQ_TTY_FRAME_NS;
+    return 0;
+}
+
+int enq_tty_autotune(int fd, int use_poll, unsigned trial_ms, const enq_tty_read_t *base,
+                     enq_tty_read_t *best, enq_tty_trial_t trials[ENQ_TTY_MAX_TRIALS]) {
+    const enq_tty_read_t *cand = use_poll ? poll_candidates : blocking_candidates;
+    size_t count = use_poll ? sizeof(poll_candidates) / sizeof(poll_candidates[0])
+                            : sizeof(blocking_candidates) / sizeof(blocking_candidates[0]);
+    int n = 0;
+    for (size_t i = 0; i < count && n < ENQ_TTY_MAX_TRIALS; i++) {
+        memset(&trials[n], 0, sizeof(trials[n]));
+        trials[n].read = cand[i];
+        trials[n].read.low_latency = base->low_latency;
+        if (run_trial(fd, use_poll, trial_ms, &trials[n]) < 0) break;
+        n++;
+    }
+
+    // 遅延が伝文1つ分以内のうち CPU 時間が最少のもの。どれも満たさなければ p99 が最小のもの
+    int pick = -1;
+    for (int i = 0; i < n; i++) {
+        const enq_tty_trial_t *t = &trials[i];
+        if (t->frames < TRIAL_MIN_FRAMES) continue;
+        if (pick < 0) {
+            pick = i;
+            continue;
+        }
+        const enq_tty_trial_t *p = &trials[pick];
+        if (t->ok != p->ok) {
+            if (t->ok) pick = i;
+        } else if (t->ok ? t->cpu_ns * p->elapsed_ns < p->cpu_ns * t->elapsed_ns
+                         : t->p99_ns < p->p99_ns) {
+            pick = i;
+        }
+    }
+    *best = pick >= 0 ? trials[pick].read : *base;
+    enq_tty_configure(fd, best);
+    return n;
+}
@@ -0,0 +1,93 @@
+// enq_tty.h
+// シリアルポートの termios 設定と読み出し方の選択・自動調整 (Linux)
+//
+// 読み出し方 (enq_tty_read_t) は VMIN/VTIME、ASYNC_LOW_LATENCY と1回の read() で
+// 要求するバイト数の組で、待ち方によって意味が変わる:
+//   ブロッキング read(): 従来どおり。VMIN バイト揃うか、最初のバイトから VTIME
+//                        (0.1秒単位) 無受信が続くと戻る
+//   epoll 待ち         : fd は非ブロッキングで、read() は到着済みの分だけ返す。
+//                        VTIME == 0 なら n_tty は VMIN バイト揃うまで読み出し可能を
+//                        通知しないので、VMIN が起床1回あたりのバイト数になる
+//                        (VTIME > 0 なら1バイトで起きる)
+// VMIN を大きくするほどシステムコールは減るが、伝文の途中で到着が途切れると
+// 残りは次の伝文が来るまで (ブロッキングなら VTIME まで) 待たされる。
+//
+// enq_tty_autotune() は実際のアダプターと実際の受信で候補を順に試し、
+// 伝文1つ分の送信時間 (9600bps 8E1 で約18ms) 以内に受け取れる候補のうち
+// CPU 時間が最も少ないものを選ぶ。遅延は TIOCINQ で受信キューを見張る別スレッドが
+// 記録した到着時刻から、その伝文の最後のバイトを read() し終えるまでを測る。
+// したがって USB 変換器の中での滞留 (FTDI の latency_timer) は測れない。
+// ASYNC_LOW_LATENCY は候補に含めず、指定されたとおりに設定する。
+
+#ifndef ENQ_TTY_H
+#define ENQ_TTY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ENQ_TTY_CHUNK_MAX 256  // read() 1回の上限 (enq_spsc.h の ENQ_SPSC_CHUNK と同じ)
+
+typedef struct {
+    uint8_t  vmin;
+    uint8_t  vtime;        // 0.1秒単位
+    uint8_t  low_latency;  // ASYNC_LOW_LATENCY を立てる (FTDI などの USB 変換器)
+    uint16_t chunk;        // 1回の read() で要求する最大バイト数 (1〜ENQ_TTY_CHUNK_MAX)
+} enq_tty_read_t;
+
+// 従来の設定 (ブロッキング: 伝文長を待って最大0.5秒、epoll: 到着ごとに起床)
+#define ENQ_TTY_BLOCKING_DEFAULT ((enq_tty_read_t){ 16, 5, 0, ENQ_TTY_CHUNK_MAX })
+#define ENQ_TTY_POLL_DEFAULT     ((enq_tty_read_t){ 1, 0, 0, ENQ_TTY_CHUNK_MAX })
+
+// 9600bps 8E1 raw に設定し、読み出し方を反映する。
+// low_latency は立てるだけで落とさない (setserial で立てた設定を消さない)。
+// 対応していないドライバー (pty など) なら黙って無視する。戻り値: 成功 0 / 失敗 -1
+int enq_tty_configure(int fd, const enq_tty_read_t *r);
+
+// ASYNC_LOW_LATENCY を読む。取得できなければ -1
+int enq_tty_low_latency(int fd);
+
+// "vmin=16,vtime=1,chunk=64,lowlat" の形式。指定のない項目は *out の値のまま。
+// 戻り値: 成功 0 / 不正 -1
+int enq_tty_parse(const char *spec, enq_tty_read_t *out);
+void enq_tty_format(const enq_tty_read_t *r, char *buf, size_t len);
+
+// UART のエラーカウンター (TIOCGICOUNT、ドライバー起動からの累計)
+enum {
+    ENQ_TTY_ERR_FRAME,
+    ENQ_TTY_ERR_PARITY,
+    ENQ_TTY_ERR_OVERRUN,      // UART の受信 FIFO 溢れ
+    ENQ_TTY_ERR_BUF_OVERRUN,  // tty バッファ溢れ
+    ENQ_TTY_ERR_BREAK,
+    ENQ_TTY_ERR_COUNT
+};
+extern const char *const enq_tty_error_names[ENQ_TTY_ERR_COUNT];  // "frame" など (ラベル用)
+extern const char *const enq_tty_error_labels[ENQ_TTY_ERR_COUNT]; // "フレーミング" など (表示用)
+
+// 戻り値: 成功 0 / 非対応 (pty など) -1
+int enq_tty_errors(int fd, uint64_t out[ENQ_TTY_ERR_COUNT]);
+
+// ---- 自動調整 ----
+
+// 伝文1つ (16バイト x 11ビット) を 9600bps で送る時間
+#define ENQ_TTY_FRAME_NS (16ull * 11 * 1000000000ull / 9600)
+
+typedef struct {
+    enq_tty_read_t read;
+    uint64_t frames;       // 受け取った伝文数 (打ち切り時に残っていた分を含む)
+    uint64_t syscalls;     // read() (epoll 待ちなら epoll_wait も) の回数
+    uint64_t cpu_ns;       // 読み出しスレッドの CPU 時間
+    uint64_t elapsed_ns;
+    uint64_t p50_ns, p99_ns, max_ns;  // 到着から read() 完了までの遅延
+    int ok;                // 伝文が揃い、p99 が ENQ_TTY_FRAME_NS 以内
+} enq_tty_trial_t;
+
+#define ENQ_TTY_MAX_TRIALS 8
+
+// 候補を1つ trial_ms ずつ試す。poll なら epoll 待ち用 (非ブロッキング) の候補、
+// そうでなければブロッキング read() 用の候補を試す。base の low_latency はそのまま使う。
+// 試した結果を trials[] に入れ、選んだ候補を *best に入れる (fd にも反映済み)。
+// 戻り値: 試した数。どの候補でも伝文が受け取れなければ *best は base のまま
+int enq_tty_autotune(int fd, int poll, unsigned trial_ms, const enq_tty_read_t *base,
+                     enq_tty_read_t *best, enq_tty_trial_t trials[ENQ_TTY_MAX_TRIALS]);
+
+#endif // ENQ_TTY_H
@@ -1,6 +1,41 @@
 // serial_debug_test.c
 // シリアル通信デバッグテスト（POSIX termios版）
-// ビルド例: gcc serial_debug_test.c -o serial_debug_test
+// ビルド例: gcc -O2 -pthread serial_debug_test.c enq_parser.c enq_simd.c enq_capture.c enq_events.c enq_arena.c enq_state.c enq_fanout.c enq_metrics.c enq_probe.c enq_tty.c enq_port.c enq_log.c enq_hotplug.c -o serial_debug_test
+//
+// 受信は I/O スレッドが read() だけを行い、ロックフリーリング (enq_spsc.h) 経由で
+// デコードスレッドに渡す。解析・表示が遅れても読み出しは止まらない。
+// capture モードではデコードスレッドが受信バイトをそのままキャプチャファイル
+// (enq_capture_format.h) にも書き、シミュレーターの replay で再生できる。
+// publish モードではデコードした状態を共有メモリ (enq_state.h) に公開し、
+// フレームを tick ごとのバイナリバッチとして UDP マルチキャスト / WebSocket にも
+// 配信する (enq_fanout.h)。-events を付けると重複抑制後の状態変化を列形式のイベント
+// ファイル (enq_events_format.h) に書き、enq_events_query で時刻範囲を問い合わせられる。
+// watch モードは共有メモリを読むだけの読者の例。
+//
+// 受信経路の各区間 (read → リング → 組み立て → 検証 → 重複抑制 → 公開) の所要時間は
+// ロックフリーのヒストグラム (enq_metrics.h) に常時記録する。環境変数
+// ENQ_METRICS_PORT を指定すると http://:ポート/metrics で Prometheus 形式で公開し、
+// SIGUSR1 を送ると分位点の要約とカウンターを標準出力に表示する。
+// probe モードはシミュレーターの probe モードが送る通番付きの伝文 (enq_probe.h) を
+// 受けて、片方向遅延・欠落・順序逆転を測る。
+//
+// 読み出し方 (VMIN/VTIME・ASYNC_LOW_LATENCY・read() の長さ、enq_tty.h) は環境変数
+// ENQ_SERIAL_READ で変えられる ("vmin=1,vtime=0,chunk=64,lowlat" のように指定)。
+// "auto" なら開いたポートごとに候補を試し、伝文1つ分の時間以内に受け取れて CPU 時間が
+// 最も少ないものを使う。tune モードは試すだけで、結果の表と推奨値を表示する。
+// UART のエラーカウンター (TIOCGICOUNT) は終了時・SIGUSR1・/metrics に出す。
+// ポートは enq_port.h で開く。"pty" を指定すると疑似端末を作るので、同じ Linux 上で
+// 動かしたシミュレーターをそのスレーブに繋げば実機なしで送受信を通せる。
+// "unix:パス" ならシミュレーターとソケットで直結し、9600bps の上限 (約60フレーム/秒) なしで
+// 解析・重複抑制・公開の各段に負荷をかけられる。-quiet で表示を止めてレートだけを出す。
+// フレームの表示はログスレッド (enq_log.h) が書式化して書き出すので、端末が遅くても
+// デコードは止まらない。環境変数 ENQ_LOG で形式 (text / json / bin)・出力先・
+// 1秒あたりの上限や間引きを指定できる ("json,file=/var/log/enq.jsonl,rx=100/s")。
+// daemon モードは publish と同じ公開・配信を常駐で行う。起動時にポートを試さず、
+// 抜き差しの通知 (enq_hotplug.h) でポートを開閉するので、再起動や USB の再認識の直後から
+// 受信できる。後から起動した表示には共有メモリと WebSocket の過去分で経過を渡す。
+// /dev の tty が抜かれたら、どのモードでもノードの再作成を inotify で待って同じ読み出し方で
+// 開き直し、欠落区間 (最後に受信したときから開き直しまで) をログ・イベントファイル・配信に記録する。
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,10 +46,30 @@
 #include <termios.h>
 #include <time.h>
 #include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+
+#include "enq_parser.h"
+#include "enq_spsc.h"
+#include "enq_capture.h"
+#include "enq_events.h"
+#include "enq_state.h"
+#include "enq_fanout.h"
+#include "enq_metrics.h"
+#include "enq_probe.h"
+#include "enq_tty.h"
+#include "enq_port.h"
+#include "enq_log.h"
+#include "enq_hotplug.h"
 
 static volatile int running = 1;
+static volatile sig_atomic_t dump_requested = 0;
 
 // シグナルハンドラー (Ctrl+C でループを抜ける)
 void handle_sigint(int sig) {
@@ -22,147 +77,1911 @@ void handle_sigint(int sig) {
     running = 0;
 }
 
+// SIGUSR1: 計測値の表示を要求する (表示は受信ループで行う)
+static void handle_sigusr1(int sig) {
+    (void)sig;
+    dump_requested = 1;
+}
+
+// SA_RESTART なしで登録し、ブロック中の read() を EINTR で戻す
+static void install_signal_handlers(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = handle_sigusr1;
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// 読み出し方 (ENQ_SERIAL_READ、load_read_config で決める)
+#define AUTOTUNE_TRIAL_MS 2000
+static enq_tty_read_t read_blocking;  // monitor_serial のブロッキング read() 用
+static enq_tty_read_t read_poll;      // 複数ポートの epoll 待ち用
+static int read_autotune;
+
+static void load_read_config(void) {
+    read_blocking = ENQ_TTY_BLOCKING_DEFAULT;
+    read_poll = ENQ_TTY_POLL_DEFAULT;
+    const char *env = getenv("ENQ_SERIAL_READ");
+    if (env == NULL || *env == '\0') return;
+    // "auto" は候補を試す。"auto,lowlat" のように続けた項目は試す前の設定になる
+    if (strncmp(env, "auto", 4) == 0 && (env[4] == '\0' || env[4] == ',')) {
+        read_autotune = 1;
+        env += env[4] == ',' ? 5 : 4;
+        if (*env == '\0') return;
+    }
+    if (enq_tty_parse(env, &read_blocking) < 0 || enq_tty_parse(env, &read_poll) < 0) {
+        fprintf(stderr, "⚠️ ENQ_SERIAL_READ が不正です: %s (既定の読み出し方を使います)\n", env);
+        read_blocking = ENQ_TTY_BLOCKING_DEFAULT;
+        read_poll = ENQ_TTY_POLL_DEFAULT;
+        read_autotune = 0;
+    }
+}
+
+// 自動調整の結果表
+static void print_trials(const char *port, const enq_tty_trial_t *trials, int n,
+                         const enq_tty_read_t *best) {
+    printf("🎛️ %s: 読み出し方の試行 (目標: 遅延 p99 <= %.1fms)\n", port,
+           (double)ENQ_TTY_FRAME_NS / 1e6);
+    for (int i = 0; i < n; i++) {
+        const enq_tty_trial_t *t = &trials[i];
+        char spec[64], p50[16], p99[16], max[16];
+        enq_tty_format(&t->read, spec, sizeof(spec));
+        enq_metrics_format_ns(p50, sizeof(p50), t->p50_ns);
+        enq_metrics_format_ns(p99, sizeof(p99), t->p99_ns);
+        enq_metrics_format_ns(max, sizeof(max), t->max_ns);
+        double sec = (double)t->elapsed_ns / 1e9;
+        printf("   %s %-28s %4llu 伝文 / %6.1f syscall/秒 / CPU %5.2fms/秒 / "
+               "遅延 p50=%s p99=%s 最大=%s\n",
+               t->ok ? "✅" : "  ", spec, (unsigned long long)t->frames,
+               sec > 0 ? (double)t->syscalls / sec : 0,
+               sec > 0 ? (double)t->cpu_ns / 1e6 / sec : 0, p50, p99, max);
+    }
+    char spec[64];
+    enq_tty_format(best, spec, sizeof(spec));
+    int any = 0;
+    for (int i = 0; i < n; i++) any |= trials[i].frames > 0;
+    if (!any) printf("⚠️ %s: 受信がないので判定できません (%s のまま)\n", port, spec);
+    else printf("🎛️ %s: 選択 ENQ_SERIAL_READ=%s\n", port, spec);
+}
+
+// 読み出し方を反映する (自動調整なら試してから)。used に実際の設定を返す
+static int apply_read_config(int fd, const char *portname, int poll, enq_tty_read_t *used) {
+    const enq_tty_read_t *cfg = poll ? &read_poll : &read_blocking;
+    if (!read_autotune) {
+        *used = *cfg;
+        return enq_tty_configure(fd, cfg);
+    }
+    if (enq_tty_configure(fd, cfg) < 0) return -1;
+    printf("🎛️ %s: 読み出し方を自動調整中 (%d 秒 x 候補)...\n", portname, AUTOTUNE_TRIAL_MS / 1000);
+    enq_tty_trial_t trials[ENQ_TTY_MAX_TRIALS];
+    int n = enq_tty_autotune(fd, poll, AUTOTUNE_TRIAL_MS, cfg, used, trials);
+    print_trials(portname, trials, n, used);
+    return 0;
+}
+
+// モニタリング用にポートを開く (enq_port.h)。"pty" なら疑似端末を作ってスレーブのパスを表示する
+static int open_port(const char *portname, int poll, enq_tty_read_t *used) {
+    enq_port_t port;
+    if (enq_port_open(&port, portname, poll ? ENQ_PORT_ASYNC : 0) < 0) return -1;
+    if (port.kind == ENQ_PORT_PTY) {
+        // スレーブ側は閉じずに残し、送信側が開閉しても回線を保つ
+        printf("🔌 疑似端末を作成しました: 送信側は %s を開いてください\n", port.name);
+        fflush(stdout);  // 相手がパスを読めるよう、パイプ越しでもすぐに出す
+    }
+    if (port.kind == ENQ_PORT_SOCKET) {
+        // termios はないので read() の長さだけを使う
+        *used = poll ? read_poll : read_blocking;
+        printf("🔌 %s: 接続しました (回線速度の制限なし)\n", port.name);
+        return port.h;
+    }
+    if (apply_read_config(port.h, portname, poll, used) < 0) {
+        fprintf(stderr, "❌ %s: termios 設定に失敗: %s\n", portname, strerror(errno));
+        enq_port_close(&port);
+        return -1;
+    }
+    return port.h;
+}
+
 // シリアルポートを開いて termios 設定を行う
-//   portname: "/dev/ttyUSB0" など
-//   nonblock: テストモードなら 1（ノンブロッキング）、モニタリングなら 0
-//   戻り値: ファイルディスクリプタ (>=0) or エラーで -1
-int open_serial(const char *portname, int nonblock) {
-    int flags = O_RDWR | O_NOCTTY | (nonblock ? O_NONBLOCK : 0);
-    int fd = open(portname, flags);
-    if (fd < 0) return -1;
-
-    // モニタリング時は VTIME/VMIN でタイムアウト制御するため
-    if (!nonblock) {
-        // ブロッキングモードに戻す
-        fcntl(fd, F_SETFL, 0);
-
-        struct termios tio;
-        if (tcgetattr(fd, &tio) < 0) {
-            close(fd);
-            return -1;
-        }
-        // ボーレート設定
-        cfsetispeed(&tio, B9600);
-        cfsetospeed(&tio, B9600);
-        // 8bit, Even parity, 1 stop bit
-        tio.c_cflag &= ~CSIZE;
-        tio.c_cflag |= CS8;
-        tio.c_cflag |= PARENB;   // parity enable
-        tio.c_cflag &= ~PARODD;  // even
-        tio.c_cflag &= ~CSTOPB;  // 1 stop bit
-        // raw モード
-        tio.c_lflag = 0;
-        tio.c_iflag = 0;
-        tio.c_oflag = 0;
-        // フレーム長(16)を指定。最大0.5秒待機。
-        tio.c_cc[VMIN]  = 16;
-        tio.c_cc[VTIME] = 5;
-        if (tcsetattr(fd, TCSANOW, &tio) < 0) {
-            close(fd);
-            return -1;
+//   portname: "/dev/ttyUSB0" など (モニタリング時は "pty" も可)
+//   nonblock: テストモードなら 1（ノンブロッキング、termios は触らない）、モニタリングなら 0
+//   used: モニタリング時に使う読み出し方を返す (NULL 可)
+//   戻り値: ファイルディスクリプタ (>=0) or エラーで -1 (モニタリング時は理由を表示済み)
+int open_serial(const char *portname, int nonblock, enq_tty_read_t *used) {
+    if (nonblock) return open(portname, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    // モニタリング時はブロッキングで、VTIME/VMIN でタイムアウト制御する。
+    // 既定は伝文長(16)を指定して最大0.5秒待機 (ENQ_SERIAL_READ で変更)
+    enq_tty_read_t r;
+    int fd = open_port(portname, 0, &r);
+    if (fd >= 0 && used) *used = r;
+    return fd;
+}
+
+// epoll 用: termios 設定済みのノンブロッキング fd を返す
+//   既定は到着済みのバイトを即座に返す (待機は epoll が行う)
+int open_serial_async(const char *portname, enq_tty_read_t *used) {
+    return open_port(portname, 1, used);
+}
+
+// 現在時刻 "%H:%M:%S"
+static void time_str(char *ts, size_t len) {
+    time_t now = time(NULL);
+    struct tm lt;
+    localtime_r(&now, &lt);
+    strftime(ts, len, "%H:%M:%S", &lt);
+}
+
+// パーサー統計の表示
+static void print_parser_stats(const enq_parser_t *parser) {
+    const enq_parser_stats_t *st = enq_parser_stats(parser);
+    printf("📊 受信統計: %llu バイト / %llu フレーム / 破棄 %llu バイト / 形式エラー %llu / チェックサム不一致 %llu",
+           (unsigned long long)st->bytes_in, (unsigned long long)st->frames,
+           (unsigned long long)st->resync_bytes, (unsigned long long)st->layout_errors,
+           (unsigned long long)st->checksum_errors);
+    if (st->duplicates) printf(" / 重複抑制 %llu", (unsigned long long)st->duplicates);
+    printf("\n");
+}
+
+// ---- 区間計測 ----
+// 各区間はそれぞれ1つのスレッドだけが記録し、スクレイプ・SIGUSR1 は別スレッドから読む
+
+enum {
+    ST_READ,      // read() システムコール (複数ポートの非ブロッキング読み出し時のみ)
+    ST_QUEUE,     // read() の完了からデコードスレッドが取り出すまで (リング待ち)
+    ST_ASSEMBLE,  // フレーム先頭バイトの受信から最後のバイトの受信まで
+    ST_VALIDATE,  // 候補1件の検証とデコード
+    ST_DEDUPE,    // 重複抑制表の参照・更新
+    ST_PUBLISH,   // 共有メモリ・配信への書き込み (出力先があるときのみ)
+    ST_TOTAL,     // フレーム先頭バイトの受信から公開完了まで
+    ST_COUNT
+};
+
+static const char *const stage_names[ST_COUNT] = {
+    "read", "queue", "assemble", "validate", "dedupe", "publish", "total",
+};
+
+static enq_hist_t stage_hist[ST_COUNT];
+static const enq_parser_timing_t parser_timing = {
+    .validate = &stage_hist[ST_VALIDATE],
+    .dedupe = &stage_hist[ST_DEDUPE],
+};
+
+// ---- I/O スレッド → デコードスレッド ----
+#define MAX_PORTS 64
+#define RECV_MARKS 32  // フレーム先頭の受信時刻を引くためのチャンク履歴 (2のべき乗)
+_Static_assert(ENQ_TTY_CHUNK_MAX <= ENQ_SPSC_CHUNK, "read() の長さがリングのスロットを超える");
+
+// パーサー統計の写し (デコードスレッドがチャンクごとに書き、スクレイプ側が読む)
+typedef struct {
+    _Atomic uint64_t bytes, frames, duplicates, resync_bytes, layout_errors, checksum_errors;
+    _Atomic uint64_t gaps;  // 回線断の回数
+} port_counters_t;
+
+// パーサーのストリーム位置 end までのバイトを受信した時刻
+typedef struct {
+    uint64_t end;
+    uint64_t t_ns;
+} recv_mark_t;
+
+typedef struct {
+    const char *name;
+    int fd;
+    enq_tty_read_t read;
+    enq_parser_t parser;
+    port_counters_t counters;
+    recv_mark_t recv[RECV_MARKS];
+    unsigned recv_next;
+    // UART のエラー (開いてからの増分、I/O スレッドが更新する)
+    int tty_errors_ok;
+    uint64_t tty_errors_base[ENQ_TTY_ERR_COUNT];
+    uint64_t tty_errors_checked_ns;
+    _Atomic uint64_t tty_errors[ENQ_TTY_ERR_COUNT];
+    // 切断と再接続。reconnect は I/O スレッド、残りはデコードスレッドが使う
+    int reconnect;          // 開き直すのを待っている (読み出し方 read はそのまま使う)
+    int link_down;          // 切断の通知を受けてから、開き直しの通知をまだ受けていない
+    uint64_t last_rx_ns;    // 最後に受信した (または開き直した) 時刻 (CLOCK_MONOTONIC)
+    uint64_t down_ns;       // 欠落区間の始まり (切断前の最後の受信)
+    uint64_t gap_ns;        // 欠落区間の合計 (開き直したもの)
+} port_ctx_t;
+
+static enq_spsc_t ring;
+static atomic_int io_done;
+
+// スクレイプ・SIGUSR1・ログスレッドから見えるポート一覧とプローブ
+static port_ctx_t *metrics_ports;
+static _Atomic size_t metrics_num_ports;
+static enq_probe_t *_Atomic metrics_probe;
+
+// 途中経過・SIGUSR1 の要約の整形先 (起動時に確保しておき、定常運転中は確保しない)
+#define REPORT_RESERVE 16384
+static enq_metrics_out_t summary_out;
+static enq_metrics_out_t probe_out;
+
+static void metrics_set_ports(port_ctx_t *ports, size_t count) {
+    enq_metrics_out_reserve(&summary_out, REPORT_RESERVE);
+    enq_metrics_out_reserve(&probe_out, REPORT_RESERVE);
+    metrics_ports = ports;
+    atomic_store_explicit(&metrics_num_ports, count, memory_order_release);
+}
+
+// ---- ログ (enq_log.h) ----
+// フレームの表示はデコードスレッドでは16バイトと数値を積むだけにし、
+// 書式化と標準出力への書き込みはログスレッドが行う
+
+enum { LOG_CAT_RX, LOG_CAT_LINK };
+static const enq_log_category_t log_categories[] = {
+    [LOG_CAT_RX] = { .name = "rx" },
+    [LOG_CAT_LINK] = { .name = "link" },
+};
+
+enum { LOG_EV_FRAME, LOG_EV_GAP };
+#define LOG_FRAME_SHOW_PORT 5  // arg[5]: 表示にポート名を付ける (JSON には出さない)
+
+static void log_frame_text(const enq_log_rec_t *r, enq_log_buf_t *o);
+static void log_gap_text(const enq_log_rec_t *r, enq_log_buf_t *o);
+
+static const enq_log_event_t log_events[] = {
+    [LOG_EV_FRAME] = { .name = "frame", .category = LOG_CAT_RX,
+                       .keys = { "port", "station", "data_num", "value", "checksum_ok" },
+                       .str_key = "raw", .str_kind = ENQ_LOG_STR_HEX, .text = log_frame_text },
+    // 開き直したポートの欠落区間 (実時刻の ns、from は含み to は含まない)
+    [LOG_EV_GAP] = { .name = "gap", .category = LOG_CAT_LINK,
+                     .keys = { "port", "from_ns", "to_ns" }, .text = log_gap_text },
+};
+
+// ENQ_LOG の設定を読み、ログスレッドを起動する
+static void start_log(void) {
+    enq_log_init(log_categories, sizeof(log_categories) / sizeof(log_categories[0]),
+                 log_events, sizeof(log_events) / sizeof(log_events[0]));
+    const char *env = getenv("ENQ_LOG");
+    if (enq_log_configure(env) < 0) {
+        fprintf(stderr, "⚠️ ENQ_LOG が不正です: %s (既定のテキスト表示を使います)\n", env);
+    }
+    if (enq_log_start() < 0) {
+        fprintf(stderr, "⚠️ ログスレッドを起動できません: %s (表示は受信スレッドで行います)\n",
+                strerror(errno));
+    }
+}
+
+// 現在時刻 "%H:%M:%S" (ログレコードの時刻から)
+static void log_time_str(uint64_t t_ns, char *ts, size_t len) {
+    time_t sec = (time_t)(t_ns / 1000000000ull);
+    struct tm lt;
+    localtime_r(&sec, &lt);
+    strftime(ts, len, "%H:%M:%S", &lt);
+}
+
+// デコード済みフレームの表示 (ログスレッドから)
+static void log_frame_text(const enq_log_rec_t *r, enq_log_buf_t *o) {
+    char ts[16];
+    log_time_str(r->t_ns, ts, sizeof(ts));
+
+    enq_frame_t f;
+    enq_frame_decode(r->str, &f);
+    char desc[64];
+    enq_frame_describe(&f, desc, sizeof(desc));
+
+    // HEX / ASCII 表示
+    char hexstr[ENQ_FRAME_LEN*2+1];
+    char ascstr[ENQ_FRAME_LEN+1];
+    enq_frame_dump(r->str, hexstr, ascstr);
+
+    // ポート一覧は監視を始める前に固定され、名前は終了まで変わらない
+    if (r->arg[LOG_FRAME_SHOW_PORT]) {
+        enq_log_printf(o, "[%s] %s 📥 ENQ受信: %s (局番号:%04u データ番号:%04X データ:%04X チェック:%s)\n",
+                       ts, metrics_ports[r->arg[0]].name, desc, f.station, f.data_num, f.value,
+                       f.checksum_ok ? "OK" : "NG");
+    } else {
+        enq_log_printf(o, "[%s] 📥 ENQ受信: %s (局番号:%04u データ番号:%04X データ:%04X チェック:%s)\n",
+                       ts, desc, f.station, f.data_num, f.value, f.checksum_ok ? "OK" : "NG");
+    }
+    enq_log_printf(o, "  HEX  : %s\n", hexstr);
+    enq_log_printf(o, "  ASCII: %s\n\n", ascstr);
+}
+
+// 欠落区間の表示 (ログスレッドから)
+static void log_gap_text(const enq_log_rec_t *r, enq_log_buf_t *o) {
+    char ts[16], from[16], to[16];
+    log_time_str(r->t_ns, ts, sizeof(ts));
+    log_time_str(r->arg[1], from, sizeof(from));
+    log_time_str(r->arg[2], to, sizeof(to));
+    enq_log_printf(o, "[%s] 🔌 %s: 再接続しました (欠落 %s.%03u〜%s.%03u、%.3f 秒)\n", ts,
+                   metrics_ports[r->arg[0]].name, from, (unsigned)(r->arg[1] / 1000000u % 1000),
+                   to, (unsigned)(r->arg[2] / 1000000u % 1000),
+                   (double)(r->arg[2] - r->arg[1]) / 1e9);
+}
+
+// デコード済みフレームを積む (デコードスレッドから)
+static void log_frame(const enq_frame_t *f, uint16_t port, int show_port) {
+    const uint64_t args[ENQ_LOG_ARGS] = { port, f->station, f->data_num, f->value,
+                                          f->checksum_ok, (uint64_t)show_port };
+    enq_log(LOG_EV_FRAME, f->raw, ENQ_FRAME_LEN, args);
+}
+
+static void update_counters(port_ctx_t *pc) {
+    const enq_parser_stats_t *st = enq_parser_stats(&pc->parser);
+    port_counters_t *c = &pc->counters;
+    atomic_store_explicit(&c->bytes, st->bytes_in, memory_order_relaxed);
+    atomic_store_explicit(&c->frames, st->frames, memory_order_relaxed);
+    atomic_store_explicit(&c->duplicates, st->duplicates, memory_order_relaxed);
+    atomic_store_explicit(&c->resync_bytes, st->resync_bytes, memory_order_relaxed);
+    atomic_store_explicit(&c->layout_errors, st->layout_errors, memory_order_relaxed);
+    atomic_store_explicit(&c->checksum_errors, st->checksum_errors, memory_order_relaxed);
+}
+
+// UART のエラーカウンターの基準を取る (開いた直後に I/O スレッドから)
+static void init_tty_errors(port_ctx_t *pc) {
+    pc->tty_errors_ok = enq_tty_errors(pc->fd, pc->tty_errors_base) == 0;
+    pc->tty_errors_checked_ns = monotonic_ns();
+    for (int k = 0; k < ENQ_TTY_ERR_COUNT; k++) atomic_store(&pc->tty_errors[k], 0);
+}
+
+// UART のエラーカウンターを読み直す (force でなければ1秒に1回まで)
+static void refresh_tty_errors(port_ctx_t *pc, int force) {
+    if (!pc->tty_errors_ok || pc->fd < 0) return;
+    uint64_t now = monotonic_ns();
+    if (!force && now - pc->tty_errors_checked_ns < 1000000000ull) return;
+    pc->tty_errors_checked_ns = now;
+    uint64_t v[ENQ_TTY_ERR_COUNT];
+    if (enq_tty_errors(pc->fd, v) < 0) return;
+    for (int k = 0; k < ENQ_TTY_ERR_COUNT; k++) {
+        atomic_store_explicit(&pc->tty_errors[k], v[k] - pc->tty_errors_base[k],
+                              memory_order_relaxed);
+    }
+}
+
+// ストリーム位置 off のバイトを含むチャンクの受信時刻。
+// 履歴より古ければ最古の時刻 (下限) を、履歴がなければ 0 を返す
+static uint64_t arrival_ns(const port_ctx_t *pc, uint64_t off) {
+    uint64_t t = 0;
+    for (unsigned k = 0; k < RECV_MARKS && k < pc->recv_next; k++) {
+        const recv_mark_t *m = &pc->recv[(pc->recv_next - 1 - k) & (RECV_MARKS - 1)];
+        if (m->end <= off) break;
+        t = m->t_ns;
+    }
+    return t;
+}
+
+// デコード結果の出力先 (NULL の項目は使わない)
+typedef struct {
+    enqcap_writer_t *capture;   // 受信バイトをキャプチャファイルに記録する
+    enq_state_writer_t *state;  // 状態を共有メモリに公開する
+    enq_fanout_t *fanout;       // フレームを UDP / WebSocket に配信する
+    enqevt_writer_t *events;    // 状態変化をイベントファイルに記録する
+    int parser_flags;           // ENQ_PARSER_CHANGES_ONLY なら変化したフレームだけを扱う
+    enq_probe_t *probe;         // プローブを解析する (プローブは表示しない)
+    int quiet;                  // フレームを表示せず、1秒ごとに処理レートを表示する (負荷試験用)
+} monitor_outputs_t;
+
+typedef struct {
+    port_ctx_t *ports;
+    size_t num_ports;
+    int show_port;    // フレーム表示にポート名を付ける
+    int idle_notice;  // 10秒無受信で「待機中」を表示する
+    const monitor_outputs_t *out;
+} decoder_args_t;
+
+// フレームコールバックに渡す文脈
+typedef struct {
+    const decoder_args_t *args;
+    uint16_t port;
+    uint64_t t_ns;  // 処理中のチャンクの受信時刻
+} frame_ctx_t;
+
+// プローブの途中経過 (1秒ごと、デコードスレッドから)
+static void probe_report(const enq_probe_t *probe) {
+    static uint64_t last_ns;
+    uint64_t now = monotonic_ns();
+    if (now - last_ns < 1000000000ull) return;
+    last_ns = now;
+
+    enq_metrics_out_t *o = &probe_out;
+    o->len = 0;
+    o->truncated = 0;
+    char ts[16];
+    time_str(ts, sizeof(ts));
+    enq_metrics_printf(o, "[%s] 📡 プローブ: ", ts);
+    enq_probe_summary(probe, o);
+    if (o->len) fwrite(o->buf, 1, o->len, stdout);
+    fflush(stdout);
+}
+
+// イベントブロックの確定間隔。状態変化は少ないので長めに溜めて辞書と列幅を共有する
+// (異常終了時に失うのは最大この時間分)
+#define EVENTS_FLUSH_NS (300ull * 1000000000ull)
+
+static void events_frame(enqevt_writer_t *ev, uint16_t port, const enq_frame_t *f) {
+    if (ev->failed) return;
+    uint64_t now = realtime_ns();
+    if (enqevt_writer_append(ev, now, port, f->station, f->data_num, f->value) < 0 ||
+        enqevt_writer_flush(ev, now, EVENTS_FLUSH_NS) < 0) {
+        fprintf(stderr, "❌ イベント書き込み失敗: %s (以降の記録を停止)\n", strerror(errno));
+    }
+}
+
+static void on_frame(const enq_frame_t *f, void *ctx) {
+    const frame_ctx_t *fc = ctx;
+    const decoder_args_t *a = fc->args;
+    port_ctx_t *pc = &a->ports[fc->port];
+
+    // コールバック時点で head はこのフレームの直後を指している
+    uint64_t first = arrival_ns(pc, pc->parser.head - ENQ_FRAME_LEN);
+    if (first) enq_hist_record(&stage_hist[ST_ASSEMBLE], fc->t_ns - first);
+
+    if (a->out->probe && enq_frame_is_probe(f)) {
+        // 遅延はフレームが揃った (最後のバイトを読んだ) 時刻で測る
+        enq_probe_frame(a->out->probe, f, fc->t_ns);
+        probe_report(a->out->probe);
+        return;
+    }
+
+    if (a->out->state || a->out->fanout) {
+        uint64_t t0 = monotonic_ns();
+        uint64_t now = realtime_ns();
+        if (a->out->state) enq_state_publish_frame(a->out->state, fc->port, f, now);
+        if (a->out->fanout) enq_fanout_frame(a->out->fanout, fc->port, f, now);
+        enq_hist_record(&stage_hist[ST_PUBLISH], monotonic_ns() - t0);
+    }
+    if (a->out->events && f->checksum_ok) events_frame(a->out->events, fc->port, f);
+    if (first) enq_hist_record(&stage_hist[ST_TOTAL], monotonic_ns() - first);
+    if (!a->out->quiet) log_frame(f, fc->port, a->show_port);
+}
+
+// ブロックの確定間隔 (異常終了時に失うのは最大この時間分)
+#define CAPTURE_FLUSH_NS 1000000000ull
+
+static void capture_chunk(enqcap_writer_t *cap, const enq_chunk_t *c) {
+    if (cap->failed) return;
+    if (enqcap_writer_append(cap, c->t_ns, c->port, c->data, c->len) < 0 ||
+        enqcap_writer_flush(cap, c->t_ns, CAPTURE_FLUSH_NS) < 0) {
+        fprintf(stderr, "❌ キャプチャ書き込み失敗: %s (以降の記録を停止)\n", strerror(errno));
+    }
+}
+
+// quiet 時の処理レート (1秒ごと、デコードスレッドから)。
+// 取り出し (重複抑制を含む) とリングのオーバーランを並べ、どこで詰まるかを見る
+static void rate_report(const decoder_args_t *a, size_t count) {
+    static uint64_t last_ns, last_frames, last_bytes, last_overruns;
+    uint64_t now = monotonic_ns();
+    if (last_ns == 0) last_ns = now;
+    if (now - last_ns < 1000000000ull) return;
+
+    uint64_t frames = 0, bytes = 0, dups = 0;
+    for (size_t i = 0; i < count; i++) {
+        const enq_parser_stats_t *st = enq_parser_stats(&a->ports[i].parser);
+        frames += st->frames + st->duplicates;
+        bytes += st->bytes_in;
+        dups += st->duplicates;
+    }
+    uint64_t overruns = atomic_load(&ring.overrun_bytes);
+    double dt = (double)(now - last_ns) / 1e9;
+    char ts[16];
+    time_str(ts, sizeof(ts));
+    printf("[%s] 📊 %.0f フレーム/秒 (%.1f MB/s) / 累計 %llu フレーム (重複抑制 %llu) / "
+           "リング溢れ %.0f バイト/秒\n", ts,
+           (double)(frames - last_frames) / dt, (double)(bytes - last_bytes) / dt / 1e6,
+           (unsigned long long)frames, (unsigned long long)dups,
+           (double)(overruns - last_overruns) / dt);
+    fflush(stdout);
+    last_ns = now;
+    last_frames = frames;
+    last_bytes = bytes;
+    last_overruns = overruns;
+}
+
+// 回線の断・復帰をイベントファイルと配信に書く (t_ns は実時刻)
+static void link_record(const decoder_args_t *a, uint16_t port, uint64_t t_ns, uint16_t value) {
+    const enq_frame_t f = { .station = ENQ_LINK_STATION, .data_num = ENQ_DATA_LINK,
+                            .value = value, .checksum_ok = 1 };
+    if (a->out->fanout) enq_fanout_frame(a->out->fanout, port, &f, t_ns);
+    enqevt_writer_t *ev = a->out->events;
+    if (ev && !ev->failed &&
+        (enqevt_writer_append(ev, t_ns, port, f.station, f.data_num, f.value) < 0 ||
+         enqevt_writer_flush(ev, t_ns, EVENTS_FLUSH_NS) < 0)) {
+        fprintf(stderr, "❌ イベント書き込み失敗: %s (以降の記録を停止)\n", strerror(errno));
+    }
+}
+
+// 単調時計の時刻を実時刻にする
+static uint64_t monotonic_to_realtime(uint64_t mono_ns) {
+    return realtime_ns() - (monotonic_ns() - mono_ns);
+}
+
+// 切断の通知。t_ns は検出した時刻で、欠落は最後に受信したときから始まっている
+// (down_ns から開き直すまでが欠落区間。まだ何も受信していなければ検出時刻から)
+static void link_down(const decoder_args_t *a, uint16_t port, uint64_t t_ns) {
+    port_ctx_t *pc = &a->ports[port];
+    pc->link_down = 1;
+    pc->down_ns = pc->last_rx_ns && pc->last_rx_ns < t_ns ? pc->last_rx_ns : t_ns;
+    atomic_fetch_add_explicit(&pc->counters.gaps, 1, memory_order_relaxed);
+    link_record(a, port, monotonic_to_realtime(pc->down_ns), ENQ_LINK_DOWN);
+}
+
+// 開き直しの通知。欠落区間を記録・表示する
+static void link_up(const decoder_args_t *a, uint16_t port, uint64_t t_ns) {
+    port_ctx_t *pc = &a->ports[port];
+    if (!pc->link_down) return;
+    pc->link_down = 0;
+    pc->last_rx_ns = t_ns;  // 開き直してから何も来ずに抜かれても、前の欠落と重ねない
+    pc->gap_ns += t_ns - pc->down_ns;
+    uint64_t to = monotonic_to_realtime(t_ns);
+    uint64_t from = to - (t_ns - pc->down_ns);
+    link_record(a, port, to, ENQ_LINK_UP);
+    const uint64_t args[ENQ_LOG_ARGS] = { port, from, to };
+    enq_log(LOG_EV_GAP, NULL, 0, args);
+}
+
+// デコードスレッド: リングを取り出してパース・表示する
+static void *decoder_thread(void *arg) {
+    const decoder_args_t *a = arg;
+    time_t last_activity = time(NULL);
+
+    for (;;) {
+        enq_chunk_t *c = enq_spsc_peek(&ring);
+        if (c == NULL) {
+            if (atomic_load(&io_done)) break;
+            enqcap_writer_t *cap = a->out->capture;
+            enqevt_writer_t *ev = a->out->events;
+            int timeout = (a->idle_notice || cap || ev || a->out->quiet) ? 1000 : -1;
+            if (enq_spsc_wait(&ring, timeout)) continue;
+            if (a->out->quiet) rate_report(a, a->num_ports);
+            // 受信が途切れたら書きかけのブロックを確定しておく
+            if (cap && !cap->failed &&
+                enqcap_writer_flush(cap, monotonic_ns(), CAPTURE_FLUSH_NS) < 0) {
+                fprintf(stderr, "❌ キャプチャ書き込み失敗: %s (以降の記録を停止)\n", strerror(errno));
+            }
+            if (ev && !ev->failed &&
+                enqevt_writer_flush(ev, realtime_ns(), EVENTS_FLUSH_NS) < 0) {
+                fprintf(stderr, "❌ イベント書き込み失敗: %s (以降の記録を停止)\n", strerror(errno));
+            }
+            if (a->idle_notice) {
+                time_t now = time(NULL);
+                if (now - last_activity > 10) {
+                    char ts[16];
+                    time_str(ts, sizeof(ts));
+                    printf("[%s] 待機中... (データなし)\n", ts);
+                    last_activity = now;
+                }
+            }
+            continue;
+        }
+
+        port_ctx_t *pc = &a->ports[c->port];
+        if (c->flags & ENQ_CHUNK_PORT_CLOSED) {
+            fprintf(stderr, "⚠️ %s: 切断されました\n", pc->name);
+            // 組み立て途中の伝文を捨てる (開き直したら同じ番号で続ける)
+            enq_parser_reset(&pc->parser);
+            pc->recv_next = 0;
+            link_down(a, c->port, c->t_ns);
+        } else if (c->flags & ENQ_CHUNK_PORT_OPENED) {
+            link_up(a, c->port, c->t_ns);
+        } else {
+            enq_hist_record(&stage_hist[ST_QUEUE], monotonic_ns() - c->t_ns);
+            pc->last_rx_ns = c->t_ns;
+            if (a->out->capture) capture_chunk(a->out->capture, c);
+            // push は全量を投入するので、このチャンクの末尾は tail + len になる
+            pc->recv[pc->recv_next++ & (RECV_MARKS - 1)] =
+                (recv_mark_t){ .end = pc->parser.tail + c->len, .t_ns = c->t_ns };
+            frame_ctx_t fc = { .args = a, .port = c->port, .t_ns = c->t_ns };
+            enq_parser_push(&pc->parser, c->data, c->len, on_frame, &fc);
+            update_counters(pc);
         }
+        enq_spsc_release(&ring);
+        if (a->out->quiet) rate_report(a, a->num_ports);
+        last_activity = time(NULL);
     }
+    return NULL;
+}
 
-    return fd;
+// ---- 制御通知 (I/O スレッド → デコードスレッド) ----
+// 切断・開き直しの通知は欠落区間の記録に要るので捨てない。受信チャンクが使わない
+// スロット (ENQ_SPSC_CONTROL_SLOTS) に積み、それでも空きがなければ保留して I/O ループの
+// 周回ごとに順に積み直す。保留がある間は受信チャンクも読み捨てて順序を保つ (リングは
+// どのみち満杯)。切断の通知が保留中のポートは開き直さないので、保留はポートあたり
+// 高々2件 (開き直し・切断) に収まる
+#define NOTICE_MAX      (2 * MAX_PORTS)
+#define NOTICE_RETRY_MS 10
+
+typedef struct {
+    uint16_t port;
+    uint32_t flags;
+    uint64_t t_ns;     // 検出した時刻 (積めた時刻ではない)
+} notice_t;
+
+static notice_t notices[NOTICE_MAX];
+static size_t notice_head, notice_len;
+
+// 保留中の通知をリングに積む。すべて積めたら 1
+static int flush_notices(void) {
+    while (notice_len > 0) {
+        enq_chunk_t *c = enq_spsc_reserve(&ring);
+        if (c == NULL) return 0;
+        const notice_t *nt = &notices[notice_head];
+        c->port  = nt->port;
+        c->len   = 0;
+        c->flags = nt->flags;
+        c->t_ns  = nt->t_ns;
+        enq_spsc_commit(&ring);
+        notice_head = (notice_head + 1) % NOTICE_MAX;
+        notice_len--;
+    }
+    return 1;
+}
+
+static void notify_ring(uint16_t port, uint32_t flags) {
+    // 上の上限により溢れないが、万一のときはデコードスレッドが空けるのを待つ
+    while (notice_len == NOTICE_MAX && !flush_notices()) usleep(1000);
+    notices[(notice_head + notice_len) % NOTICE_MAX] =
+        (notice_t){ .port = port, .flags = flags, .t_ns = monotonic_ns() };
+    notice_len++;
+    flush_notices();
+}
+
+static int notice_pending(uint16_t port) {
+    for (size_t k = 0; k < notice_len; k++) {
+        if (notices[(notice_head + k) % NOTICE_MAX].port == port) return 1;
+    }
+    return 0;
+}
+
+// 保留があれば I/O ループの待ち時間を NOTICE_RETRY_MS までに縮める
+static int notice_timeout(int timeout_ms) {
+    if (notice_len == 0) return timeout_ms;
+    return timeout_ms < 0 || timeout_ms > NOTICE_RETRY_MS ? NOTICE_RETRY_MS : timeout_ms;
+}
+
+// シグナルをブロックした状態でデコードスレッドを起動する (シグナルは I/O 側で受ける)
+static int start_decoder(pthread_t *th, decoder_args_t *args) {
+    if (enq_spsc_init(&ring) < 0) {
+        fprintf(stderr, "❌ eventfd 作成失敗: %s\n", strerror(errno));
+        return -1;
+    }
+    atomic_store(&io_done, 0);
+    notice_head = notice_len = 0;
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(th, NULL, decoder_thread, args);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "❌ デコードスレッド起動失敗: %s\n", strerror(rc));
+        enq_spsc_destroy(&ring);
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_decoder(pthread_t th) {
+    // 保留中の通知を渡し切ってから終える (デコードスレッドは動いているので空く)
+    while (!flush_notices()) usleep(1000);
+    atomic_store(&io_done, 1);
+    enq_spsc_kick(&ring);
+    pthread_join(th, NULL);
+    enq_spsc_destroy(&ring);
+}
+
+// I/O スレッド: 1回分の read() をリングのスロットへ直接行う
+//   戻り値は read() と同じ。リング満杯時 (制御通知の保留中も) は読み捨ててオーバーランに数える。
+//   chunk は要求するバイト数 (ENQ_SPSC_CHUNK 以下)。
+//   timed なら read() の所要時間を記録する (ブロッキング読み出しでは待ち時間になるので測らない)
+static ssize_t read_into_ring(int fd, uint16_t port, size_t chunk, int timed) {
+    static uint8_t scratch[ENQ_SPSC_CHUNK];
+    enq_chunk_t *c = flush_notices() ? enq_spsc_reserve_data(&ring) : NULL;
+    uint64_t t0 = timed ? monotonic_ns() : 0;
+    ssize_t n = read(fd, c ? c->data : scratch, chunk);
+    if (timed) enq_hist_record(&stage_hist[ST_READ], monotonic_ns() - t0);
+    if (n <= 0) return n;
+    if (c == NULL) {
+        enq_spsc_overrun(&ring, (size_t)n);
+        return n;
+    }
+    c->port  = port;
+    c->len   = (uint16_t)n;
+    c->flags = 0;
+    c->t_ns  = monotonic_ns();
+    enq_spsc_commit(&ring);
+    return n;
+}
+
+// ---- 切断したポートの再接続 (I/O スレッド) ----
+// /dev のノードとして開いた tty だけが対象 (pty・unix: は相手が閉じたら終わり)。
+// ノードのあるディレクトリを inotify で見張り (enq_hotplug.h)、作成・権限の変更のたびに
+// 開き直してみる。見張れないときや見落としに備えて RECONNECT_POLL_MS ごとにも試す
+#define RECONNECT_POLL_MS 1000
+#define RECONNECT_RETRY_MS 100  // inotify が使えないとき
+
+static int can_reconnect(const port_ctx_t *pc) {
+    return strncmp(pc->name, "/dev/", 5) == 0;
+}
+
+// 切断したポートを開き直す。読み出し方は切断前のもの (自動調整の結果も) をそのまま
+// 設定し、試し直さない。ノード・権限がまだなければ何も表示せずに -1。
+// 開けたらデコードスレッドに通知する (欠落区間はそこで記録する)
+static int reopen_serial(port_ctx_t *pc, uint16_t port, int poll) {
+    if (notice_pending(port) || access(pc->name, R_OK | W_OK) < 0) return -1;
+    enq_port_t p;
+    if (enq_port_open(&p, pc->name, poll ? ENQ_PORT_ASYNC : 0) < 0) return -1;
+    if (enq_tty_configure(p.h, &pc->read) < 0) {
+        fprintf(stderr, "❌ %s: termios 設定に失敗: %s\n", pc->name, strerror(errno));
+        enq_port_close(&p);
+        return -1;
+    }
+    pc->fd = p.h;
+    pc->reconnect = 0;
+    init_tty_errors(pc);
+    notify_ring(port, ENQ_CHUNK_PORT_OPENED);
+    return pc->fd;
+}
+
+// リング統計の表示
+static void print_ring_stats(void) {
+    printf("🧵 リング: 最大使用 %llu/%d スロット / オーバーラン %llu 回 (%llu バイト)\n",
+           (unsigned long long)atomic_load(&ring.high_water), ENQ_SPSC_SLOTS,
+           (unsigned long long)atomic_load(&ring.overruns),
+           (unsigned long long)atomic_load(&ring.overrun_bytes));
+}
+
+// UART のエラー (対応していないドライバーなら何も出さない)
+static void print_tty_errors(const port_ctx_t *pc) {
+    if (!pc->tty_errors_ok) return;
+    printf("🔌 %s: UART エラー", pc->name);
+    for (int k = 0; k < ENQ_TTY_ERR_COUNT; k++) {
+        printf("%s%s %llu", k ? " / " : " ", enq_tty_error_labels[k],
+               (unsigned long long)atomic_load(&pc->tty_errors[k]));
+    }
+    printf("\n");
+}
+
+// 回線断の回数と欠落区間の合計 (切断がなければ何も出さない)
+static void print_gaps(const port_ctx_t *pc) {
+    uint64_t gaps = atomic_load(&pc->counters.gaps);
+    if (gaps == 0) return;
+    printf("🔌 %s: 回線断 %llu 回", pc->name, (unsigned long long)gaps);
+    // 開き直した分の欠落区間の合計。切断したままのものは終わりがないので含めない
+    if (gaps > (uint64_t)pc->link_down) printf(" / 欠落 合計 %.3f 秒", (double)pc->gap_ns / 1e9);
+    printf("%s\n", pc->link_down ? " (切断中)" : "");
+}
+
+// ---- 計測値の公開 ----
+
+// /metrics の本文 (スクレイプのたびに HTTP スレッドから呼ばれる)
+static void render_metrics(enq_metrics_out_t *o, void *ctx) {
+    (void)ctx;
+    char labels[160];
+
+    enq_metrics_family(o, "enq_stage_latency_seconds", "histogram",
+                       "受信経路の区間ごとの所要時間");
+    for (int i = 0; i < ST_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", stage_names[i]);
+        enq_metrics_histogram(o, "enq_stage_latency_seconds", labels, &stage_hist[i]);
+    }
+    enq_metrics_family(o, "enq_stage_latency_quantile_seconds", "gauge",
+                       "区間ごとの所要時間の分位点 (起動からの累計, quantile=1 は最大値)");
+    for (int i = 0; i < ST_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", stage_names[i]);
+        enq_metrics_quantiles(o, "enq_stage_latency_quantile_seconds", labels, &stage_hist[i]);
+    }
+
+    static const struct {
+        const char *name, *help;
+        size_t offset;
+    } counters[] = {
+        { "enq_received_bytes_total", "受信バイト数", offsetof(port_counters_t, bytes) },
+        { "enq_frames_total", "取り出したフレーム数", offsetof(port_counters_t, frames) },
+        { "enq_duplicate_frames_total", "重複として捨てたフレーム数",
+          offsetof(port_counters_t, duplicates) },
+        { "enq_resync_bytes_total", "同期外れで破棄したバイト数",
+          offsetof(port_counters_t, resync_bytes) },
+        { "enq_layout_errors_total", "形式不正の候補数", offsetof(port_counters_t, layout_errors) },
+        { "enq_checksum_errors_total", "チェックサム不一致数",
+          offsetof(port_counters_t, checksum_errors) },
+        { "enq_link_gaps_total", "回線断の回数", offsetof(port_counters_t, gaps) },
+    };
+    size_t n = atomic_load_explicit(&metrics_num_ports, memory_order_acquire);
+    for (size_t k = 0; k < sizeof(counters) / sizeof(counters[0]); k++) {
+        enq_metrics_family(o, counters[k].name, "counter", counters[k].help);
+        for (size_t i = 0; i < n; i++) {
+            const port_ctx_t *pc = &metrics_ports[i];
+            const _Atomic uint64_t *v =
+                (const _Atomic uint64_t *)((const char *)&pc->counters + counters[k].offset);
+            snprintf(labels, sizeof(labels), "port=\"%s\"", pc->name);
+            enq_metrics_value(o, counters[k].name, labels,
+                              atomic_load_explicit(v, memory_order_relaxed));
+        }
+    }
+
+    enq_metrics_family(o, "enq_tty_errors_total", "counter",
+                       "UART のエラー (TIOCGICOUNT、ポートを開いてからの増分)");
+    for (size_t i = 0; i < n; i++) {
+        const port_ctx_t *pc = &metrics_ports[i];
+        if (!pc->tty_errors_ok) continue;
+        for (int k = 0; k < ENQ_TTY_ERR_COUNT; k++) {
+            snprintf(labels, sizeof(labels), "port=\"%s\",kind=\"%s\"", pc->name,
+                     enq_tty_error_names[k]);
+            enq_metrics_value(o, "enq_tty_errors_total", labels,
+                              atomic_load_explicit(&pc->tty_errors[k], memory_order_relaxed));
+        }
+    }
+
+    enq_metrics_family(o, "enq_ring_overruns_total", "counter", "リング満杯で捨てたチャンク数");
+    enq_metrics_value(o, "enq_ring_overruns_total", NULL, atomic_load(&ring.overruns));
+    enq_metrics_family(o, "enq_ring_overrun_bytes_total", "counter", "リング満杯で捨てたバイト数");
+    enq_metrics_value(o, "enq_ring_overrun_bytes_total", NULL, atomic_load(&ring.overrun_bytes));
+    enq_metrics_family(o, "enq_ring_high_water_slots", "gauge", "リングの最大使用スロット数");
+    enq_metrics_value(o, "enq_ring_high_water_slots", NULL, atomic_load(&ring.high_water));
+
+    const enq_probe_t *probe = atomic_load(&metrics_probe);
+    if (probe == NULL) return;
+    static const struct {
+        const char *name, *help;
+        size_t offset;
+    } probe_counters[] = {
+        { "enq_probe_received_total", "受信したプローブ数", offsetof(enq_probe_t, received) },
+        { "enq_probe_lost_total", "欠落したプローブ数", offsetof(enq_probe_t, lost) },
+        { "enq_probe_reordered_total", "順序が入れ替わったプローブ数",
+          offsetof(enq_probe_t, reordered) },
+        { "enq_probe_duplicates_total", "重複したプローブ数", offsetof(enq_probe_t, duplicates) },
+    };
+    for (size_t k = 0; k < sizeof(probe_counters) / sizeof(probe_counters[0]); k++) {
+        const _Atomic uint64_t *v =
+            (const _Atomic uint64_t *)((const char *)probe + probe_counters[k].offset);
+        enq_metrics_family(o, probe_counters[k].name, "counter", probe_counters[k].help);
+        enq_metrics_value(o, probe_counters[k].name, NULL, atomic_load(v));
+    }
+    enq_metrics_family(o, "enq_probe_latency_quantile_seconds", "gauge",
+                       "プローブの片方向遅延の分位点 (clock=\"relative\" は最小値からの差)");
+    static enq_hist_snap_t snap;  // レンダーは HTTP スレッドだけが呼ぶ
+    enq_hist_snapshot(&probe->latency, &snap);
+    static const char *const qs[] = { "0", "0.5", "0.9", "0.99", "0.999", "1" };
+    for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++) {
+        enq_metrics_printf(o, "enq_probe_latency_quantile_seconds{clock=\"%s\",quantile=\"%s\"} %.9f\n",
+                           probe->shared_clock ? "shared" : "relative", qs[i],
+                           (double)enq_hist_quantile(&snap, atof(qs[i])) / 1e9);
+    }
+}
+
+// 区間ごとの分位点の要約
+static void print_latency_summary(const char *title) {
+    enq_metrics_out_t *o = &summary_out;
+    o->len = 0;
+    o->truncated = 0;
+    enq_metrics_printf(o, "⏱️ 区間レイテンシ%s\n", title);
+    for (int i = 0; i < ST_COUNT; i++) enq_metrics_summary(o, stage_names[i], &stage_hist[i]);
+    if (o->len) fwrite(o->buf, 1, o->len, stdout);
+    fflush(stdout);
+}
+
+// 間引き・溢れがあったときだけ出す
+static void print_log_stats(void) {
+    enq_log_stats_t st;
+    enq_log_get_stats(&st);
+    if (st.suppressed == 0 && st.dropped == 0) return;
+    printf("📝 ログ (%s): 出力 %llu 件 / 間引き %llu 件 / リング溢れ %llu 件\n", enq_log_format_name(),
+           (unsigned long long)st.written, (unsigned long long)st.suppressed,
+           (unsigned long long)st.dropped);
+}
+
+// SIGUSR1: 要約とカウンターを表示する (I/O スレッドから呼ぶ)
+static void dump_metrics(void) {
+    print_latency_summary(" (SIGUSR1)");
+    size_t n = atomic_load_explicit(&metrics_num_ports, memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        const port_counters_t *c = &metrics_ports[i].counters;
+        printf("🧮 %s: %llu バイト / %llu フレーム / 重複 %llu / 破棄 %llu バイト / "
+               "形式エラー %llu / チェックサム不一致 %llu\n", metrics_ports[i].name,
+               (unsigned long long)atomic_load(&c->bytes), (unsigned long long)atomic_load(&c->frames),
+               (unsigned long long)atomic_load(&c->duplicates),
+               (unsigned long long)atomic_load(&c->resync_bytes),
+               (unsigned long long)atomic_load(&c->layout_errors),
+               (unsigned long long)atomic_load(&c->checksum_errors));
+        print_tty_errors(&metrics_ports[i]);
+    }
+    print_ring_stats();
+    print_log_stats();
+    fflush(stdout);
+}
+
+// ENQ_METRICS_PORT が指定されていれば /metrics を公開する
+static enq_metrics_server_t *start_metrics_server(void) {
+    const char *env = getenv("ENQ_METRICS_PORT");
+    if (env == NULL || *env == '\0') return NULL;
+    int port = atoi(env);
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "⚠️ ENQ_METRICS_PORT が不正です: %s\n", env);
+        return NULL;
+    }
+    enq_metrics_server_t *s = enq_metrics_serve((uint16_t)port, render_metrics, NULL);
+    if (s == NULL) fprintf(stderr, "❌ メトリクスを公開できません (ポート %d): %s\n", port, strerror(errno));
+    else printf("📈 メトリクス: http://0.0.0.0:%d/metrics (SIGUSR1 で要約を表示)\n", port);
+    return s;
 }
 
 // モニタリング処理
 void monitor_serial(const char *port) {
-    int fd = open_serial(port, 0);
-    if (fd < 0) {
-        fprintf(stderr, "❌ %s を開けません: %s\n", port, strerror(errno));
-        return;
-    }
+    static port_ctx_t ctx;
+    ctx.name = port;
+    ctx.fd = open_serial(port, 0, &ctx.read);
+    if (ctx.fd < 0) return;
+    init_tty_errors(&ctx);
+    enq_parser_init(&ctx.parser, 0);
+    enq_parser_set_timing(&ctx.parser, &parser_timing);
+    metrics_set_ports(&ctx, 1);
 
     printf("📡 シリアルモニタリング開始: %s\n", port);
-    printf("    設定: 9600bps, 8bit, Even parity, 1 stop bit\n");
+    char spec[64];
+    enq_tty_format(&ctx.read, spec, sizeof(spec));
+    printf("    設定: 9600bps, 8bit, Even parity, 1 stop bit (読み出し %s)\n", spec);
     printf("    Ctrl+C で終了\n\n");
 
-    signal(SIGINT, handle_sigint);
-    signal(SIGTERM, handle_sigint);
+    install_signal_handlers();
 
-    time_t last_activity = time(NULL);
+    pthread_t th;
+    static const monitor_outputs_t none;
+    decoder_args_t args = { .ports = &ctx, .num_ports = 1, .show_port = 0, .idle_notice = 1,
+                            .out = &none };
+    if (start_decoder(&th, &args) < 0) {
+        close(ctx.fd);
+        return;
+    }
 
-    unsigned char buf[256];
+    int wfd = can_reconnect(&ctx) ? enq_hotplug_watch_open() : -1;
+    if (wfd >= 0) enq_hotplug_watch_add(wfd, port);
     while (running) {
-        int n = read(fd, buf, sizeof(buf));
-        if (n < 0) {
-            // 読み取りエラーなら少し待って再試行
-            usleep(100000);
+        flush_notices();
+        if (ctx.fd < 0) {
+            // 抜かれたら挿し直されるまで待つ (ノードの作成・権限の変更で起きる)
+            struct pollfd wp = { .fd = wfd, .events = POLLIN };
+            int timeout = notice_timeout(wfd >= 0 ? RECONNECT_POLL_MS : RECONNECT_RETRY_MS);
+            if (poll(&wp, wfd >= 0 ? 1 : 0, timeout) > 0)
+                enq_hotplug_watch_drain(wfd);
+            if (running) reopen_serial(&ctx, 0, 0);
+        } else {
+            ssize_t n = read_into_ring(ctx.fd, 0, ctx.read.chunk, 0);
+            refresh_tty_errors(&ctx, 0);
+            // n == 0 はタイムアウト (VTIME)。待機表示はデコードスレッドが行う。
+            // 抜かれた tty は read() が 0 か EIO を返し続けるので、HUP を確かめて閉じる
+            struct pollfd rp = { .fd = ctx.fd, .events = 0 };
+            if (n <= 0 && !(n < 0 && errno == EINTR) &&
+                poll(&rp, 1, 0) > 0 && (rp.revents & (POLLHUP | POLLERR | POLLNVAL))) {
+                refresh_tty_errors(&ctx, 1);
+                notify_ring(0, ENQ_CHUNK_PORT_CLOSED);
+                close(ctx.fd);
+                ctx.fd = -1;
+                if (!can_reconnect(&ctx)) break;
+                ctx.reconnect = 1;
+            } else if (n < 0 && errno != EINTR) {
+                // それ以外の読み取りエラーなら少し待って再試行
+                usleep(100000);
+            }
+        }
+        if (dump_requested) {
+            dump_requested = 0;
+            dump_metrics();
+        }
+    }
+    if (wfd >= 0) close(wfd);
+
+    stop_decoder(th);
+    enq_log_flush();
+
+    printf("\n🛑 モニタリング終了\n");
+    print_parser_stats(&ctx.parser);
+    refresh_tty_errors(&ctx, 1);
+    print_tty_errors(&ctx);
+    print_gaps(&ctx);
+    print_ring_stats();
+    print_latency_summary("");
+    if (ctx.fd >= 0) close(ctx.fd);
+}
+
+// ---- 複数ポート同時モニタリング ----
+
+// ポートを閉じて epoll から外す
+static void close_port(int epfd, port_ctx_t *pc) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, pc->fd, NULL);
+    close(pc->fd);
+    pc->fd = -1;
+}
+
+// 切断したポートを開き直して epoll に登録する。戻り値: 成功 0 / まだ開けない -1
+static int reopen_port(int epfd, port_ctx_t *pc, uint16_t port) {
+    if (reopen_serial(pc, port, 1) < 0) return -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = pc };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, pc->fd, &ev) < 0) {
+        // 登録できなければ切断のままにする (次の機会に開き直す)
+        fprintf(stderr, "❌ %s を epoll に登録できません: %s\n", pc->name, strerror(errno));
+        notify_ring(port, ENQ_CHUNK_PORT_CLOSED);
+        close(pc->fd);
+        pc->fd = -1;
+        pc->reconnect = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// out の各出力先 (キャプチャ・共有メモリ・配信) にも書く。out は NULL でもよい
+void monitor_multi(const char *const *ports, size_t count, const monitor_outputs_t *out) {
+    static const monitor_outputs_t none;
+    static port_ctx_t ctx[MAX_PORTS];
+    if (out == NULL) out = &none;
+    if (count > MAX_PORTS) count = MAX_PORTS;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        fprintf(stderr, "❌ epoll_create1 失敗: %s\n", strerror(errno));
+        return;
+    }
+
+    // SIGINT/SIGTERM も epoll で受ける (待機中のレースなしで即時終了)。
+    // SIGUSR1 は計測値の表示
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+    // 抜き差しの見張り (data.ptr は &wfd)。開けないときは一定間隔で試す
+    int wfd = enq_hotplug_watch_open();
+    if (wfd >= 0) {
+        ev.data.ptr = &wfd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, wfd, &ev);
+    }
+
+    size_t open_count = 0, waiting = 0;
+    for (size_t i = 0; i < count; i++) {
+        port_ctx_t *pc = &ctx[i];
+        pc->name = ports[i];
+        enq_parser_init(&pc->parser, out->parser_flags);
+        enq_parser_set_timing(&pc->parser, &parser_timing);
+        pc->recv_next = 0;
+        pc->tty_errors_ok = 0;
+        pc->reconnect = 0;
+        pc->fd = open_serial_async(ports[i], &pc->read);
+        if (pc->fd < 0) continue;
+        init_tty_errors(pc);
+        ev.events = EPOLLIN;
+        ev.data.ptr = pc;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, pc->fd, &ev) < 0) {
+            fprintf(stderr, "❌ %s を epoll に登録できません: %s\n", ports[i], strerror(errno));
+            close(pc->fd);
+            pc->fd = -1;
             continue;
         }
-        if (n > 0) {
-            // 受信あり
-            char ts[16];
-            time_t now = time(NULL);
-            struct tm lt;
-            localtime_r(&now, &lt);
-            strftime(ts, sizeof(ts), "%H:%M:%S", &lt);
+        char spec[64];
+        enq_tty_format(&pc->read, spec, sizeof(spec));
+        printf("📡 %s: モニタリング開始 (読み出し %s)\n", ports[i], spec);
+        open_count++;
+    }
 
-            // HEX 表示
-            char hexstr[256*2+1] = {0};
-            for (int i = 0; i < n; i++) {
-                sprintf(hexstr + i*2, "%02X", buf[i]);
+    metrics_set_ports(ctx, count);
+
+    pthread_t th;
+    decoder_args_t args = { .ports = ctx, .num_ports = count, .show_port = 1, .idle_notice = 0,
+                            .out = out };
+    if (open_count == 0) {
+        fprintf(stderr, "❌ 開けるポートがありません\n");
+    } else {
+        printf("    設定: 9600bps, 8bit, Even parity, 1 stop bit (%zu ポート)\n", open_count);
+        printf("    Ctrl+C で終了\n\n");
+        if (start_decoder(&th, &args) < 0) open_count = 0;
+    }
+    int decoding = open_count > 0;
+
+    struct epoll_event events[MAX_PORTS + 2];
+    // 開いたポートがすべて閉じ、開き直すものもなくなったら終わる
+    while (running && open_count + waiting > 0) {
+        // イベントが来るまで無期限に待つ (アイドル時の起床なし)。開き直し待ちがあれば時々試す
+        flush_notices();
+        int timeout = waiting == 0 ? -1 : wfd >= 0 ? RECONNECT_POLL_MS : RECONNECT_RETRY_MS;
+        int n = epoll_wait(epfd, events, MAX_PORTS + 2, notice_timeout(timeout));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int retry = n == 0;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &wfd) {
+                retry = enq_hotplug_watch_drain(wfd) > 0;
+                continue;
             }
-            // ASCII 表示
-            char ascstr[256+1] = {0};
-            for (int i = 0; i < n; i++) {
-                unsigned char b = buf[i];
-                ascstr[i] = (b >= 32 && b <= 126) ? b : '.';
+            port_ctx_t *pc = events[i].data.ptr;
+            if (pc == NULL) {
+                // 保留中のシグナルを読む (SIGUSR1 以外なら終了)
+                struct signalfd_siginfo si;
+                while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1) dump_metrics();
+                    else running = 0;
+                }
+                continue;
             }
+            if (pc->fd < 0) continue;
 
-            printf("[%s] 受信 (%dバイト)\n", ts, n);
-            printf("  HEX  : %s\n", hexstr);
-            printf("  ASCII: %s\n\n", ascstr);
-
-            last_activity = now;
-        } else {
-            // タイムアウト (VTIME) で n == 0
-            time_t now = time(NULL);
-            if (now - last_activity > 10) {
-                char ts[16];
-                struct tm lt;
-                localtime_r(&now, &lt);
-                strftime(ts, sizeof(ts), "%H:%M:%S", &lt);
-                printf("[%s] 待機中... (データなし)\n", ts);
-                last_activity = now;
+            if (events[i].events & EPOLLIN) {
+                // レベルトリガーで1回だけ読む (どのポートも他を待たせない)
+                ssize_t r = read_into_ring(pc->fd, (uint16_t)(pc - ctx), pc->read.chunk, 1);
+                refresh_tty_errors(pc, 0);
+                if (r > 0) continue;
+                if (r < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLIN)) {
+                // 表示はデコードスレッドに任せる
+                refresh_tty_errors(pc, 1);
+                notify_ring((uint16_t)(pc - ctx), ENQ_CHUNK_PORT_CLOSED);
+                close_port(epfd, pc);
+                open_count--;
+                if (decoding && can_reconnect(pc)) {
+                    // 同じ読み出し方で開き直す。ノードはまだあることが多いので、すぐには試さない
+                    if (wfd >= 0) enq_hotplug_watch_add(wfd, pc->name);
+                    pc->reconnect = 1;
+                    waiting++;
+                }
             }
         }
-        // read 自体が最大 0.1s ブロックするので追加 Sleep は不要
+        for (size_t k = 0; retry && waiting > 0 && k < count; k++) {
+            if (!ctx[k].reconnect || reopen_port(epfd, &ctx[k], (uint16_t)k) < 0) continue;
+            waiting--;
+            open_count++;
+        }
     }
 
+    if (decoding) stop_decoder(th);
+    enq_log_flush();
+
     printf("\n🛑 モニタリング終了\n");
-    close(fd);
+    for (size_t i = 0; i < count; i++) {
+        printf("%s: ", ctx[i].name);
+        print_parser_stats(&ctx[i].parser);
+        refresh_tty_errors(&ctx[i], 1);
+        print_tty_errors(&ctx[i]);
+        print_gaps(&ctx[i]);
+        if (ctx[i].fd >= 0) close_port(epfd, &ctx[i]);
+    }
+    if (decoding) {
+        print_ring_stats();
+        print_latency_summary("");
+    }
+    if (wfd >= 0) close(wfd);
+    close(sfd);
+    close(epfd);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+// ---- 共有メモリの読者 ----
+
+static void format_car(const enq_car_state_t *c, char *buf, size_t len) {
+    char cur[8] = "-", tgt[8] = "なし", load[16] = "-";
+    if (c->flags & ENQ_CAR_HAVE_CURRENT) enq_floor_name(c->current_floor, cur, sizeof(cur));
+    if ((c->flags & ENQ_CAR_HAVE_TARGET) && c->target_floor != 0)
+        enq_floor_name(c->target_floor, tgt, sizeof(tgt));
+    if (c->flags & ENQ_CAR_HAVE_LOAD) snprintf(load, sizeof(load), "%ukg", (unsigned)c->load);
+    snprintf(buf, len, "現在階 %s / 行先階 %s / 荷重 %s%s", cur, tgt, load,
+             (c->flags & ENQ_CAR_MOVING) ? " 🚀移動中" : "");
+}
+
+// 変化があるたびに (futex で待って) 全号機を表示する
+void watch_state(void) {
+    const enq_state_shm_t *s = enq_state_attach(NULL);
+    if (s == NULL) {
+        fprintf(stderr, "❌ 共有メモリ %s を開けません: %s (publish は起動していますか)\n",
+                ENQ_STATE_SHM_NAME, strerror(errno));
+        return;
+    }
+    printf("👀 状態監視: /dev/shm%s (受信プロセス pid %u)  Ctrl+C で終了\n\n",
+           ENQ_STATE_SHM_NAME, s->writer_pid);
+    install_signal_handlers();
+
+    uint32_t gen = enq_state_generation(s) - 1;  // 最初に一度表示する
+    while (running) {
+        uint32_t now = enq_state_wait(s, gen, 1000);
+        if (now == gen) continue;
+        gen = now;
+
+        char ts[16];
+        time_str(ts, sizeof(ts));
+        uint32_t n = atomic_load_explicit(&s->num_cars, memory_order_acquire);
+        printf("[%s] 世代 %u (%u 台)\n", ts, gen, n);
+        for (uint32_t i = 0; i < n; i++) {
+            enq_car_state_t c;
+            if (enq_state_read(s, i, &c) < 0) break;
+            char line[128];
+            format_car(&c, line, sizeof(line));
+            printf("  ポート%u 局%04u: %s (%llu フレーム)\n", (unsigned)c.port, (unsigned)c.station,
+                   line, (unsigned long long)c.frames);
+        }
+    }
+    enq_state_detach(s);
 }
 
+// 既定の検索対象ポート
+static const char *const default_ports[] = {
+    "/dev/ttyUSB0",
+    "/dev/ttyUSB1",
+    "/dev/ttyAMA0",
+    "/dev/serial0",
+    "/dev/ttyS0",
+};
+
 // ポート検索テスト
-void test_serial_ports(void) {
-    const char* ports[] = {
-        "/dev/ttyUSB0",
-        "/dev/ttyUSB1",
-        "/dev/ttyAMA0",
-        "/dev/serial0",
-        "/dev/ttyS0",
-    };
-    size_t cnt = sizeof(ports)/sizeof(ports[0]);
+//   found が NULL でなければ接続できたポートを最大 max 件格納する
+//   戻り値: 接続できたポート数
+size_t test_serial_ports(const char **found, size_t max) {
+    size_t cnt = sizeof(default_ports)/sizeof(default_ports[0]);
+    size_t ok = 0;
 
     printf("🔍 利用可能なシリアルポートを検索中...\n");
     for (size_t i = 0; i < cnt; i++) {
-        int fd = open_serial(ports[i], 1);
+        int fd = open_serial(default_ports[i], 1, NULL);
         if (fd >= 0) {
-            printf("✅ %s: 接続成功\n", ports[i]);
+            printf("✅ %s: 接続成功\n", default_ports[i]);
             close(fd);
+            if (found && ok < max) found[ok] = default_ports[i];
+            ok++;
         } else {
-            printf("❌ %s: %s\n", ports[i], strerror(errno));
+            printf("❌ %s: %s\n", default_ports[i], strerror(errno));
         }
     }
+    return (found && ok > max) ? max : ok;
 }
 
-// エントリポイント
-int main(int argc, char *argv[]) {
+// probe [-shared] [ポート...]
+//   -shared は送信側と同じ単調時計を使える (同一ホスト) ときの片方向遅延。
+//   なければ最小値からの差 (遅延変動) を示す
+static int probe_main(int argc, char **argv) {
+    int shared = 0;
+    int i = 0;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-shared") == 0) {
+            shared = 1;
+        } else {
+            fprintf(stderr, "❌ 不明なオプション: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    const char *ports[MAX_PORTS];
+    size_t cnt = 0;
+    if (i < argc) {
+        for (; i < argc && cnt < MAX_PORTS; i++) ports[cnt++] = argv[i];
+    } else {
+        cnt = test_serial_ports(ports, MAX_PORTS);
+        printf("\n");
+    }
+
+    static enq_probe_t probe;
+    enq_probe_init(&probe, shared);
+    atomic_store(&metrics_probe, &probe);
+    printf("📡 プローブ受信: 局番号 %04u (%s)\n", ENQ_PROBE_STATION,
+           shared ? "時計共有: 片方向遅延" : "時計共有なし: 遅延変動");
+
+    monitor_multi(ports, cnt, &(monitor_outputs_t){ .probe = &probe });
+
+    enq_probe_finish(&probe);
+    static enq_metrics_out_t o;
+    enq_metrics_printf(&o, "📡 プローブ集計: ");
+    enq_probe_summary(&probe, &o);
+    if (o.len) fwrite(o.buf, 1, o.len, stdout);
+    enq_metrics_out_free(&o);
+    atomic_store(&metrics_probe, NULL);
+    return 0;
+}
+
+// tune [-poll] [-lowlat] [秒数] <ポート>
+//   読み出し方の候補を1つずつ (既定 3 秒) 実際の受信で試し、結果と推奨値を表示する。
+//   -poll は multi / capture / publish / probe (epoll 待ち) 用、なければ単一ポートの
+//   ブロッキング read() 用の候補を試す
+static int tune_main(int argc, char **argv) {
+    int poll = 0;
+    enq_tty_read_t base = ENQ_TTY_BLOCKING_DEFAULT;
+    unsigned trial_ms = 3000;
+    int i = 0;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-poll") == 0) {
+            poll = 1;
+        } else if (strcmp(argv[i], "-lowlat") == 0) {
+            base.low_latency = 1;
+        } else {
+            fprintf(stderr, "❌ 不明なオプション: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (i + 1 < argc) trial_ms = (unsigned)(atof(argv[i++]) * 1000);
+    if (i >= argc || trial_ms == 0) {
+        fprintf(stderr, "使用方法: tune [-poll] [-lowlat] [秒数] <ポート>\n");
+        return 1;
+    }
+    const char *port = argv[i];
+    if (poll) {
+        int lowlat = base.low_latency;
+        base = ENQ_TTY_POLL_DEFAULT;
+        base.low_latency = (uint8_t)lowlat;
+    }
+
+    int fd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0 || enq_tty_configure(fd, &base) < 0) {
+        fprintf(stderr, "❌ %s を開けません: %s\n", port, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    int lowlat = enq_tty_low_latency(fd);
+    printf("🎛️ %s: %s の読み出し方を試します (候補ごとに %.1f 秒、ASYNC_LOW_LATENCY %s)\n",
+           port, poll ? "epoll 待ち" : "ブロッキング read()", trial_ms / 1000.0,
+           lowlat < 0 ? "非対応" : lowlat ? "オン" : "オフ");
+    printf("    送信側 (シミュレーターなど) を動かしたまま実行してください\n");
+
+    enq_tty_trial_t trials[ENQ_TTY_MAX_TRIALS];
+    enq_tty_read_t best;
+    int n = enq_tty_autotune(fd, poll, trial_ms, &base, &best, trials);
+    print_trials(port, trials, n, &best);
+    uint64_t errs[ENQ_TTY_ERR_COUNT];
+    if (enq_tty_errors(fd, errs) == 0) {
+        printf("🔌 %s: UART エラー (累計)", port);
+        for (int k = 0; k < ENQ_TTY_ERR_COUNT; k++) {
+            printf("%s%s %llu", k ? " / " : " ", enq_tty_error_labels[k], (unsigned long long)errs[k]);
+        }
+        printf("\n");
+    }
+    close(fd);
+    return 0;
+}
+
+// publish と daemon で共通の配信オプション (-udp / -ws / -tick)。扱ったら 1
+static int fanout_option(enq_fanout_config_t *cfg, const char *opt, const char *v) {
+    static char group[64];
+    if (strcmp(opt, "-udp") == 0) {
+        if (strcmp(v, "off") == 0) {
+            cfg->mcast_group = NULL;
+            return 1;
+        }
+        const char *colon = strrchr(v, ':');
+        size_t n = colon ? (size_t)(colon - v) : strlen(v);
+        if (n >= sizeof(group)) n = sizeof(group) - 1;
+        memcpy(group, v, n);
+        group[n] = '\0';
+        cfg->mcast_group = group;
+        if (colon) cfg->mcast_port = (uint16_t)atoi(colon + 1);
+    } else if (strcmp(opt, "-ws") == 0) {
+        cfg->ws_port = strcmp(v, "off") == 0 ? 0 : (uint16_t)atoi(v);
+    } else if (strcmp(opt, "-tick") == 0) {
+        cfg->tick_ms = atoi(v);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// publish [-all] [-quiet] [-udp グループ:ポート|off] [-ws ポート|off] [-tick ms] [-events ファイル] [ポート...]
+//   既定では同じ値の繰り返しをパーサーで捨て、変化したフレームだけを公開・配信する。
+//   -events のファイルには -all でも値が変わったときだけ書く
+static int publish_main(int argc, char **argv) {
+    enq_fanout_config_t cfg;
+    enq_fanout_default_config(&cfg);
+    int parser_flags = ENQ_PARSER_CHANGES_ONLY;
+    int quiet = 0;
+    const char *events_path = NULL;
+    int i = 0;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-all") == 0) {
+            parser_flags &= ~ENQ_PARSER_CHANGES_ONLY;
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "-quiet") == 0) {
+            quiet = 1;
+            i++;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "❌ %s の値がありません\n", argv[i]);
+            return 1;
+        }
+        const char *v = argv[i + 1];
+        i += 2;
+        if (fanout_option(&cfg, argv[i - 2], v)) continue;
+        if (strcmp(argv[i - 2], "-events") == 0) {
+            events_path = v;
+        } else {
+            fprintf(stderr, "❌ 不明なオプション: %s\n", argv[i - 2]);
+            return 1;
+        }
+    }
+
+    const char *ports[MAX_PORTS];
+    size_t cnt = 0;
+    if (i < argc) {
+        for (; i < argc && cnt < MAX_PORTS; i++) ports[cnt++] = argv[i];
+    } else {
+        cnt = test_serial_ports(ports, MAX_PORTS);
+        printf("\n");
+    }
+
+    static enq_state_writer_t state;
+    if (enq_state_publish_open(&state, NULL) < 0) {
+        fprintf(stderr, "❌ 共有メモリ %s を作成できません: %s\n", ENQ_STATE_SHM_NAME, strerror(errno));
+        return 1;
+    }
+    printf("🧠 状態公開: /dev/shm%s\n", ENQ_STATE_SHM_NAME);
+
+    monitor_outputs_t out = { .state = &state, .parser_flags = parser_flags, .quiet = quiet };
+    static enqevt_writer_t events;
+    if (events_path) {
+        if (enqevt_writer_open(&events, events_path, ports, cnt) < 0) {
+            fprintf(stderr, "❌ イベントファイル %s を作成できません: %s\n", events_path, strerror(errno));
+            enq_state_publish_close(&state, 1);
+            return 1;
+        }
+        out.events = &events;
+        printf("🗂️ イベント記録: %s\n", events_path);
+    }
+    if (cfg.mcast_group || cfg.ws_port) {
+        out.fanout = enq_fanout_start(&cfg);
+        if (out.fanout == NULL) {
+            fprintf(stderr, "❌ 配信を開始できません: %s\n", strerror(errno));
+            enq_state_publish_close(&state, 1);
+            return 1;
+        }
+        if (cfg.mcast_group) printf("📤 UDP マルチキャスト: %s:%u\n", cfg.mcast_group, cfg.mcast_port);
+        if (cfg.ws_port) printf("📤 WebSocket: ws://0.0.0.0:%u/\n", cfg.ws_port);
+        printf("    %d ms ごとにバイナリバッチで送信\n", cfg.tick_ms);
+    }
+
+    monitor_multi(ports, cnt, &out);
+
+    if (out.fanout) {
+        enq_fanout_stats_t st;
+        enq_fanout_stop(out.fanout, &st);
+        printf("📤 配信統計: %llu レコード / %llu バッチ / 破棄 %llu / UDP エラー %llu / "
+               "WebSocket 接続 %llu 送信 %llu 切断(詰まり) %llu\n",
+               (unsigned long long)st.records, (unsigned long long)st.batches,
+               (unsigned long long)st.dropped, (unsigned long long)st.udp_errors,
+               (unsigned long long)st.ws_clients, (unsigned long long)st.ws_sent,
+               (unsigned long long)st.ws_slow);
+    }
+    int rc = 0;
+    if (out.events) {
+        if (enqevt_writer_close(&events) < 0) {
+            fprintf(stderr, "❌ イベントファイルの終了処理に失敗: %s\n", strerror(errno));
+            rc = 1;
+        } else {
+            printf("🗂️ イベント保存: %s (%llu イベント / 変化なし %llu / %zu ブロック / %llu バイト)\n",
+                   events_path, (unsigned long long)events.events,
+                   (unsigned long long)events.unchanged, events.index_len,
+                   (unsigned long long)events.block_bytes);
+        }
+    }
+    enq_state_publish_close(&state, 1);
+    return rc;
+}
+
+// ---- 常駐モード (daemon) ----
+// 起動時にポートを1つずつ試さず、/sys/class/tty にある名前と指定されたポートをすぐに開き、
+// 以降は抜き差しの通知 (enq_hotplug.h) で開閉する。ポートは名前ごとに番号を固定し、
+// 抜けて戻ってきたら同じ番号・同じ読み出し方で読み直し、その間を欠落区間として記録する
+// (共有メモリ・配信のポート番号が変わらない)。
+// 後から起動した表示・ダッシュボードは共有メモリ (状態) と WebSocket の過去分
+// (enq_fanout.h の backlog) で起動直後からの経過を受け取る。
+//
+// systemd のソケット起動にも対応する。WebSocket の待ち受けを .socket に持たせておけば、
+// デーモンの再起動中に来た接続もカーネルのキューで待たされ、起動後に過去分から受け取れる:
+//   # enq-monitor.socket
+//   [Socket]
+//   ListenStream=8765
+//   # enq-monitor.service
+//   [Service]
+//   ExecStart=/usr/local/bin/serial_debug_test daemon -quiet
+//   Restart=always
+#define DAEMON_RETRY_MS 100  // 追加直後に開けなかったポートを開き直す間隔
+#define DAEMON_RETRIES  30   // 開き直す回数 (udev が権限を設定し終えるのを待つ)
+#define DAEMON_BACKLOG  4096 // 既定で WebSocket の新しいクライアントに送る過去分のレコード数
+#define SD_LISTEN_FDS_START 3
+
+static port_ctx_t dports[MAX_PORTS];
+static char dnames[MAX_PORTS][ENQ_HOTPLUG_PATH_MAX];
+static unsigned dretry[MAX_PORTS];  // 開き直す残り回数 (0 なら待っていない)
+static size_t dcount;
+static int dwatch = -1;             // ノードの作成・権限の変更の見張り (enq_hotplug_watch_*)
+
+// 名前に対応するポートの番号。なければ追加する (一杯なら NULL)
+static port_ctx_t *daemon_slot(const char *name) {
+    for (size_t i = 0; i < dcount; i++) {
+        if (strcmp(dnames[i], name) == 0) return &dports[i];
+    }
+    if (dcount == MAX_PORTS) {
+        fprintf(stderr, "⚠️ %s: ポートが多すぎます (最大 %d)\n", name, MAX_PORTS);
+        return NULL;
+    }
+    snprintf(dnames[dcount], sizeof(dnames[dcount]), "%s", name);
+    port_ctx_t *pc = &dports[dcount];
+    pc->name = dnames[dcount];
+    pc->fd = -1;
+    // 読者 (スクレイプ・SIGUSR1) には名前を書いてから数を増やして見せる
+    metrics_set_ports(dports, ++dcount);
+    return pc;
+}
+
+// 開いて epoll に登録する。権限がまだない・ノードがまだないときは何も表示せずに -1。
+// 切断したポートは切断前の読み出し方で開き直す
+static int daemon_open(int epfd, port_ctx_t *pc) {
+    if (pc->reconnect) return reopen_port(epfd, pc, (uint16_t)(pc - dports));
+    if (strncmp(pc->name, "/dev/", 5) == 0 && access(pc->name, R_OK | W_OK) < 0) return -1;
+    pc->fd = open_serial_async(pc->name, &pc->read);
+    if (pc->fd < 0) return -1;
+    pc->tty_errors_ok = 0;
+    init_tty_errors(pc);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = pc };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, pc->fd, &ev) < 0) {
+        fprintf(stderr, "❌ %s を epoll に登録できません: %s\n", pc->name, strerror(errno));
+        close(pc->fd);
+        pc->fd = -1;
+        return -1;
+    }
+    char spec[64];
+    enq_tty_format(&pc->read, spec, sizeof(spec));
+    printf("📡 %s: 受信開始 (ポート %zu, 読み出し %s)\n", pc->name, (size_t)(pc - dports), spec);
+    fflush(stdout);
+    return 0;
+}
+
+// 抜かれた・読めなくなったポートを閉じる。/dev の tty なら戻ってくるのを待つ
+static void daemon_close(int epfd, port_ctx_t *pc) {
+    refresh_tty_errors(pc, 1);
+    notify_ring((uint16_t)(pc - dports), ENQ_CHUNK_PORT_CLOSED);
+    close_port(epfd, pc);
+    if (!can_reconnect(pc)) return;
+    pc->reconnect = 1;
+    if (dwatch >= 0) enq_hotplug_watch_add(dwatch, pc->name);
+}
+
+// systemd から受け取った待ち受けソケット (なければ -1)
+static int daemon_listen_fd(void) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    if (pid == NULL || fds == NULL || atol(pid) != (long)getpid() || atoi(fds) < 1) return -1;
+    // 子プロセスに引き継がない
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    // 待ち受け中のストリームソケットでなければ使わない (ユニットの設定違いなど)
+    int fd = SD_LISTEN_FDS_START;
+    struct stat st;
+    int listening = 0, type = 0;
+    socklen_t llen = sizeof(listening), tlen = sizeof(type);
+    if (fstat(fd, &st) < 0 || !S_ISSOCK(st.st_mode) ||
+        getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &llen) < 0 || !listening ||
+        getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &tlen) < 0 || type != SOCK_STREAM) {
+        fprintf(stderr, "⚠️ fd %d は待ち受け中のソケットではないので使いません\n", fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 出力先とデコードスレッドを用意して、終了するまでポートと通知を処理する
+static int daemon_serve(int epfd, int sfd, int hfd, const char *match,
+                        const enq_fanout_config_t *cfg, int parser_flags, int quiet,
+                        uint64_t t_start) {
+    static enq_state_writer_t state;
+    if (enq_state_publish_open(&state, NULL) < 0) {
+        fprintf(stderr, "❌ 共有メモリ %s を作成できません: %s\n", ENQ_STATE_SHM_NAME, strerror(errno));
+        return 1;
+    }
+    monitor_outputs_t out = { .state = &state, .parser_flags = parser_flags, .quiet = quiet };
+    if (cfg->mcast_group || cfg->ws_port || cfg->ws_listen_fd >= 0) {
+        out.fanout = enq_fanout_start(cfg);
+        if (out.fanout == NULL) {
+            fprintf(stderr, "❌ 配信を開始できません: %s\n", strerror(errno));
+            enq_state_publish_close(&state, 1);
+            return 1;
+        }
+    }
+
+    pthread_t th;
+    decoder_args_t args = { .ports = dports, .num_ports = MAX_PORTS, .show_port = 1,
+                            .idle_notice = 0, .out = &out };
+    if (start_decoder(&th, &args) < 0) {
+        if (out.fanout) enq_fanout_stop(out.fanout, NULL);
+        enq_state_publish_close(&state, 1);
+        return 1;
+    }
+
+    printf("🧠 状態公開: /dev/shm%s\n", ENQ_STATE_SHM_NAME);
+    if (cfg->mcast_group) printf("📤 UDP マルチキャスト: %s:%u\n", cfg->mcast_group, cfg->mcast_port);
+    if (cfg->ws_listen_fd >= 0) printf("📤 WebSocket: systemd から受け取ったソケット\n");
+    else if (cfg->ws_port) printf("📤 WebSocket: ws://0.0.0.0:%u/\n", cfg->ws_port);
+    if (out.fanout && cfg->backlog) printf("    新しい WebSocket クライアントには直近 %u レコードを先に送信\n", cfg->backlog);
+    printf("✅ 準備完了 (%.1f ms、%zu ポート、対象 %s)\n",
+           (double)(monotonic_ns() - t_start) / 1e6, dcount, hfd >= 0 ? match : "なし");
+    printf("    Ctrl+C で終了\n\n");
+    fflush(stdout);
+
+    struct epoll_event events[MAX_PORTS + 2];
+    while (running) {
+        int pending = 0;
+        for (size_t k = 0; k < dcount; k++) pending |= dretry[k] != 0;
+        // 切断の通知が保留されていた間に挿し直されたポートは、渡し終えたところで開く
+        if (notice_len > 0 && flush_notices()) {
+            for (size_t k = 0; k < dcount; k++) {
+                if (dports[k].fd < 0 && dports[k].reconnect) daemon_open(epfd, &dports[k]);
+            }
+        }
+        // 開き直し待ちがなければ通知が来るまで無期限に待つ
+        int n = epoll_wait(epfd, events, MAX_PORTS + 2, notice_timeout(pending ? DAEMON_RETRY_MS : -1));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) {
+            for (size_t k = 0; k < dcount; k++) {
+                if (dretry[k] == 0 || dports[k].fd >= 0) continue;
+                if (daemon_open(epfd, &dports[k]) == 0) {
+                    dretry[k] = 0;
+                } else if (--dretry[k] == 0) {
+                    fprintf(stderr, "❌ %s を開けません: %s\n", dports[k].name, strerror(errno));
+                }
+            }
+            continue;
+        }
+        for (int e = 0; e < n; e++) {
+            void *p = events[e].data.ptr;
+            if (p == &dwatch) {
+                // ノードができた・権限が変わった。待っているポートをすぐに試す
+                if (enq_hotplug_watch_drain(dwatch) == 0) continue;
+                for (size_t k = 0; k < dcount; k++) {
+                    port_ctx_t *pc = &dports[k];
+                    if (pc->fd < 0 && (dretry[k] || pc->reconnect) && daemon_open(epfd, pc) == 0)
+                        dretry[k] = 0;
+                }
+                continue;
+            }
+            if (p == NULL) {
+                struct signalfd_siginfo si;
+                while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1) dump_metrics();
+                    else running = 0;
+                }
+                continue;
+            }
+            if (p == &dcount) {
+                enq_hotplug_event_t hp;
+                while (enq_hotplug_read(hfd, match, &hp) == 1) {
+                    port_ctx_t *pc = daemon_slot(hp.path);
+                    if (pc == NULL) continue;
+                    size_t k = (size_t)(pc - dports);
+                    if (hp.action == ENQ_HOTPLUG_ADD && pc->fd < 0) {
+                        // udev が権限を設定し終えるまで開けないことが多いので、すぐには諦めない
+                        dretry[k] = daemon_open(epfd, pc) < 0 ? DAEMON_RETRIES : 0;
+                    } else if (hp.action == ENQ_HOTPLUG_REMOVE) {
+                        dretry[k] = 0;
+                        if (pc->fd >= 0) daemon_close(epfd, pc);
+                    }
+                }
+                continue;
+            }
+            port_ctx_t *pc = p;
+            if (pc->fd < 0) continue;
+            if (events[e].events & EPOLLIN) {
+                ssize_t r = read_into_ring(pc->fd, (uint16_t)(pc - dports), pc->read.chunk, 1);
+                refresh_tty_errors(pc, 0);
+                if (r > 0) continue;
+                if (r < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            }
+            if (events[e].events & (EPOLLERR | EPOLLHUP | EPOLLIN)) {
+                // 抜かれた tty は削除の通知より先に HUP になる。戻ってきたら追加の通知か
+                // ノードの見張りで開き直す
+                daemon_close(epfd, pc);
+            }
+        }
+    }
+
+    stop_decoder(th);
+    enq_log_flush();
+    printf("\n🛑 モニタリング終了\n");
+    for (size_t k = 0; k < dcount; k++) {
+        printf("%s: ", dports[k].name);
+        print_parser_stats(&dports[k].parser);
+        refresh_tty_errors(&dports[k], 1);
+        print_tty_errors(&dports[k]);
+        print_gaps(&dports[k]);
+        if (dports[k].fd >= 0) close_port(epfd, &dports[k]);
+    }
+    print_ring_stats();
+    print_latency_summary("");
+    if (out.fanout) {
+        enq_fanout_stats_t st;
+        enq_fanout_stop(out.fanout, &st);
+        printf("📤 配信統計: %llu レコード / %llu バッチ / 破棄 %llu / WebSocket 接続 %llu "
+               "送信 %llu 過去分 %llu 切断(詰まり) %llu\n",
+               (unsigned long long)st.records, (unsigned long long)st.batches,
+               (unsigned long long)st.dropped, (unsigned long long)st.ws_clients,
+               (unsigned long long)st.ws_sent, (unsigned long long)st.ws_replayed,
+               (unsigned long long)st.ws_slow);
+    }
+    enq_state_publish_close(&state, 1);
+    return 0;
+}
+
+// daemon [-all] [-quiet] [-match パターン] [-udp グループ:ポート|off] [-ws ポート|off]
+//        [-tick ms] [-backlog 件数] [ポート...]
+//   match に合う tty (既定 ENQ_HOTPLUG_DEFAULT_MATCH) を抜き差しに合わせて開閉する。
+//   指定したポートは追加で常に開く (pty・unix: も可)
+static int daemon_main(int argc, char **argv) {
+    uint64_t t_start = monotonic_ns();
+    enq_fanout_config_t cfg;
+    enq_fanout_default_config(&cfg);
+    cfg.backlog = DAEMON_BACKLOG;
+    const char *match = ENQ_HOTPLUG_DEFAULT_MATCH;
+    int parser_flags = ENQ_PARSER_CHANGES_ONLY;
+    int quiet = 0;
+    int i = 0;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-all") == 0) {
+            parser_flags &= ~ENQ_PARSER_CHANGES_ONLY;
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "-quiet") == 0) {
+            quiet = 1;
+            i++;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "❌ %s の値がありません\n", argv[i]);
+            return 1;
+        }
+        const char *v = argv[i + 1];
+        i += 2;
+        if (fanout_option(&cfg, argv[i - 2], v)) continue;
+        if (strcmp(argv[i - 2], "-match") == 0) {
+            match = v;
+        } else if (strcmp(argv[i - 2], "-backlog") == 0) {
+            cfg.backlog = (unsigned)strtoul(v, NULL, 10);
+        } else {
+            fprintf(stderr, "❌ 不明なオプション: %s\n", argv[i - 2]);
+            return 1;
+        }
+    }
+    cfg.ws_listen_fd = daemon_listen_fd();
+
+    // パーサーは先にすべて用意しておく (追加されたポートはすぐにデコードへ回せる)
+    for (size_t k = 0; k < MAX_PORTS; k++) {
+        enq_parser_init(&dports[k].parser, parser_flags);
+        enq_parser_set_timing(&dports[k].parser, &parser_timing);
+        dports[k].fd = -1;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        fprintf(stderr, "❌ epoll_create1 失敗: %s\n", strerror(errno));
+        return 1;
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    // data.ptr: NULL = シグナル、&dcount = 抜き差しの通知、&dwatch = ノードの見張り、
+    // それ以外はポート
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+
+    // 通知は一覧を読む前に受け始める (その間に挿されたものを取りこぼさない)
+    int hfd = enq_hotplug_open();
+    if (hfd < 0) {
+        fprintf(stderr, "⚠️ 抜き差しの通知を受けられません: %s (今あるポートだけを使います)\n",
+                strerror(errno));
+    } else {
+        ev.data.ptr = &dcount;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, hfd, &ev);
+    }
+    dwatch = enq_hotplug_watch_open();
+    if (dwatch >= 0) {
+        ev.data.ptr = &dwatch;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, dwatch, &ev);
+    }
+
+    // 先にポートを開いて受信を始める。デコードの準備ができるまでの分はカーネルの
+    // tty バッファとリングに溜まる
+    static char found[MAX_PORTS][ENQ_HOTPLUG_PATH_MAX];
+    size_t nfound = enq_hotplug_scan(match, found, MAX_PORTS);
+    for (size_t k = 0; k < nfound; k++) {
+        port_ctx_t *pc = daemon_slot(found[k]);
+        if (pc && daemon_open(epfd, pc) < 0) dretry[pc - dports] = DAEMON_RETRIES;
+    }
+    for (; i < argc; i++) {
+        port_ctx_t *pc = daemon_slot(argv[i]);
+        if (pc && daemon_open(epfd, pc) < 0) dretry[pc - dports] = DAEMON_RETRIES;
+    }
+
+    int rc = daemon_serve(epfd, sfd, hfd, match, &cfg, parser_flags, quiet, t_start);
+
+    for (size_t k = 0; k < dcount; k++) {
+        if (dports[k].fd >= 0) close_port(epfd, &dports[k]);
+    }
+    if (hfd >= 0) close(hfd);
+    if (dwatch >= 0) close(dwatch);
+    close(sfd);
+    close(epfd);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    return rc;
+}
+
+// サブコマンドの実行
+static int run_command(int argc, char *argv[]) {
     if (argc > 1) {
         if (strcmp(argv[1], "test") == 0) {
-            test_serial_ports();
+            test_serial_ports(NULL, 0);
+            return 0;
+        } else if (strcmp(argv[1], "multi") == 0) {
+            // multi [-quiet] [ポート...]: 指定ポート、指定なしなら検索で見つかった全ポート
+            int first = 2;
+            monitor_outputs_t out = { 0 };
+            if (argc > first && strcmp(argv[first], "-quiet") == 0) {
+                out.quiet = 1;
+                first++;
+            }
+            const char *ports[MAX_PORTS];
+            size_t cnt = 0;
+            if (argc > first) {
+                for (int i = first; i < argc && cnt < MAX_PORTS; i++) ports[cnt++] = argv[i];
+            } else {
+                cnt = test_serial_ports(ports, MAX_PORTS);
+                printf("\n");
+            }
+            monitor_multi(ports, cnt, &out);
+            return 0;
+        } else if (strcmp(argv[1], "capture") == 0 && argc > 2) {
+            // capture <ファイル> [ポート...]
+            const char *ports[MAX_PORTS];
+            size_t cnt = 0;
+            if (argc > 3) {
+                for (int i = 3; i < argc && cnt < MAX_PORTS; i++) ports[cnt++] = argv[i];
+            } else {
+                cnt = test_serial_ports(ports, MAX_PORTS);
+                printf("\n");
+            }
+            static enqcap_writer_t cap;
+            if (enqcap_writer_open(&cap, argv[2], ports, cnt) < 0) {
+                fprintf(stderr, "❌ キャプチャファイル %s を作成できません: %s\n", argv[2], strerror(errno));
+                return 1;
+            }
+            printf("💾 キャプチャ記録: %s\n", argv[2]);
+            monitor_multi(ports, cnt, &(monitor_outputs_t){ .capture = &cap });
+            if (enqcap_writer_close(&cap) < 0) {
+                fprintf(stderr, "❌ キャプチャファイルの終了処理に失敗: %s\n", strerror(errno));
+                return 1;
+            }
+            printf("💾 キャプチャ保存: %s (%llu レコード / %llu バイト / %zu ブロック)\n", argv[2],
+                   (unsigned long long)cap.records, (unsigned long long)cap.bytes, cap.index_len);
+            return 0;
+        } else if (strcmp(argv[1], "publish") == 0) {
+            return publish_main(argc - 2, argv + 2);
+        } else if (strcmp(argv[1], "daemon") == 0) {
+            return daemon_main(argc - 2, argv + 2);
+        } else if (strcmp(argv[1], "probe") == 0) {
+            return probe_main(argc - 2, argv + 2);
+        } else if (strcmp(argv[1], "tune") == 0) {
+            return tune_main(argc - 2, argv + 2);
+        } else if (strcmp(argv[1], "watch") == 0) {
+            watch_state();
             return 0;
         } else {
             monitor_serial(argv[1]);
@@ -173,9 +1992,39 @@ int main(int argc, char *argv[]) {
     // 引数なし時
     printf("使用方法:\n");
     printf("  %s test          # ポート検索\n", argv[0]);
-    printf("  %s /dev/ttyUSB0  # モニタリング\n\n", argv[0]);
-    test_serial_ports();
+    printf("  %s /dev/ttyUSB0  # モニタリング\n", argv[0]);
+    printf("  %s multi [-quiet] [ポート...]  # 複数ポート同時モニタリング (省略時は検索結果の全ポート)\n", argv[0]);
+    printf("  %s capture <ファイル> [ポート...]  # モニタリングしながら受信バイトを記録\n", argv[0]);
+    printf("  %s publish [-all] [-quiet] [-udp グループ:ポート|off] [-ws ポート|off] [-tick ms] [-events ファイル] [ポート...]\n", argv[0]);
+    printf("                   # 状態を共有メモリに公開し、変化したフレームを UDP マルチキャスト / WebSocket に配信\n");
+    printf("                   # (-all なら同じ値の繰り返しも捨てずに配信)\n");
+    printf("                   # (-events ファイルで状態変化を列形式で記録、enq_events_query で時刻範囲を検索)\n");
+    printf("  %s daemon [-quiet] [-match ttyUSB*,ttyACM*] [-backlog 件数] [publish と同じ配信オプション] [ポート...]\n", argv[0]);
+    printf("                   # ポートを試さずすぐに起動し、抜き差しに合わせて開閉しながら公開・配信する常駐モード\n");
+    printf("                   # (新しい WebSocket クライアントには直近の分を先に送る。systemd のソケット起動に対応)\n");
+    printf("  %s watch         # 共有メモリの状態を表示 (publish 中の別プロセスから)\n", argv[0]);
+    printf("  %s probe [-shared] [ポート...]  # シミュレーターの probe モードで遅延・欠落・順序逆転を測定\n", argv[0]);
+    printf("  %s tune [-poll] [-lowlat] [秒数] <ポート>  # 読み出し方 (VMIN/VTIME・read() の長さ) を実測して選ぶ\n", argv[0]);
+    printf("  環境変数 ENQ_METRICS_PORT=9108 で区間レイテンシを /metrics に公開 (kill -USR1 で要約表示)\n");
+    printf("  環境変数 ENQ_SERIAL_READ=vmin=1,vtime=0,chunk=64,lowlat で読み出し方を指定 (auto で開くたびに調整)\n");
+    printf("  環境変数 ENQ_LOG=json,file=/var/log/enq.jsonl,rx=100/s でフレーム表示の形式 (text/json/bin)・出力先・間引きを指定\n");
+    printf("  ポートに pty を指定すると疑似端末を作り、シミュレーターが開くスレーブのパスを表示\n");
+    printf("  ポートに unix:/tmp/enq.sock を指定するとシミュレーターとソケットで直結 (回線速度の制限なし)\n");
+    printf("  -quiet はフレームを表示せず、1秒ごとに処理レートを表示 (負荷試験用)\n\n");
+    test_serial_ports(NULL, 0);
     printf("\n");
     monitor_serial("/dev/ttyUSB0");
     return 0;
 }
+
+// エントリポイント
+int main(int argc, char *argv[]) {
+    load_read_config();
+    start_log();
+    enq_metrics_server_t *metrics = start_metrics_server();
+    int rc = run_command(argc, argv);
+    enq_metrics_serve_stop(metrics);
+    enq_log_stop();
+    print_log_stats();
+    return rc;
+}